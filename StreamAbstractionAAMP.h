@@ -29,6 +29,7 @@
 #include <map>
 #include <iterator>
 #include <vector>
+#include <deque>
 
 #include <ABRManager.h>
 #include <glib.h>
@@ -58,9 +59,11 @@ struct CachedFragment
 	double position;            /**< Position in the playlist */
 	double duration;            /**< Fragment duration */
 	bool discontinuity;         /**< PTS discontinuity status */
+	bool continuousTimeline;    /**< Discontinuity is codec compatible, timeline may continue without flush */
+	double discontinuityPts;    /**< PTS at which timeline before discontinuity would have continued, 0 if demuxer restamps */
 	int profileIndex;           /**< Profile index; Updated internally */
 #ifdef AAMP_DEBUG_INJECT
-	char uri[MAX_URI_LENGTH];   /**< Fragment url */
+	std::string uri;            /**< Fragment url */
 #endif
 };
 
@@ -149,6 +152,15 @@ public:
 	 */
 	double GetTotalInjectedDuration() { return totalInjectedDuration; };
 
+	/**
+	 * @brief Resync track with pipeline at next injected fragment, as done for discontinuity
+	 *
+	 * Pipeline is flushed and reconfigured for all tracks; cached fragments are kept.
+	 *
+	 * @return void
+	 */
+	void Resync();
+
 	/**
 	 * @brief Run fragment injector loop.
 	 *
@@ -230,9 +242,21 @@ public:
 	 */
 	bool IsDiscontinuityProcessed() { return discontinuityProcessed; }
 
-	void MonitorBufferHealth();
+	/**
+	 * @brief Update buffer health and stall prediction of track
+	 *
+	 * Called on fragment fetch and inject, and periodically on progress report.
+	 *
+	 * @return void
+	 */
+	void UpdateBufferHealth();
 
-	void ScheduleBufferHealthMonitor();
+	/**
+	 * @brief Get predicted time until track buffer runs dry
+	 *
+	 * @return Time in seconds, negative if buffer is not draining
+	 */
+	double GetPredictedTimeToEmpty() { return timeToEmpty; }
 
 	/**
 	 * @brief Get buffer health status
@@ -240,6 +264,26 @@ public:
 	 * @return current buffer health status
 	 */
 	BufferHealthStatus GetBufferHealthStatus() { return bufferStatus; };
+
+	/**
+	 * @brief Point injection at the cached or retained fragment containing a position.
+	 *
+	 * To be called while injection is stopped. Retained fragments from there on are injected
+	 * again before the cache, skipped cached fragments are retained.
+	 *
+	 * @param[in] position - Position in the playlist, seconds
+	 * @param[out] fragmentPosition - Start position of the fragment found
+	 * @param[in] commit - false to only check if position is buffered
+	 * @return true if position is buffered
+	 */
+	bool SeekInBuffer(double position, double &fragmentPosition, bool commit);
+
+	/**
+	 * @brief Free fragments retained for in-buffer seek
+	 *
+	 * @return void
+	 */
+	void ClearRetainedFragments();
 protected:
 
 	/**
@@ -273,6 +317,15 @@ protected:
 	 * @return void
 	 */
 	virtual void InjectFragmentInternal(CachedFragment* cachedFragment, bool &fragmentDiscarded) = 0;
+
+	/**
+	 * @brief Wait until data handed off by InjectFragmentInternal reaches the sink.
+	 *
+	 * Called before discontinuity and end of stream so that no queued data is left behind.
+	 *
+	 * @return void
+	 */
+	virtual void FlushFragments() {}
 
 
 	static int GetDeferTimeMs(long maxTimeSeconds);
@@ -280,6 +333,37 @@ protected:
 private:
 	static const char* GetBufferHealthStatusString(BufferHealthStatus status);
 
+	/**
+	 * @brief Keep a copy of a fragment before it is injected, and drop the ones behind retention window
+	 *
+	 * @param[in] cachedFragment - Fragment to retain
+	 * @return void
+	 */
+	void RetainFragment(const CachedFragment* cachedFragment);
+
+	/**
+	 * @brief Copy the next fragment to be injected again after in-buffer seek
+	 *
+	 * @param[out] replayFragment - Copy of the fragment, to be freed by caller
+	 * @return true if a fragment is to be replayed
+	 */
+	bool GetReplayFragment(CachedFragment* replayFragment);
+
+	/**
+	 * @brief Move the injected replay fragment back to retained fragments
+	 *
+	 * @return void
+	 */
+	void UpdateAfterReplay();
+
+	/**
+	 * @brief Get a buffered fragment, counting retained, replay and then cached fragments
+	 *
+	 * @param[in] idx - Index from the oldest retained fragment
+	 * @return Fragment at the index
+	 */
+	CachedFragment* GetBufferedFragment(int idx);
+
 public:
 	bool eosReached;                    /**< set to true when a vod asset has been played to completion */
 	bool enabled;                       /**< set to true if track is enabled */
@@ -290,6 +374,8 @@ public:
 	int segDrmDecryptFailCount;         /**< Segment decryption failure count*/
 	int mSegInjectFailCount;            /**< Segment Inject/Decode fail count */
 	TrackType type;                     /**< Media type of the track*/
+	bool retainInjectedFragments;       /**< Keep injected fragments behind play position for in-buffer seek */
+	const int maxCachedFragmentsPerTrack; /**< Length of cachedFragment ring, fixed at construction */
 protected:
 	PrivateInstanceAAMP* aamp;          /**< Pointer to the PrivateInstanceAAMP*/
 	CachedFragment *cachedFragment;     /**< storage for currently-downloaded fragment */
@@ -300,10 +386,8 @@ private:
 	pthread_cond_t fragmentFetched;     /**< Signaled after a fragment is fetched*/
 	pthread_cond_t fragmentInjected;    /**< Signaled after a fragment is injected*/
 	pthread_t fragmentInjectorThreadID; /**< Fragment injector thread id*/
-	pthread_t bufferMonitorThreadID;    /**< Buffer Monitor thread id */
 	int totalFragmentsDownloaded;       /**< Total fragments downloaded since start by track*/
 	bool fragmentInjectorThreadStarted; /**< Fragment injector's thread started or not*/
-	bool bufferMonitorThreadStarted;    /**< Buffer Monitor thread started or not */
 	double totalInjectedDuration;       /**< Total fragment injected duration*/
 	int cacheDurationSeconds;           /**< Total fragment cache duration*/
 	bool notifiedCachingComplete;       /**< Fragment caching completed or not*/
@@ -312,9 +396,18 @@ private:
 	int bandwidthBytesPerSecond;        /**< Bandwidth of last selected profile*/
 	double totalFetchedDuration;        /**< Total fragment fetched duration*/
 	bool discontinuityProcessed;
+	std::deque<CachedFragment> mRetainedFragments; /**< Copies of injected fragments, oldest first */
+	std::deque<CachedFragment> mReplayFragments;   /**< Retained fragments to be injected again after in-buffer seek */
+	bool mFragmentDiscontinuity;                   /**< Discontinuity was signaled for the fragment being injected, kept for its retained copy */
 
 	BufferHealthStatus bufferStatus;     /**< Buffer status of the track*/
 	BufferHealthStatus prevBufferStatus; /**< Previous buffer status of the track*/
+	double fillRate;                     /**< Seconds of media fetched per second, averaged over recent fetches*/
+	long long lastFetchTimeMs;           /**< Time of last fetch, or of free fragment becoming available after cache was full*/
+	double injectedBytesPerSecond;       /**< Bytes per second of media of recently injected fragments*/
+	double timeToEmpty;                  /**< Predicted seconds until buffer is empty, negative if not draining*/
+	bool stallPredicted;                 /**< timeToEmpty is below stall prediction threshold*/
+	long long lastRampDownRequestMs;     /**< Time of last ramp down requested on stall prediction*/
 };
 
 /**
@@ -526,6 +619,20 @@ public:
 	 */
 	void CheckForProfileChange(void);
 
+	/**
+	 *   @brief Update buffer health and stall prediction of enabled tracks.
+	 *
+	 *   @return void
+	 */
+	void UpdateBufferHealth(void);
+
+	/**
+	 *   @brief Request ramp down at next profile check, used on underflow recovery.
+	 *
+	 *   @return void
+	 */
+	void RequestRampDown() { mRampDownRequested = true; }
+
 	/**
 	 *   @brief Get iframe track index.
 	 *   This shall be called only after UpdateIframeTracks() is done
@@ -595,6 +702,13 @@ public:
 	 *   @return void
 	 */
 	virtual void NotifyPlaybackPaused(bool paused);
+
+	/**
+	 *   @brief Check if playback is paused, as notified by NotifyPlaybackPaused.
+	 *
+	 *   @return true, if playback is paused
+	 */
+	bool IsPlaybackPaused() { return mIsPaused; }
 
 	/**
 	 *   @brief Check if player caches are running dry.
@@ -625,6 +739,7 @@ public:
 	bool mIsFirstBuffer;                    /** <flag that denotes if the first buffer was processed or not*/
 	bool mNetworkDownDetected;              /**< Network down status indicator */
 	bool mCheckForRampdown;			/**< flag to indicate if rampdown is attempted or not */
+	bool mRampDownRequested;		/**< ramp down at next profile check, set on underflow recovery */
 	TuneType mTuneType;                     /**< Tune type of current playback, initialize by derived classes on Init()*/
 
 
@@ -722,6 +837,14 @@ public:
 	 *   @brief Start injection of fragments.
 	 */
 	virtual void StartInjection(void) = 0;
+
+	/**
+	 *   @brief Point injection at a position already fetched, to be called while injection is stopped.
+	 *
+	 *   @param[in]  position - Position in the playlist, seconds
+	 *   @return true if all tracks have the position buffered; stream position is then updated.
+	 */
+	virtual bool SeekInBuffer(double position) { return false; }
 
 protected:
 	/**
@@ -32,6 +32,7 @@
 #include <stdio.h> // for sprintf
 #include "priv_aamp.h"
 #include <pthread.h>
+#include <time.h>
 #include <atomic>
 
 #ifdef __APPLE__
@@ -96,6 +97,7 @@ typedef enum {
 #define DEFAULT_BUFFERING_MAX_CNT (DEFAULT_BUFFERING_MAX_MS/DEFAULT_BUFFERING_TO_MS)   //!< max buffering timeout count
 #define AAMP_MIN_PTS_UPDATE_INTERVAL 4000
 #define AAMP_DELAY_BETWEEN_PTS_CHECK_FOR_EOS_ON_UNDERFLOW 500
+#define MAX_BYTES_TO_SEND (128*1024)                     //!< max size of a buffer pushed for non ISO BMFF formats
 
 /**
  * @struct media_stream
@@ -112,6 +114,18 @@ struct media_stream
 	bool resetPosition;
 	bool bufferUnderrun;
 	bool eosReached;
+	bool continueTimeline; //Segment event continuing running time of previous timeline is due with next buffer
+	GstClockTime segmentStart; //Start of last segment event sent
+	GstClockTime segmentBase; //Running time at start of last segment event
+#ifdef USE_GST1
+	bool bufferPoolNegotiated; //Allocation query was done for appsrc
+	bool bufferPoolFromDownstream; //Pool or allocator was proposed by downstream
+	GstBufferPool *bufferPool; //Pool providing buffers injected through appsrc, NULL if not available
+	guint bufferPoolSize; //Size of buffers in bufferPool
+	GstAllocator *allocator; //Allocator proposed by downstream for buffers not from pool, NULL for system memory
+	GstAllocationParams allocationParams; //Parameters for allocator
+	pthread_mutex_t bufferPoolMutex; //Guards buffer pool state; demux sender threads inject while Flush/TearDownStream release it
+#endif
 };
 
 /**
@@ -169,6 +183,11 @@ struct AAMPGstPlayerPriv
 	gint64 lastKnownPTS; //To store the PTS of last displayed video
 	long long ptsUpdatedTimeMS; //Timestamp when PTS was last updated
 	guint ptsCheckForEosOnUnderflowIdleTaskId; //ID of task to ensure video PTS is not moving before notifying EOS on underflow.
+	pthread_mutex_t positionClockMutex; //Serializes updates of position clock; readers don't lock.
+	std::atomic<unsigned int> positionClockSeq; //Position clock update sequence, odd while an update is in progress.
+	std::atomic<long long> positionClockMs; //Pipeline position at last sample, -1 if not sampled since last flush/state change.
+	std::atomic<long long> positionClockTimeMs; //Monotonic time of last position sample.
+	std::atomic<int> positionClockRate; //Rate at which position advances from last sample, 0 if pipeline not playing.
 };
 
 
@@ -199,6 +218,18 @@ static GstBusSyncReply bus_sync_handler(GstBus * bus, GstMessage * msg, AAMPGstP
  */
 static gboolean buffering_timeout (gpointer data);
 
+/**
+ * @brief Invalidate position clock, next position request samples the pipeline
+ */
+static void InvalidatePositionClock(AAMPGstPlayerPriv *privateContext);
+
+#ifdef USE_GST1
+/**
+ * @brief Release buffer pool and allocator negotiated for appsrc
+ */
+static void AAMPGstPlayer_ReleaseBufferPool(media_stream *stream);
+#endif
+
 /**
  * @brief AAMPGstPlayer Constructor
  *
@@ -215,6 +246,15 @@ AAMPGstPlayer::AAMPGstPlayer(PrivateInstanceAAMP *aamp)
 		privateContext->using_westerossink = true;
 	this->aamp = aamp;
 
+	pthread_mutex_init(&privateContext->positionClockMutex, NULL);
+	privateContext->positionClockMs = -1;
+#ifdef USE_GST1
+	for (int iTrack = 0; iTrack < AAMP_TRACK_COUNT; iTrack++)
+	{
+		pthread_mutex_init(&privateContext->stream[iTrack].bufferPoolMutex, NULL);
+	}
+#endif
+
 	CreatePipeline();
 	privateContext->rate = AAMP_NORMAL_PLAY_RATE;
 	strcpy(privateContext->videoRectangle, DEFAULT_VIDEO_RECTANGLE);
@@ -227,6 +267,13 @@ AAMPGstPlayer::AAMPGstPlayer(PrivateInstanceAAMP *aamp)
 AAMPGstPlayer::~AAMPGstPlayer()
 {
 	DestroyPipeline();
+	pthread_mutex_destroy(&privateContext->positionClockMutex);
+#ifdef USE_GST1
+	for (int iTrack = 0; iTrack < AAMP_TRACK_COUNT; iTrack++)
+	{
+		pthread_mutex_destroy(&privateContext->stream[iTrack].bufferPoolMutex);
+	}
+#endif
 	free(privateContext);
 }
 
@@ -563,7 +610,7 @@ static gboolean IdleCallback(gpointer user_data)
 	_this->aamp->ReportProgress();
 	_this->privateContext->firstProgressCallbackIdleTaskPending = false;
 	_this->privateContext->firstProgressCallbackIdleTaskId = 0;
-	_this->privateContext->periodicProgressCallbackIdleTaskId = g_timeout_add(gpGlobalConfig->reportProgressInterval, ProgressCallbackOnTimeout, user_data);
+	_this->privateContext->periodicProgressCallbackIdleTaskId = g_timeout_add(_this->aamp->mReportProgressInterval, ProgressCallbackOnTimeout, user_data);
 	logprintf("%s:%d current %d, periodicProgressCallbackIdleTaskId %d \n", __FUNCTION__, __LINE__, g_source_get_id(g_main_current_source()), _this->privateContext->periodicProgressCallbackIdleTaskId);
 	return G_SOURCE_REMOVE;
 }
@@ -744,6 +791,7 @@ static void AAMPGstPlayer_OnGstBufferUnderflowCb(GstElement* object, guint arg0,
 		type = eMEDIATYPE_AUDIO;
 	}
 	_this->privateContext->stream[type].bufferUnderrun = true;
+	InvalidatePositionClock(_this->privateContext);
 	if (_this->privateContext->stream[type].eosReached)
 	{
 		if (_this->privateContext->rate > 0)
@@ -882,6 +930,10 @@ static gboolean bus_message(GstBus * bus, GstMessage * msg, AAMPGstPlayer * _thi
 		gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
 
 		isPlaybinStateChangeEvent = (GST_MESSAGE_SRC(msg) == GST_OBJECT(_this->privateContext->pipeline));
+		if (isPlaybinStateChangeEvent)
+		{ // position stops or starts advancing
+			InvalidatePositionClock(_this->privateContext);
+		}
 
 		if (gpGlobalConfig->logging.gst || isPlaybinStateChangeEvent)
 		{
@@ -1194,10 +1246,10 @@ static GstBusSyncReply bus_sync_handler(GstBus * bus, GstMessage * msg, AAMPGstP
 		gst_message_parse_context_type(msg, &contextType);
 		if (!g_strcmp0(contextType, "drm-preferred-decryption-system-id"))
 		{
-			logprintf("Setting %s as preferred drm\n",GetDrmSystemName((DRMSystems)gpGlobalConfig->preferredDrm));
+			logprintf("Setting %s as preferred drm\n",GetDrmSystemName(_this->aamp->mPreferredDrm));
 			GstContext* context = gst_context_new("drm-preferred-decryption-system-id", FALSE);
 			GstStructure* contextStructure = gst_context_writable_structure(context);
-			gst_structure_set(contextStructure, "decryption-system-id", G_TYPE_STRING, GetDrmSystemID((DRMSystems)gpGlobalConfig->preferredDrm),  NULL);
+			gst_structure_set(contextStructure, "decryption-system-id", G_TYPE_STRING, GetDrmSystemID(_this->aamp->mPreferredDrm),  NULL);
 			gst_element_set_context(GST_ELEMENT(GST_MESSAGE_SRC(msg)), context);
 		}
 
@@ -1277,6 +1329,12 @@ bool AAMPGstPlayer::CreatePipeline()
  */
 void AAMPGstPlayer::DestroyPipeline()
 {
+#ifdef USE_GST1
+	for (int iTrack = 0; iTrack < AAMP_TRACK_COUNT; iTrack++)
+	{
+		AAMPGstPlayer_ReleaseBufferPool(&privateContext->stream[iTrack]);
+	}
+#endif
 	if (privateContext->pipeline)
 	{
 		gst_object_unref(privateContext->pipeline);
@@ -1447,6 +1505,9 @@ void AAMPGstPlayer::TearDownStream(MediaType mediaType)
 	media_stream* stream = &privateContext->stream[mediaType];
 	stream->bufferUnderrun = false;
 	stream->eosReached = false;
+#ifdef USE_GST1
+	AAMPGstPlayer_ReleaseBufferPool(stream);
+#endif
 	if ((stream->format != FORMAT_INVALID) && (stream->format != FORMAT_NONE))
 	{
 		logprintf("AAMPGstPlayer::TearDownStream: mediaType %d \n", (int)mediaType);
@@ -1682,9 +1743,220 @@ static void AAMPGstPlayer_SendPendingEvents(PrivateInstanceAAMP *aamp, AAMPGstPl
 	gst_object_unref(sourceEleSrcPad);
 	stream->resetPosition = false;
 	stream->flush = false;
+	stream->continueTimeline = false;
+	stream->segmentStart = pts;
+	stream->segmentBase = 0;
+}
+
+
+#ifdef USE_GST1
+/**
+ * @brief Send segment event mapping new timeline after a gapless discontinuity onto running time reached by previous one
+ *
+ * @param[in] privateContext  Pointer to AAMPGstPlayerPriv instance
+ * @param[in] mediaType       Stream type
+ * @param[in] pts             PTS of next buffer, start of new timeline
+ */
+static void AAMPGstPlayer_SendContinuousSegment(AAMPGstPlayerPriv *privateContext, MediaType mediaType, GstClockTime pts)
+{
+	media_stream* stream = &privateContext->stream[mediaType];
+	GstPad* sourceEleSrcPad = gst_element_get_static_pad(GST_ELEMENT(stream->source), "src");
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+	segment.start = pts;
+	segment.base = stream->segmentBase;
+	segment.time = stream->segmentBase;
+	segment.rate = AAMP_NORMAL_PLAY_RATE;
+	segment.applied_rate = AAMP_NORMAL_PLAY_RATE;
+	logprintf("Sending continuous segment event for mediaType[%d]. start %" G_GUINT64_FORMAT " base %" G_GUINT64_FORMAT "\n", mediaType, segment.start, segment.base);
+	if (!gst_pad_push_event(sourceEleSrcPad, gst_event_new_segment(&segment)))
+	{
+		logprintf("%s: gst_pad_push_event segment error\n", __FUNCTION__);
+	}
+	gst_object_unref(sourceEleSrcPad);
+	stream->continueTimeline = false;
+	stream->segmentStart = pts;
+}
+#endif
+
+
+#ifdef USE_GST1
+/**
+ * @brief Negotiate buffer pool of appsrc through an allocation query to downstream, if not done yet
+ *
+ * Pool and allocator proposed by downstream are used if any, else a pool of system memory.
+ *
+ * @param[in] stream  Stream of the appsrc
+ * @param[in] size    Size of buffers to be injected
+ *
+ * @retval true if downstream proposed a pool or allocator
+ */
+static bool AAMPGstPlayer_NegotiateBufferPool(media_stream *stream, guint size)
+{
+	pthread_mutex_lock(&stream->bufferPoolMutex);
+	if (stream->bufferPoolNegotiated)
+	{
+		bool fromDownstream = stream->bufferPoolFromDownstream;
+		pthread_mutex_unlock(&stream->bufferPoolMutex);
+		return fromDownstream;
+	}
+	GstBufferPool *pool = NULL;
+	GstAllocator *allocator = NULL;
+	GstAllocationParams params;
+	guint poolSize = 0;
+	guint minBuffers = 0;
+	guint maxBuffers = 0;
+	gst_allocation_params_init(&params);
+	stream->bufferPoolNegotiated = true;
+
+	GstCaps *caps = gst_app_src_get_caps(GST_APP_SRC(stream->source));
+	GstPad *srcPad = gst_element_get_static_pad(stream->source, "src");
+	GstQuery *query = gst_query_new_allocation(caps, TRUE);
+	if (srcPad && gst_pad_peer_query(srcPad, query))
+	{
+		if (gst_query_get_n_allocation_params(query) > 0)
+		{
+			gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
+		}
+		if (gst_query_get_n_allocation_pools(query) > 0)
+		{
+			gst_query_parse_nth_allocation_pool(query, 0, &pool, &poolSize, &minBuffers, &maxBuffers);
+		}
+	}
+	gst_query_unref(query);
+	if (srcPad)
+	{
+		gst_object_unref(srcPad);
+	}
+	bool poolFromDownstream = (pool != NULL);
+
+	if (pool && gst_buffer_pool_is_active(pool))
+	{ // already in use by another upstream, take it as configured
+		GstStructure *config = gst_buffer_pool_get_config(pool);
+		gst_buffer_pool_config_get_params(config, NULL, &poolSize, NULL, NULL);
+		gst_structure_free(config);
+	}
+	else
+	{
+		if (!pool)
+		{
+			pool = gst_buffer_pool_new();
+		}
+		if (poolSize < size)
+		{
+			poolSize = size;
+		}
+		GstStructure *config = gst_buffer_pool_get_config(pool);
+		gst_buffer_pool_config_set_params(config, caps, poolSize, minBuffers, maxBuffers);
+		gst_buffer_pool_config_set_allocator(config, allocator, &params);
+		if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+		{
+			logprintf("%s: buffer pool configuration failed, size %u min %u max %u\n", __FUNCTION__, poolSize, minBuffers, maxBuffers);
+			gst_object_unref(pool);
+			pool = NULL;
+		}
+	}
+	if (caps)
+	{
+		gst_caps_unref(caps);
+	}
+	stream->bufferPoolFromDownstream = ((pool && poolFromDownstream) || allocator);
+	stream->bufferPool = pool;
+	stream->bufferPoolSize = poolSize;
+	stream->allocator = allocator;
+	stream->allocationParams = params;
+	logprintf("%s: appsrc %s pool %p size %u allocator %s from downstream %d\n", __FUNCTION__, GST_ELEMENT_NAME(stream->source),
+			pool, poolSize, allocator ? GST_OBJECT_NAME(allocator) : "default", stream->bufferPoolFromDownstream);
+	bool fromDownstream = stream->bufferPoolFromDownstream;
+	pthread_mutex_unlock(&stream->bufferPoolMutex);
+	return fromDownstream;
 }
 
 
+/**
+ * @brief Release buffer pool and allocator negotiated for appsrc
+ *
+ * @param[in] stream  Stream of the appsrc
+ */
+static void AAMPGstPlayer_ReleaseBufferPool(media_stream *stream)
+{
+	pthread_mutex_lock(&stream->bufferPoolMutex);
+	if (stream->bufferPool)
+	{
+		if (!stream->bufferPoolFromDownstream)
+		{
+			gst_buffer_pool_set_active(stream->bufferPool, FALSE);
+		}
+		gst_object_unref(stream->bufferPool);
+		stream->bufferPool = NULL;
+	}
+	if (stream->allocator)
+	{
+		gst_object_unref(stream->allocator);
+		stream->allocator = NULL;
+	}
+	stream->bufferPoolNegotiated = false;
+	stream->bufferPoolFromDownstream = false;
+	pthread_mutex_unlock(&stream->bufferPoolMutex);
+}
+
+
+/**
+ * @brief Get a buffer to be filled and injected through appsrc, from negotiated pool or allocator
+ *
+ * Pool is not waited on; if it has no free buffer, memory comes from the negotiated allocator.
+ * Used for every copied buffer, i.e. TS passed through TSProcessor. Fragments, demuxed ES and
+ * remuxed MP4 arrive as GrowableBuffer and are wrapped instead; they come here only when
+ * downstream proposed a pool or allocator.
+ *
+ * @param[in] stream  Stream of the appsrc
+ * @param[in] ptr     Data to be copied to buffer
+ * @param[in] size    Size of the data
+ *
+ * @retval Buffer holding a copy of data, NULL if memory couldn't be written
+ */
+static GstBuffer* AAMPGstPlayer_GetFilledBuffer(media_stream *stream, const void *ptr, gsize size)
+{
+	GstBuffer *buffer = NULL;
+	GstMapInfo map;
+	pthread_mutex_lock(&stream->bufferPoolMutex);
+	if (stream->bufferPool && (size <= stream->bufferPoolSize))
+	{
+		GstBufferPoolAcquireParams acquireParams;
+		memset(&acquireParams, 0, sizeof(acquireParams));
+		acquireParams.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+		if (GST_FLOW_OK == gst_buffer_pool_acquire_buffer(stream->bufferPool, &buffer, &acquireParams))
+		{
+			gst_buffer_set_size(buffer, size);
+		}
+		else
+		{
+			buffer = NULL;
+		}
+	}
+	if (!buffer)
+	{
+		buffer = gst_buffer_new_allocate(stream->allocator, size, &stream->allocationParams);
+	}
+	pthread_mutex_unlock(&stream->bufferPoolMutex);
+	if (buffer)
+	{
+		if (gst_buffer_map(buffer, &map, GST_MAP_WRITE))
+		{
+			memcpy(map.data, ptr, size);
+			gst_buffer_unmap(buffer, &map);
+		}
+		else
+		{ // e.g. secure memory not mappable by CPU
+			gst_buffer_unref(buffer);
+			buffer = NULL;
+		}
+	}
+	return buffer;
+}
+#endif
+
+
 /**
  * @brief Inject buffer of a stream type to its pipeline
  *
@@ -1697,7 +1969,6 @@ static void AAMPGstPlayer_SendPendingEvents(PrivateInstanceAAMP *aamp, AAMPGstPl
  */
 void AAMPGstPlayer::Send(MediaType mediaType, const void *ptr, size_t len0, double fpts, double fdts, double fDuration)
 {
-#define MAX_BYTES_TO_SEND (128*1024)
 	GstClockTime pts = (GstClockTime)(fpts * GST_SECOND);
 	GstClockTime dts = (GstClockTime)(fdts * GST_SECOND);
 	GstClockTime duration = (GstClockTime)(fDuration * 1000000000LL);
@@ -1743,6 +2014,13 @@ void AAMPGstPlayer::Send(MediaType mediaType, const void *ptr, size_t len0, doub
 		AAMPGstPlayer_SendPendingEvents(aamp, privateContext, mediaType, pts);
 		discontinuity = TRUE;
 	}
+#ifdef USE_GST1
+	else if (privateContext->stream[mediaType].continueTimeline)
+	{
+		AAMPGstPlayer_SendContinuousSegment(privateContext, mediaType, pts);
+		discontinuity = TRUE;
+	}
+#endif
 
 	while (aamp->DownloadsAreEnabled())
 	{
@@ -1751,21 +2029,37 @@ void AAMPGstPlayer::Send(MediaType mediaType, const void *ptr, size_t len0, doub
 		{
 			len = maxBytes;
 		}
-		GstBuffer *buffer = gst_buffer_new_and_alloc((guint)len);
+#ifdef USE_GST1
+		GstBuffer *buffer = NULL;
+		media_stream *stream = &privateContext->stream[mediaType];
+		if (gpGlobalConfig->gstBufferPool)
+		{
+			AAMPGstPlayer_NegotiateBufferPool(stream, (guint)maxBytes);
+			buffer = AAMPGstPlayer_GetFilledBuffer(stream, ptr, len);
+		}
+		if (!buffer)
+		{
+			GstMapInfo map;
+			buffer = gst_buffer_new_and_alloc((guint)len);
+			gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+			memcpy(map.data, ptr, len);
+			gst_buffer_unmap(buffer, &map);
+		}
 		if (discontinuity )
 		{
 			GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
 			discontinuity = FALSE;
 		}
-#ifdef USE_GST1
-		GstMapInfo map;
-		gst_buffer_map(buffer, &map, GST_MAP_WRITE);
-		memcpy(map.data, ptr, len);
-		gst_buffer_unmap(buffer, &map);
 		GST_BUFFER_PTS(buffer) = pts;
 		GST_BUFFER_DTS(buffer) = dts;
 		//GST_BUFFER_DURATION(buffer) = duration;
 #else
+		GstBuffer *buffer = gst_buffer_new_and_alloc((guint)len);
+		if (discontinuity )
+		{
+			GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+			discontinuity = FALSE;
+		}
 		memcpy(GST_BUFFER_DATA(buffer), ptr, len);
 		GST_BUFFER_TIMESTAMP(buffer) = pts;
 		GST_BUFFER_DURATION(buffer) = duration;
@@ -1805,7 +2099,13 @@ void AAMPGstPlayer::Send(MediaType mediaType, GrowableBuffer* pBuffer, double fp
 	GstClockTime dts = (GstClockTime)(fdts * GST_SECOND);
 	GstClockTime duration = (GstClockTime)(fDuration * 1000000000LL);
 	gboolean discontinuity = FALSE;
+	size_t maxBytes = pBuffer->len;
 
+	if ((privateContext->stream[eMEDIATYPE_VIDEO].format != FORMAT_ISO_BMFF) && (maxBytes > MAX_BYTES_TO_SEND))
+	{
+		// same limit as copied buffers; chunks share the wrapped memory
+		maxBytes = MAX_BYTES_TO_SEND;
+	}
 #ifdef TRACE_VID_PTS
 	if (mediaType == eMEDIATYPE_VIDEO && privateContext->rate != AAMP_NORMAL_PLAY_RATE)
 	{
@@ -1834,29 +2134,109 @@ void AAMPGstPlayer::Send(MediaType mediaType, GrowableBuffer* pBuffer, double fp
 		AAMPGstPlayer_SendPendingEvents(aamp, privateContext, mediaType, pts);
 		discontinuity = TRUE;
 	}
+#ifdef USE_GST1
+	else if (privateContext->stream[mediaType].continueTimeline)
+	{
+		AAMPGstPlayer_SendContinuousSegment(privateContext, mediaType, pts);
+		discontinuity = TRUE;
+	}
+#endif
 
+	GstBuffer* wrapped = NULL;
 #ifdef USE_GST1
-	GstBuffer* buffer = gst_buffer_new_wrapped (pBuffer->ptr ,pBuffer->len);
-	GST_BUFFER_PTS(buffer) = pts;
-	GST_BUFFER_DTS(buffer) = dts;
+	media_stream *stream = &privateContext->stream[mediaType];
+	bool copyToPool = false;
+	if (gpGlobalConfig->gstBufferPool)
+	{
+		// downstream wants its own memory, worth a copy
+		copyToPool = AAMPGstPlayer_NegotiateBufferPool(stream, (guint)maxBytes);
+	}
+#endif
+	size_t offset = 0;
+	while (offset < pBuffer->len)
+	{
+		size_t len = pBuffer->len - offset;
+		if (len > maxBytes)
+		{
+			len = maxBytes;
+		}
+		GstBuffer* buffer = NULL;
+#ifdef USE_GST1
+		if (copyToPool)
+		{
+			buffer = AAMPGstPlayer_GetFilledBuffer(stream, pBuffer->ptr + offset, len);
+			copyToPool = (buffer != NULL);
+		}
+		if (!buffer)
+		{
+			if (!wrapped)
+			{
+				wrapped = gst_buffer_new_wrapped (pBuffer->ptr ,pBuffer->len);
+			}
+			if (len == pBuffer->len)
+			{
+				buffer = gst_buffer_ref(wrapped);
+			}
+			else
+			{
+				buffer = gst_buffer_copy_region(wrapped, GST_BUFFER_COPY_MEMORY, offset, len);
+			}
+		}
+		if (discontinuity)
+		{
+			GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+			discontinuity = FALSE;
+		}
+		GST_BUFFER_PTS(buffer) = pts;
+		GST_BUFFER_DTS(buffer) = dts;
 #else
-	GstBuffer* buffer = gst_buffer_new();
-	GST_BUFFER_SIZE (buffer) = pBuffer->len;
-	GST_BUFFER_MALLOCDATA (buffer) = (guint8*)pBuffer->ptr;
-	GST_BUFFER_DATA (buffer) = GST_BUFFER_MALLOCDATA (buffer);
-	GST_BUFFER_TIMESTAMP(buffer) = pts;
-	GST_BUFFER_DURATION(buffer) = duration;
+		if (!wrapped)
+		{
+			wrapped = gst_buffer_new();
+			GST_BUFFER_SIZE (wrapped) = pBuffer->len;
+			GST_BUFFER_MALLOCDATA (wrapped) = (guint8*)pBuffer->ptr;
+			GST_BUFFER_DATA (wrapped) = GST_BUFFER_MALLOCDATA (wrapped);
+		}
+		if (len == pBuffer->len)
+		{
+			buffer = gst_buffer_ref(wrapped);
+		}
+		else
+		{
+			buffer = gst_buffer_create_sub(wrapped, offset, len);
+		}
+		if (discontinuity)
+		{
+			GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+			discontinuity = FALSE;
+		}
+		GST_BUFFER_TIMESTAMP(buffer) = pts;
+		GST_BUFFER_DURATION(buffer) = duration;
 #endif
 
-	GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(privateContext->stream[mediaType].source), buffer);
-	if (ret != GST_FLOW_OK)
+		GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(privateContext->stream[mediaType].source), buffer);
+		if (ret != GST_FLOW_OK)
+		{
+			logprintf("gst_app_src_push_buffer error: %d[%s] mediaType %d\n", ret, gst_flow_get_name (ret), (int)mediaType);
+			assert(false);
+		}
+		else if (privateContext->stream[mediaType].bufferUnderrun)
+		{
+			privateContext->stream[mediaType].bufferUnderrun = false;
+		}
+		offset += len;
+		if ((offset < pBuffer->len) && !aamp->DownloadsAreEnabled())
+		{
+			break;
+		}
+	}
+	if (wrapped)
 	{
-		logprintf("gst_app_src_push_buffer error: %d[%s] mediaType %d\n", ret, gst_flow_get_name (ret), (int)mediaType);
-		assert(false);
+		gst_buffer_unref(wrapped);
 	}
-	else if (privateContext->stream[mediaType].bufferUnderrun)
+	else
 	{
-		privateContext->stream[mediaType].bufferUnderrun = false;
+		aamp_Free(&pBuffer->ptr);
 	}
 
 	/*Since ownership of buffer is given to gstreamer, reset pBuffer */
@@ -2051,6 +2431,7 @@ void AAMPGstPlayer::DisconnectCallbacks()
 void AAMPGstPlayer::Stop(bool keepLastFrame)
 {
 	logprintf("entering AAMPGstPlayer_Stop keepLastFrame %d\n", keepLastFrame);
+	InvalidatePositionClock(privateContext);
 #ifdef INTELCE
 	if (privateContext->video_sink)
 	{
@@ -2343,36 +2724,130 @@ void AAMPGstPlayer::SelectAudio(int index)
 }
 
 
+/**
+ * @brief Get monotonic time used by position clock
+ *
+ * @retval Time in MS
+ */
+static long long PositionClockTimeMS(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**
+ * @brief Update position clock, or invalidate it if positionMs is -1
+ *
+ * Caller holds positionClockMutex.
+ *
+ * @param[in] privateContext Player context
+ * @param[in] positionMs Pipeline position in MS
+ * @param[in] rate Rate at which position advances from now
+ */
+static void UpdatePositionClock(AAMPGstPlayerPriv *privateContext, long long positionMs, int rate)
+{
+	privateContext->positionClockSeq.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	privateContext->positionClockMs.store(positionMs, std::memory_order_relaxed);
+	privateContext->positionClockTimeMs.store(PositionClockTimeMS(), std::memory_order_relaxed);
+	privateContext->positionClockRate.store(rate, std::memory_order_relaxed);
+	privateContext->positionClockSeq.fetch_add(1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Invalidate position clock, next position request samples the pipeline
+ *
+ * Called on flush and pipeline state changes, after which interpolation from last sample is wrong.
+ *
+ * @param[in] privateContext Player context
+ */
+static void InvalidatePositionClock(AAMPGstPlayerPriv *privateContext)
+{
+	pthread_mutex_lock(&privateContext->positionClockMutex);
+	UpdatePositionClock(privateContext, -1, 0);
+	pthread_mutex_unlock(&privateContext->positionClockMutex);
+}
+
+
+/**
+ * @brief Read position clock without locking
+ *
+ * @param[in] privateContext Player context
+ * @param[out] positionMs Position interpolated to now
+ * @param[out] ageMs Time since the position was sampled from pipeline
+ * @retval false if position clock is invalid
+ */
+static bool ReadPositionClock(AAMPGstPlayerPriv *privateContext, long long &positionMs, long long &ageMs)
+{
+	unsigned int seq;
+	long long sampleMs;
+	long long sampleTimeMs;
+	int rate;
+	do
+	{
+		seq = privateContext->positionClockSeq.load(std::memory_order_acquire);
+		sampleMs = privateContext->positionClockMs.load(std::memory_order_relaxed);
+		sampleTimeMs = privateContext->positionClockTimeMs.load(std::memory_order_relaxed);
+		rate = privateContext->positionClockRate.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || (seq != privateContext->positionClockSeq.load(std::memory_order_relaxed)));
+	if (sampleMs < 0)
+	{
+		return false;
+	}
+	ageMs = PositionClockTimeMS() - sampleTimeMs;
+	positionMs = sampleMs + ageMs * rate;
+	if (positionMs < 0)
+	{
+		positionMs = 0;
+	}
+	return true;
+}
+
+
 /**
  * @brief Get playback position in MS
  *
+ * Position is interpolated from a pipeline sample taken at most positionSampleInterval ago,
+ * so frequent callers don't query the pipeline.
+ *
  * @retval Playback position in MS
  */
 long AAMPGstPlayer::GetPositionMilliseconds(void)
 {
 	long rc = 0;
-	gint64 pos, len;
+	gint64 pos;
 	GstFormat format = GST_FORMAT_TIME;
+	long long positionMs = 0;
+	long long ageMs = 0;
+	bool clockValid = ReadPositionClock(privateContext, positionMs, ageMs);
+	if (clockValid && (ageMs < gpGlobalConfig->positionSampleInterval))
+	{
+		return (long)positionMs;
+	}
 	if (privateContext->pipeline == NULL)
 	{
 		logprintf("%s(): Pipeline is NULL\n", __FUNCTION__);
 		return rc;
 	}
+	if (pthread_mutex_trylock(&privateContext->positionClockMutex) != 0)
+	{ // another caller is sampling or clock is being invalidated
+		return clockValid ? (long)positionMs : rc;
+	}
 #ifdef USE_GST1
-//WMR CHANGE
-if (gst_element_query_position(privateContext->pipeline, format, &pos))
-  return (long)(pos / 1e6);
-else
-  return 0;
-	if (gst_element_query_position(privateContext->pipeline, format, &pos) &&
-		gst_element_query_duration(privateContext->pipeline, format, &len))
+	if (gst_element_query_position(privateContext->pipeline, format, &pos))
 #else
-	if (gst_element_query_position(privateContext->pipeline, &format, &pos) &&
-		gst_element_query_duration(privateContext->pipeline, &format, &len))
+	if (gst_element_query_position(privateContext->pipeline, &format, &pos))
 #endif
 	{
 		rc = pos / 1e6;
+		bool advancing = (GST_STATE(privateContext->pipeline) == GST_STATE_PLAYING) && (GST_STATE_PENDING(privateContext->pipeline) == GST_STATE_VOID_PENDING);
+		UpdatePositionClock(privateContext, rc, advancing ? privateContext->rate : 0);
 	}
+	pthread_mutex_unlock(&privateContext->positionClockMutex);
 	return rc;
 }
 
@@ -2384,6 +2859,7 @@ else
  */
 void AAMPGstPlayer::Pause( bool pause )
 {
+	InvalidatePositionClock(privateContext);
 	aamp->SyncBegin();
 	logprintf("entering AAMPGstPlayer_Pause\n");
 	if (privateContext->pipeline == NULL)
@@ -2616,6 +3092,13 @@ void AAMPGstPlayer::setVolumeOrMuteUnMute(void)
 void AAMPGstPlayer::Flush(double position, int rate)
 {
 	media_stream *stream = &privateContext->stream[eMEDIATYPE_VIDEO];
+	InvalidatePositionClock(privateContext);
+#ifdef USE_GST1
+	for (int iTrack = 0; iTrack < AAMP_TRACK_COUNT; iTrack++)
+	{ // downstream may have deactivated its pool, negotiate again on next buffer
+		AAMPGstPlayer_ReleaseBufferPool(&privateContext->stream[iTrack]);
+	}
+#endif
 	privateContext->rate = rate;
 	privateContext->stream[eMEDIATYPE_VIDEO].bufferUnderrun = false;
 	privateContext->stream[eMEDIATYPE_AUDIO].bufferUnderrun = false;
@@ -2704,6 +3187,50 @@ bool AAMPGstPlayer::Discontinuity(MediaType type)
 }
 
 
+/**
+ * @brief Continue timeline of a stream type across a discontinuity, without EOS and flush
+ *
+ * Timeline of transport streams is restamped by demuxer on PCR discontinuity. Others get a segment
+ * event with next buffer, which keeps running time monotonic from where the previous timeline ended.
+ *
+ * @param[in] type              Stream type
+ * @param[in] discontinuityPts  PTS at which timeline before discontinuity would have continued, 0 if demuxer restamps
+ *
+ * @retval true if discontinuity processed without flush
+ */
+bool AAMPGstPlayer::ContinueTimeline(MediaType type, double discontinuityPts)
+{
+	bool ret = false;
+	media_stream *stream = &privateContext->stream[type];
+	if (stream->format == FORMAT_NONE || stream->format == FORMAT_INVALID || privateContext->rate != AAMP_NORMAL_PLAY_RATE)
+	{
+		logprintf("AAMPGstPlayer::%s type %d format %d rate %d - not continuous\n", __FUNCTION__, (int)type, stream->format, privateContext->rate);
+	}
+	else if (stream->resetPosition)
+	{ // segment event of next buffer starts the new timeline anyway
+		ret = true;
+	}
+	else if (discontinuityPts > 0)
+	{
+#ifdef USE_GST1
+		GstClockTime end = (GstClockTime)(discontinuityPts * GST_SECOND);
+		if (end > stream->segmentStart)
+		{
+			stream->segmentBase += (end - stream->segmentStart);
+		}
+		stream->continueTimeline = true;
+		ret = true;
+#endif
+	}
+	else
+	{
+		ret = (stream->format == FORMAT_MPEGTS);
+	}
+	logprintf("AAMPGstPlayer::%s type %d discontinuityPts %f ret %d\n", __FUNCTION__, (int)type, discontinuityPts, (int)ret);
+	return ret;
+}
+
+
 /**
  * @brief Check if cache empty for a media type.
  *
@@ -2784,6 +3311,27 @@ bool AAMPGstPlayer::IsCacheEmpty(MediaType mediaType)
 	return ret;
 }
 
+
+/**
+ * @brief Get bytes queued in appsrc of a stream
+ *
+ * @param[in] mediaType stream type
+ *
+ * @retval Queued bytes, -1 if not known
+ */
+long long AAMPGstPlayer::GetCacheLevelBytes(MediaType mediaType)
+{
+	long long ret = -1;
+#ifdef USE_GST1
+	media_stream *stream = &privateContext->stream[mediaType];
+	if (stream->source)
+	{
+		ret = (long long)gst_app_src_get_current_level_bytes(GST_APP_SRC(stream->source));
+	}
+#endif
+	return ret;
+}
+
 /**
  * @brief Set pipeline to PLAYING state once fragment caching is complete
  */
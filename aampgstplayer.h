@@ -56,11 +56,13 @@ public:
 	unsigned long getCCDecoderHandle(void);
 	void SetVideoRectangle(int x, int y, int w, int h);
 	bool Discontinuity( MediaType mediaType);
+	bool ContinueTimeline(MediaType mediaType, double discontinuityPts);
 	void SetVideoZoom(VideoZoomMode zoom);
 	void SetVideoMute(bool muted);
 	void SetAudioVolume(int volume);
 	void setVolumeOrMuteUnMute(void);
 	bool IsCacheEmpty(MediaType mediaType);
+	long long GetCacheLevelBytes(MediaType mediaType);
 	void NotifyFragmentCachingComplete();
 	void GetVideoSize(int &w, int &h);
 	void QueueProtectionEvent(const char *protSystemId, const void *ptr, size_t len);
@@ -1007,18 +1007,18 @@ AampDrmSession * AampDRMSessionManager::createDrmSession(
 
 		bool isComcastStream = false;
 
-		char *externLicenseServerURL = NULL;
-		if (gpGlobalConfig->prLicenseServerURL && !isWidevine)
+		string externLicenseServerURL;
+		if (!aamp->mPRLicenseServerURL.empty() && !isWidevine)
 		{
-			externLicenseServerURL = gpGlobalConfig->prLicenseServerURL;
+			externLicenseServerURL = aamp->mPRLicenseServerURL;
 		}
-		else if (gpGlobalConfig->wvLicenseServerURL && isWidevine)
+		else if (!aamp->mWVLicenseServerURL.empty() && isWidevine)
 		{
-			externLicenseServerURL = gpGlobalConfig->wvLicenseServerURL;
+			externLicenseServerURL = aamp->mWVLicenseServerURL;
 		}
-		else if (gpGlobalConfig->licenseServerURL)
+		else if (!aamp->mLicenseServerURL.empty())
 		{
-			externLicenseServerURL = gpGlobalConfig->licenseServerURL;
+			externLicenseServerURL = aamp->mLicenseServerURL;
 		}
 
 
@@ -1057,7 +1057,7 @@ AampDrmSession * AampDRMSessionManager::createDrmSession(
 			const char * sessionToken = getAccessToken(tokenLen, tokenError);
 			const char * secclientSessionToken = NULL;
 			pthread_mutex_unlock(&accessTokenMutex);
-			if(sessionToken != NULL && !gpGlobalConfig->licenseAnonymousRequest)
+			if(sessionToken != NULL && !aamp->mAnonymousRequest)
 			{
 				logprintf("%s:%d access token is available\n", __FUNCTION__, __LINE__);
 				aamp_AppendBytes(&comChallenge,"\",\"accessToken\":\"", strlen("\",\"accessToken\":\""));
@@ -1084,12 +1084,12 @@ AampDrmSession * AampDRMSessionManager::createDrmSession(
 			licenceChallenge = new DrmData(reinterpret_cast<unsigned char*>(comChallenge.ptr),comChallenge.len);
 			aamp_Free(&comChallenge.ptr);
 
-			if (externLicenseServerURL)
+			if (!externLicenseServerURL.empty())
 			{
 #ifdef USE_SECCLIENT
-				destinationURL = getFormattedLicenseServerURL(string(externLicenseServerURL));
+				destinationURL = getFormattedLicenseServerURL(externLicenseServerURL);
 #else
-				destinationURL = string(externLicenseServerURL);
+				destinationURL = externLicenseServerURL;
 #endif
 			}
 			else
@@ -1188,9 +1188,9 @@ AampDrmSession * AampDRMSessionManager::createDrmSession(
 		}
 		else 
 		{
-			if (externLicenseServerURL)
+			if (!externLicenseServerURL.empty())
 			{
-				destinationURL = string(externLicenseServerURL);
+				destinationURL = externLicenseServerURL;
 			}
 			logprintf("%s:%d License request ready for %s stream\n", __FUNCTION__, __LINE__, sessionTypeName[streamType]);
 			aamp->profiler.ProfileBegin(PROFILE_BUCKET_LA_NETWORK);
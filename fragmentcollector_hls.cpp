@@ -376,6 +376,143 @@ static void ParseStreamInfCallback(char *attrName, char *delimEqual, char *fin,
 	}
 }
 
+/***************************************************************************
+* @fn ParseImageStreamInfCallback
+* @brief Callback function to extract image stream tag attributes
+*
+* @param[in]  attrName   Input string
+* @param[in]  delimEqual Delimiter string
+* @param[in]  fin        String end pointer
+* @param[out] arg        ThumbnailTrack pointer for storage
+*
+* @return void
+***************************************************************************/
+static void ParseImageStreamInfCallback(char *attrName, char *delimEqual, char *fin, void* arg)
+{
+	ThumbnailTrack *track = (ThumbnailTrack *) arg;
+	char *valuePtr = delimEqual + 1;
+	if (AttributeNameMatch(attrName, "URI"))
+	{
+		track->playlistUrl = GetAttributeValueString(valuePtr, fin);
+	}
+	else if (AttributeNameMatch(attrName, "BANDWIDTH"))
+	{
+		track->info.bandwidth = atol(valuePtr);
+	}
+	else if (AttributeNameMatch(attrName, "RESOLUTION"))
+	{
+		sscanf(valuePtr, "%dx%d", &track->info.width, &track->info.height);
+	}
+	else
+	{
+		AAMPLOG_INFO("unknown image stream inf attribute %s\n", attrName);
+	}
+}
+
+/**
+ * @brief Tile layout of thumbnail sprite images
+ */
+struct ThumbnailTiles
+{
+	int width;          /**< Width of a tile */
+	int height;         /**< Height of a tile */
+	int columns;        /**< Tiles per row */
+	int rows;           /**< Tiles per column */
+	double duration;    /**< Media duration covered by a tile, 0 to split segment duration evenly */
+};
+
+/***************************************************************************
+* @fn ParseTilesCallback
+* @brief Callback function to extract tiles tag attributes
+*
+* @param[in]  attrName   Input string
+* @param[in]  delimEqual Delimiter string
+* @param[in]  fin        String end pointer
+* @param[out] arg        ThumbnailTiles pointer for storage
+*
+* @return void
+***************************************************************************/
+static void ParseTilesCallback(char *attrName, char *delimEqual, char *fin, void* arg)
+{
+	ThumbnailTiles *tiles = (ThumbnailTiles *) arg;
+	char *valuePtr = delimEqual + 1;
+	if (AttributeNameMatch(attrName, "RESOLUTION"))
+	{
+		sscanf(valuePtr, "%dx%d", &tiles->width, &tiles->height);
+	}
+	else if (AttributeNameMatch(attrName, "LAYOUT"))
+	{
+		sscanf(valuePtr, "%dx%d", &tiles->columns, &tiles->rows);
+	}
+	else if (AttributeNameMatch(attrName, "DURATION"))
+	{
+		tiles->duration = atof(valuePtr);
+	}
+}
+
+/***************************************************************************
+* @fn ParseUriAttributeCallback
+* @brief Callback function to extract URI attribute of map or key tag
+*
+* @param[in]  attrName   Input string
+* @param[in]  delimEqual Delimiter string
+* @param[in]  fin        String end pointer
+* @param[out] arg        std::string pointer for storage
+*
+* @return void
+***************************************************************************/
+static void ParseUriAttributeCallback(char *attrName, char *delimEqual, char *fin, void* arg)
+{
+	if (AttributeNameMatch(attrName, "URI"))
+	{
+		*((std::string *) arg) = GetAttributeValueString(delimEqual + 1, fin);
+	}
+}
+
+/**
+ * @brief Variant or rendition considered for prefetch
+ */
+struct PrefetchVariant
+{
+	std::string uri;    /**< Playlist uri */
+	long bandwidth;     /**< Bandwidth of variant */
+	bool audio;         /**< Audio rendition */
+	bool isDefault;     /**< Default rendition */
+};
+
+/***************************************************************************
+* @fn ParsePrefetchVariantCallback
+* @brief Callback function to extract stream inf and media tag attributes used for prefetch
+*
+* @param[in]  attrName   Input string
+* @param[in]  delimEqual Delimiter string
+* @param[in]  fin        String end pointer
+* @param[out] arg        PrefetchVariant pointer for storage
+*
+* @return void
+***************************************************************************/
+static void ParsePrefetchVariantCallback(char *attrName, char *delimEqual, char *fin, void* arg)
+{
+	PrefetchVariant *variant = (PrefetchVariant *) arg;
+	char *valuePtr = delimEqual + 1;
+	if (AttributeNameMatch(attrName, "URI"))
+	{
+		variant->uri = GetAttributeValueString(valuePtr, fin);
+	}
+	else if (AttributeNameMatch(attrName, "BANDWIDTH"))
+	{
+		variant->bandwidth = atol(valuePtr);
+	}
+	else if (AttributeNameMatch(attrName, "TYPE"))
+	{
+		variant->audio = (0 == strncmp(valuePtr, "AUDIO", 5));
+	}
+	else if (AttributeNameMatch(attrName, "DEFAULT"))
+	{
+		variant->isDefault = (0 == strncmp(valuePtr, "YES", 3));
+	}
+}
+
 /***************************************************************************
 * @fn ParseMediaAttributeCallback
 * @brief Callback function to extract media tag attributes
@@ -601,6 +738,7 @@ static void * TrackPLDownloader(void *arg)
 void StreamAbstractionAAMP_HLS::ParseMainManifest(char *ptr)
 {
 	mAbrManager.clearProfiles();
+	thumbnailTracks.clear();
 	while (ptr)
 	{
 		char *next = mystrpbrk(ptr);
@@ -626,6 +764,26 @@ void StreamAbstractionAAMP_HLS::ParseMainManifest(char *ptr)
 						streamInfo->resolution.height,
 					});
 				}
+				else if (startswith(&ptr, "-X-IMAGE-STREAM-INF:"))
+				{
+					ThumbnailTrack track;
+					track.info.bandwidth = 0;
+					track.info.width = 0;
+					track.info.height = 0;
+					track.info.tileColumns = 1;
+					track.info.tileRows = 1;
+					track.info.iframeTrack = false;
+					ParseAttrList(ptr, ParseImageStreamInfCallback, &track);
+					if (track.playlistUrl.empty() && next)
+					{ // uri on following line
+						track.playlistUrl = next;
+						next = mystrpbrk(next);
+					}
+					std::string imagePlaylistUrl;
+					aamp_ResolveURL(imagePlaylistUrl, aamp->GetManifestUrl(), track.playlistUrl.c_str());
+					track.playlistUrl = imagePlaylistUrl;
+					thumbnailTracks.push_back(track);
+				}
 				else if (startswith(&ptr, "-X-STREAM-INF:"))
 				{
 					struct HlsStreamInfo *streamInfo = &this->streamInfo[GetProfileCount()];
@@ -691,6 +849,258 @@ void StreamAbstractionAAMP_HLS::ParseMainManifest(char *ptr)
 	UpdateIframeTracks();
 } // ParseMainManifest
 
+/***************************************************************************
+* @fn UpdateThumbnailTracks
+* @brief Function to register thumbnail tracks of VOD asset
+*
+* Image tracks of main manifest are registered, or I-frame track if there are
+* none. Their playlists are indexed on first thumbnail request.
+*
+* @return void
+***************************************************************************/
+void StreamAbstractionAAMP_HLS::UpdateThumbnailTracks(void)
+{
+	std::vector<ThumbnailTrack> tracks = thumbnailTracks;
+	int iframeStreamIdx = GetIframeTrack();
+	if (tracks.empty() && ABRManager::INVALID_PROFILE != iframeStreamIdx)
+	{
+		ThumbnailTrack track;
+		std::string iframePlaylistUrl;
+		aamp_ResolveURL(iframePlaylistUrl, aamp->GetManifestUrl(), streamInfo[iframeStreamIdx].uri);
+		track.info.bandwidth = streamInfo[iframeStreamIdx].bandwidthBitsPerSecond;
+		track.info.width = streamInfo[iframeStreamIdx].resolution.width;
+		track.info.height = streamInfo[iframeStreamIdx].resolution.height;
+		track.info.tileColumns = 1;
+		track.info.tileRows = 1;
+		track.info.iframeTrack = true;
+		track.playlistUrl = iframePlaylistUrl;
+		tracks.push_back(track);
+	}
+	if (!tracks.empty())
+	{
+		aamp->SetThumbnailTracks(tracks);
+	}
+}
+
+/***************************************************************************
+* @fn GetPrefetchRequests
+* @brief Function to list downloads needed to start playback of a playlist
+*
+* For a main manifest, the variant with highest bandwidth not above requested
+* bandwidth and the default audio rendition are listed, to be expanded in turn.
+* For a media playlist, keys, init fragment and fragments covering the first
+* seconds are listed.
+*
+* @param[in] playlist NUL-terminated playlist, modified in place
+* @param[in] playlistUrl Effective url of playlist
+* @param[in] bandwidth Video bandwidth to match
+* @param[in] seconds Duration of media to list
+* @param[out] requests Downloads in playback order
+*
+* @return void
+***************************************************************************/
+void StreamAbstractionAAMP_HLS::GetPrefetchRequests(char *playlist, const char *playlistUrl, long bandwidth, double seconds, std::vector<PrefetchRequest> &requests)
+{
+	PrefetchVariant video = { "", 0, false, false };
+	PrefetchVariant audio = { "", 0, false, false };
+	bool videoFound = false;
+	double position = 0;
+	int byteRangeOffset = 0;
+	int byteRangeLength = 0;
+	char *ptr = playlist;
+	while (ptr && position < seconds)
+	{
+		char *next = mystrpbrk(ptr);
+		std::string uri;
+		std::string range;
+		if (startswith(&ptr, "#EXT"))
+		{
+			if (startswith(&ptr, "-X-STREAM-INF:"))
+			{
+				PrefetchVariant variant = { "", 0, false, false };
+				ParseAttrList(ptr, ParsePrefetchVariantCallback, &variant);
+				if (variant.uri.empty() && next)
+				{ // uri on following line
+					variant.uri = next;
+					next = mystrpbrk(next);
+				}
+				bool better = (variant.bandwidth <= bandwidth) ? (video.bandwidth > bandwidth || variant.bandwidth > video.bandwidth) : (video.bandwidth > bandwidth && variant.bandwidth < video.bandwidth);
+				if (!videoFound || better)
+				{
+					video = variant;
+					videoFound = true;
+				}
+			}
+			else if (startswith(&ptr, "-X-MEDIA:"))
+			{
+				PrefetchVariant variant = { "", 0, false, false };
+				ParseAttrList(ptr, ParsePrefetchVariantCallback, &variant);
+				if (variant.audio && !variant.uri.empty() && (audio.uri.empty() || (variant.isDefault && !audio.isDefault)))
+				{
+					audio = variant;
+				}
+			}
+			else if (startswith(&ptr, "INF:"))
+			{
+				position += atof(ptr);
+			}
+			else if (startswith(&ptr, "-X-BYTERANGE:"))
+			{
+				char *offsetDelim = strchr(ptr, '@'); // optional, continues from previous range otherwise
+				if (offsetDelim)
+				{
+					byteRangeOffset = atoi(offsetDelim + 1);
+				}
+				byteRangeLength = atoi(ptr);
+			}
+			else if (startswith(&ptr, "-X-MAP:") || startswith(&ptr, "-X-KEY:"))
+			{
+				ParseAttrList(ptr, ParseUriAttributeCallback, &uri);
+			}
+		}
+		else if (*ptr && *ptr != '#')
+		{
+			uri = ptr;
+			if (byteRangeLength)
+			{
+				char rangeStr[128];
+				sprintf(rangeStr, "%d-%d", byteRangeOffset, byteRangeOffset + byteRangeLength - 1);
+				range = rangeStr;
+				byteRangeOffset += byteRangeLength;
+				byteRangeLength = 0;
+			}
+		}
+		if (!uri.empty())
+		{
+			PrefetchRequest request;
+			std::string url;
+			aamp_ResolveURL(url, playlistUrl, uri.c_str());
+			request.url = url;
+			request.range = range;
+			request.isManifest = false;
+			request.bandwidth = bandwidth;
+			requests.push_back(request);
+		}
+		ptr = next;
+	}
+	PrefetchVariant *variants[] = { &video, &audio };
+	for (int i = 0; i < 2; i++)
+	{
+		if (!variants[i]->uri.empty())
+		{
+			PrefetchRequest request;
+			std::string url;
+			aamp_ResolveURL(url, playlistUrl, variants[i]->uri.c_str());
+			request.url = url;
+			request.isManifest = true;
+			request.bandwidth = bandwidth;
+			requests.push_back(request);
+		}
+	}
+}
+
+/***************************************************************************
+* @fn IndexThumbnailPlaylist
+* @brief Function to build thumbnail index of image or I-frame playlist
+*
+* Each segment of an image playlist is a sprite image of LAYOUT tiles, covering
+* the segment duration in row-major order. I-frame playlist segments are
+* treated as single tile images.
+*
+* @param[in] playlist NUL-terminated playlist, modified in place
+* @param[in] playlistUrl Effective url of playlist
+* @param[in,out] track Thumbnail track to which index is added
+*
+* @return void
+***************************************************************************/
+void StreamAbstractionAAMP_HLS::IndexThumbnailPlaylist(char *playlist, const char *playlistUrl, ThumbnailTrack &track)
+{
+	ThumbnailTiles tiles = { track.info.width, track.info.height, 1, 1, 0 };
+	double position = 0;
+	double segmentDuration = 0;
+	int byteRangeOffset = 0;
+	int byteRangeLength = 0;
+	bool tilesUpdated = false;
+	char *ptr = playlist;
+	while (ptr)
+	{
+		char *next = mystrpbrk(ptr);
+		if (startswith(&ptr, "#EXT"))
+		{
+			if (startswith(&ptr, "INF:"))
+			{
+				segmentDuration = atof(ptr);
+			}
+			else if (startswith(&ptr, "-X-TILES:"))
+			{
+				ParseAttrList(ptr, ParseTilesCallback, &tiles);
+				if (tiles.columns <= 0 || tiles.rows <= 0)
+				{
+					tiles.columns = 1;
+					tiles.rows = 1;
+				}
+				if (!tilesUpdated)
+				{
+					tilesUpdated = true;
+					track.info.width = tiles.width;
+					track.info.height = tiles.height;
+					track.info.tileColumns = tiles.columns;
+					track.info.tileRows = tiles.rows;
+				}
+			}
+			else if (startswith(&ptr, "-X-BYTERANGE:"))
+			{
+				char *offsetDelim = strchr(ptr, '@'); // optional, continues from previous range otherwise
+				if (offsetDelim)
+				{
+					byteRangeOffset = atoi(offsetDelim + 1);
+				}
+				byteRangeLength = atoi(ptr);
+			}
+			else if (startswith(&ptr, "-X-MAP:"))
+			{
+				std::string initUri;
+				ParseAttrList(ptr, ParseUriAttributeCallback, &initUri);
+				if (!initUri.empty())
+				{
+					std::string initUrl;
+					aamp_ResolveURL(initUrl, playlistUrl, initUri.c_str());
+					track.info.initUrl = initUrl;
+				}
+			}
+		}
+		else if (*ptr && *ptr != '#')
+		{
+			ThumbnailInfo thumbnail;
+			std::string url;
+			aamp_ResolveURL(url, playlistUrl, ptr);
+			thumbnail.url = url;
+			if (byteRangeLength)
+			{
+				char rangeStr[128];
+				sprintf(rangeStr, "%d-%d", byteRangeOffset, byteRangeOffset + byteRangeLength - 1);
+				thumbnail.range = rangeStr;
+				byteRangeOffset += byteRangeLength;
+				byteRangeLength = 0;
+			}
+			int tileCount = tiles.columns * tiles.rows;
+			thumbnail.duration = (tiles.duration > 0) ? tiles.duration : (segmentDuration / tileCount);
+			thumbnail.width = tiles.width;
+			thumbnail.height = tiles.height;
+			for (int i = 0; i < tileCount; i++)
+			{
+				thumbnail.startTime = position + (i * thumbnail.duration);
+				thumbnail.x = (i % tiles.columns) * tiles.width;
+				thumbnail.y = (i / tiles.columns) * tiles.height;
+				track.index.push_back(thumbnail);
+			}
+			position += segmentDuration;
+			segmentDuration = 0;
+		}
+		ptr = next;
+	}
+}
+
 #ifdef AAMP_REWIND_PLAYLIST_SUPPORTED
 static char *RewindPlaylist(TrackState *trackState)
 { // TODO: deprecate?
@@ -751,6 +1161,18 @@ static char *RewindPlaylist(TrackState *trackState)
 * @return String fragment URI pointer
 ***************************************************************************/
 char *TrackState::GetFragmentUriFromIndex()
+{
+	return GetFragmentUriFromIndex(fragmentURIFromIndex);
+}
+/***************************************************************************
+* @fn GetFragmentUriFromIndex
+* @brief Function to get fragment URI from index count into given storage
+*		 
+* @param uriStorage[out] storage for the uri, returned pointer is valid
+*                        while it is not modified
+* @return String fragment URI pointer
+***************************************************************************/
+char *TrackState::GetFragmentUriFromIndex(std::string &uriStorage)
 {
 	char * uri = NULL;
 	const IndexNode *index = (IndexNode *) this->index.ptr;
@@ -857,11 +1279,8 @@ char *TrackState::GetFragmentUriFromIndex()
 			{
 				urlEnd--;
 			}
-			int urlLen = urlEnd - fragmentInfo;
-			uri = fragmentURIFromIndex;
-			assert(urlLen < MAX_URI_LENGTH);
-			memcpy(uri, fragmentInfo, urlLen);
-			uri[urlLen] = 0;
+			uriStorage.assign(fragmentInfo, urlEnd - fragmentInfo);
+			uri = &uriStorage[0];
 			//logprintf("%s - parsed uri %s\n", __FUNCTION__, uri);
 		}
 		else
@@ -1255,6 +1674,449 @@ char *TrackState::FindMediaForSequenceNumber()
 	return NULL;
 }
 /***************************************************************************
+* @fn TrickPlayPrefetcher
+* @brief I-frame prefetch worker thread function
+*
+* @param arg[in] TrickPlayPrefetchWorker pointer
+* @return void
+***************************************************************************/
+static void *TrickPlayPrefetcher(void *arg)
+{
+	TrickPlayPrefetchWorker *worker = (TrickPlayPrefetchWorker *)arg;
+	if(aamp_pthread_setname(pthread_self(), "aampTrickFetch"))
+	{
+		logprintf("%s:%d: aamp_pthread_setname failed\n", __FUNCTION__, __LINE__);
+	}
+	worker->track->RunTrickPlayPrefetchLoop(worker->curlInstance);
+	return NULL;
+}
+/***************************************************************************
+* @fn StartTrickPlayPrefetch
+* @brief Start workers downloading I-frames ahead of the fetch loop
+*
+* @return bool true if at least one worker is running
+***************************************************************************/
+bool TrackState::StartTrickPlayPrefetch()
+{
+	int workerCount = std::min(gpGlobalConfig->trickplayPrefetch, AAMP_TRICKPLAY_PREFETCH_CURL_COUNT);
+	if (workerCount <= 0)
+	{
+		return false;
+	}
+	aamp->CurlInit(AAMP_TRICKPLAY_PREFETCH_CURL_START, workerCount);
+	mTrickPlayFetchTimeMS = 0;
+	mTrickPlayFPSUpdateTimeMS = mTrickPlayFrameTimeMS = NOW_STEADY_TS_MS;
+	for (int i = 0; i < workerCount; i++)
+	{
+		TrickPlayPrefetchWorker *worker = &mTrickPlayPrefetchWorker[i];
+		worker->track = this;
+		worker->curlInstance = AAMP_TRICKPLAY_PREFETCH_CURL_START + i;
+		if (0 == pthread_create(&worker->threadId, NULL, &TrickPlayPrefetcher, worker))
+		{
+			worker->started = true;
+			mTrickPlayPrefetchWorkerCount++;
+		}
+		else
+		{
+			logprintf("Failed to create TrickPlayPrefetcher thread\n");
+		}
+	}
+	if (0 == mTrickPlayPrefetchWorkerCount)
+	{
+		aamp->SyncBegin();
+		aamp->CurlTerm(AAMP_TRICKPLAY_PREFETCH_CURL_START, workerCount);
+		aamp->SyncEnd();
+		return false;
+	}
+	logprintf("%s:%d: %d I-frame prefetch workers started\n", __FUNCTION__, __LINE__, mTrickPlayPrefetchWorkerCount);
+	return true;
+}
+/***************************************************************************
+* @fn StopTrickPlayPrefetch
+* @brief Stop I-frame prefetch workers and free prefetched I-frames
+*
+* @return void
+***************************************************************************/
+void TrackState::StopTrickPlayPrefetch()
+{
+	if (mTrickPlayPrefetchWorkerCount > 0)
+	{
+		pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+		mTrickPlayPrefetchStop = true;
+		pthread_cond_broadcast(&mTrickPlayPrefetchCond);
+		pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+		for (int i = 0; i < AAMP_TRICKPLAY_PREFETCH_CURL_COUNT; i++)
+		{
+			TrickPlayPrefetchWorker *worker = &mTrickPlayPrefetchWorker[i];
+			if (worker->started)
+			{
+				int rc = pthread_join(worker->threadId, NULL);
+				if (rc != 0)
+				{
+					logprintf("***pthread_join TrickPlayPrefetcher returned %d(%s)\n", rc, strerror(rc));
+				}
+				worker->started = false;
+			}
+		}
+		aamp->SyncBegin();
+		aamp->CurlTerm(AAMP_TRICKPLAY_PREFETCH_CURL_START, AAMP_TRICKPLAY_PREFETCH_CURL_COUNT);
+		aamp->SyncEnd();
+		mTrickPlayPrefetchWorkerCount = 0;
+		mTrickPlayPrefetchStop = false;
+	}
+	while (!mTrickPlayPrefetchQueue.empty())
+	{
+		DropTrickPlayPrefetch(mTrickPlayPrefetchQueue.front());
+		mTrickPlayPrefetchQueue.pop_front();
+	}
+}
+/***************************************************************************
+* @fn RunTrickPlayPrefetchLoop
+* @brief Download queued I-frames until stopped
+*
+* @param curlInstance[in] curl instance used by this worker
+* @return void
+***************************************************************************/
+void TrackState::RunTrickPlayPrefetchLoop(unsigned int curlInstance)
+{
+	pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+	while (!mTrickPlayPrefetchStop)
+	{
+		TrickPlayPrefetch *prefetch = NULL;
+		for (std::deque<TrickPlayPrefetch *>::iterator it = mTrickPlayPrefetchQueue.begin(); it != mTrickPlayPrefetchQueue.end(); it++)
+		{
+			if (eTRICKPLAY_PREFETCH_PENDING == (*it)->state)
+			{
+				prefetch = *it;
+				break;
+			}
+		}
+		if (!prefetch)
+		{
+			pthread_cond_wait(&mTrickPlayPrefetchCond, &mTrickPlayPrefetchMutex);
+			continue;
+		}
+		prefetch->state = eTRICKPLAY_PREFETCH_DOWNLOADING;
+		pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+
+		// Downloaded as I-frame so that parallel downloads stay out of normal play ABR bandwidth samples
+		std::string tempEffectiveUrl;
+		long long downloadStartMS = NOW_STEADY_TS_MS;
+		prefetch->fetched = aamp->GetFile(prefetch->url.Resolve().c_str(), &prefetch->fragment, tempEffectiveUrl, &prefetch->http_error,
+				prefetch->range[0] ? prefetch->range : NULL, curlInstance, true, eMEDIATYPE_IFRAME);
+		prefetch->downloadTimeMS = NOW_STEADY_TS_MS - downloadStartMS;
+
+		pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+		if (prefetch->fetched)
+		{
+			UpdateTrickPlayFetchTime(prefetch->downloadTimeMS);
+		}
+		prefetch->state = eTRICKPLAY_PREFETCH_DONE;
+		if (prefetch->abandoned)
+		{
+			DropTrickPlayPrefetch(prefetch);
+		}
+		pthread_cond_broadcast(&mTrickPlayPrefetchCond);
+	}
+	pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+}
+/***************************************************************************
+* @fn DropTrickPlayPrefetch
+* @brief Free a prefetched I-frame removed from prefetch queue. One still
+*        being downloaded is left for its worker to free.
+*		 
+* @param prefetch[in] prefetched I-frame, to be called with prefetch mutex held
+* @return void
+***************************************************************************/
+void TrackState::DropTrickPlayPrefetch(TrickPlayPrefetch *prefetch)
+{
+	if (eTRICKPLAY_PREFETCH_DOWNLOADING == prefetch->state)
+	{
+		prefetch->abandoned = true;
+	}
+	else
+	{
+		aamp_Free(&prefetch->fragment.ptr);
+		delete prefetch;
+	}
+}
+/***************************************************************************
+* @fn UpdateTrickPlayFetchTime
+* @brief Account download time of an I-frame in moving average
+*		 
+* @param downloadTimeMS[in] download time, to be called with prefetch mutex held
+* @return void
+***************************************************************************/
+void TrackState::UpdateTrickPlayFetchTime(long long downloadTimeMS)
+{
+	if (mTrickPlayFetchTimeMS > 0)
+	{
+		mTrickPlayFetchTimeMS = (mTrickPlayFetchTimeMS * 3 + downloadTimeMS) / 4;
+	}
+	else
+	{
+		mTrickPlayFetchTimeMS = downloadTimeMS;
+	}
+}
+/***************************************************************************
+* @fn UpdateTrickPlayFPS
+* @brief Lower trick play frame rate when I-frames can't be downloaded in
+*        time and raise it back towards configured rate as throughput allows.
+*        Steps between displayed I-frames grow at lower frame rate, so the
+*        requested speed is kept with fewer downloads.
+*		 
+* @return void
+***************************************************************************/
+void TrackState::UpdateTrickPlayFPS()
+{
+	long long now = NOW_STEADY_TS_MS;
+	if (now - mTrickPlayFPSUpdateTimeMS < TRICKPLAY_FPS_UPDATE_INTERVAL_MS)
+	{
+		return;
+	}
+	mTrickPlayFPSUpdateTimeMS = now;
+	pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+	double fetchTimeMS = mTrickPlayFetchTimeMS;
+	pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+	if (fetchTimeMS <= 0)
+	{
+		return;
+	}
+	int maxFPS = aamp->IsTSBSupported() ? aamp->mLinearTrickplayFPS : aamp->mVODTrickplayFPS;
+	int minFPS = std::min(gpGlobalConfig->trickplayMinFPS, maxFPS);
+	// Workers download in parallel, together they deliver this many I-frames per second
+	double sustainableFPS = mTrickPlayPrefetchWorkerCount * 1000 / fetchTimeMS;
+	int fps = std::max(minFPS, std::min(maxFPS, (int)sustainableFPS));
+	if (fps != context->mTrickPlayFPS)
+	{
+		logprintf("%s:%d: I-frame download %.0fms, trickplay fps %d -> %d\n", __FUNCTION__, __LINE__, fetchTimeMS, context->mTrickPlayFPS, fps);
+		context->mTrickPlayFPS = fps;
+		if (playContext)
+		{
+			playContext->setFrameRateForTM(fps);
+		}
+		// Queued I-frames were predicted with previous step, drop those no worker started on
+		pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+		std::deque<TrickPlayPrefetch *>::iterator it = mTrickPlayPrefetchQueue.begin();
+		while (it != mTrickPlayPrefetchQueue.end())
+		{
+			if (eTRICKPLAY_PREFETCH_PENDING == (*it)->state)
+			{
+				DropTrickPlayPrefetch(*it);
+				it = mTrickPlayPrefetchQueue.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+		pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+	}
+	// Remembered across tunes, next trick play starts at lowest I-frame profile
+	if (sustainableFPS < minFPS && !aamp->mIframeThroughputLimited)
+	{
+		logprintf("%s:%d: I-frame throughput below %d fps, preferring lowest I-frame profile\n", __FUNCTION__, __LINE__, minFPS);
+		aamp->mIframeThroughputLimited = true;
+	}
+	else if (sustainableFPS >= 2 * maxFPS && aamp->mIframeThroughputLimited)
+	{
+		logprintf("%s:%d: I-frame throughput recovered, preferring desired I-frame profile\n", __FUNCTION__, __LINE__);
+		aamp->mIframeThroughputLimited = false;
+	}
+}
+/***************************************************************************
+* @fn ScheduleTrickPlayPrefetch
+* @brief Predict the I-frames following current play target and queue them
+*        for download by prefetch workers
+*		 
+* @param delta[in] play target step between displayed I-frames
+* @return void
+***************************************************************************/
+void TrackState::ScheduleTrickPlayPrefetch(double delta)
+{
+	// Look ahead two I-frames per worker so that workers stay busy while fetch loop waits for injection
+	size_t depth = mTrickPlayPrefetchWorkerCount * 2;
+	pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+	if (mTrickPlayPrefetchQueue.size() < depth)
+	{
+		// Prediction moves index cursor, save state of current fragment
+		double savedPlayTarget = playTarget;
+		int savedIdx = currentIdx;
+		int savedByteRangeOffset = byteRangeOffset;
+		int savedByteRangeLength = byteRangeLength;
+		double savedFragmentDuration = fragmentDurationSeconds;
+		bool savedFragmentEncrypted = fragmentEncrypted;
+		int savedDrmMetaDataIndexPosition = mDrmMetaDataIndexPosition;
+		// predicted uris go to local storage, fragmentURI keeps pointing to fragmentURIFromIndex
+		std::string predictedURI;
+
+		double target = playTarget;
+		int lastIdx = currentIdx;
+		if (!mTrickPlayPrefetchQueue.empty())
+		{
+			TrickPlayPrefetch *last = mTrickPlayPrefetchQueue.back();
+			target = last->target + delta;
+			lastIdx = currentIdx = last->idx;
+		}
+		while (mTrickPlayPrefetchQueue.size() < depth)
+		{
+			if (target < 0)
+			{ // rewind stops at beginning
+				target = 0;
+			}
+			playTarget = target;
+			if (!GetFragmentUriFromIndex(predictedURI))
+			{
+				break;
+			}
+			if (currentIdx != lastIdx)
+			{
+				TrickPlayPrefetch *prefetch = new TrickPlayPrefetch();
+				prefetch->target = target;
+				prefetch->idx = currentIdx;
+				prefetch->url = AampUrl(GetBaseUrl(), predictedURI.c_str());
+				if (byteRangeLength)
+				{
+					sprintf(prefetch->range, "%d-%d", byteRangeOffset, byteRangeOffset + byteRangeLength - 1);
+				}
+				prefetch->state = eTRICKPLAY_PREFETCH_PENDING;
+				mTrickPlayPrefetchQueue.push_back(prefetch);
+				pthread_cond_broadcast(&mTrickPlayPrefetchCond);
+				lastIdx = currentIdx;
+			}
+			if (context->rate < 0 && target <= 0)
+			{
+				break;
+			}
+			target += delta;
+		}
+
+		playTarget = savedPlayTarget;
+		currentIdx = savedIdx;
+		byteRangeOffset = savedByteRangeOffset;
+		byteRangeLength = savedByteRangeLength;
+		fragmentDurationSeconds = savedFragmentDuration;
+		fragmentEncrypted = savedFragmentEncrypted;
+		mDrmMetaDataIndexPosition = savedDrmMetaDataIndexPosition;
+	}
+	pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+}
+/***************************************************************************
+* @fn WaitForTrickPlayPrefetch
+* @brief Wait while current I-frame is being downloaded by a prefetch worker.
+*        Once its display time has passed and a later I-frame is ready, the
+*        late one is dropped and fetch loop skips to the ready one instead
+*        of stalling trick play.
+*		 
+* @param delta[in] play target step between displayed I-frames
+* @return void
+***************************************************************************/
+void TrackState::WaitForTrickPlayPrefetch(double delta)
+{
+	pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+	while (aamp->DownloadsAreEnabled())
+	{
+		// Drop I-frames play has already passed
+		while (!mTrickPlayPrefetchQueue.empty())
+		{
+			TrickPlayPrefetch *head = mTrickPlayPrefetchQueue.front();
+			if ((context->rate > 0) ? (head->idx >= currentIdx) : (head->idx <= currentIdx))
+			{
+				break;
+			}
+			DropTrickPlayPrefetch(head);
+			mTrickPlayPrefetchQueue.pop_front();
+		}
+		if (mTrickPlayPrefetchQueue.empty())
+		{
+			break;
+		}
+		TrickPlayPrefetch *prefetch = mTrickPlayPrefetchQueue.front();
+		if ((prefetch->idx != currentIdx) || (eTRICKPLAY_PREFETCH_DOWNLOADING != prefetch->state))
+		{
+			break;
+		}
+		long long frameIntervalMS = 1000 / context->mTrickPlayFPS;
+		long long waitMS = mTrickPlayFrameTimeMS + frameIntervalMS - NOW_STEADY_TS_MS;
+		if (waitMS <= 0)
+		{
+			TrickPlayPrefetch *ready = NULL;
+			for (std::deque<TrickPlayPrefetch *>::iterator it = mTrickPlayPrefetchQueue.begin() + 1; it != mTrickPlayPrefetchQueue.end(); it++)
+			{
+				if ((eTRICKPLAY_PREFETCH_DONE == (*it)->state) && (*it)->fetched)
+				{
+					ready = *it;
+					break;
+				}
+			}
+			if (ready)
+			{
+				AAMPLOG_INFO("%s:%d: dropping late I-frame %d, skipping to %d\n", __FUNCTION__, __LINE__, prefetch->idx, ready->idx);
+				while (mTrickPlayPrefetchQueue.front() != ready)
+				{
+					DropTrickPlayPrefetch(mTrickPlayPrefetchQueue.front());
+					mTrickPlayPrefetchQueue.pop_front();
+				}
+				playTarget = ready->target;
+				fragmentURI = GetFragmentUriFromIndex();
+				if ((context->rate < 0) && (ready->target <= 0))
+				{
+					logprintf("aamp rew to beginning\n");
+					eosReached = true;
+				}
+				else
+				{
+					playTarget = std::max(ready->target + delta, 0.0);
+				}
+				break;
+			}
+			// Nothing later is ready either, keep waiting for current one
+			waitMS = frameIntervalMS;
+		}
+		struct timespec tspec;
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		tspec.tv_sec = time(NULL) + waitMS / 1000;
+		tspec.tv_nsec = (long)(tv.tv_usec * 1000 + 1000 * 1000 * (waitMS % 1000));
+		tspec.tv_sec += tspec.tv_nsec / (1000 * 1000 * 1000);
+		tspec.tv_nsec %= (1000 * 1000 * 1000);
+		pthread_cond_timedwait(&mTrickPlayPrefetchCond, &mTrickPlayPrefetchMutex, &tspec);
+	}
+	pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+}
+/***************************************************************************
+* @fn TakeTrickPlayPrefetch
+* @brief Take I-frame of current fragment out of prefetch queue
+*		 
+* @param url[in]   url of current fragment
+* @param range[in] byte range of current fragment, NULL if whole fragment
+* @return TrickPlayPrefetch* downloaded I-frame, NULL if fetch loop has to download it
+***************************************************************************/
+TrickPlayPrefetch *TrackState::TakeTrickPlayPrefetch(const AampUrl &url, const char *range)
+{
+	TrickPlayPrefetch *ret = NULL;
+	pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+	if (!mTrickPlayPrefetchQueue.empty())
+	{
+		TrickPlayPrefetch *prefetch = mTrickPlayPrefetchQueue.front();
+		if ((prefetch->idx == currentIdx) && (prefetch->url == url) && (0 == strcmp(prefetch->range, range ? range : "")))
+		{
+			mTrickPlayPrefetchQueue.pop_front();
+			if (eTRICKPLAY_PREFETCH_DONE == prefetch->state)
+			{
+				ret = prefetch;
+			}
+			else
+			{
+				// Not started or interrupted, fetch loop downloads it itself
+				DropTrickPlayPrefetch(prefetch);
+			}
+		}
+	}
+	pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+	return ret;
+}
+/***************************************************************************
 * @fn FetchFragmentHelper
 * @brief Helper function to download fragment 
 *		 
@@ -1272,6 +2134,11 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 		assert (fragmentURI);
 		if (context->trickplayMode && ABRManager::INVALID_PROFILE != context->GetIframeTrack())
 		{
+			bool prefetch = (eTRACK_VIDEO == type) && ((mTrickPlayPrefetchWorkerCount > 0) || StartTrickPlayPrefetch());
+			if (prefetch)
+			{
+				UpdateTrickPlayFPS();
+			}
 			fragmentURI = GetFragmentUriFromIndex();
 			double delta = context->rate / context->mTrickPlayFPS;
 			if (context->rate < 0)
@@ -1300,6 +2167,25 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 				playTarget += delta;
 			}
 			//logprintf("Updated playTarget to %f\n", playTarget);
+			if (prefetch && fragmentURI && !eosReached)
+			{
+				WaitForTrickPlayPrefetch(delta);
+				ScheduleTrickPlayPrefetch(delta);
+			}
+		}
+		else if (context->mReverseGOP)
+		{// rewind without I-frame track, one segment back at a time
+			fragmentURI = GetFragmentUriFromIndex();
+			if (!fragmentURI)
+			{
+				logprintf("aamp rew to beginning\n");
+				eosReached = true;
+			}
+			else
+			{
+				// Start of returned segment, next call returns the segment before it
+				playTarget = ((IndexNode *)index.ptr)[currentIdx].completionTimeSecondsFromStart - fragmentDurationSeconds;
+			}
 		}
 		else
 		{// normal speed
@@ -1328,14 +2214,15 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 
 		if (fragmentURI)
 		{
-			char fragmentUrl[MAX_URI_LENGTH];
+			AampUrl url(GetBaseUrl(), fragmentURI);
+			std::string fragmentUrl = url.Resolve();
 			CachedFragment* cachedFragment = GetFetchBuffer(true);
-			aamp_ResolveURL(fragmentUrl, effectiveUrl, fragmentURI);
-			traceprintf("Got next fragment url %s fragmentEncrypted %d discontinuity %d\n", fragmentUrl, fragmentEncrypted, (int)discontinuity);
+			traceprintf("Got next fragment url %s fragmentEncrypted %d discontinuity %d\n", fragmentUrl.c_str(), fragmentEncrypted, (int)discontinuity);
 
 			aamp->profiler.ProfileBegin(mediaTrackBucketTypes[type]);
 			const char *range;
 			char rangeStr[128];
+			bool probeKeyFrame = false;
 			if (byteRangeLength)
 			{
 				int next = byteRangeOffset + byteRangeLength;
@@ -1347,16 +2234,72 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 			else
 			{
 				range = NULL;
+				size_t iframeOffset, iframeLength;
+				if (context->trickplayMode && (eTRACK_VIDEO == type) && gpGlobalConfig->iframeIndexFromSegments
+					&& (ABRManager::INVALID_PROFILE == context->GetIframeTrack())
+					&& (!context->mReverseGOP || (fabs(context->rate) > gpGlobalConfig->reverseGOPMaxRate)))
+				{
+					if (aamp->RetrieveFromIframeIndex(url, iframeOffset, iframeLength))
+					{
+						// No I-frame track; fetch only key frame of segment indexed during normal play
+						sprintf(rangeStr, "%d-%d", (int)iframeOffset, (int)(iframeOffset + iframeLength - 1));
+						traceprintf("FetchFragmentHelper I-frame index rangeStr %s\n", rangeStr);
+						range = rangeStr;
+					}
+					else if (!fragmentEncrypted)
+					{
+						// Segment not played yet; key frame is normally at its start, fetch just the head
+						sprintf(rangeStr, "0-%d", IFRAME_INDEX_PROBE_SIZE - 1);
+						range = rangeStr;
+						probeKeyFrame = true;
+					}
+				}
 			}
 #ifdef TRACE
-			logprintf("FetchFragmentHelper: fetching %s\n", fragmentUrl);
+			logprintf("FetchFragmentHelper: fetching %s\n", fragmentUrl.c_str());
 #endif
 			// patch for http://bitdash-a.akamaihd.net/content/sintel/hls/playlist.m3u8
 			// if fragment URI uses relative path, we don't want to replace effective URI
-			char tempEffectiveUrl[MAX_URI_LENGTH];
+			std::string tempEffectiveUrl;
 			traceprintf("%s:%d Calling Getfile . buffer %p avail %d\n", __FUNCTION__, __LINE__, &cachedFragment->fragment, (int)cachedFragment->fragment.avail);
 
-			bool fetched = aamp->GetFile(fragmentUrl, &cachedFragment->fragment, tempEffectiveUrl, &http_error, range, type, false, (MediaType)(type));
+			bool fetched;
+			TrickPlayPrefetch *prefetch = NULL;
+			if (context->mReverseGOP && (eTRACK_VIDEO == type) && aamp->RetrieveFromGOPCache(fragmentUrl.c_str(), &cachedFragment->fragment))
+			{
+				// Key frames of segment kept from normal play, rewind needs nothing else
+				traceprintf("FetchFragmentHelper GOP cache hit %s\n", fragmentUrl.c_str());
+				tempEffectiveUrl.clear();
+				fetched = true;
+				probeKeyFrame = false;
+			}
+			else if ((mTrickPlayPrefetchWorkerCount > 0) && (prefetch = TakeTrickPlayPrefetch(url, range)))
+			{
+				// I-frame downloaded ahead by prefetch worker
+				traceprintf("FetchFragmentHelper prefetched %s in %lldms\n", fragmentUrl.c_str(), prefetch->downloadTimeMS);
+				cachedFragment->fragment = prefetch->fragment;
+				memset(&prefetch->fragment, 0x00, sizeof(GrowableBuffer));
+				http_error = prefetch->http_error;
+				fetched = prefetch->fetched;
+				tempEffectiveUrl.clear();
+				delete prefetch;
+				mTrickPlayFrameTimeMS = NOW_STEADY_TS_MS;
+			}
+			else
+			{
+				long long downloadStartMS = NOW_STEADY_TS_MS;
+				fetched = aamp->GetFile(fragmentUrl.c_str(), &cachedFragment->fragment, tempEffectiveUrl, &http_error, range, type, false, (MediaType)(type));
+				if (mTrickPlayPrefetchWorkerCount > 0)
+				{
+					mTrickPlayFrameTimeMS = NOW_STEADY_TS_MS;
+					if (fetched)
+					{
+						pthread_mutex_lock(&mTrickPlayPrefetchMutex);
+						UpdateTrickPlayFetchTime(mTrickPlayFrameTimeMS - downloadStartMS);
+						pthread_mutex_unlock(&mTrickPlayPrefetchMutex);
+					}
+				}
+			}
 			if (!fetched)
 			{
 				//cleanup is done in aamp_GetFile itself
@@ -1379,8 +2322,8 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 
 			if((eTRACK_VIDEO == type)  && (aamp->IsTSBSupported()))
                         {
-                                char *bwStr;
-                                bwStr           =       strstr(tempEffectiveUrl,FOG_FRAG_BW_IDENTIFIER);
+                                const char *bwStr;
+                                bwStr           =       strstr(tempEffectiveUrl.c_str(),FOG_FRAG_BW_IDENTIFIER);
                                 if(bwStr)
                                 {
                                         bwStr           +=      FOG_FRAG_BW_IDENTIFIER_LEN;
@@ -1392,6 +2335,11 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
                                 }
                         }
 
+			if (probeKeyFrame)
+			{
+				ProbeKeyFrame(url, &cachedFragment->fragment);
+			}
+
 			aamp->profiler.ProfileEnd(mediaTrackBucketTypes[type]);
 			segDLFailCount = 0;
 
@@ -1437,7 +2385,7 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 					segDrmDecryptFailCount = 0; /* Resetting the retry count in the case of decryption success */
 				}
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
-				context->HarvestFile(fragmentUrl, &cachedFragment->fragment, true);
+				context->HarvestFile(fragmentUrl.c_str(), &cachedFragment->fragment, true);
 #endif
 				if (!context->firstFragmentDecrypted)
 				{
@@ -1452,9 +2400,31 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 			else
 			{
-				context->HarvestFile(fragmentUrl, &cachedFragment->fragment, true);
+				context->HarvestFile(fragmentUrl.c_str(), &cachedFragment->fragment, true);
 			}
 #endif
+			// Key frames of segments are needed only when trick play has no I-frame track
+			bool noIframeTrack = (ABRManager::INVALID_PROFILE == context->GetIframeTrack());
+			bool indexIframes = gpGlobalConfig->iframeIndexFromSegments && noIframeTrack;
+			bool cacheGOPs = (gpGlobalConfig->reverseGOPCacheSize > 0) && noIframeTrack;
+			if ((indexIframes || cacheGOPs) && (eTRACK_VIDEO == type) && !context->trickplayMode
+				&& !fragmentEncrypted && !byteRangeLength && cachedFragment->fragment.len)
+			{
+				// Record key frame range so that trick play without I-frame track can fetch just that range,
+				// and keep all key frames of recent segments so that rewind can start without fetching them again
+				std::vector<std::pair<size_t, size_t>> iframeRanges;
+				if (TSProcessor::getIframeRanges((const unsigned char *)cachedFragment->fragment.ptr, cachedFragment->fragment.len, iframeRanges, cacheGOPs ? 0 : 1))
+				{
+					if (indexIframes)
+					{
+						aamp->InsertToIframeIndex(url, iframeRanges[0].first, iframeRanges[0].second);
+					}
+					if (cacheGOPs)
+					{
+						aamp->InsertToGOPCache(fragmentUrl.c_str(), cachedFragment->fragment.ptr, iframeRanges);
+					}
+				}
+			}
 		}
 		else
 		{
@@ -1468,6 +2438,48 @@ bool TrackState::FetchFragmentHelper(long &http_error, bool &decryption_error)
 		}
 		return true;
 }
+/***************************************************************************
+* @fn ProbeKeyFrame
+* @brief Reduce head of a TS segment fetched in trick play to its key frame
+*
+* Segment was not played at normal rate, so it is not in I-frame index. If key
+* frame does not end within the head, rest of the segment is fetched. Located
+* range is added to I-frame index for next pass over the segment.
+*
+* @param url[in] URL of the segment
+* @param fragment[in,out] Head of the segment, replaced with key frame range
+* @return void
+***************************************************************************/
+void TrackState::ProbeKeyFrame(const AampUrl &url, GrowableBuffer *fragment)
+{
+	size_t iframeOffset, iframeLength;
+	bool found = TSProcessor::getIframeRange((const unsigned char *)fragment->ptr, fragment->len, iframeOffset, iframeLength);
+	if ((!found || (iframeOffset + iframeLength == fragment->len)) && (fragment->len == IFRAME_INDEX_PROBE_SIZE))
+	{
+		// key frame not complete within head, or not in it
+		GrowableBuffer rest;
+		std::string tempEffectiveUrl;
+		long http_error = 0;
+		char rangeStr[32];
+		memset(&rest, 0x00, sizeof(rest));
+		sprintf(rangeStr, "%d-", IFRAME_INDEX_PROBE_SIZE);
+		if (aamp->GetFile(url.Resolve().c_str(), &rest, tempEffectiveUrl, &http_error, rangeStr, type, false, (MediaType)(type)))
+		{
+			aamp_AppendBytes(fragment, rest.ptr, rest.len);
+		}
+		aamp_Free(&rest.ptr);
+		found = TSProcessor::getIframeRange((const unsigned char *)fragment->ptr, fragment->len, iframeOffset, iframeLength);
+	}
+	if (found)
+	{
+		traceprintf("%s:%d %s key frame offset %d length %d\n", __FUNCTION__, __LINE__, url.Resolve().c_str(), (int)iframeOffset, (int)iframeLength);
+		aamp->InsertToIframeIndex(url, iframeOffset, iframeLength);
+		memmove(fragment->ptr, fragment->ptr + iframeOffset, iframeLength);
+		fragment->len = iframeLength;
+	}
+}
+
+
 /***************************************************************************
 * @fn FetchFragment
 * @brief Function to fetch fragment  
@@ -1507,6 +2519,10 @@ void TrackState::FetchFragment()
 				{
 					playTarget -= fragmentDurationSeconds;
 				}
+				else if (context->mReverseGOP)
+				{
+					playTarget += fragmentDurationSeconds;
+				}
 				else
 				{
 					playTarget -= context->rate / context->mTrickPlayFPS;
@@ -1543,11 +2559,17 @@ void TrackState::FetchFragment()
 		{
 			position -= fragmentDurationSeconds;
 			cachedFragment->discontinuity = discontinuity;
+			// transport stream passed through is restamped by demuxer on PCR discontinuity
+			cachedFragment->continuousTimeline = (discontinuity && (FORMAT_MPEGTS == streamOutputFormat) && !playContext);
 		}
 		else
 		{
-			position -= context->rate / context->mTrickPlayFPS;
+			if (!context->mReverseGOP)
+			{
+				position -= context->rate / context->mTrickPlayFPS;
+			}
 			cachedFragment->discontinuity = true;
+			cachedFragment->continuousTimeline = false;
 			traceprintf("%s:%d: rate %f position %f\n",__FUNCTION__, __LINE__, context->rate, position);
 		}
 
@@ -1557,6 +2579,7 @@ void TrackState::FetchFragment()
 		}
 		cachedFragment->duration = duration;
 		cachedFragment->position = position;
+		cachedFragment->discontinuityPts = 0;
 	}
 	else
 	{
@@ -1565,7 +2588,7 @@ void TrackState::FetchFragment()
 #ifdef AAMP_DEBUG_INJECT
 	if ((1 << type) & AAMP_DEBUG_INJECT)
 	{
-		strcpy(cachedFragment->uri, fragmentURI);
+		cachedFragment->uri = fragmentURI;
 	}
 #endif
 	UpdateTSAfterFetch();
@@ -1603,6 +2626,19 @@ void TrackState::InjectFragmentInternal(CachedFragment* cachedFragment, bool &fr
 #endif
 } // InjectFragmentInternal
 /***************************************************************************
+* @fn FlushFragments
+* @brief Wait till demuxed data queued by playContext is injected
+*
+* @return void
+***************************************************************************/
+void TrackState::FlushFragments()
+{
+	if (playContext)
+	{
+		playContext->drain();
+	}
+} // FlushFragments
+/***************************************************************************
 * @fn GetCompletionTimeForFragment
 * @brief Function to get end time of fragment
 *		 
@@ -1656,6 +2692,23 @@ static void DumpIndex(TrackState *trackState)
 }
 #endif
 /***************************************************************************
+* @fn GetBaseUrl
+* @brief Get shared base of fragment urls
+*
+* Shared copy is replaced only when effectiveUrl changes, so fragment urls
+* built from one playlist download refer to the same base.
+*
+* @return shared copy of effectiveUrl
+***************************************************************************/
+const std::shared_ptr<const std::string> &TrackState::GetBaseUrl()
+{
+	if (!mBaseUrl || (*mBaseUrl != effectiveUrl))
+	{
+		mBaseUrl = std::make_shared<const std::string>(effectiveUrl);
+	}
+	return mBaseUrl;
+}
+/***************************************************************************
 * @fn FlushIndex
 * @brief Function to flush all stored data before refresh and stop
 *		 
@@ -1826,7 +2879,7 @@ void TrackState::IndexPlaylist()
 		    char temp[MANIFEST_TEMP_DATA_LENGTH];
 		    strncpy(temp, playlist.ptr, tempDataLen);
 		    temp[tempDataLen] = 0x00;
-		    logprintf("ERROR: Invalid Playlist URL:%s \n", playlistUrl);
+		    logprintf("ERROR: Invalid Playlist URL:%s \n", playlistUrl.c_str());
 		    logprintf("ERROR: Invalid Playlist DATA:%s \n", temp);
 		    aamp->SendErrorEvent(AAMP_TUNE_INVALID_MANIFEST_FAILURE);
 		    mDuration = totalDuration;
@@ -2194,7 +3247,7 @@ void TrackState::IndexPlaylist()
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 /***************************************************************************
 * @fn HarvestFile
-* @brief Function to harvest stream contents locally for debugging 
+* @brief Function to harvest stream contents locally for debugging, written by aamp harvest writer
 *		 
 * @param[in] url         url string	
 * @param[in] buffer      Data content
@@ -2228,17 +3281,7 @@ void StreamAbstractionAAMP_HLS::HarvestFile(const char * url, GrowableBuffer* bu
 			strcat(path, prefix);
 		}
 		strcat(path, src);
-		FILE *f = fopen(path, "wb");
-		if (f)
-		{
-			fwrite(buffer->ptr, 1, buffer->len, f);
-			fclose(f);
-			logprintf("aamp: hls -harvest written %s buffer.len %d\n", path, (int)buffer->len);
-		}
-		else
-		{
-			logprintf("aamp: hls -harvest fopen failed %s len %d\n", path, (int)buffer->len);
-		}
+		aamp->HarvestFile(path, url, buffer->ptr, buffer->len, isFragment);
 	}
 }
 #endif
@@ -2300,9 +3343,24 @@ void TrackState::RefreshPlaylist(void)
 		memset(&tempBuff, 0, sizeof(tempBuff));
 	}
 
-	aamp->GetFile(playlistUrl, &playlist, effectiveUrl, &http_error, NULL, type, true, eMEDIATYPE_MANIFEST);
+	// refresh of indexed live playlist, other than on ABR switch, can keep current index when unchanged
+	bool conditional = gpGlobalConfig->conditionalPlaylistRefresh && (ePLAYLISTTYPE_VOD != context->playlistType)
+			&& tempBuff.ptr && (mDuration > 0.0f) && !refreshPlaylist;
+	aamp->GetFile(playlistUrl.c_str(), &playlist, effectiveUrl, &http_error, NULL, type, true, eMEDIATYPE_MANIFEST,
+			conditional ? &playlistValidators : NULL);
 
-	if (playlist.len)
+	if (conditional && playlistValidators.notModified)
+	{ // keep indexed playlist, as fragment pointers refer to it
+		traceprintf("%s:%d [%s] playlist not modified\n", __FUNCTION__, __LINE__, name);
+		aamp_Free(&playlist.ptr);
+		playlist = tempBuff;
+		if (context->mNetworkDownDetected)
+		{
+			context->mNetworkDownDetected = false;
+		}
+		manifestDLFailCount = 0;
+	}
+	else if (playlist.len)
 	{ // download successful
 		//lastPlaylistDownloadTimeMS = aamp_GetCurrentTimeMS();
 		if (context->mNetworkDownDetected)
@@ -2320,7 +3378,7 @@ void TrackState::RefreshPlaylist(void)
 		{
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 		    const char* prefix = (type == eTRACK_AUDIO)?"aud-":(context->trickplayMode)?"ifr-":"vid-";
-		    context->HarvestFile(playlistUrl, &playlist, false, prefix);
+		    context->HarvestFile(playlistUrl.c_str(), &playlist, false, prefix);
 #endif
 		    if (ePLAYLISTTYPE_VOD != context->playlistType)
 		    {
@@ -2853,7 +3911,7 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 		{
 			long persistedBandwidth = aamp->GetPersistedBandwidth();
 			//We were tuning to a lesser profile previously, so we use it as starting profile
-			if (persistedBandwidth > 0 && persistedBandwidth < gpGlobalConfig->defaultBitrate)
+			if (persistedBandwidth > 0 && persistedBandwidth < aamp->mInitialBitrate)
 			{
 				mAbrManager.setDefaultInitBitrate(persistedBandwidth);
 			}
@@ -2989,22 +4047,28 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 			trickplayMode = true;
 			if(aamp->IsTSBSupported())
 			{
-				mTrickPlayFPS = gpGlobalConfig->linearTrickplayFPS;
+				mTrickPlayFPS = aamp->mLinearTrickplayFPS;
 			}
 			else
 			{
-				mTrickPlayFPS = gpGlobalConfig->vodTrickplayFPS;
+				mTrickPlayFPS = aamp->mVODTrickplayFPS;
 			}
 		}
 		else
 		{
 			trickplayMode = false;
 		}
+		// Without I-frame track, rewind steps back through regular segments and shows their key frames last to first
+		mReverseGOP = trickplayMode && (rate < 0) && (ABRManager::INVALID_PROFILE == GetIframeTrack());
+		if (mReverseGOP)
+		{
+			logprintf("StreamAbstractionAAMP_HLS::%s:%d : rewind by GOP, no I-frame track. rate %f\n", __FUNCTION__, __LINE__, rate);
+		}
 
 		for (int iTrack = AAMP_TRACK_COUNT - 1; iTrack >= 0; iTrack--)
 		{
 			TrackState *ts = trackState[iTrack];
-			aamp->SetCurlTimeout(gpGlobalConfig->fragmentDLTimeout, iTrack);
+			aamp->SetCurlTimeout(aamp->mNetworkTimeout, iTrack);
 
 			if(ts->enabled)
 			{
@@ -3016,7 +4080,7 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 				}
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 				const char* prefix = (iTrack == eTRACK_AUDIO)?"aud-":(trickplayMode)?"ifr-":"vid-";
-				HarvestFile(ts->playlistUrl, &ts->playlist, false, prefix);
+				HarvestFile(ts->playlistUrl.c_str(), &ts->playlist, false, prefix);
 #endif
 				ts->IndexPlaylist();
 				if (ts->mDuration == 0.0f)
@@ -3052,6 +4116,10 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 						}
 					}
 					aamp->SendMediaMetadataEvent((ts->mDuration * 1000.0), langList, bitrateList, hasDrm, isIframeTrackPresent);
+					if (ePLAYLISTTYPE_VOD == playlistType && !aamp->HasThumbnailTracks())
+					{
+						UpdateThumbnailTracks();
+					}
 
 					// Delay "preparing" state until all tracks have been processed.
 					// JS Player assumes all onTimedMetadata event fire before "preparing" state.
@@ -3092,6 +4160,10 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 							{
 								logprintf("Configure audio TS track demuxing\n");
 								ts->playContext = new TSProcessor(aamp,eStreamOp_DEMUX_AUDIO);
+								if (gpGlobalConfig->remuxHLSTsToMp4 && ts->playContext->enableRemux(eMEDIATYPE_AUDIO, ts->streamOutputFormat))
+								{
+									ts->streamOutputFormat = FORMAT_ISO_BMFF;
+								}
 							}
 							else if (gpGlobalConfig->gAampMergeAudioTrack)
 							{
@@ -3192,10 +4264,22 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 						if (this->rate == AAMP_NORMAL_PLAY_RATE)
 						{
 							ts->playContext->setRate(this->rate, PlayMode_normal);
+							if (gpGlobalConfig->remuxHLSTsToMp4)
+							{
+								/*Demuxed H.264/AAC is injected as fragmented MP4, other formats stay as elementary stream*/
+								if (ts->playContext->enableRemux(eMEDIATYPE_VIDEO, ts->streamOutputFormat))
+								{
+									ts->streamOutputFormat = FORMAT_ISO_BMFF;
+								}
+								if (ts->playContext->enableRemux(eMEDIATYPE_AUDIO, trackState[eMEDIATYPE_AUDIO]->streamOutputFormat))
+								{
+									trackState[eMEDIATYPE_AUDIO]->streamOutputFormat = FORMAT_ISO_BMFF;
+								}
+							}
 						}
 						else
 						{
-							ts->playContext->setRate(this->rate, PlayMode_retimestamp_Ionly);
+							ts->playContext->setRate(this->rate, mReverseGOP ? PlayMode_reverse_GOP : PlayMode_retimestamp_Ionly);
 							ts->playContext->setFrameRateForTM(mTrickPlayFPS);
 						}
 						playContextConfigured = true;
@@ -3236,19 +4320,29 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 						this->trickplayMode = true;
 						if(aamp->IsTSBSupported())
 						{
-							mTrickPlayFPS = gpGlobalConfig->linearTrickplayFPS;
+							mTrickPlayFPS = aamp->mLinearTrickplayFPS;
 						}
 						else
 						{
-							mTrickPlayFPS = gpGlobalConfig->vodTrickplayFPS;
+							mTrickPlayFPS = aamp->mVODTrickplayFPS;
 						}
-						ts->playContext->setRate(this->rate, PlayMode_retimestamp_Ionly);
+						ts->playContext->setRate(this->rate, (mReverseGOP && (eTRACK_VIDEO == iTrack)) ? PlayMode_reverse_GOP : PlayMode_retimestamp_Ionly);
 						ts->playContext->setFrameRateForTM(mTrickPlayFPS);
 					}
 				}
 			}
 		}
 
+		// keep injected TS fragments so that a seek close to play position needs no re-tune
+		if (gpGlobalConfig->seekInBuffer && (AAMP_NORMAL_PLAY_RATE == rate) && !aamp->IsLive())
+		{
+			for (int iTrack = 0; iTrack < AAMP_TRACK_COUNT; iTrack++)
+			{
+				TrackState *ts = trackState[iTrack];
+				ts->retainInjectedFragments = (ts->enabled && (FORMAT_ISO_BMFF != ts->streamOutputFormat));
+			}
+		}
+
 		if ((video->enabled && video->mDuration == 0.0f) || (audio->enabled && audio->mDuration == 0.0f))
 		{
 			logprintf("StreamAbstractionAAMP_HLS::%s:%d Track Duration is 0. Cannot play this content\n", __FUNCTION__, __LINE__);
@@ -3493,12 +4587,12 @@ AAMPStatusType StreamAbstractionAAMP_HLS::Init(TuneType tuneType)
 			int iframeStreamIdx = GetIframeTrack();
 			if (0 <= iframeStreamIdx)
 			{
-				char defaultIframePlaylistUrl[MAX_URI_LENGTH];
-				char defaultIframePlaylistEffectiveUrl[MAX_URI_LENGTH];
+				std::string defaultIframePlaylistUrl;
+				std::string defaultIframePlaylistEffectiveUrl;
 				GrowableBuffer defaultIframePlaylist;
 				aamp_ResolveURL(defaultIframePlaylistUrl, aamp->GetManifestUrl(), streamInfo[iframeStreamIdx].uri);
 				traceprintf("StreamAbstractionAAMP_HLS::%s:%d : Downloading iframe playlist\n", __FUNCTION__, __LINE__);
-				aamp->GetFile(defaultIframePlaylistUrl, &defaultIframePlaylist, defaultIframePlaylistEffectiveUrl, &http_error);
+				aamp->GetFile(defaultIframePlaylistUrl.c_str(), &defaultIframePlaylist, defaultIframePlaylistEffectiveUrl, &http_error);
 				if (defaultIframePlaylist.len)
 				{
 					aamp->InsertToPlaylistCache(defaultIframePlaylistUrl, &defaultIframePlaylist, defaultIframePlaylistEffectiveUrl);
@@ -3774,6 +4868,7 @@ StreamAbstractionAAMP_HLS::StreamAbstractionAAMP_HLS(class PrivateInstanceAAMP *
 		this->trickplayMode = true;
 	}
 	this->enableThrottle = enableThrottle;
+	mReverseGOP = false;
 	firstFragmentDecrypted = false;
 
 	playlistType = ePLAYLISTTYPE_UNDEFINED;
@@ -3814,16 +4909,17 @@ TrackState::TrackState(TrackType type, StreamAbstractionAAMP_HLS* parent, Privat
 		mCMSha1Hash(NULL), mDrmTimeStamp(0), mDrmMetaDataIndexCount(0),firstIndexDone(false), mDrm(NULL), mDrmLicenseRequestPending(false),
 		mInjectInitFragment(true), mInitFragmentInfo(NULL), mDrmKeyTagCount(0), mIndexingInProgress(false), mForceProcessDrmMetadata(false),
 		mDuration(0), mLastMatchedDiscontPosition(-1), mCulledSeconds(0),
-		mDiscontinuityIndexCount(0), mSyncAfterDiscontinuityInProgress(false)
+		mDiscontinuityIndexCount(0), mSyncAfterDiscontinuityInProgress(false),
+		mTrickPlayPrefetchWorkerCount(0), mTrickPlayPrefetchQueue(), mTrickPlayPrefetchStop(false),
+		mTrickPlayFetchTimeMS(0), mTrickPlayFPSUpdateTimeMS(0), mTrickPlayFrameTimeMS(0), mBaseUrl()
 {
 	this->context = parent;
 	targetDurationSeconds = 1; // avoid tight loop
 
-	effectiveUrl[0] = 0,
-	playlistUrl[0] = 0;
 	memset(&playlist, 0, sizeof(playlist));
+	playlistValidators.bodyHash = 0;
+	playlistValidators.notModified = false;
 	memset(&index, 0, sizeof(index));
-	fragmentURIFromIndex[0] = 0;
 	memset(&startTimeForPlaylistSync, 0, sizeof(struct timeval));
 	fragmentEncrypted = false;
 	memset(&mDrmMetaDataIndex, 0, sizeof(mDrmMetaDataIndex));
@@ -3832,6 +4928,9 @@ TrackState::TrackState(TrackType type, StreamAbstractionAAMP_HLS* parent, Privat
 	memset(&mDiscontinuityIndex, 0, sizeof(mDiscontinuityIndex));
 	pthread_cond_init(&mPlaylistIndexed, NULL);
 	pthread_mutex_init(&mPlaylistMutex, NULL);
+	memset(&mTrickPlayPrefetchWorker, 0, sizeof(mTrickPlayPrefetchWorker));
+	pthread_cond_init(&mTrickPlayPrefetchCond, NULL);
+	pthread_mutex_init(&mTrickPlayPrefetchMutex, NULL);
 }
 /***************************************************************************
 * @fn ~TrackState
@@ -3842,7 +4941,7 @@ TrackState::TrackState(TrackType type, StreamAbstractionAAMP_HLS* parent, Privat
 TrackState::~TrackState()
 {
 	aamp_Free(&playlist.ptr);
-	for (int j=0; j< gpGlobalConfig->maxCachedFragmentsPerTrack; j++)
+	for (int j=0; j< maxCachedFragmentsPerTrack; j++)
 	{
 		aamp_Free(&cachedFragment[j].fragment.ptr);
 	}
@@ -3863,8 +4962,11 @@ TrackState::~TrackState()
 	{
 		free(mDrmInfo.uri);
 	}
+	StopTrickPlayPrefetch();
 	pthread_cond_destroy(&mPlaylistIndexed);
 	pthread_mutex_destroy(&mPlaylistMutex);
+	pthread_cond_destroy(&mTrickPlayPrefetchCond);
+	pthread_mutex_destroy(&mTrickPlayPrefetchMutex);
 }
 /***************************************************************************
 * @fn Stop
@@ -3910,6 +5012,7 @@ void TrackState::Stop(bool clearDRM)
 #endif
 		fragmentCollectorThreadStarted = false;
 	}
+	StopTrickPlayPrefetch();
 	StopInjectLoop();
 
 	if (!clearDRM && mDrm)
@@ -4422,13 +5525,13 @@ void TrackState::FetchPlaylist()
 	do
 	{
 		MediaType mType = (this->type == eTRACK_AUDIO)?eMEDIATYPE_PLAYLIST_AUDIO:eMEDIATYPE_PLAYLIST_VIDEO;
-		aamp->GetFile(playlistUrl, &playlist, effectiveUrl, &http_error, NULL, type, true, mType);
+		aamp->GetFile(playlistUrl.c_str(), &playlist, effectiveUrl, &http_error, NULL, type, true, mType);
 		if(playlist.len)
 		{
 			aamp->profiler.ProfileEnd(bucketId);
 			break;
 		}
-		logprintf("Playlist download failed : %s failure count : %d : http response : %d\n", playlistUrl, playlistDownloadFailCount, (int)http_error);
+		logprintf("Playlist download failed : %s failure count : %d : http response : %d\n", playlistUrl.c_str(), playlistDownloadFailCount, (int)http_error);
 		aamp->InterruptableMsSleep(500);
 		playlistDownloadFailCount += 1;
 	} while(aamp->DownloadsAreEnabled() && (MAX_MANIFEST_DOWNLOAD_RETRY >  playlistDownloadFailCount) && (404 == http_error));
@@ -4753,13 +5856,13 @@ bool TrackState::FetchInitFragment(long &http_code)
 		}
 		if (!uri.empty())
 		{
-			char fragmentUrl[MAX_URI_LENGTH];
-			aamp_ResolveURL(fragmentUrl, effectiveUrl, uri.c_str());
-			char tempEffectiveUrl[MAX_URI_LENGTH];
+			std::string fragmentUrl;
+			aamp_ResolveURL(fragmentUrl, effectiveUrl.c_str(), uri.c_str());
+			std::string tempEffectiveUrl;
 			WaitForFreeFragmentAvailable();
 			CachedFragment* cachedFragment = GetFetchBuffer(true);
-			logprintf("%s:%d fragmentUrl = %s \n", __FUNCTION__, __LINE__, fragmentUrl);
-			bool fetched = aamp->GetFile(fragmentUrl, &cachedFragment->fragment, tempEffectiveUrl, &http_code, range,
+			logprintf("%s:%d fragmentUrl = %s \n", __FUNCTION__, __LINE__, fragmentUrl.c_str());
+			bool fetched = aamp->GetFile(fragmentUrl.c_str(), &cachedFragment->fragment, tempEffectiveUrl, &http_code, range,
 			        type, false, (MediaType) (type));
 			if (!fetched)
 			{
@@ -4855,6 +5958,48 @@ void StreamAbstractionAAMP_HLS::StartInjection(void)
 	}
 }
 
+/***************************************************************************
+* @fn SeekInBuffer
+* @brief Point injection at fetched or retained fragments containing position,
+*        called while injection is stopped
+*
+* @param[in] position Position in the playlist, seconds
+* @return true if all enabled tracks have position buffered
+***************************************************************************/
+bool StreamAbstractionAAMP_HLS::SeekInBuffer(double position)
+{
+	TrackState *master = trackState[eMEDIATYPE_VIDEO]->enabled ? trackState[eMEDIATYPE_VIDEO] : trackState[eMEDIATYPE_AUDIO];
+	TrackState *other = (master == trackState[eMEDIATYPE_VIDEO]) ? trackState[eMEDIATYPE_AUDIO] : NULL;
+	double masterPosition = 0;
+	double otherPosition = 0;
+	bool ret = false;
+	// once all fragments are fetched, end of stream may already be signaled to the sink
+	if ((AAMP_NORMAL_PLAY_RATE == rate) && master->enabled && master->retainInjectedFragments && !master->eosReached)
+	{
+		// other track starts from the fragment covering the start of master fragment
+		ret = master->SeekInBuffer(position, masterPosition, false);
+		if (ret && other && other->enabled)
+		{
+			ret = other->retainInjectedFragments && other->SeekInBuffer(masterPosition, otherPosition, false);
+		}
+	}
+	if (ret)
+	{
+		master->SeekInBuffer(position, masterPosition, true);
+		if (other && other->enabled)
+		{
+			other->SeekInBuffer(masterPosition, otherPosition, true);
+		}
+		seekPosition = masterPosition;
+		logprintf("StreamAbstractionAAMP_HLS::%s:%d seek to %f within buffer, from fragment at %f\n", __FUNCTION__, __LINE__, position, seekPosition);
+	}
+	else
+	{
+		logprintf("StreamAbstractionAAMP_HLS::%s:%d position %f not buffered\n", __FUNCTION__, __LINE__, position);
+	}
+	return ret;
+}
+
 /***************************************************************************
 * @fn StopWaitForPlaylistRefresh
 * @brief Stop wait for playlist refresh
@@ -37,6 +37,7 @@
 #define FRAGMENTCOLLECTOR_HLS_H
 
 #include <memory>
+#include <deque>
 #include "StreamAbstractionAAMP.h"
 #include "tsprocessor.h"
 #include "drm.h"
@@ -61,6 +62,7 @@
 #define DRM_IV_LEN 16
 #define AAMP_AUDIO_FORMAT_MAP_LEN 7
 #define AAMP_VIDEO_FORMAT_MAP_LEN 3
+#define TRICKPLAY_FPS_UPDATE_INTERVAL_MS (1000) //!< Trick play frame rate is adapted to I-frame throughput at most once per second
 
 
 /**
@@ -123,6 +125,47 @@ struct DiscontinuityIndexNode
 	const char* programDateTime; /**Program Date time */
 };
 
+/**
+*	\enum	TrickPlayPrefetchState
+* 	\brief	Download state of a prefetched I-frame
+*/
+enum TrickPlayPrefetchState
+{
+	eTRICKPLAY_PREFETCH_PENDING,     /**< Queued, no worker picked it up yet */
+	eTRICKPLAY_PREFETCH_DOWNLOADING, /**< Being downloaded by a worker */
+	eTRICKPLAY_PREFETCH_DONE         /**< Download finished, successfully or not */
+};
+
+/**
+*	\struct	TrickPlayPrefetch
+* 	\brief	I-frame downloaded ahead of the fetch loop during trick play
+*/
+struct TrickPlayPrefetch
+{
+	double target;               /**< Play target the I-frame was predicted for */
+	int idx;                     /**< Idx of I-frame in index table */
+	AampUrl url;                 /**< I-frame url, resolved by worker */
+	char range[128];             /**< Byte range of I-frame, empty if whole fragment */
+	GrowableBuffer fragment;     /**< Downloaded I-frame */
+	bool fetched;                /**< Download succeeded */
+	long http_error;             /**< Http/curl error of failed download */
+	long long downloadTimeMS;    /**< Time taken by download */
+	TrickPlayPrefetchState state; /**< Download state */
+	bool abandoned;              /**< Dropped by fetch loop while being downloaded, freed by worker */
+};
+
+/**
+*	\struct	TrickPlayPrefetchWorker
+* 	\brief	Thread downloading queued I-frames on its own curl instance
+*/
+struct TrickPlayPrefetchWorker
+{
+	class TrackState *track;     /**< Track owning the prefetch queue */
+	unsigned int curlInstance;   /**< Curl instance used for downloads */
+	pthread_t threadId;          /**< Worker thread Id */
+	bool started;                /**< Worker thread started */
+};
+
 
 /**
  * @}
@@ -212,35 +255,63 @@ public:
 	/// Stop wait for playlist refresh
 	void StopWaitForPlaylistRefresh();
 
+	/// I-frame prefetch worker thread execution function
+	void RunTrickPlayPrefetchLoop(unsigned int curlInstance);
+
 private:
 	/// Function to get fragment URI based on Index 
 	char *GetFragmentUriFromIndex();
+	/// Function to get fragment URI based on Index into given storage
+	char *GetFragmentUriFromIndex(std::string &uriStorage);
+	/// Get shared base of fragment urls, effectiveUrl of playlist
+	const std::shared_ptr<const std::string> &GetBaseUrl();
 	/// Function to flush all the downloads done 
 	void FlushIndex();
 	/// Function to Fetch the fragment and inject for playback 
 	void FetchFragment();
 	/// Helper function fetch the fragments 
 	bool FetchFragmentHelper(long &http_error, bool &decryption_error);
+	/// Reduce head of a segment fetched in trick play to its key frame and index it
+	void ProbeKeyFrame(const AampUrl &url, GrowableBuffer *fragment);
 	/// Function to redownload playlist after refresh interval .
 	void RefreshPlaylist(void);
 	/// Function to get Context pointer
 	StreamAbstractionAAMP* GetContext();
 	/// Function to inject fragment decrypted fragment
 	void InjectFragmentInternal(CachedFragment* cachedFragment, bool &fragmentDiscarded);
+	/// Function to wait till demuxed data is injected
+	void FlushFragments();
 	/// Function to find the media sequence after refresh for continuity
 	char *FindMediaForSequenceNumber();
 	/// Fetch and inject init fragment
 	bool FetchInitFragment(long &http_code);
+	/// Start I-frame prefetch workers
+	bool StartTrickPlayPrefetch();
+	/// Stop I-frame prefetch workers and free prefetched I-frames
+	void StopTrickPlayPrefetch();
+	/// Queue downloads of the I-frames predicted to follow current play target
+	void ScheduleTrickPlayPrefetch(double delta);
+	/// Wait for prefetch of current I-frame, skipping to a later one if it is late
+	void WaitForTrickPlayPrefetch(double delta);
+	/// Take prefetched I-frame for current fragment out of prefetch queue
+	TrickPlayPrefetch *TakeTrickPlayPrefetch(const AampUrl &url, const char *range);
+	/// Free a prefetched I-frame dropped from prefetch queue
+	void DropTrickPlayPrefetch(TrickPlayPrefetch *prefetch);
+	/// Account download time of an I-frame in trick play throughput
+	void UpdateTrickPlayFetchTime(long long downloadTimeMS);
+	/// Adapt trick play frame rate to I-frame download throughput
+	void UpdateTrickPlayFPS();
 
 public:
-	char effectiveUrl[MAX_URI_LENGTH]; 		/**< uri associated with downloaded playlist (takes into account 302 redirect) */
-	char playlistUrl[MAX_URI_LENGTH]; 		/**< uri associated with downloaded playlist */
+	std::string effectiveUrl; 		/**< uri associated with downloaded playlist (takes into account 302 redirect) */
+	std::string playlistUrl; 		/**< uri associated with downloaded playlist */
 	GrowableBuffer playlist; 				/**< downloaded playlist contents */
+	HttpValidators playlistValidators;		/**< validators of downloaded playlist, for conditional refresh */
 		
 	GrowableBuffer index; 			/**< packed IndexNode records for associated playlist */
 	int indexCount; 				/**< number of indexed fragments in currently indexed playlist */
 	int currentIdx; 				/**< index for currently-presenting fragment used during FF/REW (-1 if undefined) */
-	char fragmentURIFromIndex[MAX_URI_LENGTH]; /**< storage for uri generated by GetFragmentUriFromIndex */
+	std::string fragmentURIFromIndex; /**< storage for uri generated by GetFragmentUriFromIndex */
 	long long indexFirstMediaSequenceNumber; /**< first media sequence number from indexed manifest */
 
 	char *fragmentURI; /**< pointer (into playlist) to URI of current fragment-of-interest */
@@ -289,6 +360,16 @@ private:
 	double mLastMatchedDiscontPosition;     /**< Holds discontinuity position last matched  by other track */
 	double mCulledSeconds;                  /**< Total culled duration */
 	bool mSyncAfterDiscontinuityInProgress; /**< Indicates if a synchronization after discontinuity tag is in progress*/
+	TrickPlayPrefetchWorker mTrickPlayPrefetchWorker[AAMP_TRICKPLAY_PREFETCH_CURL_COUNT]; /**< I-frame prefetch workers*/
+	int mTrickPlayPrefetchWorkerCount;       /**< Number of I-frame prefetch workers started, 0 if not prefetching*/
+	std::deque<TrickPlayPrefetch *> mTrickPlayPrefetchQueue; /**< Predicted I-frames in play order*/
+	pthread_mutex_t mTrickPlayPrefetchMutex; /**< Protects prefetch queue and throughput statistics*/
+	pthread_cond_t mTrickPlayPrefetchCond;   /**< Signalled on prefetch queue change and download completion*/
+	bool mTrickPlayPrefetchStop;             /**< Set to stop prefetch workers*/
+	double mTrickPlayFetchTimeMS;            /**< Moving average of I-frame download time*/
+	long long mTrickPlayFPSUpdateTimeMS;     /**< Last time trick play frame rate was adapted*/
+	long long mTrickPlayFrameTimeMS;         /**< Time last I-frame was handed to fetch loop, used by fetch loop only*/
+	std::shared_ptr<const std::string> mBaseUrl; /**< Shared copy of effectiveUrl, base of fragment urls*/
 };
 
 class StreamAbstractionAAMP_HLS;
@@ -350,9 +431,11 @@ public:
 
 	int mediaCount;									/**< Number of media in the stream */
 	MediaInfo mediaInfo[MAX_PROFILE];				/**< Array to store multiple media within stream */
+	std::vector<ThumbnailTrack> thumbnailTracks;	/**< Image streams of main manifest */
 
 	double seekPosition;							/**< Seek position for playback */
 	int mTrickPlayFPS;								/**< Trick play frames per stream */
+	bool mReverseGOP;								/**< Rewind without I-frame track, stepping back a segment at a time */
 	bool enableThrottle;							/**< Flag indicating throttle enable/disable */
 	bool firstFragmentDecrypted;					/**< Flag indicating if first fragment is decrypted for stream */
 	bool mStartTimestampZero;						/**< Flag indicating if timestamp to start is zero or not (No audio stream) */
@@ -360,6 +443,12 @@ public:
 	int mNumberOfTracks;							/**< Number of media tracks.*/
 	/// Function to parse Main manifest 
 	void ParseMainManifest(char *ptr);
+	/// Function to register thumbnail tracks of VOD asset
+	void UpdateThumbnailTracks(void);
+	/// Function to list downloads needed to start playback of a playlist
+	static void GetPrefetchRequests(char *playlist, const char *playlistUrl, long bandwidth, double seconds, std::vector<PrefetchRequest> &requests);
+	/// Function to build thumbnail index of image or I-frame playlist
+	static void IndexThumbnailPlaylist(char *playlist, const char *playlistUrl, ThumbnailTrack &track);
 	/// Function to get playlist URI for the track type 
 	const char *GetPlaylistURI(TrackType trackType, StreamOutputFormat* format = NULL);
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
@@ -372,6 +461,8 @@ public:
 	void StopInjection(void);
 	/// Start injection of fragments.
 	void StartInjection(void);
+	/// Point injection of all tracks at fetched or retained fragments containing position.
+	bool SeekInBuffer(double position);
 
 protected:
 	/// Function to get StreamInfo stucture based on the index input
@@ -86,6 +86,53 @@ struct FragmentDescriptor
 	uint64_t Time;
 };
 
+/**
+ * @class SegmentTemplateUrl
+ * @brief SegmentTemplate media url compiled once per representation
+ *
+ * Base url, $RepresentationID$ and $Bandwidth$ are substituted and resolved
+ * against the manifest url at compile time; building a segment url only
+ * appends the formatted $Number$/$Time$ values to the literal parts.
+ */
+class SegmentTemplateUrl
+{
+public:
+	SegmentTemplateUrl() : mMedia(), mBaseUrl(), mManifestUrl(), mBandwidth(0), mRepresentationID(), mParts(), mUrl()
+	{
+	}
+
+	bool IsCompiledFor(const FragmentDescriptor *fragmentDescriptor, const std::string &media) const;
+	void Compile(const FragmentDescriptor *fragmentDescriptor, const std::string &media);
+	const char *Build(uint64_t number, uint64_t time);
+
+private:
+	enum TokenType
+	{
+		eTOKEN_NONE,
+		eTOKEN_NUMBER,
+		eTOKEN_TIME
+	};
+
+	/**
+	 * @struct Part
+	 * @brief Literal text followed by an optional number token
+	 */
+	struct Part
+	{
+		std::string literal;
+		TokenType token;
+		std::string format;
+	};
+
+	std::string mMedia;
+	std::string mBaseUrl;
+	std::string mManifestUrl;
+	uint32_t mBandwidth;
+	std::string mRepresentationID;
+	std::vector<Part> mParts;
+	std::string mUrl;
+};
+
 /**
  * @struct PeriodInfo
  * @brief Stores details about available periods in mpd
@@ -112,9 +159,9 @@ static const char *mMediaTypeName[] = { "video", "audio" };
 #else
 #define HARVEST_BASE_PATH "aamp-harvest/"
 #endif
-static void GetFilePath(char filePath[MAX_URI_LENGTH], const FragmentDescriptor *fragmentDescriptor, std::string media);
-static void WriteFile(char* fileName, const char* data, int len);
+static void GetFilePath(std::string &filePath, const FragmentDescriptor *fragmentDescriptor, std::string media);
 #endif // AAMP_HARVEST_SUPPORT_ENABLED
+static std::string GetStreamFormat(IAdaptationSet *adaptationSet, IRepresentation *representation);
 
 /**
  * @class MediaStreamContext
@@ -147,7 +194,7 @@ public:
 			fragmentIndex(0), timeLineIndex(0), fragmentRepeatCount(0), fragmentOffset(0),
 			eos(false), endTimeReached(false), fragmentTime(0),targetDnldPosition(0), index_ptr(NULL), index_len(0),
 			lastSegmentTime(0), lastSegmentNumber(0), adaptationSetIdx(0), representationIndex(0), profileChanged(true),
-			adaptationSetId(0)
+			adaptationSetId(0), codec(), timeScale(0), continuousTimeline(false), discontinuityPts(0)
 	{
 		mContext = context;
 		memset(&fragmentDescriptor, 0, sizeof(FragmentDescriptor));
@@ -255,16 +302,17 @@ public:
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 			if (aamp->HarvestFragments())
 			{
-				char fileName[MAX_URI_LENGTH];
-				strcpy(fileName, fragmentUrl);
+				std::string fileName;
 				GetFilePath(fileName, &fragmentDescriptor, media);
-				logprintf("%s:%d filePath %s\n", __FUNCTION__, __LINE__, fileName);
-				WriteFile(fileName, cachedFragment->fragment.ptr, cachedFragment->fragment.len);
+				logprintf("%s:%d filePath %s\n", __FUNCTION__, __LINE__, fileName.c_str());
+				aamp->HarvestFile(fileName.c_str(), fragmentUrl, cachedFragment->fragment.ptr, cachedFragment->fragment.len, true);
 			}
 #endif
 			cachedFragment->position = position;
 			cachedFragment->duration = duration;
 			cachedFragment->discontinuity = discontinuity;
+			cachedFragment->continuousTimeline = (discontinuity && continuousTimeline);
+			cachedFragment->discontinuityPts = discontinuityPts;
 #ifdef AAMP_DEBUG_INJECT
 			if (discontinuity)
 			{
@@ -272,7 +320,7 @@ public:
 			}
 			if ((1 << type) & AAMP_DEBUG_INJECT)
 			{
-				strcpy(cachedFragment->uri, fragmentUrl);
+				cachedFragment->uri = fragmentUrl;
 			}
 #endif
 			segDLFailCount = 0;
@@ -303,6 +351,7 @@ public:
 			}
 			fragmentDescriptor.Bandwidth = representation->GetBandwidth();
 			strcpy(fragmentDescriptor.RepresentationID, representation->GetId().c_str());
+			codec = GetStreamFormat(adaptationSet, representation);
 			profileChanged = true;
 		}
 		else
@@ -336,6 +385,11 @@ public:
 	StreamAbstractionAAMP_MPD* mContext;
 	std::string initialization;
 	uint32_t adaptationSetId;
+	std::string codec;
+	uint32_t timeScale;
+	bool continuousTimeline;
+	double discontinuityPts;
+	SegmentTemplateUrl mediaUrlTemplate;
 };
 
 /**
@@ -419,7 +473,7 @@ public:
 
 	void FetcherLoop();
 	bool PushNextFragment( MediaStreamContext *pMediaStreamContext, unsigned int curlInstance = 0);
-	bool FetchFragment(MediaStreamContext *pMediaStreamContext, std::string media, double fragmentDuration, bool isInitializationSegment, unsigned int curlInstance = 0, bool discontinuity = false );
+	bool FetchFragment(MediaStreamContext *pMediaStreamContext, const std::string &media, double fragmentDuration, bool isInitializationSegment, unsigned int curlInstance = 0, bool discontinuity = false );
 	uint64_t GetPeriodEndTime();
 	int GetProfileCount();
 	StreamInfo* GetStreamInfo(int idx);
@@ -455,6 +509,7 @@ private:
 	uint64_t GetDurationFromRepresentation();
 	void UpdateCullingState();
 	void UpdateLanguageList();
+	void UpdateThumbnailTracks();
 
 	bool fragmentCollectorThreadStarted;
 	std::set<std::string> mLangList;
@@ -480,6 +535,8 @@ private:
 	uint64_t mPeriodStartTime;
 	int64_t mMinUpdateDurationMs;
 	uint64_t mLastPlaylistDownloadTimeMs;
+	HttpValidators mManifestValidators; /**< Validators of downloaded live manifest, for conditional refresh */
+	bool mManifestUnchanged;            /**< Last UpdateMPD found manifest unchanged and kept current mpd */
 	double mFirstPTS;
 	AudioType mAudioType;
 	std::string mPeriodId;
@@ -489,6 +546,7 @@ private:
 	bool mIsFogTSB;
 	bool mIsIframeTrackPresent;
 	vector<PeriodInfo> mMPDPeriodsInfo;
+	std::string mPrefetchedPeriodId;
 };
 
 /**
@@ -512,6 +570,9 @@ PrivateStreamAbstractionMPD::PrivateStreamAbstractionMPD( StreamAbstractionAAMP_
 	fragmentCollectorThreadID = 0;
 	createDRMSessionThreadID = 0;
 	mpd = NULL;
+	mManifestValidators.bodyHash = 0;
+	mManifestValidators.notModified = false;
+	mManifestUnchanged = false;
 	fragmentCollectorThreadStarted = false;
 	drmSessionThreadStarted = false;
 	memset(&mMediaStreamContext, 0, sizeof(mMediaStreamContext));
@@ -573,6 +634,53 @@ static bool IsCompatibleMimeType(std::string mimeType, MediaType mediaType)
 }
 
 
+/**
+ * @brief Get stream format of representation, e.g. avc1.4d401f 1280x720 or mp4a.40.2 48000Hz
+ *
+ * Full codec string along with resolution or sampling rate, so that timeline is continued
+ * across a discontinuity only when decoder needs no reconfiguration at all.
+ *
+ * @param[in] adaptationSet  Adaptation set object, attributes of which are used when representation has none
+ * @param[in] representation Representation object
+ *
+ * @retval stream format, empty if codec not signalled
+ */
+static std::string GetStreamFormat(IAdaptationSet *adaptationSet, IRepresentation *representation)
+{
+	std::string format;
+	const std::vector<string> codecs = representation->GetCodecs();
+	if (codecs.size())
+	{
+		format = codecs.at(0);
+	}
+	else if (adaptationSet->GetCodecs().size())
+	{
+		format = adaptationSet->GetCodecs().at(0);
+	}
+	if (!format.empty())
+	{
+		char attributes[64];
+		uint32_t width = representation->GetWidth() ? representation->GetWidth() : adaptationSet->GetWidth();
+		uint32_t height = representation->GetHeight() ? representation->GetHeight() : adaptationSet->GetHeight();
+		std::vector<string> samplingRates = representation->GetAudioSamplingRate();
+		if (samplingRates.empty())
+		{
+			samplingRates = adaptationSet->GetAudioSamplingRate();
+		}
+		if (width || height)
+		{
+			snprintf(attributes, sizeof(attributes), " %ux%u", width, height);
+			format += attributes;
+		}
+		if (samplingRates.size())
+		{
+			format += " " + samplingRates.at(0) + "Hz";
+		}
+	}
+	return format;
+}
+
+
 /**
  * @brief Get representation index of desired codec
  *
@@ -843,33 +951,32 @@ static int replace(std::string& str, const std::string& from, const std::string&
 
 
 /**
- * @brief Generates fragment URL from media information
+ * @brief Gets base url of fragment descriptor
  *
- * @param[out] fragmentUrl         Fragment URL
- * @param[in]  fragmentDescriptor  Descriptor
- * @param[in]  media               Media information string
+ * @param[in] fragmentDescriptor  Descriptor
+ * @retval base url, '/' terminated if absolute
  */
-static void GetFragmentUrl( char fragmentUrl[MAX_URI_LENGTH], const FragmentDescriptor *fragmentDescriptor, std::string media)
+static std::string GetBaseUrl(const FragmentDescriptor *fragmentDescriptor)
 {
-	std::string constructedUri;
+	std::string baseUrl;
 	if (fragmentDescriptor->baseUrls->size() > 0)
 	{
-		constructedUri = fragmentDescriptor->baseUrls->at(0)->GetUrl();
+		baseUrl = fragmentDescriptor->baseUrls->at(0)->GetUrl();
 		if(gpGlobalConfig->dashIgnoreBaseURLIfSlash)
 		{
-			if (constructedUri == "/")
+			if (baseUrl == "/")
 			{
 				logprintf("%s:%d ignoring baseurl /\n", __FUNCTION__, __LINE__);
-				constructedUri.clear();
+				baseUrl.clear();
 			}
 		}
 
 		//Add '/' to BaseURL if not already available.
-		if( constructedUri.compare(0, 7, "http://")==0 || constructedUri.compare(0, 8, "https://")==0 )
+		if( baseUrl.compare(0, 7, "http://")==0 || baseUrl.compare(0, 8, "https://")==0 )
 		{
-			if( constructedUri.back() != '/' )
+			if( baseUrl.back() != '/' )
 			{
-				constructedUri += '/';
+				baseUrl += '/';
 			}
 		}
 	}
@@ -877,70 +984,179 @@ static void GetFragmentUrl( char fragmentUrl[MAX_URI_LENGTH], const FragmentDesc
 	{
 		traceprintf("%s:%d BaseURL not available\n", __FUNCTION__, __LINE__);
 	}
-	constructedUri += media;
+	return baseUrl;
+}
 
-	replace(constructedUri, "Bandwidth", fragmentDescriptor->Bandwidth);
-	replace(constructedUri, "RepresentationID", fragmentDescriptor->RepresentationID);
-	replace(constructedUri, "Number", fragmentDescriptor->Number);
-	replace(constructedUri, "Time", fragmentDescriptor->Time );
 
-	aamp_ResolveURL(fragmentUrl, fragmentDescriptor->manifestUrl, constructedUri.c_str());
+/**
+ * @brief Check if template was compiled for given descriptor and media
+ *
+ * @param[in] fragmentDescriptor  Descriptor
+ * @param[in] media               Media template string
+ * @retval true if Build can be used as is
+ */
+bool SegmentTemplateUrl::IsCompiledFor(const FragmentDescriptor *fragmentDescriptor, const std::string &media) const
+{
+	if (mParts.empty() || mMedia != media || mBandwidth != fragmentDescriptor->Bandwidth
+			|| mRepresentationID != fragmentDescriptor->RepresentationID || mManifestUrl != fragmentDescriptor->manifestUrl)
+	{
+		return false;
+	}
+	if (fragmentDescriptor->baseUrls->size() > 0)
+	{
+		return (mBaseUrl == fragmentDescriptor->baseUrls->at(0)->GetUrl());
+	}
+	return mBaseUrl.empty();
 }
 
-#ifdef AAMP_HARVEST_SUPPORT_ENABLED
-
-#include <sys/stat.h>
 
 /**
- * @brief Gets file path to havest
+ * @brief Compile media template of a representation
  *
- * @param[out] filePath             Path of file
- * @param[in]  fragmentDescriptor   Fragment descriptor
- * @param[in]  media                String containing media info
+ * @param[in] fragmentDescriptor  Descriptor
+ * @param[in] media               Media template string
  */
-static void GetFilePath(char filePath[MAX_URI_LENGTH], const FragmentDescriptor *fragmentDescriptor, std::string media)
+void SegmentTemplateUrl::Compile(const FragmentDescriptor *fragmentDescriptor, const std::string &media)
 {
-	std::string constructedUri = HARVEST_BASE_PATH;
+	mMedia = media;
+	mBandwidth = fragmentDescriptor->Bandwidth;
+	mRepresentationID = fragmentDescriptor->RepresentationID;
+	mManifestUrl = fragmentDescriptor->manifestUrl;
+	mBaseUrl.clear();
+	if (fragmentDescriptor->baseUrls->size() > 0)
+	{
+		mBaseUrl = fragmentDescriptor->baseUrls->at(0)->GetUrl();
+	}
+
+	std::string constructedUri = GetBaseUrl(fragmentDescriptor);
 	constructedUri += media;
 	replace(constructedUri, "Bandwidth", fragmentDescriptor->Bandwidth);
 	replace(constructedUri, "RepresentationID", fragmentDescriptor->RepresentationID);
-	replace(constructedUri, "Number", fragmentDescriptor->Number);
-	replace(constructedUri, "Time", fragmentDescriptor->Time);
-	strcpy(filePath, constructedUri.c_str());
+	// Resolving only looks at scheme and leading '/', so $Number$/$Time$ can stay until Build
+	std::string resolved;
+	aamp_ResolveURL(resolved, fragmentDescriptor->manifestUrl, constructedUri.c_str());
+
+	mParts.clear();
+	Part part;
+	part.token = eTOKEN_NONE;
+	size_t pos = 0;
+	for (;;)
+	{
+		size_t start = resolved.find('$', pos);
+		size_t end = (start == std::string::npos) ? std::string::npos : resolved.find('$', start + 1);
+		if (end == std::string::npos)
+		{
+			part.literal.append(resolved, pos, std::string::npos);
+			break;
+		}
+		TokenType token = eTOKEN_NONE;
+		size_t tokenLength = 0;
+		if (resolved.compare(start + 1, 6, "Number") == 0)
+		{
+			token = eTOKEN_NUMBER;
+			tokenLength = 6;
+		}
+		else if (resolved.compare(start + 1, 4, "Time") == 0)
+		{
+			token = eTOKEN_TIME;
+			tokenLength = 4;
+		}
+		if (token == eTOKEN_NONE)
+		{
+			// Not a number identifier, keep it verbatim
+			part.literal.append(resolved, pos, end - pos);
+			pos = end;
+			continue;
+		}
+		part.literal.append(resolved, pos, start - pos);
+		part.token = token;
+		part.format = "%";
+		std::string format = resolved.substr(start + 1 + tokenLength, end - start - 1 - tokenLength);
+		if (format.size() > 1 && format[0] == '%')
+		{
+			// Keep width/flags, use 64-bit conversion matching the requested radix
+			char conversion = format[format.size() - 1];
+			for (size_t i = 1; i < format.size() - 1; i++)
+			{
+				if (strchr("hljzqL", format[i]) == NULL)
+				{
+					part.format += format[i];
+				}
+			}
+			part.format += (conversion == 'x') ? PRIx64 : ((conversion == 'X') ? PRIX64 : ((conversion == 'o') ? PRIo64 : PRIu64));
+		}
+		else
+		{
+			part.format += PRIu64;
+		}
+		mParts.push_back(part);
+		part.literal.clear();
+		part.token = eTOKEN_NONE;
+		pos = end + 1;
+	}
+	mParts.push_back(part);
+	mUrl.reserve(resolved.size() + 32);
 }
 
 
 /**
- * @brief Write file to storage
+ * @brief Build segment url from compiled template
  *
- * @param[in]  fileName  Out file name
- * @param[in]  data      Buffer
- * @param[in]  len       Length of buffer
+ * @param[in] number  Value of $Number$
+ * @param[in] time    Value of $Time$
+ * @retval segment url, valid until next Build or Compile
  */
-static void WriteFile(char* fileName, const char* data, int len)
+const char *SegmentTemplateUrl::Build(uint64_t number, uint64_t time)
 {
-	struct stat st = { 0 };
-	for (unsigned int i = 0; i < strlen(fileName); i++)
+	mUrl.clear();
+	for (std::vector<Part>::const_iterator it = mParts.begin(); it != mParts.end(); ++it)
 	{
-		if (fileName[i] == '/')
+		mUrl += it->literal;
+		if (it->token != eTOKEN_NONE)
 		{
-			fileName[i] = '\0';
-			if (-1 == stat(fileName, &st))
-			{
-				mkdir(fileName, 0777);
-			}
-			fileName[i] = '/';
+			char buf[64];
+			snprintf(buf, sizeof(buf), it->format.c_str(), (it->token == eTOKEN_NUMBER) ? number : time);
+			mUrl += buf;
 		}
 	}
-	FILE *fp = fopen(fileName, "wb");
-	if (NULL == fp)
-	{
-		logprintf("File open failed. outfile = %s \n", fileName);
-		return;
-	}
-	fwrite(data, len, 1, fp);
-	fclose(fp);
+	return mUrl.c_str();
+}
+
+
+/**
+ * @brief Generates fragment URL from media information
+ *
+ * @param[out] fragmentUrl         Fragment URL
+ * @param[in]  fragmentDescriptor  Descriptor
+ * @param[in]  media               Media information string
+ */
+static void GetFragmentUrl(std::string &fragmentUrl, const FragmentDescriptor *fragmentDescriptor, const std::string &media)
+{
+	SegmentTemplateUrl urlTemplate;
+	urlTemplate.Compile(fragmentDescriptor, media);
+	fragmentUrl = urlTemplate.Build(fragmentDescriptor->Number, fragmentDescriptor->Time);
+}
+
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+
+/**
+ * @brief Gets file path to havest
+ *
+ * @param[out] filePath             Path of file
+ * @param[in]  fragmentDescriptor   Fragment descriptor
+ * @param[in]  media                String containing media info
+ */
+static void GetFilePath(std::string &filePath, const FragmentDescriptor *fragmentDescriptor, std::string media)
+{
+	std::string constructedUri = HARVEST_BASE_PATH;
+	constructedUri += media;
+	replace(constructedUri, "Bandwidth", fragmentDescriptor->Bandwidth);
+	replace(constructedUri, "RepresentationID", fragmentDescriptor->RepresentationID);
+	replace(constructedUri, "Number", fragmentDescriptor->Number);
+	replace(constructedUri, "Time", fragmentDescriptor->Time);
+	filePath = constructedUri;
 }
+
 #endif // AAMP_HARVEST_SUPPORT_ENABLED
 
 /**
@@ -955,11 +1171,18 @@ static void WriteFile(char* fileName, const char* data, int len)
  *
  * @retval true on fetch success
  */
-bool PrivateStreamAbstractionMPD::FetchFragment(MediaStreamContext *pMediaStreamContext, std::string media, double fragmentDuration, bool isInitializationSegment, unsigned int curlInstance, bool discontinuity)
+bool PrivateStreamAbstractionMPD::FetchFragment(MediaStreamContext *pMediaStreamContext, const std::string &media, double fragmentDuration, bool isInitializationSegment, unsigned int curlInstance, bool discontinuity)
 { // given url, synchronously download and transmit associated fragment
 	bool retval = true;
-	char fragmentUrl[MAX_URI_LENGTH];
-	GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor, media);
+	const FragmentDescriptor *fragmentDescriptor = &pMediaStreamContext->fragmentDescriptor;
+	// Init segments are compiled on the spot so they don't evict the media template
+	SegmentTemplateUrl initUrlTemplate;
+	SegmentTemplateUrl &urlTemplate = isInitializationSegment ? initUrlTemplate : pMediaStreamContext->mediaUrlTemplate;
+	if (!urlTemplate.IsCompiledFor(fragmentDescriptor, media))
+	{
+		urlTemplate.Compile(fragmentDescriptor, media);
+	}
+	const char *fragmentUrl = urlTemplate.Build(fragmentDescriptor->Number, fragmentDescriptor->Time);
 	size_t len = 0;
 	float position;
 	if(isInitializationSegment)
@@ -986,7 +1209,7 @@ bool PrivateStreamAbstractionMPD::FetchFragment(MediaStreamContext *pMediaStream
 		position = position/rate;
 		AAMPLOG_INFO("PrivateStreamAbstractionMPD::%s:%d rate %f pMediaStreamContext->fragmentTime %f updated position %f\n",
 				__FUNCTION__, __LINE__, rate, pMediaStreamContext->fragmentTime, position);
-		duration = duration/rate * gpGlobalConfig->vodTrickplayFPS;
+		duration = duration/rate * aamp->mVODTrickplayFPS;
 		//aamp->disContinuity();
 	}
 	if(!pMediaStreamContext->CacheFragment(fragmentUrl, curlInstance, position, duration, NULL, isInitializationSegment, discontinuity
@@ -1029,7 +1252,7 @@ bool PrivateStreamAbstractionMPD::PushNextFragment( struct MediaStreamContext *p
 #endif
 	if (segmentTemplate)
 	{
-		std::string media = segmentTemplate->Getmedia();
+		const std::string &media = segmentTemplate->Getmedia();
 		const ISegmentTimeline *segmentTimeline = segmentTemplate->GetSegmentTimeline();
 		if (segmentTimeline)
 		{
@@ -1345,7 +1568,7 @@ bool PrivateStreamAbstractionMPD::PushNextFragment( struct MediaStreamContext *p
 		ISegmentBase *segmentBase = pMediaStreamContext->representation->GetSegmentBase();
 		if (segmentBase)
 		{ // single-segment
-			char fragmentUrl[MAX_URI_LENGTH];
+			std::string fragmentUrl;
 			GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor, "");
 			if (!pMediaStreamContext->index_ptr)
 			{ // lazily load index
@@ -1354,7 +1577,7 @@ bool PrivateStreamAbstractionMPD::PushNextFragment( struct MediaStreamContext *p
 				sscanf(range.c_str(), "%d-%d", &start, &pMediaStreamContext->fragmentOffset);
 				ProfilerBucketType bucketType = aamp->GetProfilerBucketForMedia(pMediaStreamContext->mediaType, true);
 				MediaType actualType = (MediaType)(eMEDIATYPE_INIT_VIDEO+pMediaStreamContext->mediaType);
-				pMediaStreamContext->index_ptr = aamp->LoadFragment(bucketType, fragmentUrl, &pMediaStreamContext->index_len, curlInstance, range.c_str(),actualType);
+				pMediaStreamContext->index_ptr = aamp->LoadFragment(bucketType, fragmentUrl.c_str(), &pMediaStreamContext->index_len, curlInstance, range.c_str(),actualType);
 
 				pMediaStreamContext->fragmentOffset++; // first byte following packed index
 
@@ -1383,9 +1606,9 @@ bool PrivateStreamAbstractionMPD::PushNextFragment( struct MediaStreamContext *p
 					char range[128];
 					sprintf(range, "%d-%d", pMediaStreamContext->fragmentOffset, pMediaStreamContext->fragmentOffset + referenced_size - 1);
 					AAMPLOG_INFO("%s:%d %s [%s]\n", __FUNCTION__, __LINE__,mMediaTypeName[pMediaStreamContext->mediaType], range);
-					if(!pMediaStreamContext->CacheFragment(fragmentUrl, curlInstance, pMediaStreamContext->fragmentTime, 0.0, range ))
+					if(!pMediaStreamContext->CacheFragment(fragmentUrl.c_str(), curlInstance, pMediaStreamContext->fragmentTime, 0.0, range ))
 					{
-						logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl, pMediaStreamContext->fragmentTime);
+						logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl.c_str(), pMediaStreamContext->fragmentTime);
 					}
 					pMediaStreamContext->fragmentTime += fragmentDuration;
 					pMediaStreamContext->fragmentOffset += referenced_size;
@@ -1418,12 +1641,12 @@ bool PrivateStreamAbstractionMPD::PushNextFragment( struct MediaStreamContext *p
 					std::map<string,string> rawAttributes = segmentList->GetRawAttributes();
 					if(rawAttributes.find("customlist") == rawAttributes.end()) //"CheckForFogSegmentList")
 					{
-						char fragmentUrl[MAX_URI_LENGTH];
+						std::string fragmentUrl;
 						GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor,  segmentURL->GetMediaURI());
 						AAMPLOG_INFO("%s [%s]\n", mMediaTypeName[pMediaStreamContext->mediaType], segmentURL->GetMediaRange().c_str());
-						if(!pMediaStreamContext->CacheFragment(fragmentUrl, curlInstance, pMediaStreamContext->fragmentTime, 0.0, segmentURL->GetMediaRange().c_str() ))
+						if(!pMediaStreamContext->CacheFragment(fragmentUrl.c_str(), curlInstance, pMediaStreamContext->fragmentTime, 0.0, segmentURL->GetMediaRange().c_str() ))
 						{
-							logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl, pMediaStreamContext->fragmentTime);
+							logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl.c_str(), pMediaStreamContext->fragmentTime);
 						}
 					}
 					else //We are procesing the custom segment list provided by Fog for DASH TSB
@@ -2224,7 +2447,7 @@ void PrivateStreamAbstractionMPD::ProcessContentProtection(IAdaptationSet * adap
 
 	// Choose widevine if both widevine and playready contentprotectiondata sections are presenet.
 	// TODO: We need to add more flexible selection logic here (using aamp.cfg etc)
-	if(wvData != NULL && wvDataLength > 0 && ((DRMSystems)gpGlobalConfig->preferredDrm == eDRM_WideVine || prData == NULL))
+	if(wvData != NULL && wvDataLength > 0 && (aamp->mPreferredDrm == eDRM_WideVine || prData == NULL))
 	{
 		isWidevine = true;
 		data = wvData;
@@ -2503,7 +2726,7 @@ AAMPStatusType PrivateStreamAbstractionMPD::Init(TuneType tuneType)
 
 		for (int i = 0; i < AAMP_TRACK_COUNT; i++)
 		{
-			aamp->SetCurlTimeout(gpGlobalConfig->fragmentDLTimeout, i);
+			aamp->SetCurlTimeout(aamp->mNetworkTimeout, i);
 		}
 
 		mIsLive = !(mpd->GetType() == "static");
@@ -2686,6 +2909,10 @@ AAMPStatusType PrivateStreamAbstractionMPD::Init(TuneType tuneType)
 			}
 		}
 		UpdateLanguageList();
+		if (!mIsLive && !aamp->HasThumbnailTracks())
+		{
+			UpdateThumbnailTracks();
+		}
 		StreamSelection(true);
 
 		if(mNumberOfTracks)
@@ -2836,6 +3063,9 @@ AAMPStatusType PrivateStreamAbstractionMPD::UpdateMPD(bool retrievePlaylistFromC
 	bool gotManifest = false;
 	bool retrievedPlaylistFromCache = false;
 	bool harvestManifest = (gpGlobalConfig->mpdHarvestLimit && strstr(manifestUrl, "ccr.mm-"));
+	// refresh of live manifest can keep current mpd when unchanged
+	bool conditional = gpGlobalConfig->conditionalPlaylistRefresh && (this->mpd != NULL) && mIsLive;
+	mManifestUnchanged = false;
 	if (retrievePlaylistFromCache)
 	{
 		memset(&manifest, 0, sizeof(manifest));
@@ -2853,7 +3083,8 @@ AAMPStatusType PrivateStreamAbstractionMPD::UpdateMPD(bool retrievePlaylistFromC
 			downloadAttempt++;
 			memset(&manifest, 0, sizeof(manifest));
 			aamp->profiler.ProfileBegin(PROFILE_BUCKET_MANIFEST);
-			gotManifest = aamp->GetFile(manifestUrl, &manifest, manifestUrl, &http_error, NULL, 0, true, eMEDIATYPE_MANIFEST);
+			gotManifest = aamp->GetFile(manifestUrl, &manifest, manifestUrl, &http_error, NULL, 0, true, eMEDIATYPE_MANIFEST,
+					conditional ? &mManifestValidators : NULL);
 			if (gotManifest)
 			{
 				aamp->profiler.ProfileEnd(PROFILE_BUCKET_MANIFEST);
@@ -2861,6 +3092,14 @@ AAMPStatusType PrivateStreamAbstractionMPD::UpdateMPD(bool retrievePlaylistFromC
 				{
 					mContext->mNetworkDownDetected = false;
 				}
+				if (conditional && mManifestValidators.notModified)
+				{ // skip parse, segment and period indexes of current mpd stay valid
+					traceprintf("PrivateStreamAbstractionMPD::%s:%d manifest not modified\n", __FUNCTION__, __LINE__);
+					this->mpd->SetFetchTime(Time::GetCurrentUTCTimeInSec());
+					mManifestUnchanged = true;
+					mLastPlaylistDownloadTimeMs = aamp_GetCurrentTimeMS();
+					break;
+				}
 			}
 			else if (aamp->DownloadsAreEnabled())
 			{
@@ -2888,13 +3127,17 @@ AAMPStatusType PrivateStreamAbstractionMPD::UpdateMPD(bool retrievePlaylistFromC
 			gotManifest = true;
 		}
 
-		if (gotManifest)
+		if (mManifestUnchanged)
+		{
+			// current mpd retained, nothing downloaded to parse
+		}
+		else if (gotManifest)
 		{
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 		char fileName[1024] = {'\0'};
 		strcat(fileName, HARVEST_BASE_PATH);
 		strcat(fileName, "manifest.mpd");
-		WriteFile( fileName, manifest.ptr, manifest.len);
+		aamp->HarvestFile(fileName, manifestUrl, manifest.ptr, manifest.len, false);
 #endif
 			// parse xml
 			xmlTextReaderPtr reader = xmlReaderForMemory(manifest.ptr, (int) manifest.len, NULL, NULL, 0);
@@ -3558,6 +3801,537 @@ void PrivateStreamAbstractionMPD::UpdateLanguageList()
 }
 
 
+/**
+ * @brief Check if adaptation set carries thumbnail images
+ *
+ * @param[in] adaptationSet Adaptation set
+ *
+ * @retval true if image adaptation set
+ */
+static bool IsImageTrack(IAdaptationSet *adaptationSet)
+{
+	return (adaptationSet->GetContentType() == "image" || adaptationSet->GetMimeType().compare(0, 6, "image/") == 0);
+}
+
+/**
+ * @brief Get tile layout of thumbnail sprite images
+ *
+ * @param[in]  subnodes Additional sub nodes of representation or adaptation set
+ * @param[out] columns  Tiles per row
+ * @param[out] rows     Tiles per column
+ *
+ * @retval true if tile layout is signalled
+ */
+static bool GetThumbnailTileLayout(const std::vector<INode *> &subnodes, int &columns, int &rows)
+{
+	for (unsigned i = 0; i < subnodes.size(); i++)
+	{
+		INode *xml = subnodes[i];
+		if (xml->GetName() == "EssentialProperty" && xml->HasAttribute("schemeIdUri") && xml->HasAttribute("value"))
+		{
+			const std::string& schemeUri = xml->GetAttributeValue("schemeIdUri");
+			if (schemeUri == "http://dashif.org/thumbnail_tile" || schemeUri == "http://dashif.org/guidelines/thumbnail_tile")
+			{
+				if (sscanf(xml->GetAttributeValue("value").c_str(), "%dx%d", &columns, &rows) == 2 && columns > 0 && rows > 0)
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Expand S elements of a SegmentTimeline to segments
+ *
+ * A negative S@r repeats till the next S@t or, for the last S element, till
+ * the period end. Without either, the listing is bounded by maxTime, else the
+ * S element yields one segment.
+ *
+ * @param[in]  timeline       S elements in document order
+ * @param[in]  periodDuration Period duration in timescale units, 0 if unknown
+ * @param[in]  maxTime        Duration of segments to list in timescale units, 0 for all
+ * @param[out] segments       Start time and duration of segments in timescale units
+ *
+ * @retval Start time of first segment in timescale units
+ */
+uint64_t StreamAbstractionAAMP_MPD::GetTimelineSegments(const std::vector<TimelineEntry> &timeline, uint64_t periodDuration, uint64_t maxTime, std::vector<std::pair<uint64_t, uint64_t>> &segments)
+{
+	uint64_t firstTime = 0;
+	uint64_t startTime = 0;
+	for (size_t i = 0; i < timeline.size(); i++)
+	{
+		const TimelineEntry &entry = timeline[i];
+		if (i == 0 || entry.startTime > 0)
+		{
+			startTime = entry.startTime;
+			if (i == 0)
+			{
+				firstTime = startTime;
+			}
+		}
+		uint64_t repeatCount = entry.repeatCount;
+		if ((int32_t)entry.repeatCount < 0)
+		{
+			uint64_t endTime = 0;
+			if (i + 1 < timeline.size() && timeline[i + 1].startTime > 0)
+			{
+				endTime = timeline[i + 1].startTime;
+			}
+			else if (periodDuration)
+			{
+				endTime = firstTime + periodDuration;
+			}
+			else if (maxTime)
+			{
+				endTime = firstTime + maxTime;
+			}
+			if (entry.duration && endTime > startTime)
+			{
+				repeatCount = ((endTime - startTime) + entry.duration - 1) / entry.duration - 1;
+			}
+			else
+			{
+				logprintf("%s:%d S@r %d without end time or duration, listing one segment\n", __FUNCTION__, __LINE__, (int32_t)entry.repeatCount);
+				repeatCount = 0;
+			}
+		}
+		for (uint64_t repeat = 0; repeat <= repeatCount; repeat++)
+		{
+			if (maxTime && (startTime - firstTime) >= maxTime)
+			{
+				return firstTime;
+			}
+			segments.push_back(std::make_pair(startTime, entry.duration));
+			startTime += entry.duration;
+		}
+	}
+	return firstTime;
+}
+
+/**
+ * @brief Get segments of a segment template
+ *
+ * @param[in]  segmentTemplate Segment template
+ * @param[in]  periodDuration  Period duration in seconds, used when there is no timeline
+ * @param[in]  maxDuration     Seconds of segments to list, 0 for all
+ * @param[out] segments        Start time and duration of segments in timescale units
+ *
+ * @retval Start time of first segment in timescale units
+ */
+static uint64_t GetTemplateSegments(ISegmentTemplate *segmentTemplate, double periodDuration, double maxDuration, std::vector<std::pair<uint64_t, uint64_t>> &segments)
+{
+	uint32_t timeScale = segmentTemplate->GetTimescale();
+	if (!timeScale)
+	{
+		timeScale = 1;
+	}
+	uint64_t firstTime = 0;
+	uint64_t maxTime = (maxDuration > 0) ? (uint64_t)(maxDuration * timeScale) : 0;
+	const ISegmentTimeline *segmentTimeline = segmentTemplate->GetSegmentTimeline();
+	if (segmentTimeline)
+	{
+		std::vector<ITimeline *>&timelines = segmentTimeline->GetTimelines();
+		std::vector<TimelineEntry> timeline(timelines.size());
+		for (size_t i = 0; i < timelines.size(); i++)
+		{
+			timeline[i].startTime = timelines.at(i)->GetStartTime();
+			timeline[i].duration = timelines.at(i)->GetDuration();
+			timeline[i].repeatCount = timelines.at(i)->GetRepeatCount();
+		}
+		uint64_t periodTime = (periodDuration > 0) ? (uint64_t)(periodDuration * timeScale) : 0;
+		firstTime = StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, periodTime, maxTime, segments);
+	}
+	else if (segmentTemplate->GetDuration() && (periodDuration > 0 || maxTime))
+	{
+		uint64_t duration = segmentTemplate->GetDuration();
+		uint64_t periodEnd = (uint64_t)(periodDuration * timeScale);
+		if (maxTime && (!periodEnd || maxTime < periodEnd))
+		{
+			periodEnd = maxTime;
+		}
+		for (uint64_t startTime = 0; startTime < periodEnd; startTime += duration)
+		{
+			segments.push_back(std::make_pair(startTime, duration));
+		}
+	}
+	return firstTime;
+}
+
+/**
+ * @brief Set up fragment descriptor of a representation
+ *
+ * @param[out] fragmentDescriptor Descriptor
+ * @param[in]  manifestUrl        Manifest URL
+ * @param[in]  mpd                MPD
+ * @param[in]  period             Period of representation
+ * @param[in]  adaptationSet      Adaptation set of representation
+ * @param[in]  representation     Representation
+ */
+static void GetRepresentationDescriptor(FragmentDescriptor *fragmentDescriptor, const char *manifestUrl, IMPD *mpd, IPeriod *period, IAdaptationSet *adaptationSet, IRepresentation *representation)
+{
+	memset(fragmentDescriptor, 0, sizeof(FragmentDescriptor));
+	fragmentDescriptor->manifestUrl = manifestUrl;
+	fragmentDescriptor->Bandwidth = representation->GetBandwidth();
+	fragmentDescriptor->baseUrls = &representation->GetBaseURLs();
+	if (fragmentDescriptor->baseUrls->size() == 0)
+	{
+		fragmentDescriptor->baseUrls = &adaptationSet->GetBaseURLs();
+		if (fragmentDescriptor->baseUrls->size() == 0)
+		{
+			fragmentDescriptor->baseUrls = &period->GetBaseURLs();
+			if (fragmentDescriptor->baseUrls->size() == 0)
+			{
+				fragmentDescriptor->baseUrls = &mpd->GetBaseUrls();
+			}
+		}
+	}
+	strncpy(fragmentDescriptor->RepresentationID, representation->GetId().c_str(), MAX_ID_SIZE - 1);
+}
+
+/**
+ * @brief Get duration of a period
+ *
+ * @param[in] mpd    MPD
+ * @param[in] period Period
+ *
+ * @retval Duration in milliseconds, from period or single period MPD, else from its segments
+ */
+static uint64_t GetPeriodDurationMs(IMPD *mpd, IPeriod *period)
+{
+	uint64_t periodDurationMs = 0;
+	if (!period->GetDuration().empty())
+	{
+		ParseISO8601Duration(period->GetDuration().c_str(), periodDurationMs);
+	}
+	else if (mpd->GetPeriods().size() == 1 && !mpd->GetMediaPresentationDuration().empty())
+	{
+		ParseISO8601Duration(mpd->GetMediaPresentationDuration().c_str(), periodDurationMs);
+	}
+	else
+	{
+		periodDurationMs = GetPeriodDuration(period);
+	}
+	return periodDurationMs;
+}
+
+/**
+ * @brief Get start of a period
+ *
+ * @param[in] mpd       MPD
+ * @param[in] periodIdx Index of period
+ *
+ * @retval Start in seconds, from Period@start, else from durations of preceding periods
+ */
+static double GetPeriodStartSeconds(IMPD *mpd, size_t periodIdx)
+{
+	uint64_t periodStartMs = 0;
+	for (size_t iPeriod = 0; iPeriod <= periodIdx; iPeriod++)
+	{
+		IPeriod *period = mpd->GetPeriods().at(iPeriod);
+		if (!period->GetStart().empty())
+		{
+			ParseISO8601Duration(period->GetStart().c_str(), periodStartMs);
+		}
+		if (iPeriod < periodIdx)
+		{
+			periodStartMs += GetPeriodDurationMs(mpd, period);
+		}
+	}
+	return (double)periodStartMs / 1000;
+}
+
+/**
+ * @brief Add thumbnails of a representation to thumbnail track
+ *
+ * Each segment is a sprite image of columns x rows tiles covering segment
+ * duration in row-major order.
+ *
+ * @param[in]     fragmentDescriptor Descriptor of representation
+ * @param[in]     segmentTemplate    Segment template of representation
+ * @param[in]     periodStart        Period start in seconds
+ * @param[in]     periodDuration     Period duration in seconds
+ * @param[in,out] track              Thumbnail track
+ */
+static void IndexThumbnailSegments(FragmentDescriptor *fragmentDescriptor, ISegmentTemplate *segmentTemplate, double periodStart, double periodDuration, ThumbnailTrack &track)
+{
+	uint32_t timeScale = segmentTemplate->GetTimescale();
+	if (!timeScale)
+	{
+		timeScale = 1;
+	}
+	std::string media = segmentTemplate->Getmedia();
+	int tileCount = track.info.tileColumns * track.info.tileRows;
+	std::vector<std::pair<uint64_t, uint64_t>> segments;
+	uint64_t firstTime = GetTemplateSegments(segmentTemplate, periodDuration, 0, segments);
+	fragmentDescriptor->Number = segmentTemplate->GetStartNumber();
+	for (size_t i = 0; i < segments.size(); i++, fragmentDescriptor->Number++)
+	{
+		std::string fragmentUrl;
+		fragmentDescriptor->Time = segments[i].first;
+		GetFragmentUrl(fragmentUrl, fragmentDescriptor, media);
+		ThumbnailInfo thumbnail;
+		thumbnail.url = fragmentUrl;
+		thumbnail.duration = ((double)segments[i].second / timeScale) / tileCount;
+		thumbnail.width = track.info.width;
+		thumbnail.height = track.info.height;
+		double segmentStart = periodStart + ((double)(segments[i].first - firstTime) / timeScale);
+		for (int tile = 0; tile < tileCount; tile++)
+		{
+			thumbnail.startTime = segmentStart + (tile * thumbnail.duration);
+			thumbnail.x = (tile % track.info.tileColumns) * track.info.width;
+			thumbnail.y = (tile / track.info.tileColumns) * track.info.height;
+			track.index.push_back(thumbnail);
+		}
+	}
+}
+
+/**
+ * @brief Register thumbnail tracks of static MPD
+ *
+ * Representations of image adaptation sets are registered, or the lowest
+ * bandwidth trick mode representation if there are none.
+ */
+void PrivateStreamAbstractionMPD::UpdateThumbnailTracks()
+{
+	std::vector<ThumbnailTrack> imageTracks;
+	ThumbnailTrack iframeTrack;
+	std::map<std::string, size_t> imageTrackIndex; // representation id to track
+	size_t numPeriods = mpd->GetPeriods().size();
+	uint64_t nextPeriodStartMs = 0;
+	for (unsigned iPeriod = 0; iPeriod < numPeriods; iPeriod++)
+	{
+		IPeriod *period = mpd->GetPeriods().at(iPeriod);
+		uint64_t periodStartMs = nextPeriodStartMs;
+		uint64_t periodDurationMs = GetPeriodDurationMs(mpd, period);
+		if (!period->GetStart().empty())
+		{
+			ParseISO8601Duration(period->GetStart().c_str(), periodStartMs);
+		}
+		nextPeriodStartMs = periodStartMs + periodDurationMs;
+
+		size_t numAdaptationSets = period->GetAdaptationSets().size();
+		for (int iAdaptationSet = 0; iAdaptationSet < numAdaptationSets; iAdaptationSet++)
+		{
+			IAdaptationSet *adaptationSet = period->GetAdaptationSets().at(iAdaptationSet);
+			bool isImage = IsImageTrack(adaptationSet);
+			if (!isImage && !(IsContentType(adaptationSet, eMEDIATYPE_VIDEO) && IsIframeTrack(adaptationSet)))
+			{
+				continue;
+			}
+			const std::vector<IRepresentation *> representations = adaptationSet->GetRepresentation();
+			for (size_t iRepresentation = 0; iRepresentation < representations.size(); iRepresentation++)
+			{
+				IRepresentation *representation = representations.at(iRepresentation);
+				ISegmentTemplate *segmentTemplate = representation->GetSegmentTemplate();
+				if (!segmentTemplate)
+				{
+					segmentTemplate = adaptationSet->GetSegmentTemplate();
+				}
+				if (!segmentTemplate)
+				{
+					continue;
+				}
+				ThumbnailTrack *track = NULL;
+				if (isImage)
+				{
+					std::map<std::string, size_t>::iterator it = imageTrackIndex.find(representation->GetId());
+					if (it == imageTrackIndex.end())
+					{
+						ThumbnailTrack newTrack;
+						newTrack.info.bandwidth = representation->GetBandwidth();
+						newTrack.info.tileColumns = 1;
+						newTrack.info.tileRows = 1;
+						if (!GetThumbnailTileLayout(representation->GetAdditionalSubNodes(), newTrack.info.tileColumns, newTrack.info.tileRows))
+						{
+							GetThumbnailTileLayout(adaptationSet->GetAdditionalSubNodes(), newTrack.info.tileColumns, newTrack.info.tileRows);
+						}
+						newTrack.info.width = representation->GetWidth() / newTrack.info.tileColumns;
+						newTrack.info.height = representation->GetHeight() / newTrack.info.tileRows;
+						newTrack.info.iframeTrack = false;
+						imageTrackIndex[representation->GetId()] = imageTracks.size();
+						imageTracks.push_back(newTrack);
+						it = imageTrackIndex.find(representation->GetId());
+					}
+					track = &imageTracks[it->second];
+				}
+				else if (iPeriod == 0 && (iframeTrack.index.empty() || representation->GetBandwidth() < iframeTrack.info.bandwidth))
+				{
+					iframeTrack.index.clear();
+					iframeTrack.info.bandwidth = representation->GetBandwidth();
+					iframeTrack.info.width = representation->GetWidth();
+					iframeTrack.info.height = representation->GetHeight();
+					iframeTrack.info.tileColumns = 1;
+					iframeTrack.info.tileRows = 1;
+					iframeTrack.info.iframeTrack = true;
+					track = &iframeTrack;
+				}
+				if (!track)
+				{
+					continue;
+				}
+				FragmentDescriptor fragmentDescriptor;
+				GetRepresentationDescriptor(&fragmentDescriptor, aamp->GetManifestUrl(), mpd, period, adaptationSet, representation);
+				if (track->info.iframeTrack && !segmentTemplate->Getinitialization().empty())
+				{
+					std::string initUrl;
+					GetFragmentUrl(initUrl, &fragmentDescriptor, segmentTemplate->Getinitialization());
+					track->info.initUrl = initUrl;
+				}
+				IndexThumbnailSegments(&fragmentDescriptor, segmentTemplate, (double)periodStartMs / 1000, (double)periodDurationMs / 1000, *track);
+			}
+		}
+	}
+	if (imageTracks.empty() && !iframeTrack.index.empty())
+	{
+		imageTracks.push_back(iframeTrack);
+	}
+	if (!imageTracks.empty())
+	{
+		aamp->SetThumbnailTracks(imageTracks);
+	}
+}
+
+/**
+ * @brief Add downloads of a representation to prefetch requests
+ *
+ * @param[in]  manifestUrl    Manifest URL
+ * @param[in]  mpd            MPD
+ * @param[in]  period         Period of representation
+ * @param[in]  adaptationSet  Adaptation set of representation
+ * @param[in]  representation Representation
+ * @param[in]  seconds        Seconds of media to add, 0 for init fragment only
+ * @param[out] requests       Prefetch requests
+ */
+static void AddRepresentationPrefetchRequests(const char *manifestUrl, IMPD *mpd, IPeriod *period, IAdaptationSet *adaptationSet, IRepresentation *representation, double seconds, std::vector<PrefetchRequest> &requests)
+{
+	ISegmentTemplate *segmentTemplate = representation->GetSegmentTemplate();
+	if (!segmentTemplate)
+	{
+		segmentTemplate = adaptationSet->GetSegmentTemplate();
+	}
+	if (!segmentTemplate)
+	{
+		return;
+	}
+	FragmentDescriptor fragmentDescriptor;
+	GetRepresentationDescriptor(&fragmentDescriptor, manifestUrl, mpd, period, adaptationSet, representation);
+	PrefetchRequest request;
+	std::string fragmentUrl;
+	request.isManifest = false;
+	request.bandwidth = representation->GetBandwidth();
+	if (!segmentTemplate->Getinitialization().empty())
+	{
+		GetFragmentUrl(fragmentUrl, &fragmentDescriptor, segmentTemplate->Getinitialization());
+		request.url = fragmentUrl;
+		requests.push_back(request);
+	}
+	if (seconds > 0)
+	{
+		std::vector<std::pair<uint64_t, uint64_t>> segments;
+		GetTemplateSegments(segmentTemplate, (double)GetPeriodDurationMs(mpd, period) / 1000, seconds, segments);
+		fragmentDescriptor.Number = segmentTemplate->GetStartNumber();
+		for (size_t i = 0; i < segments.size(); i++, fragmentDescriptor.Number++)
+		{
+			fragmentDescriptor.Time = segments[i].first;
+			GetFragmentUrl(fragmentUrl, &fragmentDescriptor, segmentTemplate->Getmedia());
+			request.url = fragmentUrl;
+			requests.push_back(request);
+		}
+	}
+}
+
+/**
+ * @brief List downloads needed to start playback of a period
+ *
+ * Init fragment and first seconds of media are listed for the video representation
+ * with highest bandwidth not above requested bandwidth and for the first audio
+ * representation, preferring given language. When the period is clear, init
+ * fragments pushed from the first protected period (PushEncryptedHeaders) are added.
+ *
+ * @param[in]  mpd         MPD
+ * @param[in]  periodIdx   Index of period
+ * @param[in]  manifestUrl Manifest URL
+ * @param[in]  bandwidth   Video bandwidth to match
+ * @param[in]  language    Preferred audio language
+ * @param[in]  seconds     Seconds of media to list
+ * @param[out] requests    Prefetch requests
+ */
+static void GetPeriodPrefetchRequests(IMPD *mpd, size_t periodIdx, const char *manifestUrl, long bandwidth, const char *language, double seconds, std::vector<PrefetchRequest> &requests)
+{
+	IPeriod *period = mpd->GetPeriods().at(periodIdx);
+	bool encrypted = false;
+	for (int i = eMEDIATYPE_VIDEO; i <= eMEDIATYPE_AUDIO; i++)
+	{
+		IAdaptationSet *selectedAdaptationSet = NULL;
+		size_t numAdaptationSets = period->GetAdaptationSets().size();
+		for (size_t iAdaptationSet = 0; iAdaptationSet < numAdaptationSets; iAdaptationSet++)
+		{
+			IAdaptationSet *adaptationSet = period->GetAdaptationSets().at(iAdaptationSet);
+			if (!IsContentType(adaptationSet, (MediaType)i) || adaptationSet->GetRepresentation().empty() || (eMEDIATYPE_VIDEO == i && IsIframeTrack(adaptationSet)))
+			{
+				continue;
+			}
+			if (!selectedAdaptationSet || (eMEDIATYPE_AUDIO == i && adaptationSet->GetLang() == language && selectedAdaptationSet->GetLang() != language))
+			{
+				selectedAdaptationSet = adaptationSet;
+			}
+		}
+		if (!selectedAdaptationSet)
+		{
+			continue;
+		}
+		if (0 != selectedAdaptationSet->GetContentProtection().size())
+		{
+			encrypted = true;
+		}
+		const std::vector<IRepresentation *> representations = selectedAdaptationSet->GetRepresentation();
+		IRepresentation *selectedRepresentation = representations.at(0);
+		if (eMEDIATYPE_VIDEO == i)
+		{
+			for (size_t iRepresentation = 1; iRepresentation < representations.size(); iRepresentation++)
+			{
+				long candidate = representations.at(iRepresentation)->GetBandwidth();
+				long selected = selectedRepresentation->GetBandwidth();
+				if ((candidate <= bandwidth) ? (selected > bandwidth || candidate > selected) : (selected > bandwidth && candidate < selected))
+				{
+					selectedRepresentation = representations.at(iRepresentation);
+				}
+			}
+		}
+		AddRepresentationPrefetchRequests(manifestUrl, mpd, period, selectedAdaptationSet, selectedRepresentation, seconds, requests);
+	}
+	if (!encrypted)
+	{
+		for (int i = eMEDIATYPE_VIDEO; i <= eMEDIATYPE_AUDIO; i++)
+		{
+			bool encryptionFound = false;
+			for (size_t iPeriod = 0; iPeriod < mpd->GetPeriods().size() && !encryptionFound; iPeriod++)
+			{
+				IPeriod *encryptedPeriod = mpd->GetPeriods().at(iPeriod);
+				size_t numAdaptationSets = encryptedPeriod->GetAdaptationSets().size();
+				for (size_t iAdaptationSet = 0; iAdaptationSet < numAdaptationSets && !encryptionFound; iAdaptationSet++)
+				{
+					IAdaptationSet *adaptationSet = encryptedPeriod->GetAdaptationSets().at(iAdaptationSet);
+					if (IsContentType(adaptationSet, (MediaType)i) && 0 != adaptationSet->GetContentProtection().size() && !adaptationSet->GetRepresentation().empty())
+					{
+						const std::vector<IRepresentation *> representations = adaptationSet->GetRepresentation();
+						IRepresentation *representation = representations.at(0);
+						if (eMEDIATYPE_VIDEO == i && representation->GetBandwidth() > representations.back()->GetBandwidth())
+						{
+							representation = representations.back();
+						}
+						AddRepresentationPrefetchRequests(manifestUrl, mpd, encryptedPeriod, adaptationSet, representation, 0, requests);
+						encryptionFound = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+
 /**
  * @brief Does stream selection
  *
@@ -3835,7 +4609,7 @@ static void GetBitrateInfoFromCustomMpd(IAdaptationSet *adaptationSet, std::vect
  */
 void PrivateStreamAbstractionMPD::UpdateTrackInfo(bool modifyDefaultBW, bool periodChanged, bool resetTimeLineIndex)
 {
-	long defaultBitrate = gpGlobalConfig->defaultBitrate;
+	long defaultBitrate = aamp->mInitialBitrate;
 	long iframeBitrate = gpGlobalConfig->iframeBitrate;
 	for (int i = 0; i < mNumberOfTracks; i++)
 	{
@@ -3908,7 +4682,7 @@ void PrivateStreamAbstractionMPD::UpdateTrackInfo(bool modifyDefaultBW, bool per
 						if(mStreamInfo[idx].resolution.height > 1080
 								|| mStreamInfo[idx].resolution.width > 1920)
 						{
-							defaultBitrate = gpGlobalConfig->defaultBitrate4K;
+							defaultBitrate = aamp->mInitialBitrate4K;
 							iframeBitrate = gpGlobalConfig->iframeBitrate4K;
 						}
 					}
@@ -3923,7 +4697,7 @@ void PrivateStreamAbstractionMPD::UpdateTrackInfo(bool modifyDefaultBW, bool per
 					}
 				}
 
-				if (defaultBitrate != gpGlobalConfig->defaultBitrate)
+				if (defaultBitrate != aamp->mInitialBitrate)
 				{
 					mContext->GetABRManager().setDefaultInitBitrate(defaultBitrate);
 				}
@@ -3978,6 +4752,7 @@ void PrivateStreamAbstractionMPD::UpdateTrackInfo(bool modifyDefaultBW, bool per
 				}
 			}
 			pMediaStreamContext->representation = pMediaStreamContext->adaptationSet->GetRepresentation().at(pMediaStreamContext->representationIndex);
+			pMediaStreamContext->codec = GetStreamFormat(pMediaStreamContext->adaptationSet, pMediaStreamContext->representation);
 
 			pMediaStreamContext->fragmentDescriptor.baseUrls = &pMediaStreamContext->representation->GetBaseURLs();
 			if (pMediaStreamContext->fragmentDescriptor.baseUrls->size() == 0)
@@ -4013,6 +4788,7 @@ void PrivateStreamAbstractionMPD::UpdateTrackInfo(bool modifyDefaultBW, bool per
 			if(segmentTemplate)
 			{
 				pMediaStreamContext->fragmentDescriptor.Number = segmentTemplate->GetStartNumber();
+				pMediaStreamContext->timeScale = segmentTemplate->GetTimescale();
 				AAMPLOG_INFO("PrivateStreamAbstractionMPD::%s:%d Track %d timeLineIndex %d fragmentDescriptor.Number %lu\n", __FUNCTION__, __LINE__, i, pMediaStreamContext->timeLineIndex, pMediaStreamContext->fragmentDescriptor.Number);
 			}
 		}
@@ -4325,14 +5101,14 @@ void PrivateStreamAbstractionMPD::FetchAndInjectInitialization(bool discontinuit
 #ifdef DEBUG_TIMELINE
 							logprintf("init %s %d..%d\n", mMediaTypeName[pMediaStreamContext->mediaType], start, fin);
 #endif
-							char fragmentUrl[MAX_URI_LENGTH];
+							std::string fragmentUrl;
 							GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor, "");
 							if(pMediaStreamContext->WaitForFreeFragmentAvailable(0))
 							{
 								pMediaStreamContext->profileChanged = false;
-								if(!pMediaStreamContext->CacheFragment(fragmentUrl, 0, pMediaStreamContext->fragmentTime, 0, range.c_str(), true ))
+								if(!pMediaStreamContext->CacheFragment(fragmentUrl.c_str(), 0, pMediaStreamContext->fragmentTime, 0, range.c_str(), true ))
 								{
-									logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl, pMediaStreamContext->fragmentTime);
+									logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl.c_str(), pMediaStreamContext->fragmentTime);
 								}
 							}
 						}
@@ -4347,14 +5123,14 @@ void PrivateStreamAbstractionMPD::FetchAndInjectInitialization(bool discontinuit
 								char range[10];
 								snprintf(range, 9, "%d-%d", start, stop);
 								range[9] = '\0';
-								char fragmentUrl[MAX_URI_LENGTH];
+								std::string fragmentUrl;
 								GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor, "");
 								if(pMediaStreamContext->WaitForFreeFragmentAvailable(0))
 								{
 									pMediaStreamContext->profileChanged = false;
-									if(!pMediaStreamContext->CacheFragment(fragmentUrl, 0, pMediaStreamContext->fragmentTime, 0, range, true ))
+									if(!pMediaStreamContext->CacheFragment(fragmentUrl.c_str(), 0, pMediaStreamContext->fragmentTime, 0, range, true ))
 									{
-										logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl, pMediaStreamContext->fragmentTime);
+										logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl.c_str(), pMediaStreamContext->fragmentTime);
 									}
 								}
 							}
@@ -4444,16 +5220,16 @@ void PrivateStreamAbstractionMPD::FetchAndInjectInitialization(bool discontinuit
 #endif
 								if (!range.empty())
 								{
-									char fragmentUrl[MAX_URI_LENGTH];
+									std::string fragmentUrl;
 									GetFragmentUrl(fragmentUrl, &pMediaStreamContext->fragmentDescriptor, "");
 									AAMPLOG_INFO("%s [%s]\n", mMediaTypeName[pMediaStreamContext->mediaType],
 											range.c_str());
 									if(pMediaStreamContext->WaitForFreeFragmentAvailable(0))
 									{
 										pMediaStreamContext->profileChanged = false;
-										if(!pMediaStreamContext->CacheFragment(fragmentUrl, 0, pMediaStreamContext->fragmentTime, 0.0, range.c_str(), true ))
+										if(!pMediaStreamContext->CacheFragment(fragmentUrl.c_str(), 0, pMediaStreamContext->fragmentTime, 0.0, range.c_str(), true ))
 										{
-											logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl, pMediaStreamContext->fragmentTime);
+											logprintf("PrivateStreamAbstractionMPD::%s:%d failed. fragmentUrl %s fragmentTime %f\n", __FUNCTION__, __LINE__, fragmentUrl.c_str(), pMediaStreamContext->fragmentTime);
 										}
 									}
 								}
@@ -4544,7 +5320,7 @@ void PrivateStreamAbstractionMPD::PushEncryptedHeaders()
 							std::string initialization = segmentTemplate->Getinitialization();
 							if (!initialization.empty())
 							{
-								char fragmentUrl[MAX_URI_LENGTH];
+								std::string fragmentUrl;
 								struct FragmentDescriptor * fragmentDescriptor = (struct FragmentDescriptor *) malloc(sizeof(struct FragmentDescriptor));
 								memset(fragmentDescriptor, 0, sizeof(FragmentDescriptor));
 								fragmentDescriptor->manifestUrl = mMediaStreamContext[eMEDIATYPE_VIDEO]->fragmentDescriptor.manifestUrl;
@@ -4593,7 +5369,7 @@ void PrivateStreamAbstractionMPD::PushEncryptedHeaders()
 								if (mMediaStreamContext[i]->WaitForFreeFragmentAvailable())
 								{
 									logprintf("%s %d Pushing encrypted header for %s\n", __FUNCTION__, __LINE__, mMediaTypeName[i]);
-									mMediaStreamContext[i]->CacheFragment(fragmentUrl, i, mMediaStreamContext[i]->fragmentTime, 0.0, NULL, true);
+									mMediaStreamContext[i]->CacheFragment(fragmentUrl.c_str(), i, mMediaStreamContext[i]->fragmentTime, 0.0, NULL, true);
 								}
 								free(fragmentDescriptor);
 								encryptionFound = true;
@@ -4649,6 +5425,8 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 					bool discontinuity = false;
 					bool requireStreamSelection = false;
 					uint64_t nextSegmentTime = mMediaStreamContext[eMEDIATYPE_VIDEO]->fragmentDescriptor.Time;
+					// timescale of the period nextSegmentTime belongs to, before tracks move to the new one
+					uint32_t nextSegmentTimeScale = mMediaStreamContext[eMEDIATYPE_VIDEO]->timeScale;
 					mpdChanged = false;
 					if (periodChanged)
 					{
@@ -4701,6 +5479,11 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 						}
 					}
 
+					std::string prevCodec[AAMP_TRACK_COUNT];
+					for (int i = 0; i < mNumberOfTracks; i++)
+					{
+						prevCodec[i] = mMediaStreamContext[i]->codec;
+					}
 					if(requireStreamSelection)
 					{
 						StreamSelection();
@@ -4735,6 +5518,21 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 								logprintf("PrivateStreamAbstractionMPD::%s:%d discontinuity detected nextSegmentTime %" PRIu64 " FirstSegmentStartTime %" PRIu64 " \n", __FUNCTION__, __LINE__, nextSegmentTime, segmentStartTime);
 								discontinuity = true;
 								mFirstPTS = (double)segmentStartTime/segmentTemplate->GetTimescale();
+								// same codecs need no decoder reconfiguration, new timeline continues where previous one ended
+								bool codecCompatible = true;
+								for (int i = 0; i < mNumberOfTracks; i++)
+								{
+									if (mMediaStreamContext[i]->enabled && (prevCodec[i] != mMediaStreamContext[i]->codec))
+									{
+										logprintf("PrivateStreamAbstractionMPD::%s:%d track %d format changed from %s to %s\n", __FUNCTION__, __LINE__, i, prevCodec[i].c_str(), mMediaStreamContext[i]->codec.c_str());
+										codecCompatible = false;
+									}
+								}
+								for (int i = 0; i < mNumberOfTracks; i++)
+								{
+									mMediaStreamContext[i]->continuousTimeline = codecCompatible;
+									mMediaStreamContext[i]->discontinuityPts = (double)nextSegmentTime/(nextSegmentTimeScale ? nextSegmentTimeScale : segmentTemplate->GetTimescale());
+								}
 							}
 							else
 							{
@@ -4753,6 +5551,24 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 					}
 				}
 
+				// fetch init and first fragments of next period ahead of splice, e.g. DAI ad period
+				if (rate == AAMP_NORMAL_PLAY_RATE && (iPeriod + 1) < numPeriods && gpGlobalConfig->adPrefetchSeconds > 0)
+				{
+					IPeriod *nextPeriod = mpd->GetPeriods().at(iPeriod + 1);
+					std::string nextPeriodId = nextPeriod->GetId().empty() ? std::to_string(iPeriod + 1) : nextPeriod->GetId();
+					if (nextPeriodId != mPrefetchedPeriodId && nextPeriod->GetAdaptationSets().size() > 0)
+					{
+						std::vector<PrefetchRequest> requests;
+						mPrefetchedPeriodId = nextPeriodId;
+						GetPeriodPrefetchRequests(mpd, iPeriod + 1, mMediaStreamContext[eMEDIATYPE_VIDEO]->fragmentDescriptor.manifestUrl,
+								mMediaStreamContext[eMEDIATYPE_VIDEO]->fragmentDescriptor.Bandwidth, aamp->language, gpGlobalConfig->adPrefetchSeconds, requests);
+						// splice position is known for static MPD only, where play position counts from presentation start
+						double splicePosition = mIsLive ? -1 : GetPeriodStartSeconds(mpd, iPeriod + 1);
+						logprintf("PrivateStreamAbstractionMPD::%s:%d prefetch period %s downloads %d splice %f\n", __FUNCTION__, __LINE__, nextPeriodId.c_str(), (int)requests.size(), splicePosition);
+						aamp->SchedulePrefetch(requests, splicePosition);
+					}
+				}
+
 				// playback
 				while (!exitFetchLoop && !liveMPDRefresh)
 				{
@@ -4762,7 +5578,7 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 						struct MediaStreamContext *pMediaStreamContext = mMediaStreamContext[i];
 						if (pMediaStreamContext->adaptationSet )
 						{
-							if((pMediaStreamContext->numberOfFragmentsCached != gpGlobalConfig->maxCachedFragmentsPerTrack) && !(pMediaStreamContext->profileChanged))
+							if((pMediaStreamContext->numberOfFragmentsCached != pMediaStreamContext->maxCachedFragmentsPerTrack) && !(pMediaStreamContext->profileChanged))
 							{	// profile not changed and Cache not full scenario
 								if (!pMediaStreamContext->eos)
 								{
@@ -4770,7 +5586,7 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 									{
 										if((rate > 0 && delta <= 0) || (rate < 0 && delta >= 0))
 										{
-											delta = rate / gpGlobalConfig->vodTrickplayFPS;
+											delta = rate / aamp->mVODTrickplayFPS;
 										}
 										delta = SkipFragments(pMediaStreamContext, delta);
 									}
@@ -4807,7 +5623,7 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 								FetchAndInjectInitialization();
 							}
 
-							if(pMediaStreamContext->numberOfFragmentsCached != gpGlobalConfig->maxCachedFragmentsPerTrack)
+							if(pMediaStreamContext->numberOfFragmentsCached != pMediaStreamContext->maxCachedFragmentsPerTrack)
 							{
 								bCacheFullState = false;
 							}
@@ -5006,6 +5822,10 @@ void PrivateStreamAbstractionMPD::FetcherLoop()
 		{
 			break;
 		}
+		if (mManifestUnchanged)
+		{
+			continue;
+		}
 
 		if(mIsFogTSB)
 		{
@@ -5515,6 +6335,48 @@ void PrivateStreamAbstractionMPD::StartInjection(void)
 	}
 }
 
+
+/**
+ * @brief List downloads needed to start playback of an MPD, used to prefetch ads
+ *
+ * @param[in]  manifest    MPD document
+ * @param[in]  len         Length of document
+ * @param[in]  manifestUrl Effective URL of MPD
+ * @param[in]  bandwidth   Video bandwidth to match
+ * @param[in]  language    Preferred audio language
+ * @param[in]  seconds     Seconds of media to list
+ * @param[out] requests    Prefetch requests
+ */
+void StreamAbstractionAAMP_MPD::GetPrefetchRequests(const char *manifest, size_t len, const char *manifestUrl, long bandwidth, const char *language, double seconds, std::vector<PrefetchRequest> &requests)
+{
+	xmlTextReaderPtr reader = xmlReaderForMemory(manifest, (int) len, NULL, NULL, 0);
+	if (reader != NULL)
+	{
+		if (xmlTextReaderRead(reader))
+		{
+			Node *root = ProcessNode(&reader, (char *)manifestUrl);
+			if (root != NULL)
+			{
+				MPD *mpd = root->ToMPD();
+				if (mpd)
+				{
+					for (size_t iPeriod = 0; iPeriod < mpd->GetPeriods().size(); iPeriod++)
+					{
+						if (mpd->GetPeriods().at(iPeriod)->GetAdaptationSets().size() > 0)
+						{
+							GetPeriodPrefetchRequests(mpd, iPeriod, manifestUrl, bandwidth, language, seconds, requests);
+							break;
+						}
+					}
+					delete mpd;
+				}
+				delete root;
+			}
+		}
+		xmlFreeTextReader(reader);
+	}
+}
+
 /**
  * @}
  */
@@ -31,6 +31,17 @@
  * @{
  */
 
+/**
+ * @struct TimelineEntry
+ * @brief S element of a SegmentTimeline
+ */
+struct TimelineEntry
+{
+	uint64_t startTime;   /**< S@t in timescale units, 0 if absent */
+	uint64_t duration;    /**< S@d in timescale units */
+	uint32_t repeatCount; /**< S@r, negative (-1) read as UINT32_MAX repeats till next S@t or period end */
+};
+
 /**
  * @class StreamAbstractionAAMP_MPD
  * @brief Fragment collector for MPEG DASH
@@ -54,6 +65,8 @@ public:
 	std::vector<long> GetAudioBitrates(void);
 	void StopInjection(void);
 	void StartInjection(void);
+	static void GetPrefetchRequests(const char *manifest, size_t len, const char *manifestUrl, long bandwidth, const char *language, double seconds, std::vector<PrefetchRequest> &requests);
+	static uint64_t GetTimelineSegments(const std::vector<TimelineEntry> &timeline, uint64_t periodDuration, uint64_t maxTime, std::vector<std::pair<uint64_t, uint64_t>> &segments);
 protected:
 	StreamInfo* GetStreamInfo(int idx);
 private:
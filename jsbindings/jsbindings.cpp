@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <float.h>
 #include <pthread.h>
 
 #include "jsutils.h"
@@ -411,13 +412,14 @@ static JSValueRef AAMP_getProperty_timedMetadata(JSContextRef context, JSObjectR
 		return JSValueMakeUndefined(context);
 	}
 
-	int32_t length = privAAMP->timedMetadata.size();
+	std::vector<TimedMetadataInfo> cues;
+	privAAMP->GetTimedMetadata(-DBL_MAX, DBL_MAX, cues);
+	int32_t length = cues.size();
 
 	JSValueRef* array = new JSValueRef[length];
 	for (int32_t i = 0; i < length; i++)
 	{
-		TimedMetadata item = privAAMP->timedMetadata.at(i);
-		JSObjectRef ref = AAMP_JS_CreateTimedMetadata(context, item._timeMS, item._name.c_str(), item._content.c_str());
+		JSObjectRef ref = AAMP_JS_CreateTimedMetadata(context, cues[i].timeMilliseconds, cues[i].name.c_str(), cues[i].content.c_str());
 		array[i] = ref;
 	}
 
@@ -48,6 +48,9 @@
 #include <algorithm>
 #include <vector>
 #include <list>
+#ifdef AAMP_HARVEST_COMPRESSION
+#include <zlib.h>
+#endif
 #ifdef AAMP_CC_ENABLED
 #include "ccDataReader.h"
 #include "vlCCConstants.h"
@@ -162,7 +165,6 @@ GlobalConfigAAMP *gpGlobalConfig;
 
 #define LOCAL_HOST_IP       "127.0.0.1"
 #define STR_PROXY_BUFF_SIZE  64
-#define AAMP_MAX_SIMULTANEOUS_INSTANCES 2
 #define AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS (20*1000LL)
 
 #define VALIDATE_INT(param_name, param_value, default_value)        \
@@ -177,16 +179,6 @@ GlobalConfigAAMP *gpGlobalConfig;
         param_value = default_value; \
     }
 
-static struct
-{
-	PrivateInstanceAAMP* pAAMP;
-	bool reTune;
-	int numPtsErrors;
-} gActivePrivAAMPs[AAMP_MAX_SIMULTANEOUS_INSTANCES] = { { NULL, false, 0 }, { NULL, false, 0 } };
-
-static pthread_mutex_t gMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t gCond = PTHREAD_COND_INITIALIZER;
-
 /**
  * @}
  */
@@ -368,6 +360,12 @@ else
 				// would likely be more accurate, but would need to be tested to accomodate
 				// and compensate for FF/REW play rates
 			}
+			CheckForAdPrefetch(eventData.data.progress.positionMiliseconds);
+			EvictPrefetchCache(eventData.data.progress.positionMiliseconds);
+			if (mpStreamAbstractionAAMP)
+			{ // catch tracks that ran dry without fetch or inject events
+				mpStreamAbstractionAAMP->UpdateBufferHealth();
+			}
 		}
 		else
 		{
@@ -723,7 +721,7 @@ void PrivateInstanceAAMP::SendErrorEvent(AAMPTuneFailure tuneFailure, const char
 		{
 			if (tuneFailure == AAMP_TUNE_PLAYBACK_STALLED)
 			{ // allow config override for stall detection error code
-				e.data.mediaError.code = gpGlobalConfig->stallErrorCode;
+				e.data.mediaError.code = mStallErrorCode;
 			}
 			else
 			{
@@ -1364,7 +1362,7 @@ void PrivateInstanceAAMP::BlockUntilGstreamerWantsData(void(*cb)(void), int peri
 	int elapsedMs = 0;
 	while (mbDownloadsBlocked || mbTrackDownloadsBlocked[track])
 	{
-		if (!mDownloadsEnabled)
+		if (!mDownloadsEnabled || mbSeekInBuffer)
 		{
 			logprintf("PrivateInstanceAAMP::%s interrupted\n", __FUNCTION__);
 			break;
@@ -1450,6 +1448,9 @@ struct CurlCallbackContext
 	PrivateInstanceAAMP *aamp;
 	GrowableBuffer *buffer;
 	httpRespHeaderData *responseHeaderData;
+	HttpValidators *validators;     /**< Validators of conditional download, NULL if not conditional */
+	std::string etag;               /**< ETag of response, when conditional */
+	std::string lastModified;       /**< Last-Modified of response, when conditional */
 };
 
 /**
@@ -1492,6 +1493,42 @@ static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdat
 
 #define FOG_REASON_STRING           "Fog-Reason:"
 
+/**
+ * @brief Get value of http header line if it has given name, case insensitive
+ * @param[in] header header line
+ * @param[in] name header name including ':'
+ * @param[out] value header value without surrounding white space
+ * @retval true if header has the name
+ */
+static bool GetHeaderValue(const std::string &header, const char *name, std::string &value)
+{
+	size_t nameLen = strlen(name);
+	if (header.length() < nameLen || 0 != strncasecmp(header.c_str(), name, nameLen))
+	{
+		return false;
+	}
+	size_t start = header.find_first_not_of(" \t", nameLen);
+	size_t end = header.find_last_not_of(" \t\r\n");
+	value = (start == std::string::npos || end < start) ? std::string() : header.substr(start, end - start + 1);
+	return true;
+}
+
+/**
+ * @brief FNV-1a hash of downloaded body, to detect unchanged manifests
+ * @param[in] ptr body
+ * @param[in] len length of body
+ * @retval hash
+ */
+static size_t aamp_HashBody(const char *ptr, size_t len)
+{
+	size_t hash = (size_t)2166136261U;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ (unsigned char)ptr[i]) * 16777619U;
+	}
+	return hash;
+}
+
 /**
  * @brief callback invoked on http header by curl
  * @param ptr pointer to buffer containing the data
@@ -1531,6 +1568,10 @@ static size_t header_callback(void *ptr, size_t size, size_t nmemb, void *user_d
 		startPos = header.find("Set-Cookie:") + strlen("Set-Cookie:");
 		endPos = header.length() - 1;
 	}
+	else if (context->validators && (GetHeaderValue(header, "ETag:", context->etag) || GetHeaderValue(header, "Last-Modified:", context->lastModified)))
+	{
+		traceprintf("%s:%d %s", __FUNCTION__, __LINE__, header.c_str());
+	}
 	else if (0 == context->buffer->avail)
 	{
 		size_t headerStart = header.find("Content-Length:");
@@ -1978,17 +2019,44 @@ const char* PrivateInstanceAAMP::MediaTypeString(MediaType fileType)
  *
  * @retval true if success
  */
-bool PrivateInstanceAAMP::GetFile(const char *remoteUrl2, struct GrowableBuffer *buffer, char effectiveUrl[MAX_URI_LENGTH], long * http_error, const char *range, unsigned int curlInstance, bool resetBuffer, MediaType fileType)
+bool PrivateInstanceAAMP::GetFile(const char *remoteUrl, struct GrowableBuffer *buffer, char effectiveUrl[MAX_URI_LENGTH], long * http_error, const char *range, unsigned int curlInstance, bool resetBuffer, MediaType fileType, HttpValidators *validators)
+{
+	std::string url;
+	bool ret = GetFile(remoteUrl, buffer, url, http_error, range, curlInstance, resetBuffer, fileType, validators);
+	if (!url.empty())
+	{
+		strncpy(effectiveUrl, url.c_str(), MAX_URI_LENGTH-1);
+		effectiveUrl[MAX_URI_LENGTH-1] = '\0';
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Fetch a file from CDN, without limit on length of effective URL
+ *
+ * @param[in]  remoteUrl2    URL of the file
+ * @param[out] buffer        Pointer to buffer abstraction
+ * @param[out] effectiveUrl  Last effective URL
+ * @param[in]  http_error    Error code in case of failure
+ * @param[in]  range         Http range
+ * @param[in]  curlInstance  Instance to be used to fetch
+ * @param[in]  resetBuffer   True to reset buffer before fetch
+ * @param[in]  fileType      Media type of the file
+ * @param[in,out] validators Validators of last download of the URL. When set, request is
+ *                           conditional and validators are updated from the response
+ *
+ * @retval true if success
+ */
+bool PrivateInstanceAAMP::GetFile(const char *remoteUrl2, struct GrowableBuffer *buffer, std::string &effectiveUrl, long * http_error, const char *range, unsigned int curlInstance, bool resetBuffer, MediaType fileType, HttpValidators *validators)
 {
 //WMR CHANGE
-char remoteUrl[2048];
-size_t remoteUrlLen = strlen(remoteUrl2);
-for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
+std::string remoteUrlString = remoteUrl2;
+if (remoteUrlString.compare(0, 5, "https") == 0)
 {
-	if(i == 4 && remoteUrl2[4] == 's')
-    		i++;
-	remoteUrl[j] = remoteUrl2[i];
+	remoteUrlString.erase(4, 1);
 }
+const char *remoteUrl = remoteUrlString.c_str();
 	long http_code = -1;
 	bool ret = false;
 	int downloadAttempt = 0;
@@ -1998,6 +2066,12 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 
 	// temporarily increase timeout for manifest download - these files (especially for VOD) can be large and slow to download
 	bool modifyDownloadTimeout = (!mIsLocalPlayback && fileType == eMEDIATYPE_MANIFEST);
+	// validators apply only to the URL they were received for
+	bool conditional = (validators && validators->url == remoteUrl2);
+	if (validators)
+	{
+		validators->notModified = false;
+	}
 
 	pthread_mutex_lock(&mLock);
 	if (resetBuffer)
@@ -2008,6 +2082,16 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
         	}	
 		memset(buffer, 0x00, sizeof(*buffer));
 	}
+	if (mDownloadsEnabled && !mPrefetchCache.empty() && RetrieveFromPrefetchCache(remoteUrl2, range, buffer, effectiveUrl))
+	{
+		pthread_mutex_unlock(&mLock);
+		AAMPLOG_INFO("aamp url: %s from prefetch cache\n", remoteUrl2);
+		if (http_error)
+		{
+			*http_error = 200;
+		}
+		return true;
+	}
 	if (mDownloadsEnabled)
 	{
 		long long downloadTimeMS = 0;
@@ -2022,6 +2106,7 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 			context.aamp = this;
 			context.buffer = buffer;
 			context.responseHeaderData = &httpRespHeaders[curlInstance];
+			context.validators = validators;
 			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
 			curl_easy_setopt(curl, CURLOPT_HEADERDATA, &context);
 			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
@@ -2079,10 +2164,18 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 					customHeader.append(headerValue);
 					httpHeaders = curl_slist_append(httpHeaders, customHeader.c_str());
 				}
-				if (httpHeaders != NULL)
-				{
-					curl_easy_setopt(curl, CURLOPT_HTTPHEADER, httpHeaders);
-				}
+			}
+			if (conditional && !validators->etag.empty())
+			{
+				httpHeaders = curl_slist_append(httpHeaders, ("If-None-Match: " + validators->etag).c_str());
+			}
+			if (conditional && !validators->lastModified.empty())
+			{
+				httpHeaders = curl_slist_append(httpHeaders, ("If-Modified-Since: " + validators->lastModified).c_str());
+			}
+			if (httpHeaders != NULL)
+			{
+				curl_easy_setopt(curl, CURLOPT_HTTPHEADER, httpHeaders);
 			}
 
 			while(downloadAttempt < 2)
@@ -2094,6 +2187,8 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 				}
 
 				isCurlLowSpeedTimedout = false;
+				context.etag.clear();
+				context.lastModified.clear();
 
 				long long tStartTime = NOW_STEADY_TS_MS;
 				CURLcode res = curl_easy_perform(curl); // synchronous; callbacks allow interruption
@@ -2105,7 +2200,7 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 				if (res == CURLE_OK)
 				{ // all data collected
 					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-					if (http_code != 200 && http_code != 206)
+					if (http_code != 200 && http_code != 206 && !(http_code == 304 && conditional))
 					{
 #if 0 /* Commented since the same is supported via AAMP_LOG_NETWORK_ERROR */
 						logprintf("HTTP RESPONSE CODE: %ld\n", http_code);
@@ -2120,18 +2215,20 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 					}
 					char *effectiveUrlPtr = NULL;
 					res = curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrlPtr);
-					strncpy(effectiveUrl, effectiveUrlPtr, MAX_URI_LENGTH-1);
-					effectiveUrl[MAX_URI_LENGTH-1] = '\0';
+					if (effectiveUrlPtr)
+					{
+						effectiveUrl = effectiveUrlPtr;
+					}
 
 					// check if redirected url is pointing to fog / local ip
 					if(mIsFirstRequestToFOG)
 					{
-					    if( strstr(effectiveUrl,LOCAL_HOST_IP) == NULL )
+					    if( strstr(effectiveUrl.c_str(),LOCAL_HOST_IP) == NULL )
 					    {
 					        // oops, TSB is not working, we got redirected away from fog
 					        mIsLocalPlayback = false;
 					        mTSBEnabled = false;
-					        logprintf("NO_TSB_AVAILABLE playing from:%s \n", effectiveUrl);
+					        logprintf("NO_TSB_AVAILABLE playing from:%s \n", effectiveUrl.c_str());
 					    }
 					}
 
@@ -2141,12 +2238,12 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 					 */
 					if (downloadTimeMS > FRAGMENT_DOWNLOAD_WARNING_THRESHOLD )
 					{
-						AAMP_LOG_NETWORK_LATENCY (effectiveUrl, downloadTimeMS, FRAGMENT_DOWNLOAD_WARNING_THRESHOLD );
+						AAMP_LOG_NETWORK_LATENCY (effectiveUrl.c_str(), downloadTimeMS, FRAGMENT_DOWNLOAD_WARNING_THRESHOLD );
 					}
 				}
 				else
 				{
-					long curlDownloadTimeout = modifyDownloadTimeout ? CURL_MANIFEST_DL_TIMEOUT : gpGlobalConfig->fragmentDLTimeout;
+					long curlDownloadTimeout = modifyDownloadTimeout ? CURL_MANIFEST_DL_TIMEOUT : mNetworkTimeout;
 					//use a delta of 100ms for edge cases
 					isCurlLowSpeedTimedout = ((res == CURLE_OPERATION_TIMEDOUT || res == CURLE_PARTIAL_FILE) &&
 													(buffer->len >= 0) &&
@@ -2216,7 +2313,23 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 
 			if (modifyDownloadTimeout)
 			{
-				curl_easy_setopt(curl, CURLOPT_TIMEOUT, gpGlobalConfig->fragmentDLTimeout);
+				curl_easy_setopt(curl, CURLOPT_TIMEOUT, mNetworkTimeout);
+			}
+			if (validators)
+			{
+				if (http_code == 200)
+				{
+					size_t bodyHash = aamp_HashBody(buffer->ptr, buffer->len);
+					validators->notModified = (conditional && bodyHash == validators->bodyHash);
+					validators->url = remoteUrl2;
+					validators->etag = context.etag;
+					validators->lastModified = context.lastModified;
+					validators->bodyHash = bodyHash;
+				}
+				else if (http_code == 304 && conditional)
+				{
+					validators->notModified = true;
+				}
 			}
 		}
 
@@ -2237,7 +2350,17 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 				}
 			}
 		}
-		if (http_code == 200 || http_code == 206)
+		if (validators && validators->notModified)
+		{ // caller keeps its copy, no need to deliver or check body
+			AAMPLOG_INFO("aamp url: %s not modified, http_code %ld\n", remoteUrl, http_code);
+			if (buffer->ptr)
+			{
+				aamp_Free(&buffer->ptr);
+			}
+			memset(buffer, 0x00, sizeof(*buffer));
+			ret = true;
+		}
+		else if (http_code == 200 || http_code == 206)
 		{
 #ifdef SAVE_DOWNLOADS_TO_DISK
 			const char *fname = remoteUrl;
@@ -2342,6 +2465,10 @@ for(size_t i = 0, j = 0; i < remoteUrlLen+1; i++, j++)
 	}
 	if (httpHeaders != NULL)
 	{
+		if (conditional)
+		{ // next request may not set headers, so don't leave freed list on handle
+			curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+		}
 		curl_slist_free_all(httpHeaders);
 	}
 	if (mIsFirstRequestToFOG)
@@ -2505,56 +2632,86 @@ static void ParseISO8601(struct DateTime *datetime, const char *ptr)
 
 
 /**
- * @brief Resolve URL from base and uri
+ * @brief Create file URL from the base and file path
  *
- * @param[out] dst   Destination buffer
- * @param[in]  base  Base URL
- * @param[in]  uri   Manifest/ fragment uri
+ * @param[out] dst Created URL
+ * @param[in] base Base URL
+ * @param[in] uri File path
  */
-void aamp_ResolveURL(char *dst, const char *base, const char *uri)
+void aamp_ResolveURL(std::string &dst, const char *base, const char *uri)
 {
-	if (memcmp(uri, "http://", 7) != 0 && memcmp(uri, "https://", 8) != 0) // explicit endpoint - needed for DAI playlist
+	if (strncmp(uri, "http://", 7) != 0 && strncmp(uri, "https://", 8) != 0) // explicit endpoint - needed for DAI playlist
 	{
-		strcpy(dst, base);
-
+		const char *end;
 		if (uri[0] == '/')
 		{ // absolute path; preserve only endpoint http://<endpoint>:<port>/
-			dst = strstr(dst, "://");
-			assert(dst);
-			if (dst)
-			{
-				dst = strchr(dst + 3, '/');
-			}
+			end = strstr(base, "://");
+			assert(end);
+			end = end ? strchr(end + 3, '/') : NULL;
 		}
 		else
 		{ // relative path; include base directory
-			dst = strchr(dst, '/');
-			assert(dst);
-			for (;;)
-			{
-				char *next = strchr(dst + 1, '/');
-				if (!next)
-				{
-					break;
-				}
-				dst = next;
-			}
-			dst++;
+			end = strrchr(base, '/');
+			assert(end);
+			end = end ? end + 1 : NULL;
 		}
-
-		strcpy(dst, uri);
+		if (end)
+		{
+			dst.assign(base, end - base);
+		}
+		else
+		{
+			dst = base;
+		}
+		dst += uri;
 
 		if (strchr(uri, '?') == 0)//if uri doesn't already have url parameters, then copy from the parents(if they exist)
 		{
 			const char* params = strchr(base, '?');
 			if (params)
-				strcat(dst, params);
+				dst += params;
 		}
 	}
 	else
-		strcpy(dst, uri);
+		dst = uri;
+}
+
+
+/**
+ * @brief AampUrl Constructor
+ *
+ * @param[in] base Shared base URL, not referred to when uri is absolute
+ * @param[in] uri File path relative to base, or absolute URL
+ */
+AampUrl::AampUrl(const std::shared_ptr<const std::string> &base, const char *uri) : mBase(), mRelative(uri)
+{
+	if (strncmp(uri, "http://", 7) != 0 && strncmp(uri, "https://", 8) != 0)
+	{
+		mBase = base;
+	}
+}
+
+
+/**
+ * @brief Get resolved URL
+ *
+ * @retval URL
+ */
+std::string AampUrl::Resolve() const
+{
+	std::string url;
+	if (mBase)
+	{
+		aamp_ResolveURL(url, mBase->c_str(), mRelative.c_str());
+	}
+	else
+	{
+		url = mRelative;
+	}
+	return url;
 }
 
+
 /**
  * @brief
  * @param url
@@ -2746,6 +2903,23 @@ static void ProcessConfigEntry(char *cfg)
 		{
 			logprintf("harvest=%d\n", gpGlobalConfig->harvest);
 		}
+		else if (sscanf(cfg, "harvest-queue-size=%d", &gpGlobalConfig->harvestQueueSize) == 1)
+		{ // default 16 MB, files harvested while queue is full are dropped
+			VALIDATE_INT("harvest-queue-size", gpGlobalConfig->harvestQueueSize, DEFAULT_HARVEST_QUEUE_SIZE);
+			logprintf("harvest-queue-size=%d\n", gpGlobalConfig->harvestQueueSize);
+		}
+		else if (sscanf(cfg, "harvest-compress=%d", &value) == 1)
+		{
+			gpGlobalConfig->harvestCompress = (value != 0);
+#ifndef AAMP_HARVEST_COMPRESSION
+			if (gpGlobalConfig->harvestCompress)
+			{
+				logprintf("harvest-compress needs build with AAMP_HARVEST_COMPRESSION, ignored\n");
+				gpGlobalConfig->harvestCompress = false;
+			}
+#endif
+			logprintf("harvest-compress=%d\n", value);
+		}
 #endif
 		else if (sscanf(cfg, "forceEC3=%d", &gpGlobalConfig->forceEC3) == 1)
 		{
@@ -2916,6 +3090,63 @@ static void ProcessConfigEntry(char *cfg)
 		{ // default 0, set to 1 to send audio es before video in case of s/w demux.
 			logprintf("demuxed-audio-before-video=%d\n", gpGlobalConfig->demuxedAudioBeforeVideo);
 		}
+		else if (sscanf(cfg, "demux-pipeline=%d", &gpGlobalConfig->demuxPipeline) == 1)
+		{ // default 0, set to 1 to inject demuxed es from per track sender threads
+			logprintf("demux-pipeline=%d\n", gpGlobalConfig->demuxPipeline);
+		}
+		else if (sscanf(cfg, "remux-hls-ts-to-mp4=%d", &gpGlobalConfig->remuxHLSTsToMp4) == 1)
+		{ // default 0, set to 1 to inject demuxed H.264/AAC from HLS TS as fragmented MP4
+			logprintf("remux-hls-ts-to-mp4=%d\n", gpGlobalConfig->remuxHLSTsToMp4);
+		}
+		else if (sscanf(cfg, "iframe-index-from-segments=%d", &gpGlobalConfig->iframeIndexFromSegments) == 1)
+		{ // default 1, set to 0 to disable key frame byte range index used by trick play without I-frame track
+			logprintf("iframe-index-from-segments=%d\n", gpGlobalConfig->iframeIndexFromSegments);
+		}
+		else if (sscanf(cfg, "reverse-gop-cache=%d", &gpGlobalConfig->reverseGOPCacheSize) == 1)
+		{ // default 0 (disabled), key frames of this many recently played segments are kept for rewind without I-frame track
+			logprintf("reverse-gop-cache=%d\n", gpGlobalConfig->reverseGOPCacheSize);
+		}
+		else if (sscanf(cfg, "reverse-gop-max-rate=%d", &gpGlobalConfig->reverseGOPMaxRate) == 1)
+		{ // default 4, faster rewind without I-frame track fetches only indexed first key frame of segments
+			logprintf("reverse-gop-max-rate=%d\n", gpGlobalConfig->reverseGOPMaxRate);
+		}
+		else if (sscanf(cfg, "seek-in-buffer=%d", &gpGlobalConfig->seekInBuffer) == 1)
+		{ // default 0, set to 1 to seek without re-tune when target position is already fetched; costs a copy of each injected TS fragment
+			logprintf("seek-in-buffer=%d\n", gpGlobalConfig->seekInBuffer);
+		}
+		else if (sscanf(cfg, "seek-retention=%d", &gpGlobalConfig->seekRetentionSeconds) == 1)
+		{ // default 10, seconds of injected fragments kept behind play position for backward in-buffer seek
+			logprintf("seek-retention=%d\n", gpGlobalConfig->seekRetentionSeconds);
+		}
+		else if (sscanf(cfg, "thumbnail-cache-size=%d", &gpGlobalConfig->thumbnailCacheSize) == 1)
+		{ // default 16, thumbnail images kept for scrubbing, those farthest from requested position are dropped first
+			VALIDATE_INT("thumbnail-cache-size", gpGlobalConfig->thumbnailCacheSize, DEFAULT_THUMBNAIL_CACHE_SIZE);
+			logprintf("thumbnail-cache-size=%d\n", gpGlobalConfig->thumbnailCacheSize);
+		}
+		else if (sscanf(cfg, "timed-metadata-limit=%d", &gpGlobalConfig->timedMetadataLimit) == 1)
+		{ // default 1000, timed metadata entries kept for dedupe and range query, earliest are dropped first
+			VALIDATE_INT("timed-metadata-limit", gpGlobalConfig->timedMetadataLimit, DEFAULT_TIMED_METADATA_LIMIT);
+			logprintf("timed-metadata-limit=%d\n", gpGlobalConfig->timedMetadataLimit);
+		}
+		else if (sscanf(cfg, "timed-metadata-events=%d\n", &value) == 1)
+		{
+			gpGlobalConfig->timedMetadataEvents = (value != 0);
+			logprintf("timed-metadata-events=%d\n", value);
+		}
+		else if (sscanf(cfg, "ad-prefetch-seconds=%d", &gpGlobalConfig->adPrefetchSeconds) == 1)
+		{ // default 6, seconds of media fetched ahead of an ad or DASH period splice, 0 to disable
+			logprintf("ad-prefetch-seconds=%d\n", gpGlobalConfig->adPrefetchSeconds);
+		}
+		else if (sscanf(cfg, "ad-prefetch-lookahead=%d", &gpGlobalConfig->adPrefetchLookahead) == 1)
+		{ // default 20, seconds before ad position at which ad manifest and first fragments are fetched
+			VALIDATE_INT("ad-prefetch-lookahead", gpGlobalConfig->adPrefetchLookahead, DEFAULT_AD_PREFETCH_LOOKAHEAD_SECONDS);
+			logprintf("ad-prefetch-lookahead=%d\n", gpGlobalConfig->adPrefetchLookahead);
+		}
+		else if (sscanf(cfg, "ad-prefetch-cache-size=%d", &gpGlobalConfig->adPrefetchCacheSize) == 1)
+		{ // default 16, MB of prefetched downloads kept until their splice, oldest are dropped first
+			VALIDATE_INT("ad-prefetch-cache-size", gpGlobalConfig->adPrefetchCacheSize, DEFAULT_AD_PREFETCH_CACHE_SIZE);
+			logprintf("ad-prefetch-cache-size=%d\n", gpGlobalConfig->adPrefetchCacheSize);
+		}
 		else if (sscanf(cfg, "throttle=%d", &gpGlobalConfig->gThrottle) == 1)
 		{ // default is true; used with restamping?
 			logprintf("aamp throttle=%d\n", gpGlobalConfig->gThrottle);
@@ -2930,10 +3161,10 @@ static void ProcessConfigEntry(char *cfg)
 			VALIDATE_INT("buffer-health-monitor-delay", gpGlobalConfig->bufferHealthMonitorDelay, DEFAULT_BUFFER_HEALTH_MONITOR_DELAY)
 			logprintf("buffer-health-monitor-delay=%d\n", gpGlobalConfig->bufferHealthMonitorDelay);
 		}
-		else if (sscanf(cfg, "buffer-health-monitor-interval=%d", &gpGlobalConfig->bufferHealthMonitorInterval) == 1)
-		{ // override for buffer health monitor interval
-			VALIDATE_INT("buffer-health-monitor-interval", gpGlobalConfig->bufferHealthMonitorInterval, DEFAULT_BUFFER_HEALTH_MONITOR_INTERVAL)
-			logprintf("buffer-health-monitor-interval=%d\n", gpGlobalConfig->bufferHealthMonitorInterval);
+		else if (sscanf(cfg, "stall-prediction-threshold=%d", &gpGlobalConfig->stallPredictionThreshold) == 1)
+		{ // default 6 seconds, predicted time to buffer empty at which ABR ramps down and prefetch is deferred
+			VALIDATE_INT("stall-prediction-threshold", gpGlobalConfig->stallPredictionThreshold, DEFAULT_STALL_PREDICTION_THRESHOLD)
+			logprintf("stall-prediction-threshold=%d\n", gpGlobalConfig->stallPredictionThreshold);
 		}
 		else if (sscanf(cfg, "preferred-drm=%d", &value) == 1)
 		{ // override for preferred drm value
@@ -2974,6 +3205,11 @@ static void ProcessConfigEntry(char *cfg)
 			gpGlobalConfig->prefetchIframePlaylist = (value != 0);
 			logprintf("pre-fetch-iframe-playlist=%d\n", value);
 		}
+		else if (sscanf(cfg, "conditional-playlist-refresh=%d\n", &value) == 1)
+		{
+			gpGlobalConfig->conditionalPlaylistRefresh = (value != 0);
+			logprintf("conditional-playlist-refresh=%d\n", value);
+		}
 		else if (sscanf(cfg, "hls-av-sync-use-start-time=%d\n", &value) == 1)
 		{
 			gpGlobalConfig->hlsAVTrackSyncUsingStartTime = (value != 0);
@@ -2989,6 +3225,11 @@ static void ProcessConfigEntry(char *cfg)
 			gpGlobalConfig->mpdDiscontinuityHandlingCdvr = (value != 0);
 			logprintf("mpd-discontinuity-handling-cdvr=%d\n", value);
 		}
+		else if (sscanf(cfg, "gapless-discontinuity=%d\n", &value) == 1)
+		{ // default 0, set to 1 to continue on the same pipeline across discontinuities with unchanged stream format
+			gpGlobalConfig->gaplessDiscontinuity = (value != 0);
+			logprintf("gapless-discontinuity=%d\n", value);
+		}
 		else if(ReadConfigStringHelper(cfg, "license-server-url=", (const char**)&gpGlobalConfig->licenseServerURL))
 		{
 			gpGlobalConfig->licenseServerLocalOverride = true;
@@ -3008,11 +3249,32 @@ static void ProcessConfigEntry(char *cfg)
 				gpGlobalConfig->linearTrickplayFPSLocalOverride = true;
 			logprintf("linear-trickplay-fps=%d\n", gpGlobalConfig->linearTrickplayFPS);
 		}
+		else if (sscanf(cfg, "trickplay-prefetch=%d", &gpGlobalConfig->trickplayPrefetch) == 1)
+		{ // default 2, I-frames downloaded in parallel ahead of trickplay; 0 to download one at a time
+			if (gpGlobalConfig->trickplayPrefetch > AAMP_TRICKPLAY_PREFETCH_CURL_COUNT)
+			{
+				gpGlobalConfig->trickplayPrefetch = AAMP_TRICKPLAY_PREFETCH_CURL_COUNT;
+			}
+			logprintf("trickplay-prefetch=%d\n", gpGlobalConfig->trickplayPrefetch);
+		}
+		else if (sscanf(cfg, "trickplay-min-fps=%d", &gpGlobalConfig->trickplayMinFPS) == 1)
+		{ // default 2, trickplay frame rate is lowered down to this when I-frames can't be downloaded in time
+			VALIDATE_INT("trickplay-min-fps", gpGlobalConfig->trickplayMinFPS, TRICKPLAY_MIN_PLAYBACK_FPS)
+			logprintf("trickplay-min-fps=%d\n", gpGlobalConfig->trickplayMinFPS);
+		}
 		else if (sscanf(cfg, "report-progress-interval=%d\n", &gpGlobalConfig->reportProgressInterval) == 1)
 		{
 			VALIDATE_INT("report-progress-interval", gpGlobalConfig->reportProgressInterval, DEFAULT_REPORT_PROGRESS_INTERVAL)
 			logprintf("report-progress-interval=%d\n", gpGlobalConfig->reportProgressInterval);
 		}
+		else if (sscanf(cfg, "position-sample-interval=%d", &gpGlobalConfig->positionSampleInterval) == 1)
+		{ // default 2000 ms, pipeline position is interpolated between samples; 0 to query pipeline on every call
+			logprintf("position-sample-interval=%d\n", gpGlobalConfig->positionSampleInterval);
+		}
+		else if (sscanf(cfg, "gst-buffer-pool=%d", &gpGlobalConfig->gstBufferPool) == 1)
+		{ // default 1, set to 0 to allocate each injected buffer from system memory without allocation query
+			logprintf("gst-buffer-pool=%d\n", gpGlobalConfig->gstBufferPool);
+		}
 		else if (ReadConfigStringHelper(cfg, "http-proxy=", &gpGlobalConfig->httpProxy))
 		{
 			logprintf("http-proxy=%s\n", gpGlobalConfig->httpProxy);
@@ -3027,6 +3289,16 @@ static void ProcessConfigEntry(char *cfg)
 			gpGlobalConfig->internalReTune = (value != 0);
 			logprintf("internal-retune=%d\n", (int)value);
 		}
+		else if (sscanf(cfg, "underflow-recovery=%d\n", &value) == 1)
+		{
+			gpGlobalConfig->underflowRecovery = (value != 0);
+			logprintf("underflow-recovery=%d\n", (int)value);
+		}
+		else if (sscanf(cfg, "underflow-rebuffer-timeout=%d", &gpGlobalConfig->underflowRebufferTimeout) == 1)
+		{ // default 5000 ms, time to refill after underflow before escalating to track resync
+			VALIDATE_INT("underflow-rebuffer-timeout", gpGlobalConfig->underflowRebufferTimeout, DEFAULT_UNDERFLOW_REBUFFER_TIMEOUT_MS);
+			logprintf("underflow-rebuffer-timeout=%d\n", gpGlobalConfig->underflowRebufferTimeout);
+		}
 		else if (sscanf(cfg, "gst-buffering-before-play=%d\n", &value) == 1)
 		{
 			gpGlobalConfig->gstreamerBufferingBeforePlay = (value != 0);
@@ -3490,20 +3762,14 @@ void PlayerInstanceAAMP::Stop(void)
 	}
 	aamp->SetState(eSTATE_IDLE);
 
-	pthread_mutex_lock(&gMutex);
-	for (int i = 0; i < AAMP_MAX_SIMULTANEOUS_INSTANCES; i++)
+	pthread_mutex_lock(&aamp->mRetuneMutex);
+	while (aamp->mReTune && aamp->mIsRetuneInProgress)
 	{
-		if (aamp == gActivePrivAAMPs[i].pAAMP)
-		{
-			if (gActivePrivAAMPs[i].reTune && aamp->mIsRetuneInProgress)
-			{
-				// Wait for any ongoing re-tune operation to complete
-				pthread_cond_wait(&gCond, &gMutex);
-			}
-			gActivePrivAAMPs[i].reTune = false;
-		}
+		// Wait for any ongoing re-tune operation to complete
+		pthread_cond_wait(&aamp->mRetuneCond, &aamp->mRetuneMutex);
 	}
-	pthread_mutex_unlock(&gMutex);
+	aamp->mReTune = false;
+	pthread_mutex_unlock(&aamp->mRetuneMutex);
 	AAMPLOG_INFO("Stopping Playback at Position '%lld'.\n", aamp->GetPositionMs());
 	aamp->Stop();
 }
@@ -3749,6 +4015,56 @@ void PrivateInstanceAAMP::TuneHelper(TuneType tuneType)
 }
 
 
+/**
+ * @brief Seek to seek_pos_seconds using fragments already fetched or retained by the tracks.
+ *
+ * Injection is stopped and the pipeline flushed; the stream abstraction, playlists, DRM and
+ * download threads are kept, so no network request is made for the seek.
+ *
+ * @retval true if seek was done within buffer, false if a full seek is needed
+ */
+bool PrivateInstanceAAMP::SeekInBuffer()
+{
+	bool ret = false;
+	if (!gpGlobalConfig->seekInBuffer || !mpStreamAbstractionAAMP || mIsLive || (rate != AAMP_NORMAL_PLAY_RATE))
+	{
+		return ret;
+	}
+	SyncBegin();
+	bool busy = (mDiscontinuityTuneOperationInProgress || mProcessingDiscontinuity || mProcessingAdInsertion || mPlayingAd);
+	SyncEnd();
+	if (busy)
+	{
+		return ret;
+	}
+	mSeekOperationInProgress = true;
+	mbSeekInBuffer = true;
+	mpStreamAbstractionAAMP->StopInjection();
+	mbSeekInBuffer = false;
+	if (mpStreamAbstractionAAMP->SeekInBuffer(seek_pos_seconds - culledSeconds))
+	{
+		lastUnderFlowTimeMs[eMEDIATYPE_VIDEO] = 0;
+		lastUnderFlowTimeMs[eMEDIATYPE_AUDIO] = 0;
+		trickStartUTCMS = -1;
+		mpStreamAbstractionAAMP->mIsFirstBuffer = true;
+		seek_pos_seconds = mpStreamAbstractionAAMP->GetStreamPosition() + culledSeconds;
+		logprintf("%s:%d Updated seek_pos_seconds %f \n", __FUNCTION__, __LINE__, seek_pos_seconds);
+#ifndef AAMP_STOP_SINK_ON_SEEK
+		mStreamSink->Flush(mpStreamAbstractionAAMP->GetFirstPTS(), rate);
+#else
+		mStreamSink->Stop(true);
+		mStreamSink->Configure(mFormat, mAudioFormat, false);
+#endif
+		mpStreamAbstractionAAMP->StartInjection();
+		mStreamSink->Stream();
+		ret = true;
+	}
+	// on failure injection stays stopped, TuneHelper tears down the stream
+	mSeekOperationInProgress = false;
+	return ret;
+}
+
+
 /**
  * @brief Tune to a URL.
  *
@@ -3836,6 +4152,8 @@ void PrivateInstanceAAMP::Tune(const char *mainManifestUrl, const char *contentT
 	mIsLocalPlayback = (aamp_getHostFromURL(manifestUrl).find(LOCAL_HOST_IP) != std::string::npos);
 	mPersistedProfileIndex	=	-1;
 	mCurrentDrm = eDRM_NONE;
+	ClearThumbnails();
+	ClearPrefetchCache();
 	
 	SetContentType(mainManifestUrl, contentType);
 	if(IsVodOrCdvrAsset())
@@ -4116,7 +4434,7 @@ void PrivateInstanceAAMP::SyncEnd(void)
 char *PrivateInstanceAAMP::LoadFragment(ProfilerBucketType bucketType, const char *fragmentUrl, size_t *len, unsigned int curlInstance, const char *range, MediaType fileType)
 {
 	profiler.ProfileBegin(bucketType);
-	char effectiveUrl[MAX_URI_LENGTH];
+	std::string effectiveUrl;
 	struct GrowableBuffer fragment = { 0, 0, 0 }; // TODO: leaks if thread killed
 	if (!GetFile(fragmentUrl, &fragment, effectiveUrl, NULL, range, curlInstance, true, fileType))
 	{
@@ -4147,7 +4465,7 @@ bool PrivateInstanceAAMP::LoadFragment(ProfilerBucketType bucketType, const char
 {
 	bool ret = true;
 	profiler.ProfileBegin(bucketType);
-	char effectiveUrl[MAX_URI_LENGTH];
+	std::string effectiveUrl;
 	if (!GetFile(fragmentUrl, fragment, effectiveUrl, http_code, range, curlInstance, false, fileType))
 	{
 		ret = false;
@@ -4243,6 +4561,7 @@ void PrivateInstanceAAMP::InsertAd(const char *url, double positionSeconds)
 		mAdUrl[0] = 0;
 		mAdPosition = 0;
 	}
+	mAdPrefetchScheduled = false;
 }
 
 
@@ -4436,7 +4755,10 @@ void PlayerInstanceAAMP::Seek(double secondsRelativeToTuneTime)
 	if (aamp->mpStreamAbstractionAAMP)
 	{ // for seek while streaming
 		aamp->SetState(eSTATE_SEEKING);
-		aamp->TuneHelper(tuneType);
+		if (sentSpeedChangedEv || (tuneType != eTUNETYPE_SEEK) || !aamp->SeekInBuffer())
+		{
+			aamp->TuneHelper(tuneType);
+		}
 		if (sentSpeedChangedEv)
 		{
 			aamp->NotifySpeedChanged(aamp->rate);
@@ -4999,6 +5321,86 @@ std::vector<long> PlayerInstanceAAMP::GetAudioBitrates(void)
 }
 
 
+/**
+ *   @brief To get the available thumbnail tracks.
+ *
+ *   @return Thumbnail tracks, empty if asset has none
+ */
+std::vector<ThumbnailTrackInfo> PlayerInstanceAAMP::GetAvailableThumbnailTracks(void)
+{
+	return aamp->GetAvailableThumbnailTracks();
+}
+
+
+/**
+ *   @brief To select the thumbnail track used for previews.
+ *
+ *   @param[in] Index of track in list returned by GetAvailableThumbnailTracks
+ *   @return true if track is selected
+ */
+bool PlayerInstanceAAMP::SetThumbnailTrack(int thumbnailTrack)
+{
+	return aamp->SetThumbnailTrack(thumbnailTrack);
+}
+
+
+/**
+ *   @brief To get the thumbnails of selected track in a range of media time.
+ *
+ *   @param[in] Start of range
+ *   @param[in] End of range
+ *   @return Thumbnails in media time order
+ */
+std::vector<ThumbnailInfo> PlayerInstanceAAMP::GetThumbnails(double startTime, double endTime)
+{
+	std::vector<ThumbnailInfo> thumbnails;
+	aamp->GetThumbnails(startTime, endTime, thumbnails);
+	return thumbnails;
+}
+
+
+/**
+ *   @brief To get the timed metadata of current asset in a range of media time.
+ *
+ *   @param[in] Start of range in milliseconds
+ *   @param[in] End of range in milliseconds, exclusive
+ *   @return Timed metadata in time order
+ */
+std::vector<TimedMetadataInfo> PlayerInstanceAAMP::GetTimedMetadata(double startMS, double endMS)
+{
+	std::vector<TimedMetadataInfo> cues;
+	aamp->GetTimedMetadata(startMS, endMS, cues);
+	return cues;
+}
+
+
+/**
+ *   @brief To get the counts of recoveries from underflow and PTS errors.
+ *
+ *   @return Recovery counts per tier since player instance was created
+ */
+PlaybackRecoveryInfo PlayerInstanceAAMP::GetPlaybackRecoveryInfo(void)
+{
+	PlaybackRecoveryInfo info;
+	aamp->GetPlaybackRecoveryInfo(info);
+	return info;
+}
+
+
+/**
+ *   @brief To get the thumbnail of a media position along with its image.
+ *
+ *   @param[in] Media position
+ *   @param[out] Thumbnail covering position
+ *   @param[out] Image data
+ *   @return true on success
+ */
+bool PlayerInstanceAAMP::GetThumbnail(double position, ThumbnailInfo &thumbnail, std::vector<unsigned char> &image)
+{
+	return aamp->GetThumbnail(position, thumbnail, image);
+}
+
+
 /**
  *   @brief To set the initial bitrate value.
  *
@@ -5334,6 +5736,7 @@ bool PrivateInstanceAAMP::IsLive()
  */
 void PrivateInstanceAAMP::Stop()
 {
+	CancelRebuffer();
 	// Stopping the playback, release all DRM context
 	if (mpStreamAbstractionAAMP)
 	{
@@ -5364,7 +5767,7 @@ void PrivateInstanceAAMP::Stop()
 	}
 	if (timedMetadata.size() > 0)
 	{
-		logprintf("PrivateInstanceAAMP::%s() - timedMetadata.size - %d\n", __FUNCTION__, timedMetadata.size());
+		logprintf("PrivateInstanceAAMP::%s() - timedMetadata.size - %d\n", __FUNCTION__, (int)timedMetadata.size());
 		timedMetadata.clear();
 	}
 	pthread_mutex_unlock(&mLock);
@@ -5374,6 +5777,16 @@ void PrivateInstanceAAMP::Stop()
 	rate = 1;
 	mPlayingAd = false;
 	ClearPlaylistCache();
+	ClearIframeIndex();
+	ClearGOPCache();
+	ClearThumbnails();
+	pthread_mutex_lock(&mThumbnailFetchMutex);
+	CurlTerm(AAMP_THUMBNAIL_CURL_INSTANCE, 1);
+	pthread_mutex_unlock(&mThumbnailFetchMutex);
+	ClearPrefetchCache();
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	StopHarvest();
+#endif
 	mEnableCache = true;
 	mSeekOperationInProgress = false;
 	mMaxLanguageCount = 0; // reset language count
@@ -5395,43 +5808,35 @@ void PrivateInstanceAAMP::ReportTimedMetadata(double timeMilliseconds, const cha
 	bool bFireEvent = false;
 
 	// Check if timedMetadata was already reported
-	std::vector<TimedMetadata>::iterator i;
-	for (i=timedMetadata.begin(); i != timedMetadata.end(); i++)
+	std::pair<double, std::string> key(timeMilliseconds, (szName == NULL) ? "" : szName);
+	pthread_mutex_lock(&mLock);
+	std::map<std::pair<double, std::string>, std::string>::iterator i = timedMetadata.lower_bound(key);
+	if (i != timedMetadata.end() && i->first == key)
 	{
-		if (i->_timeMS < timeMilliseconds)
-			continue;
-
-		// Does an entry already exist?
-		if ((i->_timeMS == timeMilliseconds) && (i->_name.compare(szName) == 0))
+		if (i->second.compare(content) != 0)
 		{
-			if (i->_content.compare(content) == 0)
-			{
-				//logprintf("aamp_ReportTimedMetadata(%ld, '%s', '%s', nb) DUPLICATE\n", (long)timeMilliseconds, szName, content.data(), nb);
-			} else {
-				//logprintf("aamp_ReportTimedMetadata(%ld, '%s', '%s', nb) REPLACE\n", (long)timeMilliseconds, szName, content.data(), nb);
-				i->_content = content;
-				bFireEvent = true;
-			}
-			break;
-		}
-
-		if (i->_timeMS > timeMilliseconds)
-		{
-			//logprintf("aamp_ReportTimedMetadata(%ld, '%s', '%s', nb) INSERT\n", (long)timeMilliseconds, szName, content.data(), nb);
-			timedMetadata.insert(i, TimedMetadata(timeMilliseconds, szName, content));
+			//logprintf("aamp_ReportTimedMetadata(%ld, '%s', '%s', nb) REPLACE\n", (long)timeMilliseconds, szName, content.data(), nb);
+			i->second = content;
 			bFireEvent = true;
-			break;
 		}
 	}
-
-	if (i == timedMetadata.end())
+	else
 	{
-		//logprintf("aamp_ReportTimedMetadata(%ld, '%s', '%s', nb) APPEND\n", (long)timeMilliseconds, szName, content.data(), nb);
-		timedMetadata.push_back(TimedMetadata(timeMilliseconds, szName, content));
+		i = timedMetadata.insert(i, std::make_pair(key, content));
 		bFireEvent = true;
+		// Bounded for 24/7 linear; an entry older than all kept ones is dropped at once and not reported again
+		while ((int)timedMetadata.size() > gpGlobalConfig->timedMetadataLimit)
+		{
+			if (timedMetadata.begin() == i)
+			{
+				bFireEvent = false;
+			}
+			timedMetadata.erase(timedMetadata.begin());
+		}
 	}
+	pthread_mutex_unlock(&mLock);
 
-	if (bFireEvent)
+	if (bFireEvent && gpGlobalConfig->timedMetadataEvents)
 	{
 		AAMPEvent eventData;
 		eventData.type = AAMP_EVENT_TIMED_METADATA;
@@ -5475,28 +5880,211 @@ bool PrivateInstanceAAMP::HarvestFragments(bool modifyCount)
 	}
 	return false;
 }
-#endif
+
 
 /**
- * @brief Notify first frame is displayed. Sends CC handle event to listeners.
+ * @brief Harvest writer thread entry
+ *
+ * @param[in] arg PrivateInstanceAAMP pointer
+ * @retval NULL
  */
-void PrivateInstanceAAMP::NotifyFirstFrameReceived()
+static void *HarvestThread(void *arg)
 {
-	SetState(eSTATE_PLAYING);
-#ifdef AAMP_STOP_SINK_ON_SEEK
-	/*Do not send event on trickplay as CC is not enabled*/
-	if (AAMP_NORMAL_PLAY_RATE != rate)
+	PrivateInstanceAAMP *aamp = (PrivateInstanceAAMP *)arg;
+	if(aamp_pthread_setname(pthread_self(), "aampHarvest"))
 	{
-		logprintf("PrivateInstanceAAMP::%s:%d : not sending cc handle as rate = %f\n", __FUNCTION__, __LINE__, rate);
-		return;
+		logprintf("%s:%d: aamp_pthread_setname failed\n", __FUNCTION__, __LINE__);
 	}
-#endif
-	if (mStreamSink != NULL)
-	{
-		AAMPEvent event;
-		event.type = AAMP_EVENT_CC_HANDLE_RECEIVED;
-		event.data.ccHandle.handle = mStreamSink->getCCDecoderHandle();
-		SendEventSync(event);
+	aamp->HarvestLoop();
+	return NULL;
+}
+
+
+/**
+ * @brief Queue file for harvest writer, which writes it off the fetch thread
+ *
+ * Content is copied once, as fragment buffers are handed over to the sink on injection.
+ * Files are dropped rather than stalling the fetch thread when harvest-queue-size is reached.
+ *
+ * @param[in] path Path of file to be written
+ * @param[in] url Url file was downloaded from
+ * @param[in] ptr File content
+ * @param[in] len Length of file content
+ * @param[in] isFragment Media fragment, else manifest or playlist
+ */
+void PrivateInstanceAAMP::HarvestFile(const char *path, const char *url, const char *ptr, size_t len, bool isFragment)
+{
+	long long nowMs = aamp_GetCurrentTimeMS();
+	pthread_mutex_lock(&mHarvestMutex);
+	if (mHarvestQueueBytes + len > (size_t)gpGlobalConfig->harvestQueueSize * 1024 * 1024)
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : queue full (%d bytes), dropped %s\n", __FUNCTION__, __LINE__, (int)mHarvestQueueBytes, path);
+	}
+	else
+	{
+		if (!mHarvestThreadStarted)
+		{
+			if (0 == pthread_create(&mHarvestThreadID, NULL, &HarvestThread, this))
+			{
+				mHarvestThreadStarted = true;
+			}
+			else
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d : failed to create harvest thread\n", __FUNCTION__, __LINE__);
+			}
+		}
+		if (mHarvestThreadStarted)
+		{
+			if (0 == mHarvestStartTimeMs)
+			{
+				mHarvestStartTimeMs = nowMs;
+			}
+			HarvestRequest request;
+			request.path = path;
+			request.url = url;
+			memset(&request.buffer, 0, sizeof(GrowableBuffer));
+			aamp_AppendBytes(&request.buffer, ptr, len);
+			request.isFragment = isFragment;
+			request.fetchTimeMs = nowMs - mHarvestStartTimeMs;
+			mHarvestQueueBytes += len;
+			mHarvestQueue.push_back(request);
+			pthread_cond_signal(&mHarvestCond);
+		}
+	}
+	pthread_mutex_unlock(&mHarvestMutex);
+}
+
+
+/**
+ * @brief Create parent directories of file path
+ *
+ * @param[in] path Path of file
+ */
+static void CreateParentDirectories(const std::string &path)
+{
+	struct stat st = { 0 };
+	for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+	{
+		std::string dir = path.substr(0, pos);
+		if (-1 == stat(dir.c_str(), &st))
+		{
+			mkdir(dir.c_str(), 0777);
+		}
+	}
+}
+
+
+/**
+ * @brief Harvest writer thread, writes queued files and their timing index
+ *
+ * Each written file gets a line in HARVEST_INDEX_FILE of its directory:
+ * fetch time in ms since start of harvest, fragment(1) or manifest(0), bytes, url and file name,
+ * so that the session can be replayed with the pacing it was captured with.
+ */
+void PrivateInstanceAAMP::HarvestLoop()
+{
+	pthread_mutex_lock(&mHarvestMutex);
+	while (mHarvestThreadStarted || !mHarvestQueue.empty())
+	{
+		if (mHarvestQueue.empty())
+		{
+			pthread_cond_wait(&mHarvestCond, &mHarvestMutex);
+			continue;
+		}
+		HarvestRequest request = mHarvestQueue.front();
+		mHarvestQueue.pop_front();
+		pthread_mutex_unlock(&mHarvestMutex);
+
+		std::string path = request.path;
+		CreateParentDirectories(path);
+		bool written = false;
+#ifdef AAMP_HARVEST_COMPRESSION
+		if (gpGlobalConfig->harvestCompress)
+		{
+			path += ".gz";
+			gzFile gz = gzopen(path.c_str(), "wb");
+			if (gz)
+			{
+				written = (gzwrite(gz, request.buffer.ptr, (unsigned)request.buffer.len) == (int)request.buffer.len);
+				gzclose(gz);
+			}
+		}
+		else
+#endif
+		{
+			FILE *f = fopen(path.c_str(), "wb");
+			if (f)
+			{
+				written = (fwrite(request.buffer.ptr, 1, request.buffer.len, f) == request.buffer.len);
+				fclose(f);
+			}
+		}
+		if (written)
+		{
+			size_t dirEnd = path.rfind('/');
+			std::string dir = (dirEnd == std::string::npos) ? std::string() : path.substr(0, dirEnd + 1);
+			FILE *index = fopen((dir + HARVEST_INDEX_FILE).c_str(), "a");
+			if (index)
+			{
+				fprintf(index, "%lld %d %d %s %s\n", request.fetchTimeMs, (int)request.isFragment, (int)request.buffer.len,
+						request.url.c_str(), path.c_str() + dir.length());
+				fclose(index);
+			}
+			traceprintf("PrivateInstanceAAMP::%s:%d : written %s len %d\n", __FUNCTION__, __LINE__, path.c_str(), (int)request.buffer.len);
+		}
+		else
+		{
+			logprintf("PrivateInstanceAAMP::%s:%d : write failed %s len %d\n", __FUNCTION__, __LINE__, path.c_str(), (int)request.buffer.len);
+		}
+
+		pthread_mutex_lock(&mHarvestMutex);
+		mHarvestQueueBytes -= request.buffer.len;
+		aamp_Free(&request.buffer.ptr);
+	}
+	pthread_mutex_unlock(&mHarvestMutex);
+}
+
+
+/**
+ * @brief Stop harvest writer once queued files are written
+ */
+void PrivateInstanceAAMP::StopHarvest()
+{
+	pthread_mutex_lock(&mHarvestMutex);
+	bool threadStarted = mHarvestThreadStarted;
+	pthread_t threadID = mHarvestThreadID;
+	mHarvestThreadStarted = false;
+	mHarvestThreadID = 0;
+	mHarvestStartTimeMs = 0;
+	pthread_cond_signal(&mHarvestCond);
+	pthread_mutex_unlock(&mHarvestMutex);
+	if (threadStarted)
+	{
+		pthread_join(threadID, NULL);
+	}
+}
+#endif
+
+/**
+ * @brief Notify first frame is displayed. Sends CC handle event to listeners.
+ */
+void PrivateInstanceAAMP::NotifyFirstFrameReceived()
+{
+	SetState(eSTATE_PLAYING);
+#ifdef AAMP_STOP_SINK_ON_SEEK
+	/*Do not send event on trickplay as CC is not enabled*/
+	if (AAMP_NORMAL_PLAY_RATE != rate)
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : not sending cc handle as rate = %f\n", __FUNCTION__, __LINE__, rate);
+		return;
+	}
+#endif
+	if (mStreamSink != NULL)
+	{
+		AAMPEvent event;
+		event.type = AAMP_EVENT_CC_HANDLE_RECEIVED;
+		event.data.ccHandle.handle = mStreamSink->getCCDecoderHandle();
+		SendEventSync(event);
 	}
 }
 
@@ -5521,6 +6109,27 @@ bool PrivateInstanceAAMP::Discontinuity(MediaType track)
 }
 
 
+/**
+ * @brief Continue timeline of track across a codec compatible discontinuity, without pipeline flush
+ *
+ * @param track MediaType of the track
+ * @param discontinuityPts PTS at which timeline before discontinuity would have continued, 0 if demuxer restamps
+ *
+ * @retval true if discontinuity is handled without flush
+ */
+bool PrivateInstanceAAMP::ContinueTimeline(MediaType track, double discontinuityPts)
+{
+	bool ret = false;
+	if (gpGlobalConfig->gaplessDiscontinuity && (AAMP_NORMAL_PLAY_RATE == rate))
+	{
+		SyncBegin();
+		ret = mStreamSink->ContinueTimeline(track, discontinuityPts);
+		SyncEnd();
+	}
+	return ret;
+}
+
+
 /**
  * @brief Tune again to currently viewing asset. Used for internal error handling
  *
@@ -5531,40 +6140,30 @@ bool PrivateInstanceAAMP::Discontinuity(MediaType track)
 static gboolean PrivateInstanceAAMP_Retune(gpointer ptr)
 {
 	PrivateInstanceAAMP* aamp = (PrivateInstanceAAMP*) ptr;
-	bool activeAAMPFound = false;
-	bool reTune = false;
-	int i;
-	pthread_mutex_lock(&gMutex);
-	for ( i = 0; i < AAMP_MAX_SIMULTANEOUS_INSTANCES; i++)
+	// Source is removed by instance destructor, so aamp is valid unless destroyed
+	if (!g_source_is_destroyed(g_main_current_source()))
 	{
-		if (aamp == gActivePrivAAMPs[i].pAAMP)
+		pthread_mutex_lock(&aamp->mRetuneMutex);
+		aamp->mRetuneOperationId = 0;
+		if (!aamp->mReTune)
 		{
-			activeAAMPFound = true;
-			reTune = gActivePrivAAMPs[i].reTune;
-			break;
+			logprintf("PrivateInstanceAAMP::%s : %p reTune flag not set\n", __FUNCTION__, aamp);
 		}
-	}
-	if (!activeAAMPFound)
-	{
-		logprintf("PrivateInstanceAAMP::%s : %p not in Active AAMP list\n", __FUNCTION__, aamp);
-	}
-	else if (!reTune)
-	{
-		logprintf("PrivateInstanceAAMP::%s : %p reTune flag not set\n", __FUNCTION__, aamp);
-	}
-	else
-	{
-		aamp->mIsRetuneInProgress = true;
-		pthread_mutex_unlock(&gMutex);
+		else
+		{
+			aamp->mIsRetuneInProgress = true;
+			pthread_mutex_unlock(&aamp->mRetuneMutex);
 
-		aamp->TuneHelper(eTUNETYPE_RETUNE);
+			aamp->TuneHelper(eTUNETYPE_RETUNE);
 
-		pthread_mutex_lock(&gMutex);
-		aamp->mIsRetuneInProgress = false;
-		gActivePrivAAMPs[i].reTune = false;
-		pthread_cond_signal(&gCond);
+			pthread_mutex_lock(&aamp->mRetuneMutex);
+			aamp->mIsRetuneInProgress = false;
+			aamp->mReTune = false;
+			aamp->mRecoveryTier = eRECOVERY_NONE;
+			pthread_cond_broadcast(&aamp->mRetuneCond);
+		}
+		pthread_mutex_unlock(&aamp->mRetuneMutex);
 	}
-	pthread_mutex_unlock(&gMutex);
 	return G_SOURCE_REMOVE;
 }
 
@@ -5618,73 +6217,265 @@ void PrivateInstanceAAMP::ScheduleRetune(PlaybackErrorType errorType, MediaType
 		SendAnomalyEvent(ANOMALY_WARNING, "%s %s", (trackType == eMEDIATYPE_VIDEO ? "VIDEO" : "AUDIO"),
 		        (errorType == eGST_ERROR_PTS) ? "PTS ERROR" :
 		        (errorType == eGST_ERROR_UNDERFLOW) ? "Underflow" : "STARTTIME RESET");
-		bool activeAAMPFound = false;
-		pthread_mutex_lock(&gMutex);
-		for (int i = 0; i < AAMP_MAX_SIMULTANEOUS_INSTANCES; i++)
+		if (RecoverInPlace(errorType, trackType))
+		{
+			return;
+		}
+		pthread_mutex_lock(&mRetuneMutex);
+		if (mReTune)
+		{
+			logprintf("PrivateInstanceAAMP::%s:%d: Already scheduled\n", __FUNCTION__, __LINE__);
+		}
+		else
 		{
-			if (this == gActivePrivAAMPs[i].pAAMP)
+
+			if(eGST_ERROR_PTS == errorType || eGST_ERROR_UNDERFLOW == errorType)
 			{
-				if (gActivePrivAAMPs[i].reTune)
-				{
-					logprintf("PrivateInstanceAAMP::%s:%d: Already scheduled\n", __FUNCTION__, __LINE__);
-				}
-				else
+				long long now = aamp_GetCurrentTimeMS();
+				long long lastErrorReportedTimeMs = lastUnderFlowTimeMs[trackType];
+				if (lastErrorReportedTimeMs)
 				{
-
-					if(eGST_ERROR_PTS == errorType || eGST_ERROR_UNDERFLOW == errorType)
+					long long diffMs = (now - lastErrorReportedTimeMs);
+					if (diffMs < AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS)
 					{
-						long long now = aamp_GetCurrentTimeMS();
-						long long lastErrorReportedTimeMs = lastUnderFlowTimeMs[trackType];
-						if (lastErrorReportedTimeMs)
-						{
-							long long diffMs = (now - lastErrorReportedTimeMs);
-							if (diffMs < AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS)
-							{
-								gActivePrivAAMPs[i].numPtsErrors++;
-								logprintf("PrivateInstanceAAMP::%s:%d: numPtsErrors %d, ptsErrorThreshold %d\n",
-									__FUNCTION__, __LINE__, gActivePrivAAMPs[i].numPtsErrors, gpGlobalConfig->ptsErrorThreshold);
-								if (gActivePrivAAMPs[i].numPtsErrors >= gpGlobalConfig->ptsErrorThreshold)
-								{
-									gActivePrivAAMPs[i].numPtsErrors = 0;
-									gActivePrivAAMPs[i].reTune = true;
-									logprintf("PrivateInstanceAAMP::%s:%d: Schedule Retune. diffMs %lld < threshold %lld\n",
-										__FUNCTION__, __LINE__, diffMs, AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS);
-									g_idle_add(PrivateInstanceAAMP_Retune, (gpointer)this);
-								}
-							}
-							else
-							{
-								gActivePrivAAMPs[i].numPtsErrors = 0;
-								logprintf("PrivateInstanceAAMP::%s:%d: Not scheduling reTune since (diff %lld > threshold %lld) numPtsErrors %d, ptsErrorThreshold %d.\n",
-									__FUNCTION__, __LINE__, diffMs, AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS,
-									gActivePrivAAMPs[i].numPtsErrors, gpGlobalConfig->ptsErrorThreshold);
-							}
-						}
-						else
+						mNumPtsErrors++;
+						logprintf("PrivateInstanceAAMP::%s:%d: numPtsErrors %d, ptsErrorThreshold %d\n",
+							__FUNCTION__, __LINE__, mNumPtsErrors, gpGlobalConfig->ptsErrorThreshold);
+						if (mNumPtsErrors >= gpGlobalConfig->ptsErrorThreshold)
 						{
-							const char* errorString = (errorType == eGST_ERROR_UNDERFLOW) ? "underflow" : "pts error";
-							gActivePrivAAMPs[i].numPtsErrors = 0;
-							logprintf("PrivateInstanceAAMP::%s:%d: Not scheduling reTune since first %s.\n", __FUNCTION__, __LINE__, errorString);
+							mNumPtsErrors = 0;
+							mReTune = true;
+							logprintf("PrivateInstanceAAMP::%s:%d: Schedule Retune. diffMs %lld < threshold %lld\n",
+								__FUNCTION__, __LINE__, diffMs, AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS);
+							mRetuneOperationId = g_idle_add(PrivateInstanceAAMP_Retune, (gpointer)this);
 						}
-						lastUnderFlowTimeMs[trackType] = now;
 					}
-					else if(eDASH_ERROR_STARTTIME_RESET == errorType)
+					else
 					{
-						logprintf("PrivateInstanceAAMP::%s:%d: Schedule Retune to handle start time reset.\n", __FUNCTION__, __LINE__);
-						gActivePrivAAMPs[i].reTune = true;
-						g_idle_add(PrivateInstanceAAMP_Retune, (gpointer) this);
+						mNumPtsErrors = 0;
+						logprintf("PrivateInstanceAAMP::%s:%d: Not scheduling reTune since (diff %lld > threshold %lld) numPtsErrors %d, ptsErrorThreshold %d.\n",
+							__FUNCTION__, __LINE__, diffMs, AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS,
+							mNumPtsErrors, gpGlobalConfig->ptsErrorThreshold);
 					}
 				}
-				activeAAMPFound = true;
-				break;
+				else
+				{
+					const char* errorString = (errorType == eGST_ERROR_UNDERFLOW) ? "underflow" : "pts error";
+					mNumPtsErrors = 0;
+					logprintf("PrivateInstanceAAMP::%s:%d: Not scheduling reTune since first %s.\n", __FUNCTION__, __LINE__, errorString);
+				}
+				lastUnderFlowTimeMs[trackType] = now;
+			}
+			else if(eDASH_ERROR_STARTTIME_RESET == errorType)
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d: Schedule Retune to handle start time reset.\n", __FUNCTION__, __LINE__);
+				mReTune = true;
+				mRetuneOperationId = g_idle_add(PrivateInstanceAAMP_Retune, (gpointer) this);
+			}
+		}
+		pthread_mutex_unlock(&mRetuneMutex);
+	}
+}
+
+
+/**
+ * @brief Timer to pause and refill playback after underflow
+ *
+ * @param[in] ptr pointer to PrivateInstanceAAMP object
+ *
+ * @retval G_SOURCE_CONTINUE while rebuffering, else G_SOURCE_REMOVE
+ */
+static gboolean PrivateInstanceAAMP_Rebuffer(gpointer ptr)
+{
+	PrivateInstanceAAMP* aamp = (PrivateInstanceAAMP*) ptr;
+	// Source is removed on stop and by instance destructor, so aamp is valid unless destroyed
+	if (!g_source_is_destroyed(g_main_current_source()) && aamp->ContinueRebuffer())
+	{
+		return G_SOURCE_CONTINUE;
+	}
+	return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * @brief Recover underflow or PTS error without tearing down the stream
+ *
+ * First underflow pauses playback until the track refills, with a ramp down so that
+ * refill is faster. PTS error or repeated error within AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS
+ * resyncs the affected track with pipeline, and after that a re-tune is scheduled.
+ *
+ * @param[in] errorType type of playback error
+ * @param[in] trackType media type
+ * @retval true if error is handled
+ */
+bool PrivateInstanceAAMP::RecoverInPlace(PlaybackErrorType errorType, MediaType trackType)
+{
+	bool handled = false;
+	if (gpGlobalConfig->underflowRecovery && (eGST_ERROR_PTS == errorType || eGST_ERROR_UNDERFLOW == errorType))
+	{
+		long long now = aamp_GetCurrentTimeMS();
+		pthread_mutex_lock(&mRetuneMutex);
+		if (!mReTune && mRebufferOperationId == 0)
+		{
+			if (mRecoveryTier != eRECOVERY_NONE && (now - mLastRecoveryTimeMs) > AAMP_MAX_TIME_BW_UNDERFLOWS_TO_TRIGGER_RETUNE_MS)
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d: Playback stable for %lld ms, recovery starts from rebuffer\n",
+					__FUNCTION__, __LINE__, now - mLastRecoveryTimeMs);
+				mRecoveryTier = eRECOVERY_NONE;
+			}
+			RecoveryTier tier = (mRecoveryTier == eRECOVERY_NONE) ? eRECOVERY_REBUFFER : eRECOVERY_RETUNE;
+			if (mRecoveryTier == eRECOVERY_REBUFFER || (eGST_ERROR_PTS == errorType && tier == eRECOVERY_REBUFFER))
+			{ // refill does not help timestamp errors
+				tier = eRECOVERY_RESYNC;
+			}
+			MediaTrack *track = mpStreamAbstractionAAMP->GetMediaTrack((TrackType) trackType);
+			if (tier == eRECOVERY_REBUFFER)
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d: Rebuffer %s after underflow\n", __FUNCTION__, __LINE__,
+					(trackType == eMEDIATYPE_VIDEO ? "video" : "audio"));
+				mRecoveryInfo.rebufferCount++;
+				mRecoveryTrack = trackType;
+				mRebufferPaused = false;
+				mRebufferOperationId = g_timeout_add(UNDERFLOW_REBUFFER_CHECK_INTERVAL_MS, PrivateInstanceAAMP_Rebuffer, (gpointer) this);
+			}
+			else if (tier == eRECOVERY_RESYNC && track)
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d: Resync %s track\n", __FUNCTION__, __LINE__, track->name);
+				mRecoveryInfo.resyncCount++;
+				track->Resync();
+			}
+			else
+			{
+				tier = eRECOVERY_RETUNE;
+				logprintf("PrivateInstanceAAMP::%s:%d: Schedule Retune as rebuffer and resync did not recover\n", __FUNCTION__, __LINE__);
+				mRecoveryInfo.retuneCount++;
+				mReTune = true;
+				mRetuneOperationId = g_idle_add(PrivateInstanceAAMP_Retune, (gpointer) this);
+			}
+			mRecoveryTier = tier;
+			mLastRecoveryTimeMs = now;
+			handled = true;
+		}
+		pthread_mutex_unlock(&mRetuneMutex);
+	}
+	return handled;
+}
+
+
+/**
+ * @brief Rebuffer step run from timer
+ *
+ * Pauses sink on first run without stopping downloads, then resumes once cache of
+ * the underflowed track is full. Escalates to track resync on timeout.
+ *
+ * @retval true to keep polling
+ */
+bool PrivateInstanceAAMP::ContinueRebuffer()
+{
+	bool keepPolling = true;
+	bool pause = false;
+	bool resume = false;
+	MediaTrack *track = mpStreamAbstractionAAMP ? mpStreamAbstractionAAMP->GetMediaTrack((TrackType) mRecoveryTrack) : NULL;
+	PrivAAMPState state;
+	GetState(state);
+	pthread_mutex_lock(&mRetuneMutex);
+	if (!track)
+	{
+		keepPolling = false;
+	}
+	else if (!mRebufferPaused)
+	{
+		if (state == eSTATE_PLAYING && !pipeline_paused)
+		{
+			mRebufferPaused = true;
+			mRebufferStartTimeMs = aamp_GetCurrentTimeMS();
+			pause = true;
+		}
+		else
+		{
+			keepPolling = false;
+		}
+	}
+	else if (state != eSTATE_BUFFERING)
+	{ // paused, seeked or stopped meanwhile, which owns the pipeline state now
+		logprintf("PrivateInstanceAAMP::%s:%d: Rebuffer abandoned, state %d\n", __FUNCTION__, __LINE__, state);
+		mRebufferPaused = false;
+		keepPolling = false;
+	}
+	else
+	{
+		bool refilled = (track->numberOfFragmentsCached >= track->maxCachedFragmentsPerTrack);
+		long long waitMs = aamp_GetCurrentTimeMS() - mRebufferStartTimeMs;
+		if (refilled || waitMs >= gpGlobalConfig->underflowRebufferTimeout)
+		{
+			logprintf("PrivateInstanceAAMP::%s:%d: Rebuffer of %s %s after %lld ms\n", __FUNCTION__, __LINE__, track->name,
+				refilled ? "done" : "timed out", waitMs);
+			if (!refilled)
+			{
+				mRecoveryInfo.resyncCount++;
+				mRecoveryTier = eRECOVERY_RESYNC;
+				track->Resync();
 			}
+			mLastRecoveryTimeMs = aamp_GetCurrentTimeMS();
+			mRebufferPaused = false;
+			resume = true;
+			keepPolling = false;
 		}
-		pthread_mutex_unlock(&gMutex);
-		if (!activeAAMPFound)
+	}
+	if (!keepPolling)
+	{
+		mRebufferOperationId = 0;
+	}
+	pthread_mutex_unlock(&mRetuneMutex);
+
+	// Sink and state changes are done outside retune lock as state listeners may call back to player
+	if (pause)
+	{
+		mpStreamAbstractionAAMP->NotifyPlaybackPaused(true);
+		mStreamSink->Pause(true);
+		SetState(eSTATE_BUFFERING);
+		if (CheckABREnabled())
 		{
-			logprintf("PrivateInstanceAAMP::%s:%d: %p not in Active AAMP list\n", __FUNCTION__, __LINE__, this);
+			mpStreamAbstractionAAMP->RequestRampDown();
 		}
 	}
+	else if (resume)
+	{
+		mpStreamAbstractionAAMP->NotifyPlaybackPaused(false);
+		mStreamSink->Pause(false);
+		SetState(eSTATE_PLAYING);
+	}
+	return keepPolling;
+}
+
+
+/**
+ * @brief Stop rebuffering started by RecoverInPlace, if any
+ */
+void PrivateInstanceAAMP::CancelRebuffer()
+{
+	pthread_mutex_lock(&mRetuneMutex);
+	if (mRebufferOperationId != 0)
+	{
+		g_source_remove(mRebufferOperationId);
+		mRebufferOperationId = 0;
+	}
+	mRebufferPaused = false;
+	mRecoveryTier = eRECOVERY_NONE;
+	pthread_mutex_unlock(&mRetuneMutex);
+}
+
+
+/**
+ * @brief Get counts of underflow recoveries per tier
+ *
+ * @param[out] info Recovery counts
+ */
+void PrivateInstanceAAMP::GetPlaybackRecoveryInfo(PlaybackRecoveryInfo &info)
+{
+	pthread_mutex_lock(&mRetuneMutex);
+	info = mRecoveryInfo;
+	pthread_mutex_unlock(&mRetuneMutex);
 }
 
 
@@ -5701,6 +6492,21 @@ PrivateInstanceAAMP::PrivateInstanceAAMP()
 	mDownloadsEnabled = true;
 	mStreamSink = NULL;
 	mbDownloadsBlocked = false;
+	mbSeekInBuffer = false;
+	mIframeThroughputLimited = false;
+	mThumbnailTrackIdx = 0;
+	mThumbnailGeneration = 0;
+	mPrefetchThreadID = 0;
+	mPrefetchThreadStarted = false;
+	mPrefetchCacheBytes = 0;
+	mAdPrefetchScheduled = false;
+	mStallPredictedTracks = 0;
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	mHarvestQueueBytes = 0;
+	mHarvestStartTimeMs = 0;
+	mHarvestThreadID = 0;
+	mHarvestThreadStarted = false;
+#endif
 	streamerIsActive = false;
 	seek_pos_seconds = -1;
 	rate = 0;
@@ -5740,6 +6546,12 @@ PrivateInstanceAAMP::PrivateInstanceAAMP()
 	pthread_mutexattr_init(&mMutexAttr);
 	pthread_mutexattr_settype(&mMutexAttr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&mLock, &mMutexAttr);
+	pthread_mutex_init(&mThumbnailFetchMutex, NULL);
+	pthread_cond_init(&mPrefetchCond, NULL);
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	pthread_mutex_init(&mHarvestMutex, NULL);
+	pthread_cond_init(&mHarvestCond, NULL);
+#endif
 
 	for (int i = 0; i < MAX_CURL_INSTANCE_COUNT; i++)
 	{
@@ -5759,18 +6571,21 @@ PrivateInstanceAAMP::PrivateInstanceAAMP()
 		mbTrackDownloadsBlocked[i] = false;
 	}
 
-	pthread_mutex_lock(&gMutex);
-	for (int i = 0; i < AAMP_MAX_SIMULTANEOUS_INSTANCES; i++)
-	{
-		if (NULL == gActivePrivAAMPs[i].pAAMP)
-		{
-			gActivePrivAAMPs[i].pAAMP = this;
-			gActivePrivAAMPs[i].reTune = false;
-			break;
-		}
-	}
 	mIsRetuneInProgress = false;
-	pthread_mutex_unlock(&gMutex);
+	mReTune = false;
+	mNumPtsErrors = 0;
+	mRetuneOperationId = 0;
+	pthread_mutex_init(&mRetuneMutex, NULL);
+	pthread_cond_init(&mRetuneCond, NULL);
+	mRecoveryTier = eRECOVERY_NONE;
+	mLastRecoveryTimeMs = 0;
+	mRebufferOperationId = 0;
+	mRebufferPaused = false;
+	mRebufferStartTimeMs = 0;
+	mRecoveryTrack = eMEDIATYPE_VIDEO;
+	mRecoveryInfo.rebufferCount = 0;
+	mRecoveryInfo.resyncCount = 0;
+	mRecoveryInfo.retuneCount = 0;
 	discardEnteringLiveEvt = false;
 	licenceFromManifest = false;
 	mPlayingAd = false;
@@ -5794,6 +6609,20 @@ PrivateInstanceAAMP::PrivateInstanceAAMP()
 	previousAudioType = eAUDIO_UNKNOWN;
 	mABREnabled = gpGlobalConfig->bEnableABR;
 	mUserRequestedBandwidth = gpGlobalConfig->defaultBitrate;
+	mInitialBitrate = gpGlobalConfig->defaultBitrate;
+	mInitialBitrate4K = gpGlobalConfig->defaultBitrate4K;
+	mNetworkTimeout = gpGlobalConfig->fragmentDLTimeout;
+	mAnonymousRequest = gpGlobalConfig->licenseAnonymousRequest;
+	mVODTrickplayFPS = gpGlobalConfig->vodTrickplayFPS;
+	mLinearTrickplayFPS = gpGlobalConfig->linearTrickplayFPS;
+	mStallErrorCode = gpGlobalConfig->stallErrorCode;
+	mStallTimeoutInMS = gpGlobalConfig->stallTimeoutInMS;
+	mReportProgressInterval = gpGlobalConfig->reportProgressInterval;
+	mPreferredDrm = gpGlobalConfig->preferredDrm;
+	mLicenseServerURL = gpGlobalConfig->licenseServerURL ? gpGlobalConfig->licenseServerURL : "";
+	mPRLicenseServerURL = gpGlobalConfig->prLicenseServerURL ? gpGlobalConfig->prLicenseServerURL : "";
+	mWVLicenseServerURL = gpGlobalConfig->wvLicenseServerURL ? gpGlobalConfig->wvLicenseServerURL : "";
+	mMaxCachedFragmentsPerTrack = gpGlobalConfig->maxCachedFragmentsPerTrack;
 	mNetworkProxy = NULL;
 	mLicenseProxy = NULL;
 }
@@ -5804,15 +6633,18 @@ PrivateInstanceAAMP::PrivateInstanceAAMP()
  */
 PrivateInstanceAAMP::~PrivateInstanceAAMP()
 {
-	pthread_mutex_lock(&gMutex);
-	for (int i = 0; i < AAMP_MAX_SIMULTANEOUS_INSTANCES; i++)
+	pthread_mutex_lock(&mRetuneMutex);
+	if (mRetuneOperationId != 0)
 	{
-		if (this == gActivePrivAAMPs[i].pAAMP)
-		{
-			gActivePrivAAMPs[i].pAAMP = NULL;
-		}
+		g_source_remove(mRetuneOperationId);
+		mRetuneOperationId = 0;
 	}
-	pthread_mutex_unlock(&gMutex);
+	pthread_mutex_unlock(&mRetuneMutex);
+	CancelRebuffer();
+	ClearPrefetchCache();
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	StopHarvest();
+#endif
 
 	for (int i = 0; i < AAMP_MAX_NUM_EVENTS; i++)
 	{
@@ -5836,6 +6668,14 @@ PrivateInstanceAAMP::~PrivateInstanceAAMP()
 
 	pthread_cond_destroy(&mDownloadsDisabled);
 	pthread_cond_destroy(&mCondDiscontinuity);
+	pthread_mutex_destroy(&mThumbnailFetchMutex);
+	pthread_cond_destroy(&mPrefetchCond);
+	pthread_cond_destroy(&mRetuneCond);
+	pthread_mutex_destroy(&mRetuneMutex);
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	pthread_cond_destroy(&mHarvestCond);
+	pthread_mutex_destroy(&mHarvestMutex);
+#endif
 	pthread_mutex_destroy(&mLock);
 }
 
@@ -5913,20 +6753,58 @@ bool PrivateInstanceAAMP::IsSinkCacheEmpty(MediaType mediaType)
 	return mStreamSink->IsCacheEmpty(mediaType);
 }
 
+
 /**
- * @brief Notification on completing fragment caching
+ * @brief Get bytes queued in sink
+ *
+ * @param[in] mediaType type of track
+ *
+ * @retval Queued bytes, -1 if not known
  */
-void PrivateInstanceAAMP::NotifyFragmentCachingComplete()
+long long PrivateInstanceAAMP::GetSinkCacheLevelBytes(MediaType mediaType)
 {
-	mStreamSink->NotifyFragmentCachingComplete();
+	return mStreamSink->GetCacheLevelBytes(mediaType);
 }
 
 
 /**
- * @brief Send tuned event to listeners if required
+ * @brief Update stall prediction of a track
  *
- * @retval true if event is scheduled, false if discarded
- */
+ * Prefetch of ad and period splice content waits while any track is predicted
+ * to run dry, so that it does not take bandwidth from the playing content.
+ *
+ * @param[in] mediaType type of track
+ * @param[in] predicted true if track buffer is predicted to run dry
+ */
+void PrivateInstanceAAMP::SetStallPredicted(MediaType mediaType, bool predicted)
+{
+	pthread_mutex_lock(&mLock);
+	if (predicted)
+	{
+		mStallPredictedTracks |= (1 << mediaType);
+	}
+	else
+	{
+		mStallPredictedTracks &= ~(1 << mediaType);
+		pthread_cond_signal(&mPrefetchCond);
+	}
+	pthread_mutex_unlock(&mLock);
+}
+
+/**
+ * @brief Notification on completing fragment caching
+ */
+void PrivateInstanceAAMP::NotifyFragmentCachingComplete()
+{
+	mStreamSink->NotifyFragmentCachingComplete();
+}
+
+
+/**
+ * @brief Send tuned event to listeners if required
+ *
+ * @retval true if event is scheduled, false if discarded
+ */
 bool PrivateInstanceAAMP::SendTunedEvent()
 {
 	bool ret = false;
@@ -6047,7 +6925,7 @@ void PrivateInstanceAAMP::AddCustomHTTPHeader(std::string headerName, std::vecto
  */
 void PrivateInstanceAAMP::SetLicenseServerURL(const char *url, DRMSystems type)
 {
-	char **serverUrl = &(gpGlobalConfig->licenseServerURL);
+	std::string *serverUrl = &mLicenseServerURL;
 	if (type == eDRM_MAX_DRMSystems)
 	{
 		// Local aamp.cfg config trumps JS PP config
@@ -6058,11 +6936,11 @@ void PrivateInstanceAAMP::SetLicenseServerURL(const char *url, DRMSystems type)
 	}
 	else if (type == eDRM_PlayReady)
 	{
-		serverUrl = &(gpGlobalConfig->prLicenseServerURL);
+		serverUrl = &mPRLicenseServerURL;
 	}
 	else if (type == eDRM_WideVine)
 	{
-		serverUrl = &(gpGlobalConfig->wvLicenseServerURL);
+		serverUrl = &mWVLicenseServerURL;
 	}
 	else
 	{
@@ -6071,11 +6949,7 @@ void PrivateInstanceAAMP::SetLicenseServerURL(const char *url, DRMSystems type)
 	}
 
 	AAMPLOG_INFO("PrivateInstanceAAMP::%s - set license url - %s for type - %d\n", __FUNCTION__, url, type);
-	if (*serverUrl != NULL)
-	{
-		free(*serverUrl);
-	}
-	*serverUrl = strdup(url);
+	*serverUrl = url;
 }
 
 
@@ -6086,7 +6960,7 @@ void PrivateInstanceAAMP::SetLicenseServerURL(const char *url, DRMSystems type)
  */
 void PrivateInstanceAAMP::SetAnonymousRequest(bool isAnonymous)
 {
-	gpGlobalConfig->licenseAnonymousRequest = isAnonymous;
+	mAnonymousRequest = isAnonymous;
 }
 
 
@@ -6103,7 +6977,7 @@ void PrivateInstanceAAMP::SetVODTrickplayFPS(int vodTrickplayFPS)
 		return;
 	}
 
-	gpGlobalConfig->vodTrickplayFPS = vodTrickplayFPS;
+	mVODTrickplayFPS = vodTrickplayFPS;
 	logprintf("PrivateInstanceAAMP::%s(), vodTrickplayFPS %d\n", __FUNCTION__, vodTrickplayFPS);
 }
 
@@ -6121,7 +6995,7 @@ void PrivateInstanceAAMP::SetLinearTrickplayFPS(int linearTrickplayFPS)
 		return;
 	}
 
-	gpGlobalConfig->linearTrickplayFPS = linearTrickplayFPS;
+	mLinearTrickplayFPS = linearTrickplayFPS;
 	logprintf("PrivateInstanceAAMP::%s(), linearTrickplayFPS %d\n", __FUNCTION__, linearTrickplayFPS);
 }
 
@@ -6146,11 +7020,10 @@ void PrivateInstanceAAMP::SetLiveOffset(int liveoffset)
  * @param[in] buffer Contains the playlist
  * @param[in] effectiveUrl Effective URL of playlist
  */
-void PrivateInstanceAAMP::InsertToPlaylistCache(const std::string url, const GrowableBuffer* buffer, const char* effectiveUrl)
+void PrivateInstanceAAMP::InsertToPlaylistCache(const std::string url, const GrowableBuffer* buffer, const std::string &effectiveUrl)
 {
 	GrowableBuffer* buf = NULL;
-	char* eUrl;
-	std::unordered_map<std::string, std::pair<GrowableBuffer*, char*>>::iterator  it = mPlaylistCache.find(url);
+	std::unordered_map<std::string, std::pair<GrowableBuffer*, std::string>>::iterator  it = mPlaylistCache.find(url);
 	if (it != mPlaylistCache.end())
 	{
 		traceprintf("PrivateInstanceAAMP::%s:%d : playlist %s already present in cache\n", __FUNCTION__, __LINE__, url.c_str());
@@ -6160,9 +7033,7 @@ void PrivateInstanceAAMP::InsertToPlaylistCache(const std::string url, const Gro
 		buf = new GrowableBuffer();
 		memset (buf, 0, sizeof(GrowableBuffer));
 		aamp_AppendBytes(buf, buffer->ptr, buffer->len );
-		eUrl = (char*) malloc(MAX_URI_LENGTH);
-		strncpy(eUrl, effectiveUrl, MAX_URI_LENGTH);
-		mPlaylistCache[url] = std::pair<GrowableBuffer*, char*>(buf, eUrl);
+		mPlaylistCache[url] = std::pair<GrowableBuffer*, std::string>(buf, effectiveUrl);
 		traceprintf("PrivateInstanceAAMP::%s:%d : Inserted. url %s\n", __FUNCTION__, __LINE__, url.c_str());
 	}
 }
@@ -6178,19 +7049,38 @@ void PrivateInstanceAAMP::InsertToPlaylistCache(const std::string url, const Gro
  * @retval true if playlist is successfully retrieved.
  */
 bool PrivateInstanceAAMP::RetrieveFromPlaylistCache(const std::string url, GrowableBuffer* buffer, char effectiveUrl[])
+{
+	std::string eUrl;
+	bool ret = RetrieveFromPlaylistCache(url, buffer, eUrl);
+	if (ret)
+	{
+		strncpy(effectiveUrl, eUrl.c_str(), MAX_URI_LENGTH - 1);
+		effectiveUrl[MAX_URI_LENGTH - 1] = '\0';
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Retrieve playlist from playlist cache, without limit on length of effective URL
+ *
+ * @param[in] url URL corresponding to playlist
+ * @param[out] buffer Output buffer containing playlist
+ * @param[out] effectiveUrl effective URL of retrieved playlist
+ *
+ * @retval true if playlist is successfully retrieved.
+ */
+bool PrivateInstanceAAMP::RetrieveFromPlaylistCache(const std::string url, GrowableBuffer* buffer, std::string &effectiveUrl)
 {
 	GrowableBuffer* buf = NULL;
 	bool ret;
-	char* eUrl;
-	std::unordered_map<std::string, std::pair<GrowableBuffer*, char*>>::iterator  it = mPlaylistCache.find(url);
+	std::unordered_map<std::string, std::pair<GrowableBuffer*, std::string>>::iterator  it = mPlaylistCache.find(url);
 	if (it != mPlaylistCache.end())
 	{
-		std::pair<GrowableBuffer*, char*> p = it->second;
-		buf = p.first;
-		eUrl = p.second;
+		buf = it->second.first;
 		buffer->len = 0;
 		aamp_AppendBytes(buffer, buf->ptr, buf->len );
-		strncpy(effectiveUrl,eUrl, MAX_URI_LENGTH);
+		effectiveUrl = it->second.second;
 		traceprintf("PrivateInstanceAAMP::%s:%d : url %s found\n", __FUNCTION__, __LINE__, url.c_str());
 		ret = true;
 	}
@@ -6209,25 +7099,817 @@ bool PrivateInstanceAAMP::RetrieveFromPlaylistCache(const std::string url, Growa
 void PrivateInstanceAAMP::ClearPlaylistCache()
 {
 	GrowableBuffer* buf = NULL;
-	char* eUrl;
 	if(mPlaylistCache.size() > 2)
 	{
 		logprintf("PrivateInstanceAAMP::%s:%d : cache size %d\n", __FUNCTION__, __LINE__, (int)mPlaylistCache.size());
 	}
-	for (std::unordered_map<std::string, std::pair<GrowableBuffer*, char*>>::iterator  it = mPlaylistCache.begin();
+	for (std::unordered_map<std::string, std::pair<GrowableBuffer*, std::string>>::iterator  it = mPlaylistCache.begin();
 						it != mPlaylistCache.end(); it++)
 	{
-		std::pair<GrowableBuffer*,char*> p = it->second;
-		buf = p.first;
-		eUrl = p.second;
+		buf = it->second.first;
 		aamp_Free(&buf->ptr);
-		free(eUrl);
 		delete buf;
 	}
 	mPlaylistCache.clear();
 }
 
 
+/**
+ * @brief Insert key frame byte range of a TS fragment into I-frame index
+ *
+ * Oldest entry is dropped when index is full, newest fragments are most likely to be used.
+ *
+ * @param[in] url URL of fragment
+ * @param[in] offset Byte offset of key frame range
+ * @param[in] length Length of key frame range
+ */
+void PrivateInstanceAAMP::InsertToIframeIndex(const AampUrl &url, size_t offset, size_t length)
+{
+	pthread_mutex_lock(&mLock);
+	if (mIframeIndex.find(url) == mIframeIndex.end())
+	{
+		if (mIframeIndex.size() >= MAX_IFRAME_INDEX_ENTRIES)
+		{
+			mIframeIndex.erase(mIframeIndexOrder.front());
+			mIframeIndexOrder.pop_front();
+		}
+		mIframeIndexOrder.push_back(url);
+	}
+	mIframeIndex[url] = std::pair<size_t, size_t>(offset, length);
+	traceprintf("PrivateInstanceAAMP::%s:%d : url %s offset %d length %d\n", __FUNCTION__, __LINE__, url.Resolve().c_str(), (int)offset, (int)length);
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Retrieve key frame byte range of a TS fragment from I-frame index
+ *
+ * @param[in] url URL of fragment
+ * @param[out] offset Byte offset of key frame range
+ * @param[out] length Length of key frame range
+ *
+ * @retval true if fragment is indexed
+ */
+bool PrivateInstanceAAMP::RetrieveFromIframeIndex(const AampUrl &url, size_t &offset, size_t &length)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mLock);
+	std::unordered_map<AampUrl, std::pair<size_t, size_t>, AampUrl::Hash>::iterator it = mIframeIndex.find(url);
+	if (it != mIframeIndex.end())
+	{
+		offset = it->second.first;
+		length = it->second.second;
+		ret = true;
+	}
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Clear I-frame index
+ */
+void PrivateInstanceAAMP::ClearIframeIndex()
+{
+	pthread_mutex_lock(&mLock);
+	if (mIframeIndex.size() > 0)
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : index size %d\n", __FUNCTION__, __LINE__, (int)mIframeIndex.size());
+	}
+	mIframeIndex.clear();
+	mIframeIndexOrder.clear();
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Insert key frames of a TS fragment into GOP cache
+ *
+ * Oldest entry is dropped when cache is full, rewind reaches newest fragments first.
+ *
+ * @param[in] url URL of fragment
+ * @param[in] fragment Fragment data
+ * @param[in] ranges Byte offset and length of each key frame range in fragment
+ */
+void PrivateInstanceAAMP::InsertToGOPCache(const std::string url, const char *fragment, const std::vector<std::pair<size_t, size_t>> &ranges)
+{
+	GrowableBuffer *buffer = new GrowableBuffer();
+	memset(buffer, 0, sizeof(GrowableBuffer));
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		aamp_AppendBytes(buffer, fragment + ranges[i].first, ranges[i].second);
+	}
+	pthread_mutex_lock(&mLock);
+	std::unordered_map<std::string, GrowableBuffer*>::iterator it = mGOPCache.find(url);
+	if (it != mGOPCache.end())
+	{
+		aamp_Free(&it->second->ptr);
+		delete it->second;
+	}
+	else
+	{
+		while (!mGOPCacheOrder.empty() && ((int)mGOPCache.size() >= gpGlobalConfig->reverseGOPCacheSize))
+		{
+			it = mGOPCache.find(mGOPCacheOrder.front());
+			aamp_Free(&it->second->ptr);
+			delete it->second;
+			mGOPCache.erase(it);
+			mGOPCacheOrder.pop_front();
+		}
+		mGOPCacheOrder.push_back(url);
+	}
+	mGOPCache[url] = buffer;
+	traceprintf("PrivateInstanceAAMP::%s:%d : url %s key frames %d bytes %d\n", __FUNCTION__, __LINE__, url.c_str(), (int)ranges.size(), (int)buffer->len);
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Retrieve key frames of a TS fragment from GOP cache
+ *
+ * @param[in] url URL of fragment
+ * @param[out] buffer Buffer to which key frames are appended
+ *
+ * @retval true if fragment is cached
+ */
+bool PrivateInstanceAAMP::RetrieveFromGOPCache(const std::string url, GrowableBuffer *buffer)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mLock);
+	std::unordered_map<std::string, GrowableBuffer*>::iterator it = mGOPCache.find(url);
+	if (it != mGOPCache.end())
+	{
+		aamp_AppendBytes(buffer, it->second->ptr, it->second->len);
+		ret = true;
+	}
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Clear GOP cache
+ */
+void PrivateInstanceAAMP::ClearGOPCache()
+{
+	pthread_mutex_lock(&mLock);
+	if (mGOPCache.size() > 0)
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : cache size %d\n", __FUNCTION__, __LINE__, (int)mGOPCache.size());
+	}
+	for (std::unordered_map<std::string, GrowableBuffer*>::iterator it = mGOPCache.begin(); it != mGOPCache.end(); ++it)
+	{
+		aamp_Free(&it->second->ptr);
+		delete it->second;
+	}
+	mGOPCache.clear();
+	mGOPCacheOrder.clear();
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Get key of prefetch cache entry
+ *
+ * @param[in] url URL of file
+ * @param[in] range Byte range, NULL or empty for whole file
+ * @retval Key of entry
+ */
+static std::string GetPrefetchKey(const char *url, const char *range)
+{
+	std::string key = url;
+	if (range && range[0])
+	{
+		key += '@';
+		key += range;
+	}
+	return key;
+}
+
+
+/**
+ * @brief Prefetch thread entry
+ *
+ * @param[in] arg PrivateInstanceAAMP pointer
+ * @retval NULL
+ */
+static void *PrefetchThread(void *arg)
+{
+	PrivateInstanceAAMP *aamp = (PrivateInstanceAAMP *)arg;
+	if(aamp_pthread_setname(pthread_self(), "aampPrefetch"))
+	{
+		logprintf("%s:%d: aamp_pthread_setname failed\n", __FUNCTION__, __LINE__);
+	}
+	aamp->PrefetchLoop();
+	return NULL;
+}
+
+
+/**
+ * @brief Schedule downloads ahead of an ad or period splice
+ *
+ * Files are fetched in order on a dedicated curl instance and kept until
+ * GetFile asks for them, so that the splice does not wait for network.
+ *
+ * @param[in] requests Downloads to schedule
+ * @param[in] splicePosition Position in seconds at which downloads are needed, negative if unknown
+ */
+void PrivateInstanceAAMP::SchedulePrefetch(const std::vector<PrefetchRequest> &requests, double splicePosition)
+{
+	if (requests.empty() || gpGlobalConfig->adPrefetchSeconds <= 0)
+	{
+		return;
+	}
+	pthread_mutex_lock(&mLock);
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		mPrefetchQueue.push_back(requests[i]);
+		mPrefetchQueue.back().splicePosition = splicePosition;
+	}
+	if (!mPrefetchThreadStarted)
+	{
+		if (0 == pthread_create(&mPrefetchThreadID, NULL, &PrefetchThread, this))
+		{
+			mPrefetchThreadStarted = true;
+		}
+		else
+		{
+			logprintf("PrivateInstanceAAMP::%s:%d : failed to create prefetch thread\n", __FUNCTION__, __LINE__);
+			mPrefetchQueue.clear();
+		}
+	}
+	pthread_cond_signal(&mPrefetchCond);
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Prefetch thread, fetches scheduled downloads into prefetch cache
+ *
+ * Manifests and playlists are expanded to the init fragments and first
+ * ad-prefetch-seconds of media of the representation closest to request bandwidth.
+ */
+void PrivateInstanceAAMP::PrefetchLoop()
+{
+	CurlInit(AAMP_PREFETCH_CURL_INSTANCE, 1);
+	pthread_mutex_lock(&mLock);
+	while (mPrefetchThreadStarted)
+	{
+		if (mPrefetchQueue.empty() || mStallPredictedTracks)
+		{
+			pthread_cond_wait(&mPrefetchCond, &mLock);
+			continue;
+		}
+		PrefetchRequest request = mPrefetchQueue.front();
+		mPrefetchQueue.pop_front();
+		bool cached = (mPrefetchCache.find(GetPrefetchKey(request.url.c_str(), request.range.c_str())) != mPrefetchCache.end());
+		pthread_mutex_unlock(&mLock);
+
+		GrowableBuffer *buffer = new GrowableBuffer();
+		std::string effectiveUrl;
+		long http_error = 0;
+		memset(buffer, 0, sizeof(GrowableBuffer));
+		bool fetched = !cached && GetFile(request.url.c_str(), buffer, effectiveUrl, &http_error, request.range.empty() ? NULL : request.range.c_str(),
+				AAMP_PREFETCH_CURL_INSTANCE, true, request.isManifest ? eMEDIATYPE_MANIFEST : eMEDIATYPE_DEFAULT);
+		std::vector<PrefetchRequest> requests;
+		if (fetched && buffer->len)
+		{
+			traceprintf("PrivateInstanceAAMP::%s:%d : url %s bytes %d\n", __FUNCTION__, __LINE__, request.url.c_str(), (int)buffer->len);
+			if (request.isManifest)
+			{
+				GrowableBuffer manifest;
+				memset(&manifest, 0, sizeof(manifest));
+				aamp_AppendBytes(&manifest, buffer->ptr, buffer->len);
+				aamp_AppendNulTerminator(&manifest);
+				if (strstr(request.url.c_str(), "m3u8"))
+				{
+					StreamAbstractionAAMP_HLS::GetPrefetchRequests(manifest.ptr, effectiveUrl.c_str(), request.bandwidth, gpGlobalConfig->adPrefetchSeconds, requests);
+				}
+#if !defined (DISABLE_DASH) && !defined (INTELCE)
+				else
+				{
+					StreamAbstractionAAMP_MPD::GetPrefetchRequests(manifest.ptr, buffer->len, effectiveUrl.c_str(), request.bandwidth, language, gpGlobalConfig->adPrefetchSeconds, requests);
+				}
+#endif
+				aamp_Free(&manifest.ptr);
+				for (size_t i = 0; i < requests.size(); i++)
+				{
+					requests[i].splicePosition = request.splicePosition;
+				}
+			}
+		}
+		else if (!cached)
+		{
+			logprintf("PrivateInstanceAAMP::%s:%d : failed to fetch %s http_error %ld\n", __FUNCTION__, __LINE__, request.url.c_str(), http_error);
+		}
+
+		pthread_mutex_lock(&mLock);
+		size_t maxBytes = (size_t)gpGlobalConfig->adPrefetchCacheSize * 1024 * 1024;
+		if (fetched && buffer->len && mPrefetchThreadStarted)
+		{
+			std::string key = GetPrefetchKey(request.url.c_str(), request.range.c_str());
+			std::unordered_map<std::string, PrefetchEntry>::iterator it = mPrefetchCache.find(key);
+			if (it != mPrefetchCache.end())
+			{ // same file scheduled twice, keep latest
+				mPrefetchCacheOrder.remove(key);
+				RemovePrefetchEntry(it);
+			}
+			if (buffer->len <= maxBytes)
+			{
+				while (!mPrefetchCacheOrder.empty() && ((mPrefetchCache.size() >= MAX_PREFETCH_CACHE_ENTRIES) || (mPrefetchCacheBytes + buffer->len > maxBytes)))
+				{
+					it = mPrefetchCache.find(mPrefetchCacheOrder.front());
+					if (it != mPrefetchCache.end())
+					{
+						RemovePrefetchEntry(it);
+					}
+					mPrefetchCacheOrder.pop_front();
+				}
+				PrefetchEntry &entry = mPrefetchCache[key];
+				entry.buffer = buffer;
+				entry.effectiveUrl = effectiveUrl;
+				entry.splicePosition = request.splicePosition;
+				mPrefetchCacheBytes += buffer->len;
+				mPrefetchCacheOrder.push_back(key);
+				buffer = NULL;
+			}
+			else
+			{
+				logprintf("PrivateInstanceAAMP::%s:%d : %s bytes %d exceed ad-prefetch-cache-size, not cached\n", __FUNCTION__, __LINE__, request.url.c_str(), (int)buffer->len);
+			}
+			// expanded downloads go ahead of queued ones, keeping each splice's files together
+			mPrefetchQueue.insert(mPrefetchQueue.begin(), requests.begin(), requests.end());
+		}
+		if (buffer)
+		{
+			aamp_Free(&buffer->ptr);
+			delete buffer;
+		}
+	}
+	pthread_mutex_unlock(&mLock);
+	CurlTerm(AAMP_PREFETCH_CURL_INSTANCE, 1);
+}
+
+
+/**
+ * @brief Take a download from prefetch cache
+ *
+ * Entry is removed once taken, as the stream abstraction keeps its own copy.
+ *
+ * @param[in] url URL of file
+ * @param[in] range Byte range, NULL for whole file
+ * @param[out] buffer Buffer to which file is appended
+ * @param[out] effectiveUrl Effective URL of file
+ * @retval true if file was prefetched
+ */
+bool PrivateInstanceAAMP::RetrieveFromPrefetchCache(const char *url, const char *range, GrowableBuffer *buffer, std::string &effectiveUrl)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mLock);
+	std::unordered_map<std::string, PrefetchEntry>::iterator it = mPrefetchCache.find(GetPrefetchKey(url, range));
+	if (it != mPrefetchCache.end())
+	{
+		aamp_AppendBytes(buffer, it->second.buffer->ptr, it->second.buffer->len);
+		effectiveUrl = it->second.effectiveUrl;
+		mPrefetchCacheOrder.remove(it->first);
+		RemovePrefetchEntry(it);
+		ret = true;
+	}
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Stop prefetch and clear prefetch cache
+ */
+void PrivateInstanceAAMP::ClearPrefetchCache()
+{
+	pthread_mutex_lock(&mLock);
+	bool threadStarted = mPrefetchThreadStarted;
+	mPrefetchThreadStarted = false;
+	mPrefetchQueue.clear();
+	pthread_cond_signal(&mPrefetchCond);
+	pthread_mutex_unlock(&mLock);
+	if (threadStarted)
+	{
+		pthread_join(mPrefetchThreadID, NULL);
+		mPrefetchThreadID = 0;
+	}
+	pthread_mutex_lock(&mLock);
+	if (mPrefetchCache.size() > 0)
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : cache size %d bytes %d\n", __FUNCTION__, __LINE__, (int)mPrefetchCache.size(), (int)mPrefetchCacheBytes);
+	}
+	for (std::unordered_map<std::string, PrefetchEntry>::iterator it = mPrefetchCache.begin(); it != mPrefetchCache.end(); ++it)
+	{
+		aamp_Free(&it->second.buffer->ptr);
+		delete it->second.buffer;
+	}
+	mPrefetchCache.clear();
+	mPrefetchCacheOrder.clear();
+	mPrefetchCacheBytes = 0;
+	mAdPrefetchScheduled = false;
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Schedule prefetch of ad if its position is within lookahead
+ *
+ * @param[in] positionMs Current position of main content
+ */
+void PrivateInstanceAAMP::CheckForAdPrefetch(double positionMs)
+{
+	if (mAdUrl[0] && !mAdPrefetchScheduled && (gpGlobalConfig->adPrefetchSeconds > 0) && (rate == AAMP_NORMAL_PLAY_RATE)
+		&& (positionMs < mAdPosition * 1000) && (positionMs >= (mAdPosition - gpGlobalConfig->adPrefetchLookahead) * 1000))
+	{
+		PrefetchRequest request;
+		request.url = mAdUrl;
+		request.isManifest = true;
+		request.bandwidth = mpStreamAbstractionAAMP ? mpStreamAbstractionAAMP->GetVideoBitrate() : GetPersistedBandwidth();
+		logprintf("PrivateInstanceAAMP::%s:%d : prefetch ad %s at position %f bandwidth %ld\n", __FUNCTION__, __LINE__, mAdUrl, positionMs / 1000, request.bandwidth);
+		mAdPrefetchScheduled = true;
+		SchedulePrefetch(std::vector<PrefetchRequest>(1, request), mAdPosition);
+	}
+}
+
+
+/**
+ * @brief Drop prefetched and queued downloads of splices behind play position
+ *
+ * Such downloads are left when playback skipped the splice, or when the stream
+ * abstraction picked other files at the splice.
+ *
+ * @param[in] positionMs Current position
+ */
+void PrivateInstanceAAMP::EvictPrefetchCache(double positionMs)
+{
+	double position = positionMs / 1000;
+	pthread_mutex_lock(&mLock);
+	for (std::list<std::string>::iterator key = mPrefetchCacheOrder.begin(); key != mPrefetchCacheOrder.end();)
+	{
+		std::unordered_map<std::string, PrefetchEntry>::iterator it = mPrefetchCache.find(*key);
+		if (it == mPrefetchCache.end() || (it->second.splicePosition >= 0 && it->second.splicePosition < position))
+		{
+			if (it != mPrefetchCache.end())
+			{
+				traceprintf("PrivateInstanceAAMP::%s:%d : drop %s splice %f position %f\n", __FUNCTION__, __LINE__, key->c_str(), it->second.splicePosition, position);
+				RemovePrefetchEntry(it);
+			}
+			key = mPrefetchCacheOrder.erase(key);
+		}
+		else
+		{
+			++key;
+		}
+	}
+	for (std::deque<PrefetchRequest>::iterator request = mPrefetchQueue.begin(); request != mPrefetchQueue.end();)
+	{
+		if (request->splicePosition >= 0 && request->splicePosition < position)
+		{
+			request = mPrefetchQueue.erase(request);
+		}
+		else
+		{
+			++request;
+		}
+	}
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Free a prefetch cache entry
+ *
+ * Caller holds mLock and updates mPrefetchCacheOrder.
+ *
+ * @param[in] it Entry to remove
+ */
+void PrivateInstanceAAMP::RemovePrefetchEntry(std::unordered_map<std::string, PrefetchEntry>::iterator it)
+{
+	mPrefetchCacheBytes -= it->second.buffer->len;
+	aamp_Free(&it->second.buffer->ptr);
+	delete it->second.buffer;
+	mPrefetchCache.erase(it);
+}
+
+
+/**
+ * @brief Check if thumbnail tracks of current asset are registered
+ *
+ * @retval true if registered
+ */
+bool PrivateInstanceAAMP::HasThumbnailTracks()
+{
+	pthread_mutex_lock(&mLock);
+	bool ret = !mThumbnailTracks.empty();
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Register thumbnail tracks of current asset
+ *
+ * Called by stream abstraction once manifest is parsed. Tracks are kept across
+ * trick play and seek, so that scrubbing does not depend on pipeline state.
+ *
+ * @param[in] tracks Image tracks, or I-frame track if there are none
+ */
+void PrivateInstanceAAMP::SetThumbnailTracks(const std::vector<ThumbnailTrack> &tracks)
+{
+	pthread_mutex_lock(&mLock);
+	mThumbnailTracks = tracks;
+	mThumbnailTrackIdx = 0;
+	mThumbnailCache.clear();
+	mThumbnailGeneration++;
+	logprintf("PrivateInstanceAAMP::%s:%d : thumbnail tracks %d\n", __FUNCTION__, __LINE__, (int)tracks.size());
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Clear thumbnail tracks and cached thumbnail images
+ */
+void PrivateInstanceAAMP::ClearThumbnails()
+{
+	pthread_mutex_lock(&mLock);
+	mThumbnailTracks.clear();
+	mThumbnailTrackIdx = 0;
+	mThumbnailCache.clear();
+	mThumbnailGeneration++;
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Get available thumbnail tracks
+ *
+ * @retval Thumbnail tracks, empty if asset has none or manifest is not parsed yet
+ */
+std::vector<ThumbnailTrackInfo> PrivateInstanceAAMP::GetAvailableThumbnailTracks()
+{
+	std::vector<ThumbnailTrackInfo> tracks;
+	pthread_mutex_lock(&mLock);
+	for (size_t i = 0; i < mThumbnailTracks.size(); i++)
+	{
+		tracks.push_back(mThumbnailTracks[i].info);
+	}
+	pthread_mutex_unlock(&mLock);
+	return tracks;
+}
+
+
+/**
+ * @brief Select thumbnail track
+ *
+ * @param[in] thumbnailTrack Index in list returned by GetAvailableThumbnailTracks
+ * @retval true if selected
+ */
+bool PrivateInstanceAAMP::SetThumbnailTrack(int thumbnailTrack)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mLock);
+	if (thumbnailTrack >= 0 && thumbnailTrack < (int)mThumbnailTracks.size())
+	{
+		if (thumbnailTrack != mThumbnailTrackIdx)
+		{
+			mThumbnailTrackIdx = thumbnailTrack;
+			mThumbnailCache.clear();
+			mThumbnailGeneration++;
+		}
+		ret = true;
+	}
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Build index of selected thumbnail track if not done yet
+ *
+ * HLS image playlists are fetched on first use, so that tune is not delayed.
+ *
+ * @retval true if selected track is indexed
+ */
+bool PrivateInstanceAAMP::IndexThumbnailTrack()
+{
+	pthread_mutex_lock(&mLock);
+	if (mThumbnailTrackIdx >= (int)mThumbnailTracks.size())
+	{
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	if (mThumbnailTracks[mThumbnailTrackIdx].playlistUrl.empty())
+	{
+		pthread_mutex_unlock(&mLock);
+		return true;
+	}
+	ThumbnailTrack track = mThumbnailTracks[mThumbnailTrackIdx];
+	int generation = mThumbnailGeneration;
+	pthread_mutex_unlock(&mLock);
+
+	bool ret = false;
+	GrowableBuffer playlist;
+	std::string effectiveUrl;
+	long http_error = 0;
+	memset(&playlist, 0, sizeof(playlist));
+	pthread_mutex_lock(&mThumbnailFetchMutex);
+	CurlInit(AAMP_THUMBNAIL_CURL_INSTANCE, 1);
+	bool fetched = GetFile(track.playlistUrl.c_str(), &playlist, effectiveUrl, &http_error, NULL, AAMP_THUMBNAIL_CURL_INSTANCE, true, eMEDIATYPE_DEFAULT);
+	pthread_mutex_unlock(&mThumbnailFetchMutex);
+	if (fetched && playlist.len)
+	{
+		aamp_AppendNulTerminator(&playlist);
+		track.index.clear();
+		StreamAbstractionAAMP_HLS::IndexThumbnailPlaylist(playlist.ptr, effectiveUrl.c_str(), track);
+		track.playlistUrl.clear();
+		pthread_mutex_lock(&mLock);
+		if (generation == mThumbnailGeneration)
+		{
+			mThumbnailTracks[mThumbnailTrackIdx] = track;
+			ret = true;
+		}
+		pthread_mutex_unlock(&mLock);
+		logprintf("PrivateInstanceAAMP::%s:%d : %s thumbnails %d\n", __FUNCTION__, __LINE__, effectiveUrl.c_str(), (int)track.index.size());
+	}
+	else
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : failed to fetch %s http_error %ld\n", __FUNCTION__, __LINE__, track.playlistUrl.c_str(), http_error);
+	}
+	aamp_Free(&playlist.ptr);
+	return ret;
+}
+
+
+/**
+ * @brief Get thumbnails of selected track in a range of media time
+ *
+ * @param[in] startTime Start of range
+ * @param[in] endTime End of range
+ * @param[out] thumbnails Thumbnails overlapping range, in media time order
+ * @retval true if selected track is indexed
+ */
+bool PrivateInstanceAAMP::GetThumbnails(double startTime, double endTime, std::vector<ThumbnailInfo> &thumbnails)
+{
+	if (!IndexThumbnailTrack())
+	{
+		return false;
+	}
+	pthread_mutex_lock(&mLock);
+	bool ret = (mThumbnailTrackIdx < (int)mThumbnailTracks.size());
+	if (ret)
+	{
+		const std::vector<ThumbnailInfo> &index = mThumbnailTracks[mThumbnailTrackIdx].index;
+		for (size_t i = 0; i < index.size(); i++)
+		{
+			if ((index[i].startTime + index[i].duration) > startTime && index[i].startTime < endTime)
+			{
+				thumbnails.push_back(index[i]);
+			}
+		}
+	}
+	pthread_mutex_unlock(&mLock);
+	return ret;
+}
+
+
+/**
+ * @brief Get timed metadata reported in a range of media time
+ *
+ * @param[in] startMS Start of range in milliseconds
+ * @param[in] endMS End of range in milliseconds, exclusive
+ * @param[out] cues Timed metadata in time order
+ */
+void PrivateInstanceAAMP::GetTimedMetadata(double startMS, double endMS, std::vector<TimedMetadataInfo> &cues)
+{
+	pthread_mutex_lock(&mLock);
+	std::map<std::pair<double, std::string>, std::string>::const_iterator it = timedMetadata.lower_bound(std::make_pair(startMS, std::string()));
+	for (; it != timedMetadata.end() && it->first.first < endMS; ++it)
+	{
+		TimedMetadataInfo cue;
+		cue.timeMilliseconds = it->first.first;
+		cue.name = it->first.second;
+		cue.content = it->second;
+		cues.push_back(cue);
+	}
+	pthread_mutex_unlock(&mLock);
+}
+
+
+/**
+ * @brief Get thumbnail of a media position along with its image
+ *
+ * Image is served from thumbnail cache when possible. Otherwise it is downloaded
+ * on caller's thread using dedicated curl instance, and the cached image whose
+ * time window is farthest from position is dropped when cache is full.
+ *
+ * @param[in] position Media position
+ * @param[out] thumbnail Thumbnail covering position
+ * @param[out] image Sprite sheet or I-frame fragment containing thumbnail
+ * @retval true on success
+ */
+bool PrivateInstanceAAMP::GetThumbnail(double position, ThumbnailInfo &thumbnail, std::vector<unsigned char> &image)
+{
+	if (!IndexThumbnailTrack())
+	{
+		return false;
+	}
+	pthread_mutex_lock(&mLock);
+	if (mThumbnailTrackIdx >= (int)mThumbnailTracks.size() || mThumbnailTracks[mThumbnailTrackIdx].index.empty())
+	{
+		pthread_mutex_unlock(&mLock);
+		return false;
+	}
+	const std::vector<ThumbnailInfo> &index = mThumbnailTracks[mThumbnailTrackIdx].index;
+	size_t lo = 0;
+	size_t hi = index.size();
+	while ((hi - lo) > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (index[mid].startTime <= position)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	thumbnail = index[lo];
+	double imageStart = thumbnail.startTime;
+	double imageEnd = thumbnail.startTime + thumbnail.duration;
+	for (size_t i = lo; i > 0 && index[i - 1].url == thumbnail.url && index[i - 1].range == thumbnail.range; i--)
+	{
+		imageStart = index[i - 1].startTime;
+	}
+	for (size_t i = lo + 1; i < index.size() && index[i].url == thumbnail.url && index[i].range == thumbnail.range; i++)
+	{
+		imageEnd = index[i].startTime + index[i].duration;
+	}
+	for (std::list<ThumbnailImage>::iterator it = mThumbnailCache.begin(); it != mThumbnailCache.end(); ++it)
+	{
+		if (it->url == thumbnail.url && it->range == thumbnail.range)
+		{
+			image = it->data;
+			pthread_mutex_unlock(&mLock);
+			return true;
+		}
+	}
+	int generation = mThumbnailGeneration;
+	pthread_mutex_unlock(&mLock);
+
+	GrowableBuffer buffer;
+	std::string effectiveUrl;
+	long http_error = 0;
+	memset(&buffer, 0, sizeof(buffer));
+	pthread_mutex_lock(&mThumbnailFetchMutex);
+	CurlInit(AAMP_THUMBNAIL_CURL_INSTANCE, 1);
+	bool ret = GetFile(thumbnail.url.c_str(), &buffer, effectiveUrl, &http_error, thumbnail.range.empty() ? NULL : thumbnail.range.c_str(), AAMP_THUMBNAIL_CURL_INSTANCE, true, eMEDIATYPE_DEFAULT);
+	pthread_mutex_unlock(&mThumbnailFetchMutex);
+	if (ret && buffer.len)
+	{
+		ThumbnailImage entry;
+		entry.url = thumbnail.url;
+		entry.range = thumbnail.range;
+		entry.startTime = imageStart;
+		entry.endTime = imageEnd;
+		entry.data.assign((unsigned char *)buffer.ptr, (unsigned char *)buffer.ptr + buffer.len);
+		image = entry.data;
+		pthread_mutex_lock(&mLock);
+		if (generation == mThumbnailGeneration)
+		{
+			while (!mThumbnailCache.empty() && ((int)mThumbnailCache.size() >= gpGlobalConfig->thumbnailCacheSize))
+			{
+				std::list<ThumbnailImage>::iterator farthest = mThumbnailCache.end();
+				double farthestDistance = -1;
+				for (std::list<ThumbnailImage>::iterator it = mThumbnailCache.begin(); it != mThumbnailCache.end(); ++it)
+				{
+					double distance = (position < it->startTime) ? (it->startTime - position) : ((position > it->endTime) ? (position - it->endTime) : 0);
+					if (distance > farthestDistance)
+					{
+						farthestDistance = distance;
+						farthest = it;
+					}
+				}
+				mThumbnailCache.erase(farthest);
+			}
+			mThumbnailCache.push_back(entry);
+		}
+		pthread_mutex_unlock(&mLock);
+		traceprintf("PrivateInstanceAAMP::%s:%d : position %f url %s bytes %d\n", __FUNCTION__, __LINE__, position, effectiveUrl.c_str(), (int)buffer.len);
+	}
+	else
+	{
+		logprintf("PrivateInstanceAAMP::%s:%d : failed to fetch %s http_error %ld\n", __FUNCTION__, __LINE__, thumbnail.url.c_str(), http_error);
+		ret = false;
+	}
+	aamp_Free(&buffer.ptr);
+	return ret;
+}
+
+
 /**
  *   @brief To set the error code to be used for playback stalled error.
  *
@@ -6235,7 +7917,7 @@ void PrivateInstanceAAMP::ClearPlaylistCache()
  */
 void PrivateInstanceAAMP::SetStallErrorCode(int errorCode)
 {
-	gpGlobalConfig->stallErrorCode = errorCode;
+	mStallErrorCode = errorCode;
 }
 
 
@@ -6246,12 +7928,12 @@ void PrivateInstanceAAMP::SetStallErrorCode(int errorCode)
  */
 void PrivateInstanceAAMP::SetStallTimeout(int timeoutMS)
 {
-	gpGlobalConfig->stallTimeoutInMS = timeoutMS;
+	mStallTimeoutInMS = timeoutMS;
 }
 
 void PrivateInstanceAAMP::SetReportInterval(int reportIntervalMS)
 {
-	gpGlobalConfig->reportProgressInterval = reportIntervalMS;
+	mReportProgressInterval = reportIntervalMS;
 }
 
 /**
@@ -6261,7 +7943,7 @@ void PrivateInstanceAAMP::SendStalledErrorEvent()
 {
 	char description[MAX_ERROR_DESCRIPTION_LENGTH];
 	memset(description, '\0', MAX_ERROR_DESCRIPTION_LENGTH);
-	snprintf(description, MAX_ERROR_DESCRIPTION_LENGTH - 1, "Playback has been stalled for more than %d ms", gpGlobalConfig->stallTimeoutInMS);
+	snprintf(description, MAX_ERROR_DESCRIPTION_LENGTH - 1, "Playback has been stalled for more than %d ms", mStallTimeoutInMS);
 	SendErrorEvent(AAMP_TUNE_PLAYBACK_STALLED, description);
 }
 
@@ -6573,7 +8255,7 @@ void PrivateInstanceAAMP::SetInitialBitrate(long bitrate)
 {
 	if (bitrate > 0)
 	{
-		gpGlobalConfig->defaultBitrate = bitrate;
+		mInitialBitrate = bitrate;
 	}
 }
 
@@ -6587,7 +8269,7 @@ void PrivateInstanceAAMP::SetInitialBitrate4K(long bitrate4K)
 {
 	if (bitrate4K > 0)
 	{
-		gpGlobalConfig->defaultBitrate4K = bitrate4K;
+		mInitialBitrate4K = bitrate4K;
 	}
 }
 
@@ -6601,7 +8283,7 @@ void PrivateInstanceAAMP::SetNetworkTimeout(int timeout)
 {
 	if (timeout > 0)
 	{
-		gpGlobalConfig->fragmentDLTimeout = timeout;
+		mNetworkTimeout = timeout;
 	}
 }
 
@@ -6615,7 +8297,7 @@ void PrivateInstanceAAMP::SetDownloadBufferSize(int bufferSize)
 {
 	if (bufferSize > 0)
 	{
-		gpGlobalConfig->maxCachedFragmentsPerTrack = bufferSize;
+		mMaxCachedFragmentsPerTrack = bufferSize;
 	}
 }
 
@@ -6640,7 +8322,7 @@ void PrivateInstanceAAMP::SetPreferredDRM(DRMSystems drmType)
     else
     {
         AAMPLOG_INFO("%s:%d set Preferred drm: %d\n", __FUNCTION__, __LINE__, drmType);
-        gpGlobalConfig->preferredDrm = drmType;
+        mPreferredDrm = drmType;
     }
 }
 
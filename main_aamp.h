@@ -448,6 +448,57 @@ enum AuthTokenErrors {
 	eAUTHTOKEN_INVALID_STATUS_CODE = -2
 };
 
+/**
+ * @brief Thumbnail track available for scrubbing previews
+ */
+struct ThumbnailTrackInfo
+{
+	long bandwidth;         /**< Bandwidth of track in bits per second */
+	int width;              /**< Width of a thumbnail */
+	int height;             /**< Height of a thumbnail */
+	int tileColumns;        /**< Thumbnails per row of sprite image, 1 if not tiled */
+	int tileRows;           /**< Thumbnails per column of sprite image, 1 if not tiled */
+	bool iframeTrack;       /**< Thumbnails are I-frame fragments to be decoded rather than images */
+	std::string initUrl;    /**< Initialization fragment to decode I-frame fragments with, empty if not needed */
+};
+
+/**
+ * @brief Thumbnail covering a range of media time
+ */
+struct ThumbnailInfo
+{
+	std::string url;        /**< Url of sprite image or I-frame fragment */
+	std::string range;      /**< Byte range within url, empty for whole file */
+	double startTime;       /**< Media position in seconds from which thumbnail applies */
+	double duration;        /**< Media duration in seconds covered by thumbnail */
+	int x;                  /**< Horizontal offset of thumbnail within sprite image */
+	int y;                  /**< Vertical offset of thumbnail within sprite image */
+	int width;              /**< Width of thumbnail */
+	int height;             /**< Height of thumbnail */
+};
+
+
+/**
+ * @brief Timed metadata (subscribed HLS tag or DASH event) reported by player
+ */
+struct TimedMetadataInfo
+{
+	double timeMilliseconds; /**< Media time of metadata */
+	std::string name;        /**< Tag or scheme name */
+	std::string content;     /**< Metadata content */
+};
+
+
+/**
+ * @brief Counts of playback recoveries from underflow and PTS errors, per tier
+ */
+struct PlaybackRecoveryInfo
+{
+	int rebufferCount;      /**< Paused to refill with profile ramp-down */
+	int resyncCount;        /**< Pipeline flushed from affected track's next fragment, fragments kept */
+	int retuneCount;        /**< Full re-tune */
+};
+
 
 /**
  * @brief GStreamer Abstraction class for the implementation of AAMPGstPlayer and gstaamp plugin
@@ -628,6 +679,16 @@ public:
 	 */
 	virtual bool Discontinuity( MediaType mediaType) = 0;
 
+	/**
+	 *   @brief Continue timeline of a stream type across a discontinuity without flush
+	 *
+	 *   @param[in]  mediaType        Media Type
+	 *   @param[in]  discontinuityPts PTS at which timeline before discontinuity would have continued, 0 if demuxer restamps
+         *
+	 *   @return TRUE if discontinuity processed without flush
+	 */
+	virtual bool ContinueTimeline(MediaType mediaType, double discontinuityPts){ return false; }
+
 
 	/**
 	 *   @brief Check whether cach is empty
@@ -638,6 +699,15 @@ public:
 	 */
 	virtual bool IsCacheEmpty(MediaType mediaType){ return true; };
 
+	/**
+	 *   @brief Get bytes queued in sink, not yet consumed by decoder
+	 *
+	 *   @param[in]  mediaType  Media Type
+         *
+	 *   @return Queued bytes, -1 if not known
+	 */
+	virtual long long GetCacheLevelBytes(MediaType mediaType){ return -1; };
+
 	/**
 	 *   @brief API to notify that fragment caching done
 	 *
@@ -1060,6 +1130,63 @@ public:
 	 */
 	std::vector<long> GetAudioBitrates(void);
 
+	/**
+	 *   @brief To get the thumbnail tracks available for scrubbing previews.
+	 *
+	 *   Image tracks are listed first, I-frame track is listed when there are none.
+	 *
+	 *   @return Available thumbnail tracks
+	 */
+	std::vector<ThumbnailTrackInfo> GetAvailableThumbnailTracks(void);
+
+	/**
+	 *   @brief To select the thumbnail track used for previews.
+	 *
+	 *   @param[in] Index of track in list returned by GetAvailableThumbnailTracks
+	 *   @return true if track is selected
+	 */
+	bool SetThumbnailTrack(int thumbnailTrack);
+
+	/**
+	 *   @brief To get the thumbnails of selected track in a range of media time.
+	 *
+	 *   @param[in] startTime - Start of range in seconds
+	 *   @param[in] endTime - End of range in seconds
+	 *   @return Thumbnails in media time order
+	 */
+	std::vector<ThumbnailInfo> GetThumbnails(double startTime, double endTime);
+
+	/**
+	 *   @brief To get the thumbnail of a media position along with its image.
+	 *
+	 *   Images are cached around recently requested positions, so scrubbing
+	 *   back and forth is served from cache without touching playback.
+	 *
+	 *   @param[in]  position - Media position in seconds
+	 *   @param[out] thumbnail - Thumbnail covering position
+	 *   @param[out] image - Sprite image, or I-frame fragment for I-frame track
+	 *   @return true on success
+	 */
+	bool GetThumbnail(double position, ThumbnailInfo &thumbnail, std::vector<unsigned char> &image);
+
+	/**
+	 *   @brief To get the timed metadata of current asset in a range of media time.
+	 *
+	 *   Lets applications fetch cues in bulk, e.g. with timed-metadata-events=0.
+	 *
+	 *   @param[in] startMS - Start of range in milliseconds
+	 *   @param[in] endMS - End of range in milliseconds, exclusive
+	 *   @return Timed metadata in time order
+	 */
+	std::vector<TimedMetadataInfo> GetTimedMetadata(double startMS, double endMS);
+
+	/**
+	 *   @brief To get the counts of recoveries from underflow and PTS errors.
+	 *
+	 *   @return Recovery counts per tier since player instance was created
+	 */
+	PlaybackRecoveryInfo GetPlaybackRecoveryInfo(void);
+
 	/**
 	 *   @brief To set the initial bitrate value.
 	 *
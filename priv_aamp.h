@@ -38,8 +38,10 @@
 #include <map>
 #include <set>
 #include <list>
+#include <deque>
 #include <sstream>
 #include <mutex>
+#include <memory>
 
 #ifdef __APPLE__
 #define aamp_pthread_setname(tid,name) pthread_setname_np(name)
@@ -60,7 +62,11 @@
 #define MAX_URI_LENGTH (2048)           /**< Increasing size to include longer urls */
 #define AAMP_TRACK_COUNT 2              /**< internal use - audio+video track */
 #define AAMP_DRM_CURL_COUNT 2           /**< audio+video track DRMs */
-#define MAX_CURL_INSTANCE_COUNT (AAMP_TRACK_COUNT + AAMP_DRM_CURL_COUNT)    /**< Maximum number of CURL instances */
+#define AAMP_TRICKPLAY_PREFETCH_CURL_COUNT 2    /**< parallel I-frame downloads during trick play */
+#define AAMP_TRICKPLAY_PREFETCH_CURL_START (AAMP_TRACK_COUNT + AAMP_DRM_CURL_COUNT)    /**< First curl instance used for I-frame prefetch */
+#define AAMP_THUMBNAIL_CURL_INSTANCE (AAMP_TRICKPLAY_PREFETCH_CURL_START + AAMP_TRICKPLAY_PREFETCH_CURL_COUNT)    /**< Curl instance used for thumbnail downloads */
+#define AAMP_PREFETCH_CURL_INSTANCE (AAMP_THUMBNAIL_CURL_INSTANCE + 1)    /**< Curl instance used for ad and period lookahead downloads */
+#define MAX_CURL_INSTANCE_COUNT (AAMP_PREFETCH_CURL_INSTANCE + 1)    /**< Maximum number of CURL instances */
 #define AAMP_MAX_PIPE_DATA_SIZE 1024    /**< Max size of data send across pipe */
 #define AAMP_LIVE_OFFSET 15             /**< Live offset in seconds */
 #define AAMP_CDVR_LIVE_OFFSET 30 	/**< Live offset in seconds for CDVR hot recording */
@@ -75,6 +81,7 @@
 #define DEFAULT_INTERVAL_BETWEEN_PLAYLIST_UPDATES_MS (6*1000)   /**< Interval between playlist refreshes */
 #define TRICKPLAY_NETWORK_PLAYBACK_FPS 4            /**< Frames rate for trickplay from CDN server */
 #define TRICKPLAY_TSB_PLAYBACK_FPS 8                /**< Frames rate for trickplay from TSB */
+#define TRICKPLAY_MIN_PLAYBACK_FPS 2                /**< Lowest frame rate trickplay adapts down to when I-frames can't be downloaded in time */
 #define DEFAULT_INIT_BITRATE     2500000            /**< Initial bitrate: 2.5 mb - for non-4k playback */
 #define DEFAULT_INIT_BITRATE_4K 13000000            /**< Initial bitrate for 4K playback: 13mb ie, 3/4 profile */
 #define DEFAULT_MINIMUM_CACHE_VOD_SECONDS  0        /**< Default cache size of VOD playback */
@@ -91,14 +98,30 @@
 #define DEF_LICENSE_REQ_RETRY_WAIT_TIME 500			/**< Wait time in milliseconds before retrying for DRM license */
 
 #define DEFAULT_CACHED_FRAGMENTS_PER_TRACK  3       /**< Default cached fragements per track */
+#define MAX_IFRAME_INDEX_ENTRIES 2048               /**< Max fragments in I-frame index built from TS segments */
+#define IFRAME_INDEX_PROBE_SIZE (256*1024)          /**< Head of a TS segment not yet in I-frame index, fetched in trick play to locate its key frame */
+#define DEFAULT_REVERSE_GOP_CACHE_SIZE 0            /**< Default segments in GOP cache used by rewind without I-frame track, 0 to disable */
+#define DEFAULT_REVERSE_GOP_MAX_RATE 4              /**< Default max rewind rate using all key frames of segments */
+#define DEFAULT_SEEK_RETENTION_SECONDS 10           /**< Default seconds of injected fragments kept behind play position for in-buffer seek */
+#define DEFAULT_THUMBNAIL_CACHE_SIZE 16             /**< Default number of thumbnail images cached around scrub position */
+#define DEFAULT_TIMED_METADATA_LIMIT 1000           /**< Default number of timed metadata entries kept for dedupe and range query */
+#define DEFAULT_UNDERFLOW_REBUFFER_TIMEOUT_MS 5000  /**< Default time to refill after underflow before escalating to track resync */
+#define UNDERFLOW_REBUFFER_CHECK_INTERVAL_MS 250    /**< Interval of refill checks while rebuffering after underflow */
+#define DEFAULT_AD_PREFETCH_SECONDS 6               /**< Default seconds of media fetched ahead of an ad or period splice */
+#define DEFAULT_AD_PREFETCH_LOOKAHEAD_SECONDS 20    /**< Default seconds before ad position at which ad prefetch starts */
+#define MAX_PREFETCH_CACHE_ENTRIES 64               /**< Maximum number of downloads kept in prefetch cache */
+#define DEFAULT_AD_PREFETCH_CACHE_SIZE 16           /**< Default MB of downloads kept in prefetch cache */
+#define DEFAULT_HARVEST_QUEUE_SIZE 16               /**< Default MB of harvested files waiting for harvest writer */
+#define HARVEST_INDEX_FILE "harvest-index.txt"      /**< Timing index written next to harvested files, for paced replay */
 #define DEFAULT_BUFFER_HEALTH_MONITOR_DELAY 10
-#define DEFAULT_BUFFER_HEALTH_MONITOR_INTERVAL 5
+#define DEFAULT_STALL_PREDICTION_THRESHOLD 6        /**< Default seconds of predicted time to empty at which ABR ramps down and prefetch is deferred */
 
 #define DEFAULT_STALL_ERROR_CODE (7600)             /**< Default stall error code: 7600 */
 #define DEFAULT_STALL_DETECTION_TIMEOUT (10000)     /**< Stall detection timeout: 10sec */
 #define FRAGMENT_DOWNLOAD_WARNING_THRESHOLD 2000    /**< MAX Fragment download threshold time in Msec*/
 
 #define DEFAULT_REPORT_PROGRESS_INTERVAL (1000)     /**< Progress event reporting interval: 1sec */
+#define DEFAULT_POSITION_SAMPLE_INTERVAL (2000)     /**< Max age of sampled pipeline position before it is queried again: 2sec */
 #define NOW_SYSTEM_TS_MS std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()     /**< Getting current system clock in milliseconds */
 #define NOW_STEADY_TS_MS std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()     /**< Getting current steady clock in milliseconds */
 
@@ -456,6 +479,8 @@ public:
 	bool fogSupportsDash;       /**< Enable FOG support for DASH*/
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
 	int harvest;                /**< Save decrypted fragments for debugging*/
+	int harvestQueueSize;       /**< MB of harvested files queued for writer, beyond which files are dropped*/
+	bool harvestCompress;       /**< Write harvested files gzip compressed*/
 #endif
 
 	AampLogManager logging;             	/**< Aamp log manager class*/
@@ -468,8 +493,22 @@ public:
 	TunedEventConfig tunedEventConfigVOD;   /**< When to send TUNED event for VOD*/
 	int demuxHLSVideoTsTrackTM;             /**< Demux video track from HLS transport stream track mode*/
 	int demuxedAudioBeforeVideo;            /**< Send demuxed audio before video*/
+	int demuxPipeline;                      /**< Inject demuxed audio/video from dedicated sender threads*/
+	int remuxHLSTsToMp4;                    /**< Remux demuxed HLS TS tracks to fragmented MP4*/
+	int iframeIndexFromSegments;            /**< Index key frames of TS segments for trick play without I-frame track*/
+	int reverseGOPCacheSize;                /**< Segments whose key frames are kept for rewind without I-frame track*/
+	int reverseGOPMaxRate;                  /**< Max rewind rate fetching whole segments without I-frame track*/
+	int seekInBuffer;                       /**< Seek within already fetched fragments without re-tune*/
+	int seekRetentionSeconds;               /**< Seconds of injected fragments kept behind play position for in-buffer seek*/
+	int thumbnailCacheSize;                 /**< Number of thumbnail images cached, those farthest from requested position are dropped first*/
+	int timedMetadataLimit;                 /**< Number of timed metadata entries kept, earliest are dropped first*/
+	bool timedMetadataEvents;               /**< Send an event for each new timed metadata entry*/
+	int adPrefetchSeconds;                  /**< Seconds of media fetched ahead of an ad or period splice, 0 to disable*/
+	int adPrefetchLookahead;                /**< Seconds before ad position at which ad prefetch starts*/
+	int adPrefetchCacheSize;                /**< MB of prefetched downloads kept, oldest are dropped first*/
 	bool playlistsParallelFetch;            /**< Enabled parallel fetching of audio & video playlists*/
 	bool prefetchIframePlaylist;            /**< Enabled prefetching of I-Frame playlist*/
+	bool conditionalPlaylistRefresh;        /**< Refresh live manifest/ playlist with conditional GET, skip re-index if unchanged*/
 	int forceEC3;                           /**< Forcefully enable DDPlus*/
 	int disableEC3;                         /**< Disable DDPlus*/
 	int disableATMOS;                       /**< Disable Dolby ATMOS*/
@@ -489,7 +528,7 @@ public:
 	int abrOutlierDiffBytes;                /**< Adaptive bitrate outlier, if values goes beyond this*/
 	int abrNwConsistency;                   /**< Adaptive bitrate network consistency*/
 	int bufferHealthMonitorDelay;           /**< Buffer health monitor start delay after tune/ seek*/
-	int bufferHealthMonitorInterval;        /**< Buffer health monitor interval*/
+	int stallPredictionThreshold;           /**< Predicted seconds to buffer empty at which stall is avoided*/
 	bool hlsAVTrackSyncUsingStartTime;      /**< HLS A/V track to be synced with start time*/
 	char* licenseServerURL;                 /**< License server URL*/
 	bool licenseServerLocalOverride;        /**< Enable license server local overriding*/
@@ -497,17 +536,24 @@ public:
 	bool vodTrickplayFPSLocalOverride;      /**< Enabled VOD Trickplay FPS local overriding*/
 	int linearTrickplayFPS;                 /**< Trickplay frames per second for LIVE*/
 	bool linearTrickplayFPSLocalOverride;   /**< Enabled LIVE Trickplay FPS local overriding*/
+	int trickplayPrefetch;                  /**< Number of I-frames downloaded in parallel ahead of trickplay, 0 to fetch serially*/
+	int trickplayMinFPS;                    /**< Lowest frames per second trickplay adapts down to on slow network*/
 	int stallErrorCode;                     /**< Stall error code*/
 	int stallTimeoutInMS;                   /**< Stall timeout in milliseconds*/
 	const char* httpProxy;                  /**< HTTP proxy address*/
 	int reportProgressInterval;             /**< Interval of progress reporting*/
+	int positionSampleInterval;             /**< Pipeline position is queried at most once per interval (ms), interpolated in between*/
+	int gstBufferPool;                      /**< Inject through appsrc buffers from pool/allocator negotiated with downstream*/
 	DRMSystems preferredDrm;                /**< Preferred DRM*/
 	bool  isUsingLocalConfigForPreferredDRM;          /**< Preferred DRM configured as part of aamp.cfg */
 	bool mpdDiscontinuityHandling;          /**< Enable MPD discontinuity handling*/
 	bool mpdDiscontinuityHandlingCdvr;      /**< Enable MPD discontinuity handling for CDVR*/
+	bool gaplessDiscontinuity;              /**< Continue timeline across codec compatible discontinuities without pipeline flush*/
 	bool bForceHttp;                        /**< Force HTTP*/
 	int abrSkipDuration;                    /**< Initial duration for ABR skip*/
 	bool internalReTune;                    /**< Internal re-tune on underflows/ pts errors*/
+	bool underflowRecovery;                 /**< Try rebuffer and track resync on underflows/ pts errors before re-tune*/
+	int underflowRebufferTimeout;           /**< Time in ms to refill after underflow before escalating to track resync*/
 	int ptsErrorThreshold;                       /**< Max number of back-to-back PTS errors within designated time*/
 	bool bAudioOnlyPlayback;                /**< AAMP Audio Only Playback*/
 	bool gstreamerBufferingBeforePlay;      /**< Enable pre buffering logic which ensures minimum buffering is done before pipeline play*/
@@ -530,22 +576,26 @@ public:
 		bEnableCC(true),
 #endif
 #ifdef AAMP_HARVEST_SUPPORT_ENABLED
-		harvest(0),
+		harvest(0), harvestQueueSize(DEFAULT_HARVEST_QUEUE_SIZE), harvestCompress(false),
 #endif
 		gPreservePipeline(0), gAampDemuxHLSAudioTsTrack(1), gAampMergeAudioTrack(1), forceEC3(0),
-		gAampDemuxHLSVideoTsTrack(1), demuxHLSVideoTsTrackTM(1), gThrottle(0), demuxedAudioBeforeVideo(0),
-		playlistsParallelFetch(false), prefetchIframePlaylist(false),
+		gAampDemuxHLSVideoTsTrack(1), demuxHLSVideoTsTrackTM(1), gThrottle(0), demuxedAudioBeforeVideo(0), demuxPipeline(0), remuxHLSTsToMp4(0), iframeIndexFromSegments(1), reverseGOPCacheSize(DEFAULT_REVERSE_GOP_CACHE_SIZE), reverseGOPMaxRate(DEFAULT_REVERSE_GOP_MAX_RATE),
+		seekInBuffer(0), seekRetentionSeconds(DEFAULT_SEEK_RETENTION_SECONDS), thumbnailCacheSize(DEFAULT_THUMBNAIL_CACHE_SIZE),
+		timedMetadataLimit(DEFAULT_TIMED_METADATA_LIMIT), timedMetadataEvents(true),
+		adPrefetchSeconds(DEFAULT_AD_PREFETCH_SECONDS), adPrefetchLookahead(DEFAULT_AD_PREFETCH_LOOKAHEAD_SECONDS), adPrefetchCacheSize(DEFAULT_AD_PREFETCH_CACHE_SIZE),
+		playlistsParallelFetch(false), prefetchIframePlaylist(false), conditionalPlaylistRefresh(true),
 		disableEC3(0), disableATMOS(0),abrOutlierDiffBytes(DEFAULT_ABR_OUTLIER),abrSkipDuration(DEFAULT_ABR_SKIP_DURATION),
 		liveOffset(AAMP_LIVE_OFFSET),cdvrliveOffset(AAMP_CDVR_LIVE_OFFSET), adPositionSec(0), adURL(0),abrNwConsistency(DEFAULT_ABR_NW_CONSISTENCY_CNT),
 		disablePlaylistIndexEvent(1), enableSubscribedTags(1), dashIgnoreBaseURLIfSlash(false),fragmentDLTimeout(CURL_FRAGMENT_DL_TIMEOUT),
 		licenseAnonymousRequest(false), minVODCacheSeconds(DEFAULT_MINIMUM_CACHE_VOD_SECONDS),
-		bufferHealthMonitorDelay(DEFAULT_BUFFER_HEALTH_MONITOR_DELAY), bufferHealthMonitorInterval(DEFAULT_BUFFER_HEALTH_MONITOR_INTERVAL),
+		bufferHealthMonitorDelay(DEFAULT_BUFFER_HEALTH_MONITOR_DELAY), stallPredictionThreshold(DEFAULT_STALL_PREDICTION_THRESHOLD),
 		preferredDrm(eDRM_PlayReady), hlsAVTrackSyncUsingStartTime(false), licenseServerURL(NULL), licenseServerLocalOverride(false),
 		vodTrickplayFPS(TRICKPLAY_NETWORK_PLAYBACK_FPS),vodTrickplayFPSLocalOverride(false),
 		linearTrickplayFPS(TRICKPLAY_TSB_PLAYBACK_FPS),linearTrickplayFPSLocalOverride(false),
+		trickplayPrefetch(AAMP_TRICKPLAY_PREFETCH_CURL_COUNT), trickplayMinFPS(TRICKPLAY_MIN_PLAYBACK_FPS),
 		stallErrorCode(DEFAULT_STALL_ERROR_CODE), stallTimeoutInMS(DEFAULT_STALL_DETECTION_TIMEOUT), httpProxy(0),
-		reportProgressInterval(DEFAULT_REPORT_PROGRESS_INTERVAL), mpdDiscontinuityHandling(true), mpdDiscontinuityHandlingCdvr(true),bForceHttp(false),
-		internalReTune(true), bAudioOnlyPlayback(false), gstreamerBufferingBeforePlay(true),licenseRetryWaitTime(DEF_LICENSE_REQ_RETRY_WAIT_TIME),
+		reportProgressInterval(DEFAULT_REPORT_PROGRESS_INTERVAL), positionSampleInterval(DEFAULT_POSITION_SAMPLE_INTERVAL), gstBufferPool(1), mpdDiscontinuityHandling(true), mpdDiscontinuityHandlingCdvr(true), gaplessDiscontinuity(false),bForceHttp(false),
+		internalReTune(true), underflowRecovery(true), underflowRebufferTimeout(DEFAULT_UNDERFLOW_REBUFFER_TIMEOUT_MS), bAudioOnlyPlayback(false), gstreamerBufferingBeforePlay(true),licenseRetryWaitTime(DEF_LICENSE_REQ_RETRY_WAIT_TIME),
 		iframeBitrate(0), iframeBitrate4K(0),ptsErrorThreshold(MAX_PTS_ERRORS_THRESHOLD),
 		prLicenseServerURL(NULL), wvLicenseServerURL(NULL)
 		,enableMicroEvents(false), mpdHarvestLimit(0),
@@ -623,7 +673,86 @@ extern GlobalConfigAAMP *gpGlobalConfig;
  *
  * @return void
  */
-void aamp_ResolveURL(char *dst, const char *base, const char *uri);
+void aamp_ResolveURL(std::string &dst, const char *base, const char *uri);
+
+/**
+ * @class AampUrl
+ * @brief Compact url of a file, resolved only when it is downloaded
+ *
+ * Base url, the effective url of the playlist, is shared by all urls built from the
+ * same track state, so only the part relative to it is kept per url. Short segment
+ * names fit in small string storage of std::string.
+ */
+class AampUrl
+{
+public:
+	/**
+	 * @brief Hash of AampUrl, for use as unordered_map key
+	 */
+	struct Hash
+	{
+		size_t operator()(const AampUrl &url) const
+		{
+			return std::hash<std::string>()(url.mRelative) ^ (url.mBase ? url.mBase->size() : 0);
+		}
+	};
+
+	/**
+	 * @brief AampUrl Constructor, empty url
+	 */
+	AampUrl() : mBase(), mRelative()
+	{
+	}
+
+	/**
+	 * @brief AampUrl Constructor
+	 *
+	 * @param[in] base - Shared base URL, not referred to when uri is absolute
+	 * @param[in] uri - File path relative to base, or absolute URL
+	 */
+	AampUrl(const std::shared_ptr<const std::string> &base, const char *uri);
+
+	/**
+	 * @brief Get resolved URL
+	 *
+	 * @return URL
+	 */
+	std::string Resolve() const;
+
+	/**
+	 * @brief Check whether url is empty
+	 *
+	 * @return true if empty
+	 */
+	bool empty() const
+	{
+		return mRelative.empty();
+	}
+
+	/**
+	 * @brief Compare urls without resolving them
+	 *
+	 * @param[in] other - Url to compare with
+	 *
+	 * @return true if base and relative part are equal
+	 */
+	bool operator==(const AampUrl &other) const
+	{
+		if (mRelative != other.mRelative)
+		{
+			return false;
+		}
+		if (mBase == other.mBase)
+		{
+			return true;
+		}
+		return mBase && other.mBase && (*mBase == *other.mBase);
+	}
+
+private:
+	std::shared_ptr<const std::string> mBase; /**< Shared base URL, NULL when mRelative is absolute */
+	std::string mRelative;                    /**< File path relative to mBase */
+};
 
 /**
  * @brief Get current time from epoch is milliseconds
@@ -1292,30 +1421,14 @@ public:
 };
 
 /**
- * @brief Class for Timed Metadata
+ * @brief Tiers of in-place recovery from underflow and PTS errors
  */
-class TimedMetadata
+enum RecoveryTier
 {
-public:
-
-	/**
-	 * @brief TimedMetadata Constructor
-	 */
-	TimedMetadata() : _timeMS(0), _name(""), _content("") {}
-
-	/**
-	 * @brief TimedMetadata Constructor
-	 *
-	 * @param[in] timeMS - Time in milliseconds
-	 * @param[in] name - Metadata name
-	 * @param[in] content - Metadata content
-	 */
-	TimedMetadata(double timeMS, std::string name, std::string content) : _timeMS(timeMS), _name(name), _content(content) {}
-
-public:
-	double      _timeMS;     /**< Time in milliseconds */
-	std::string _name;       /**< Metadata name */
-	std::string _content;    /**< Metadata content */
+	eRECOVERY_NONE,         /**< No recovery in progress */
+	eRECOVERY_REBUFFER,     /**< Paused to refill, with profile ramp-down */
+	eRECOVERY_RESYNC,       /**< Pipeline flushed through discontinuity of affected track, fragments kept */
+	eRECOVERY_RETUNE        /**< Full re-tune */
 };
 
 
@@ -1337,6 +1450,76 @@ struct httpRespHeaderData {
 };
 
 
+/**
+ * @brief Thumbnail track registered by stream abstraction
+ */
+struct ThumbnailTrack
+{
+	ThumbnailTrackInfo info;            /**< Track details exposed to application */
+	std::string playlistUrl;            /**< HLS playlist to index on first use, empty once index is built */
+	std::vector<ThumbnailInfo> index;   /**< Thumbnails in media time order */
+};
+
+/**
+ * @brief Thumbnail image kept for scrubbing
+ */
+struct ThumbnailImage
+{
+	std::string url;                    /**< Url of image */
+	std::string range;                  /**< Byte range of image, empty for whole file */
+	double startTime;                   /**< Start of media time covered by image */
+	double endTime;                     /**< End of media time covered by image */
+	std::vector<unsigned char> data;    /**< Image data */
+};
+
+/**
+ * @brief Validators of a refreshed manifest or playlist, for conditional download
+ */
+struct HttpValidators
+{
+	std::string url;                    /**< Url which validators belong to */
+	std::string etag;                   /**< ETag of last response, sent as If-None-Match */
+	std::string lastModified;           /**< Last-Modified of last response, sent as If-Modified-Since */
+	size_t bodyHash;                    /**< Hash of last response body */
+	bool notModified;                   /**< Set by GetFile, true on 304 or when body is identical to last one */
+};
+
+/**
+ * @brief Download scheduled ahead of an ad or period splice
+ */
+struct PrefetchRequest
+{
+	std::string url;                    /**< Url to fetch */
+	std::string range;                  /**< Byte range, empty for whole file */
+	bool isManifest;                    /**< Manifest or playlist, expanded to its first fragments once fetched */
+	long bandwidth;                     /**< Video bandwidth used to pick representation when expanding manifest */
+	double splicePosition;              /**< Position in seconds of splice the download is needed at, negative if unknown; set by SchedulePrefetch */
+};
+
+/**
+ * @brief Download kept in prefetch cache until its splice
+ */
+struct PrefetchEntry
+{
+	GrowableBuffer *buffer;             /**< Downloaded file */
+	std::string effectiveUrl;           /**< Effective URL of file */
+	double splicePosition;              /**< Position in seconds of splice the file is needed at, negative if unknown */
+};
+
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+/**
+ * @brief Harvested file waiting for harvest writer
+ */
+struct HarvestRequest
+{
+	std::string path;                   /**< Path of file to be written */
+	std::string url;                    /**< Url file was downloaded from */
+	GrowableBuffer buffer;              /**< File content, owned by request */
+	bool isFragment;                    /**< Media fragment, else manifest or playlist */
+	long long fetchTimeMs;              /**< Time file was downloaded, since start of harvest */
+};
+#endif
+
 /**
  * @brief  Structure of the event listener list
  */
@@ -1409,6 +1592,15 @@ public:
 	 */
 	void TuneHelper(TuneType tuneType);
 
+	/**
+	 * @brief Seek to seek_pos_seconds using fragments already fetched, without tearing down the stream
+	 *
+	 * Only the pipeline is flushed; falls back to caller doing TuneHelper if position is not buffered.
+	 *
+	 * @return true if seek was done within buffer
+	 */
+	bool SeekInBuffer();
+
 	/**
 	 * @brief Terminate the stream
 	 *
@@ -1496,6 +1688,8 @@ public:
 	char tunedManifestUrl[MAX_URI_LENGTH];
 
 	bool mbDownloadsBlocked;
+	bool mbSeekInBuffer;    /**< Set while injection is stopped for in-buffer seek, interrupts BlockUntilGstreamerWantsData */
+	bool mIframeThroughputLimited;    /**< Last trickplay couldn't download I-frames fast enough even at lowest fps, prefer lowest I-frame profile */
 	bool streamerIsActive;
 	bool mTSBEnabled;
 	bool mIscDVR;
@@ -1512,7 +1706,7 @@ public:
 	bool video_muted;
 	int audio_volume;
 	std::vector<std::string> subscribedTags;
-	std::vector<TimedMetadata> timedMetadata;
+	std::map<std::pair<double, std::string>, std::string> timedMetadata; /**< Timed metadata content, by time and name */
 
 	/* START: Added As Part of DELIA-28363 and DELIA-28247 */
 	bool IsTuneTypeNew; /* Flag for the eTUNETYPE_NEW_NORMAL */
@@ -1532,7 +1726,33 @@ public:
 	double mAdPosition;
 	char mAdUrl[MAX_URI_LENGTH];
 	bool mIsRetuneInProgress;
+	bool mReTune;                       /**< Retune scheduled and not yet completed */
+	int mNumPtsErrors;                  /**< PTS errors/underflows within retune window */
+	gint mRetuneOperationId;            /**< Idle source of scheduled retune, 0 if none */
+	pthread_mutex_t mRetuneMutex;       /**< Protects retune state; per instance so that instances don't serialize */
+	pthread_cond_t mRetuneCond;         /**< Signalled when retune completes */
+	RecoveryTier mRecoveryTier;         /**< Last underflow recovery tier used, protected by mRetuneMutex */
+	long long mLastRecoveryTimeMs;      /**< Time of last underflow recovery */
+	gint mRebufferOperationId;          /**< Timer of rebuffer in progress, 0 if none */
+	bool mRebufferPaused;               /**< Sink paused by rebuffer */
+	long long mRebufferStartTimeMs;     /**< Time rebuffer started */
+	MediaType mRecoveryTrack;           /**< Track which underflowed */
+	PlaybackRecoveryInfo mRecoveryInfo; /**< Recoveries done per tier */
 	bool mEnableCache;
+	long mInitialBitrate;               /**< Initial bitrate of this instance, default-bitrate unless overridden */
+	long mInitialBitrate4K;             /**< Initial bitrate of this instance for 4K assets */
+	long mNetworkTimeout;               /**< Fragment download timeout of this instance in seconds */
+	bool mAnonymousRequest;             /**< Acquire license without token for this instance */
+	int mVODTrickplayFPS;               /**< Trickplay frames per second for VOD on this instance */
+	int mLinearTrickplayFPS;            /**< Trickplay frames per second for LIVE on this instance */
+	int mStallErrorCode;                /**< Error code reported for playback stall on this instance */
+	int mStallTimeoutInMS;              /**< Stall detection timeout of this instance in milliseconds */
+	int mReportProgressInterval;        /**< Progress reporting interval of this instance in milliseconds */
+	DRMSystems mPreferredDrm;           /**< Preferred DRM of this instance */
+	std::string mLicenseServerURL;      /**< License server URL of this instance, empty if none */
+	std::string mPRLicenseServerURL;    /**< Playready license server URL of this instance, empty if none */
+	std::string mWVLicenseServerURL;    /**< Widevine license server URL of this instance, empty if none */
+	int mMaxCachedFragmentsPerTrack;    /**< Fragment cache length of tracks created by this instance */
 	pthread_cond_t mCondDiscontinuity;
 	gint mDiscontinuityTuneOperationId;
 	bool mIsVSS;       /**< Indicates if stream is VSS, updated during Tune*/
@@ -1609,10 +1829,28 @@ public:
 	 * @param[in] curlInstance - Curl instance to be used
 	 * @param[in] resetBuffer - Flag to reset the out buffer
 	 * @param[in] fileType - File type
+	 * @param[in,out] validators - Validators of last download of the URL for conditional GET, NULL for unconditional
          *
 	 * @return void
 	 */
-	bool GetFile(const char *remoteUrl, struct GrowableBuffer *buffer, char effectiveUrl[MAX_URI_LENGTH], long *http_error = NULL, const char *range = NULL,unsigned int curlInstance = 0, bool resetBuffer = true,MediaType fileType = eMEDIATYPE_DEFAULT);
+	bool GetFile(const char *remoteUrl, struct GrowableBuffer *buffer, char effectiveUrl[MAX_URI_LENGTH], long *http_error = NULL, const char *range = NULL,unsigned int curlInstance = 0, bool resetBuffer = true,MediaType fileType = eMEDIATYPE_DEFAULT, HttpValidators *validators = NULL);
+
+	/**
+	 * @brief Download a file from the server, without limit on length of effective URL
+	 *
+	 * @param[in] remoteUrl - File URL
+	 * @param[out] buffer - Pointer to the output buffer
+	 * @param[out] effectiveUrl - Final URL after HTTP redirection
+	 * @param[out] http_error - HTTP error code
+	 * @param[in] range - Byte range
+	 * @param[in] curlInstance - Curl instance to be used
+	 * @param[in] resetBuffer - Flag to reset the out buffer
+	 * @param[in] fileType - File type
+	 * @param[in,out] validators - Validators of last download of the URL for conditional GET, NULL for unconditional
+         *
+	 * @return true if file is downloaded, or is not modified as flagged in validators
+	 */
+	bool GetFile(const char *remoteUrl, struct GrowableBuffer *buffer, std::string &effectiveUrl, long *http_error = NULL, const char *range = NULL,unsigned int curlInstance = 0, bool resetBuffer = true,MediaType fileType = eMEDIATYPE_DEFAULT, HttpValidators *validators = NULL);
 
 	/**
 	 * @brief get Media Type in string
@@ -1999,6 +2237,33 @@ public:
 	 * @return void
 	 */
 	bool HarvestFragments(bool modifyCount = true);
+
+	/**
+	 * @brief Queue file for harvest writer, which writes it off the fetch thread
+	 *
+	 * @param[in] path - Path of file to be written
+	 * @param[in] url - Url file was downloaded from
+	 * @param[in] ptr - File content, copied
+	 * @param[in] len - Length of file content
+	 * @param[in] isFragment - Media fragment, else manifest or playlist
+	 *
+	 * @return void
+	 */
+	void HarvestFile(const char *path, const char *url, const char *ptr, size_t len, bool isFragment);
+
+	/**
+	 * @brief Stop harvest writer once queued files are written
+	 *
+	 * @return void
+	 */
+	void StopHarvest();
+
+	/**
+	 * @brief Harvest writer thread, writes queued files and their timing index
+	 *
+	 * @return void
+	 */
+	void HarvestLoop();
 #endif
 
 
@@ -2210,6 +2475,40 @@ public:
 	 */
 	void ScheduleRetune(PlaybackErrorType errorType, MediaType trackType);
 
+	/**
+	 *   @brief Recover underflow or PTS error without tearing down the stream
+	 *
+	 *   Tiers are rebuffer with profile ramp-down, resync of the affected track, and
+	 *   finally re-tune. Resync flushes and reconfigures the whole pipeline through the
+	 *   discontinuity path but keeps fragment caches. Tier goes back to start after
+	 *   stable playback.
+	 *
+	 *   @param[in] errorType - Current error type
+	 *   @param[in] trackType - Video/Audio
+	 *
+	 *   @return true if error is handled, false to continue with regular re-tune logic
+	 */
+	bool RecoverInPlace(PlaybackErrorType errorType, MediaType trackType);
+
+	/**
+	 *   @brief Rebuffer step run from timer, pauses on first run and resumes once track is refilled
+	 *
+	 *   @return true to keep polling
+	 */
+	bool ContinueRebuffer();
+
+	/**
+	 *   @brief Stop rebuffering started by RecoverInPlace, if any
+	 */
+	void CancelRebuffer();
+
+	/**
+	 *   @brief Get counts of underflow recoveries per tier
+	 *
+	 *   @param[out] info - Recovery counts
+	 */
+	void GetPlaybackRecoveryInfo(PlaybackRecoveryInfo &info);
+
 	/**
 	 * @brief PrivateInstanceAAMP Constructor
 	 */
@@ -2242,6 +2541,17 @@ public:
 	 */
 	bool Discontinuity(MediaType);
 
+	/**
+	 *   @brief Continue timeline of track across a codec compatible discontinuity, without pipeline flush.
+	 *   Called from StreamAbstractionAAMP before falling back to Discontinuity
+	 *
+	 *   @param[in] track - Media type
+	 *   @param[in] discontinuityPts - PTS at which timeline before discontinuity would have continued, 0 if demuxer restamps
+	 *
+	 *   @return true if discontinuity is handled without flush.
+	 */
+	bool ContinueTimeline(MediaType track, double discontinuityPts);
+
 	/**
 	 *   @brief Set video zoom mode
 	 *
@@ -2305,6 +2615,23 @@ public:
 	 */
 	bool IsSinkCacheEmpty(MediaType mediaType);
 
+	/**
+	 *   @brief Get bytes queued in sink
+	 *
+	 *   @param[in] mediaType - Audio/Video
+	 *   @return Queued bytes, -1 if not known
+	 */
+	long long GetSinkCacheLevelBytes(MediaType mediaType);
+
+	/**
+	 *   @brief Update stall prediction of a track, used to defer background downloads
+	 *
+	 *   @param[in] mediaType - Audio/Video
+	 *   @param[in] predicted - true if track buffer is predicted to run dry
+	 *   @return void
+	 */
+	void SetStallPredicted(MediaType mediaType, bool predicted);
+
 	/**
 	 *   @brief Notify fragment caching complete
 	 *
@@ -2429,7 +2756,7 @@ public:
          *
 	 *   @return void
 	 */
-	void InsertToPlaylistCache(const std::string url, const GrowableBuffer* buffer, const char* effectiveUrl);
+	void InsertToPlaylistCache(const std::string url, const GrowableBuffer* buffer, const std::string &effectiveUrl);
 
 	/**
 	 *   @brief Retrieve playlist from cache
@@ -2442,6 +2769,17 @@ public:
 	 */
 	bool RetrieveFromPlaylistCache(const std::string url, GrowableBuffer* buffer, char effectiveUrl[]);
 
+	/**
+	 *   @brief Retrieve playlist from cache
+	 *
+	 *   @param[in] url - URL
+	 *   @param[out] buffer - Pointer to growable buffer
+	 *   @param[out] effectiveUrl - Final URL
+         *
+	 *   @return true: found, false: not found
+	 */
+	bool RetrieveFromPlaylistCache(const std::string url, GrowableBuffer* buffer, std::string &effectiveUrl);
+
 	/**
 	 *   @brief Clear playlist cache
 	 *
@@ -2449,6 +2787,187 @@ public:
 	 */
 	void ClearPlaylistCache();
 
+	/**
+	 *   @brief Insert key frame byte range of a TS fragment into I-frame index
+	 *
+	 *   @param[in] url - Fragment URL
+	 *   @param[in] offset - Byte offset of key frame range
+	 *   @param[in] length - Length of key frame range
+	 *
+	 *   @return void
+	 */
+	void InsertToIframeIndex(const AampUrl &url, size_t offset, size_t length);
+
+	/**
+	 *   @brief Retrieve key frame byte range of a TS fragment from I-frame index
+	 *
+	 *   @param[in] url - Fragment URL
+	 *   @param[out] offset - Byte offset of key frame range
+	 *   @param[out] length - Length of key frame range
+	 *
+	 *   @return true: found, false: not found
+	 */
+	bool RetrieveFromIframeIndex(const AampUrl &url, size_t &offset, size_t &length);
+
+	/**
+	 *   @brief Clear I-frame index
+	 *
+	 *   @return void
+	 */
+	void ClearIframeIndex();
+
+	/**
+	 *   @brief Insert key frames of a TS fragment into GOP cache
+	 *
+	 *   @param[in] url - Fragment URL
+	 *   @param[in] fragment - Fragment data
+	 *   @param[in] ranges - Byte offset and length of each key frame in fragment
+	 *
+	 *   @return void
+	 */
+	void InsertToGOPCache(const std::string url, const char *fragment, const std::vector<std::pair<size_t, size_t>> &ranges);
+
+	/**
+	 *   @brief Retrieve key frames of a TS fragment from GOP cache
+	 *
+	 *   @param[in] url - Fragment URL
+	 *   @param[out] buffer - Buffer to which key frames are appended
+	 *
+	 *   @return true: found, false: not found
+	 */
+	bool RetrieveFromGOPCache(const std::string url, GrowableBuffer *buffer);
+
+	/**
+	 *   @brief Clear GOP cache
+	 *
+	 *   @return void
+	 */
+	void ClearGOPCache();
+
+	/**
+	 *   @brief Check if thumbnail tracks of current asset are registered
+	 *
+	 *   @return true if registered
+	 */
+	bool HasThumbnailTracks();
+
+	/**
+	 *   @brief Register thumbnail tracks of current asset
+	 *
+	 *   @param[in] tracks - Image tracks, or I-frame track if there are none
+	 *
+	 *   @return void
+	 */
+	void SetThumbnailTracks(const std::vector<ThumbnailTrack> &tracks);
+
+	/**
+	 *   @brief Clear thumbnail tracks and cached thumbnail images
+	 *
+	 *   @return void
+	 */
+	void ClearThumbnails();
+
+	/**
+	 *   @brief Get available thumbnail tracks
+	 *
+	 *   @return Thumbnail tracks
+	 */
+	std::vector<ThumbnailTrackInfo> GetAvailableThumbnailTracks();
+
+	/**
+	 *   @brief Select thumbnail track
+	 *
+	 *   @param[in] thumbnailTrack - Index of track
+	 *
+	 *   @return true if selected
+	 */
+	bool SetThumbnailTrack(int thumbnailTrack);
+
+	/**
+	 *   @brief Get thumbnails of selected track in a range of media time
+	 *
+	 *   @param[in] startTime - Start of range
+	 *   @param[in] endTime - End of range
+	 *   @param[out] thumbnails - Thumbnails in media time order
+	 *
+	 *   @return true if selected track is indexed
+	 */
+	bool GetThumbnails(double startTime, double endTime, std::vector<ThumbnailInfo> &thumbnails);
+
+	/**
+	 *   @brief Get thumbnail of a media position along with its image
+	 *
+	 *   @param[in] position - Media position
+	 *   @param[out] thumbnail - Thumbnail covering position
+	 *   @param[out] image - Image data
+	 *
+	 *   @return true on success
+	 */
+	bool GetThumbnail(double position, ThumbnailInfo &thumbnail, std::vector<unsigned char> &image);
+
+	/**
+	 *   @brief Get timed metadata reported in a range of media time
+	 *
+	 *   @param[in] startMS - Start of range in milliseconds
+	 *   @param[in] endMS - End of range in milliseconds, exclusive
+	 *   @param[out] cues - Timed metadata in time order
+	 */
+	void GetTimedMetadata(double startMS, double endMS, std::vector<TimedMetadataInfo> &cues);
+
+	/**
+	 *   @brief Schedule downloads ahead of an ad or period splice
+	 *
+	 *   @param[in] requests - Downloads, fetched in order into prefetch cache
+	 *   @param[in] splicePosition - Position in seconds at which downloads are needed, negative if unknown
+	 *
+	 *   @return void
+	 */
+	void SchedulePrefetch(const std::vector<PrefetchRequest> &requests, double splicePosition);
+
+	/**
+	 *   @brief Take a download from prefetch cache
+	 *
+	 *   @param[in] url - Url of file
+	 *   @param[in] range - Byte range, NULL for whole file
+	 *   @param[out] buffer - Buffer to which file is appended
+	 *   @param[out] effectiveUrl - Effective URL of file
+	 *
+	 *   @return true if file was prefetched
+	 */
+	bool RetrieveFromPrefetchCache(const char *url, const char *range, GrowableBuffer *buffer, std::string &effectiveUrl);
+
+	/**
+	 *   @brief Stop prefetch and clear prefetch cache
+	 *
+	 *   @return void
+	 */
+	void ClearPrefetchCache();
+
+	/**
+	 *   @brief Drop prefetched and queued downloads of splices behind play position
+	 *
+	 *   @param[in] positionMs - Current position
+	 *
+	 *   @return void
+	 */
+	void EvictPrefetchCache(double positionMs);
+
+	/**
+	 *   @brief Free a prefetch cache entry, caller holds mLock and updates mPrefetchCacheOrder
+	 *
+	 *   @param[in] it - Entry to remove
+	 *
+	 *   @return void
+	 */
+	void RemovePrefetchEntry(std::unordered_map<std::string, PrefetchEntry>::iterator it);
+
+	/**
+	 *   @brief Prefetch thread, fetches scheduled downloads into prefetch cache
+	 *
+	 *   @return void
+	 */
+	void PrefetchLoop();
+
 	/**
 	 *   @brief Set stall error code
 	 *
@@ -2710,6 +3229,22 @@ private:
 	 */
 	void ScheduleEvent(struct AsyncEventDescriptor* e);
 
+	/**
+	 *   @brief Build index of selected thumbnail track if not done yet
+	 *
+	 *   @return true if selected track is indexed
+	 */
+	bool IndexThumbnailTrack();
+
+	/**
+	 *   @brief Schedule prefetch of ad if its position is within lookahead
+	 *
+	 *   @param[in] positionMs - Current position
+	 *
+	 *   @return void
+	 */
+	void CheckForAdPrefetch(double positionMs);
+
 	/**
 	 *   @brief Set Content Type
 	 *
@@ -2749,7 +3284,34 @@ private:
 	ContentType mContentType;
 	bool mTunedEventPending;
 	bool mSeekOperationInProgress;
-	std::unordered_map<std::string, std::pair<GrowableBuffer*, char*>> mPlaylistCache;
+	std::unordered_map<std::string, std::pair<GrowableBuffer*, std::string>> mPlaylistCache;
+	std::unordered_map<AampUrl, std::pair<size_t, size_t>, AampUrl::Hash> mIframeIndex; /**< Key frame byte range of fragments, by URL */
+	std::list<AampUrl> mIframeIndexOrder; /**< Insertion order of mIframeIndex, oldest first */
+	std::unordered_map<std::string, GrowableBuffer*> mGOPCache; /**< Key frames of recently played fragments, by URL */
+	std::list<std::string> mGOPCacheOrder; /**< Insertion order of mGOPCache, oldest first */
+	std::vector<ThumbnailTrack> mThumbnailTracks; /**< Thumbnail tracks of current asset */
+	int mThumbnailTrackIdx; /**< Selected thumbnail track */
+	std::list<ThumbnailImage> mThumbnailCache; /**< Thumbnail images around recently requested positions */
+	int mThumbnailGeneration; /**< Bumped when thumbnails are cleared, so that downloads in progress are discarded */
+	pthread_mutex_t mThumbnailFetchMutex; /**< Serializes thumbnail downloads on thumbnail curl instance */
+	std::unordered_map<std::string, PrefetchEntry> mPrefetchCache; /**< Downloads fetched ahead of ad or period splice, by URL and range */
+	std::list<std::string> mPrefetchCacheOrder; /**< Insertion order of mPrefetchCache, oldest first */
+	size_t mPrefetchCacheBytes; /**< Bytes held in mPrefetchCache, bounded by ad-prefetch-cache-size */
+	std::deque<PrefetchRequest> mPrefetchQueue; /**< Downloads waiting for prefetch thread */
+	pthread_t mPrefetchThreadID; /**< Prefetch thread */
+	bool mPrefetchThreadStarted; /**< Prefetch thread is running */
+	pthread_cond_t mPrefetchCond; /**< Signalled when prefetch queue is updated */
+	bool mAdPrefetchScheduled; /**< Prefetch of scheduled ad is done or in progress */
+	int mStallPredictedTracks; /**< Bitmask by media type of tracks predicted to run dry, prefetch waits while set */
+#ifdef AAMP_HARVEST_SUPPORT_ENABLED
+	std::deque<HarvestRequest> mHarvestQueue; /**< Files waiting for harvest writer */
+	size_t mHarvestQueueBytes; /**< Bytes of files in mHarvestQueue */
+	long long mHarvestStartTimeMs; /**< Time of first harvested file, 0 before */
+	pthread_t mHarvestThreadID; /**< Harvest writer thread */
+	bool mHarvestThreadStarted; /**< Harvest writer thread is running */
+	pthread_mutex_t mHarvestMutex; /**< Protects harvest queue */
+	pthread_cond_t mHarvestCond; /**< Signalled when harvest queue is updated */
+#endif
 	std::map<gint, bool> mPendingAsyncEvents;
 	std::unordered_map<std::string, std::vector<std::string>> mCustomHeaders;
 	bool mIsFirstRequestToFOG;
@@ -56,22 +56,6 @@ using namespace std;
  * @{
  */
 
-/**
- * @brief Thread funtion for Buffer Health Monitoring
- *
- * @return NULL
- */
-static void* BufferHealthMonitor(void* user_data)
-{
-	MediaTrack *track = (MediaTrack *)user_data;
-	if(aamp_pthread_setname(pthread_self(), "aampBuffHealth"))
-	{
-		logprintf("%s:%d: aamp_pthread_setname failed\n", __FUNCTION__, __LINE__);
-	}
-	track->MonitorBufferHealth();
-	return NULL;
-}
-
 /**
  * @brief Get string corresponding to buffer status.
  *
@@ -97,63 +81,107 @@ const char* MediaTrack::GetBufferHealthStatusString(BufferHealthStatus status)
 }
 
 /**
- * @brief Monitors buffer health of track
+ * @brief Update buffer health and stall prediction of track
+ *
+ * Buffered time is duration of fragments cached in AAMP plus duration queued in sink.
+ * Sink side is the larger of injected duration not yet played and appsrc queue level,
+ * as elapsed time keeps running when pipeline does not consume. Buffer drains at play
+ * rate and fills at rate fragments are fetched, giving the time until it runs dry.
  */
-void MediaTrack::MonitorBufferHealth()
+void MediaTrack::UpdateBufferHealth()
 {
-	assert(gpGlobalConfig->bufferHealthMonitorDelay >= gpGlobalConfig->bufferHealthMonitorInterval);
-	unsigned int bufferMontiorSceduleTime = gpGlobalConfig->bufferHealthMonitorDelay - gpGlobalConfig->bufferHealthMonitorInterval;
-	aamp->InterruptableMsSleep(bufferMontiorSceduleTime *1000);
-	int monitorInterval = gpGlobalConfig->bufferHealthMonitorInterval  * 1000;
-	bool keepRunning = true;
-	while(keepRunning)
-	{
-		aamp->InterruptableMsSleep(monitorInterval);
-		pthread_mutex_lock(&mutex);
-		if (aamp->DownloadsAreEnabled() && !abort)
+	StreamAbstractionAAMP* context = GetContext();
+	if (AAMP_NORMAL_PLAY_RATE != aamp->rate || !enabled || totalInjectedDuration <= 0)
+	{
+		return;
+	}
+	double elapsedTime = context->GetElapsedTime();
+	if (elapsedTime < gpGlobalConfig->bufferHealthMonitorDelay)
+	{ // skip initial buffering after tune/ seek
+		return;
+	}
+	long long queuedBytes = aamp->GetSinkCacheLevelBytes((MediaType) type);
+	long long now = aamp_GetCurrentTimeMS();
+	bool notifyStallPrediction = false;
+	bool requestRampDown = false;
+
+	pthread_mutex_lock(&mutex);
+	if (aamp->DownloadsAreEnabled() && !abort)
+	{
+		double cachedDuration = 0;
+		for (int i = 0, idx = fragmentIdxToInject; i < numberOfFragmentsCached; i++)
 		{
-			if ( numberOfFragmentsCached > 0)
+			cachedDuration += cachedFragment[idx].duration;
+			if (++idx == maxCachedFragmentsPerTrack)
 			{
-				bufferStatus = BUFFER_STATUS_GREEN;
+				idx = 0;
 			}
-			else
-			{
-				double bufferedTime = totalInjectedDuration - GetContext()->GetElapsedTime();
-				if (bufferedTime > AAMP_BUFFER_MONITOR_GREEN_THRESHOLD)
-				{
-					bufferStatus = BUFFER_STATUS_GREEN;
-				}
-				else
-				{
-					logprintf("%s:%d [%s] bufferedTime %f totalInjectedDuration %f elapsed time %f\n",__FUNCTION__, __LINE__,
-							name, bufferedTime, totalInjectedDuration, GetContext()->GetElapsedTime());
-					if (bufferedTime <= 0)
-					{
-						bufferStatus = BUFFER_STATUS_RED;
-					}
-					else
-					{
-						bufferStatus = BUFFER_STATUS_YELLOW;
-					}
-				}
-			}
-			if (bufferStatus != prevBufferStatus)
-			{
-				logprintf("aamp: track[%s] buffering %s->%s\n", name, GetBufferHealthStatusString(prevBufferStatus),
-						GetBufferHealthStatusString(bufferStatus));
-				prevBufferStatus = bufferStatus;
-			}
-			else
-			{
-				traceprintf("%s:%d track[%s] No Change [%s]\n", __FUNCTION__, __LINE__, name,
-						GetBufferHealthStatusString(bufferStatus));
+		}
+		double sinkDuration = totalInjectedDuration - elapsedTime;
+		if (queuedBytes > 0 && injectedBytesPerSecond > 0 && (queuedBytes / injectedBytesPerSecond) > sinkDuration)
+		{
+			sinkDuration = queuedBytes / injectedBytesPerSecond;
+		}
+		double bufferedTime = cachedDuration + (sinkDuration > 0 ? sinkDuration : 0);
+
+		if (numberOfFragmentsCached == maxCachedFragmentsPerTrack || context->IsPlaybackPaused())
+		{ // fetch is waiting for a free fragment or playback is not consuming
+			timeToEmpty = -1;
+		}
+		else
+		{
+			double rate = fillRate;
+			double sinceLastFetch = (now - lastFetchTimeMs) / 1000.0;
+			if (lastFetchTimeMs && fragmentDurationSeconds > 0 && sinceLastFetch > 0 && (fragmentDurationSeconds / sinceLastFetch) < rate)
+			{ // fetch in progress is taking longer than average
+				rate = fragmentDurationSeconds / sinceLastFetch;
 			}
+			double drainRate = AAMP_NORMAL_PLAY_RATE - rate;
+			timeToEmpty = (drainRate > 0) ? (bufferedTime / drainRate) : -1;
+		}
+		bool predicted = (timeToEmpty >= 0 && timeToEmpty < gpGlobalConfig->stallPredictionThreshold);
+		if (predicted != stallPredicted)
+		{
+			logprintf("%s:%d [%s] stall %s, bufferedTime %f (cached %f) fillRate %f timeToEmpty %f\n", __FUNCTION__, __LINE__,
+					name, predicted ? "predicted" : "no longer predicted", bufferedTime, cachedDuration, fillRate, timeToEmpty);
+			stallPredicted = predicted;
+			notifyStallPrediction = true;
+		}
+		if (predicted && (eTRACK_VIDEO == type) && (now - lastRampDownRequestMs) > (gpGlobalConfig->stallPredictionThreshold * 1000))
+		{
+			lastRampDownRequestMs = now;
+			requestRampDown = true;
+		}
+
+		if (bufferedTime <= 0)
+		{
+			bufferStatus = BUFFER_STATUS_RED;
+		}
+		else if (predicted || bufferedTime <= AAMP_BUFFER_MONITOR_GREEN_THRESHOLD)
+		{
+			bufferStatus = BUFFER_STATUS_YELLOW;
 		}
 		else
 		{
-			keepRunning = false;
+			bufferStatus = BUFFER_STATUS_GREEN;
+		}
+		if (bufferStatus != prevBufferStatus)
+		{
+			logprintf("aamp: track[%s] buffering %s->%s bufferedTime %f totalInjectedDuration %f elapsed time %f\n", name,
+					GetBufferHealthStatusString(prevBufferStatus), GetBufferHealthStatusString(bufferStatus),
+					bufferedTime, totalInjectedDuration, elapsedTime);
+			prevBufferStatus = bufferStatus;
 		}
-		pthread_mutex_unlock(&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+
+	if (notifyStallPrediction)
+	{
+		aamp->SetStallPredicted((MediaType) type, stallPredicted);
+	}
+	if (requestRampDown && aamp->CheckABREnabled())
+	{
+		context->RequestRampDown();
 	}
 }
 
@@ -164,9 +192,9 @@ void MediaTrack::UpdateTSAfterInject()
 {
 	pthread_mutex_lock(&mutex);
 	aamp_Free(&cachedFragment[fragmentIdxToInject].fragment.ptr);
-	memset(&cachedFragment[fragmentIdxToInject], 0, sizeof(CachedFragment));
+	cachedFragment[fragmentIdxToInject] = CachedFragment();
 	fragmentIdxToInject++;
-	if (fragmentIdxToInject == gpGlobalConfig->maxCachedFragmentsPerTrack)
+	if (fragmentIdxToInject == maxCachedFragmentsPerTrack)
 	{
 		fragmentIdxToInject = 0;
 	}
@@ -183,6 +211,200 @@ void MediaTrack::UpdateTSAfterInject()
 }
 
 
+/**
+ * @brief Copy a cached fragment along with its content
+ *
+ * @param[out] dst - Copy owning a new buffer
+ * @param[in] src - Fragment to be copied
+ */
+static void CopyCachedFragment(CachedFragment &dst, const CachedFragment &src)
+{
+	dst = src;
+	memset(&dst.fragment, 0, sizeof(dst.fragment));
+	aamp_AppendBytes(&dst.fragment, src.fragment.ptr, src.fragment.len);
+}
+
+
+/**
+ * @brief Retains a copy of the fragment to be injected for in-buffer seek
+ *
+ * Fragments ending more than seekRetentionSeconds behind play position are freed.
+ *
+ * @param[in] cachedFragment Fragment to be injected
+ */
+void MediaTrack::RetainFragment(const CachedFragment* cachedFragment)
+{
+	CachedFragment retained;
+	CopyCachedFragment(retained, *cachedFragment);
+	retained.discontinuity = (cachedFragment->discontinuity || mFragmentDiscontinuity);
+	mFragmentDiscontinuity = false;
+	double retainFrom = (aamp->GetPositionMs() / 1000.0) - aamp->culledSeconds - gpGlobalConfig->seekRetentionSeconds;
+	pthread_mutex_lock(&mutex);
+	mRetainedFragments.push_back(retained);
+	while (!mRetainedFragments.empty() &&
+	        (mRetainedFragments.front().position + mRetainedFragments.front().duration < retainFrom))
+	{
+		aamp_Free(&mRetainedFragments.front().fragment.ptr);
+		mRetainedFragments.pop_front();
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/**
+ * @brief Copies the next fragment to be injected again after in-buffer seek
+ *
+ * @param[out] replayFragment Copy of the fragment, to be freed by caller
+ * @retval true if there is a fragment to replay
+ */
+bool MediaTrack::GetReplayFragment(CachedFragment* replayFragment)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mutex);
+	if (!abort && !mReplayFragments.empty())
+	{
+		CopyCachedFragment(*replayFragment, mReplayFragments.front());
+		// discontinuity is signaled from the copy only, UpdateAfterReplay restores it
+		mReplayFragments.front().discontinuity = false;
+		ret = true;
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/**
+ * @brief Moves the replayed fragment back to retained fragments
+ */
+void MediaTrack::UpdateAfterReplay()
+{
+	pthread_mutex_lock(&mutex);
+	if (!mReplayFragments.empty())
+	{
+		CachedFragment &replayed = mReplayFragments.front();
+		replayed.discontinuity = (replayed.discontinuity || mFragmentDiscontinuity);
+		mRetainedFragments.push_back(replayed);
+		mReplayFragments.pop_front();
+	}
+	mFragmentDiscontinuity = false;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/**
+ * @brief Gets a buffered fragment; retained, replay and cached fragments in that order
+ *
+ * @param[in] idx Index from the oldest retained fragment, caller holds mutex
+ * @retval Fragment at the index
+ */
+CachedFragment* MediaTrack::GetBufferedFragment(int idx)
+{
+	if (idx < (int)mRetainedFragments.size())
+	{
+		return &mRetainedFragments[idx];
+	}
+	idx -= mRetainedFragments.size();
+	if (idx < (int)mReplayFragments.size())
+	{
+		return &mReplayFragments[idx];
+	}
+	idx -= mReplayFragments.size();
+	return &cachedFragment[(fragmentIdxToInject + idx) % maxCachedFragmentsPerTrack];
+}
+
+
+/**
+ * @brief Points injection at the retained or cached fragment containing position
+ *
+ * @param[in] position Position in the playlist, seconds
+ * @param[out] fragmentPosition Start position of the fragment found
+ * @param[in] commit false to only check if position is buffered
+ * @retval true if position is buffered
+ */
+bool MediaTrack::SeekInBuffer(double position, double &fragmentPosition, bool commit)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mutex);
+	int retainedCount = mRetainedFragments.size();
+	int count = retainedCount + mReplayFragments.size() + numberOfFragmentsCached;
+	int target = -1;
+	for (int i = 0; i < count; i++)
+	{
+		CachedFragment* fragment = GetBufferedFragment(i);
+		if (fragment->fragment.ptr && (position >= fragment->position) && (position < fragment->position + fragment->duration))
+		{
+			target = i;
+			break;
+		}
+	}
+	if (target >= 0)
+	{
+		fragmentPosition = GetBufferedFragment(target)->position;
+		ret = true;
+		if (commit)
+		{
+			if (mFragmentDiscontinuity && (retainedCount < count))
+			{ // discontinuity of the fragment pending injection was already consumed
+				GetBufferedFragment(retainedCount)->discontinuity = true;
+			}
+			mFragmentDiscontinuity = false;
+			while (!mReplayFragments.empty())
+			{
+				mRetainedFragments.push_back(mReplayFragments.front());
+				mReplayFragments.pop_front();
+			}
+			retainedCount = mRetainedFragments.size();
+			if (target < retainedCount)
+			{
+				while ((int)mRetainedFragments.size() > target)
+				{
+					mReplayFragments.push_front(mRetainedFragments.back());
+					mRetainedFragments.pop_back();
+				}
+			}
+			else
+			{
+				for (int i = retainedCount; i < target; i++)
+				{ // skipped cached fragments can still be sought back to
+					mRetainedFragments.push_back(cachedFragment[fragmentIdxToInject]);
+					cachedFragment[fragmentIdxToInject] = CachedFragment();
+					fragmentIdxToInject++;
+					if (fragmentIdxToInject == maxCachedFragmentsPerTrack)
+					{
+						fragmentIdxToInject = 0;
+					}
+					numberOfFragmentsCached--;
+				}
+				pthread_cond_signal(&fragmentInjected);
+			}
+			AAMPLOG_INFO("%s:%d [%s] position %f fragment %f replay %d cached %d\n", __FUNCTION__, __LINE__, name,
+			        position, fragmentPosition, (int)mReplayFragments.size(), numberOfFragmentsCached);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+
+/**
+ * @brief Frees fragments retained for in-buffer seek
+ */
+void MediaTrack::ClearRetainedFragments()
+{
+	pthread_mutex_lock(&mutex);
+	for (std::deque<CachedFragment>::iterator it = mRetainedFragments.begin(); it != mRetainedFragments.end(); it++)
+	{
+		aamp_Free(&it->fragment.ptr);
+	}
+	mRetainedFragments.clear();
+	for (std::deque<CachedFragment>::iterator it = mReplayFragments.begin(); it != mReplayFragments.end(); it++)
+	{
+		aamp_Free(&it->fragment.ptr);
+	}
+	mReplayFragments.clear();
+	pthread_mutex_unlock(&mutex);
+}
+
 /**
  * @brief Updates internal state after a fragment fetch
  */
@@ -199,6 +421,13 @@ void MediaTrack::UpdateTSAfterFetch()
 	}
 #endif
 	totalFetchedDuration += cachedFragment[fragmentIdxToFetch].duration;
+	long long now = aamp_GetCurrentTimeMS();
+	if (lastFetchTimeMs && now > lastFetchTimeMs)
+	{
+		double rate = cachedFragment[fragmentIdxToFetch].duration * 1000 / (now - lastFetchTimeMs);
+		fillRate = (fillRate > 0) ? (fillRate * 0.7 + rate * 0.3) : rate;
+	}
+	lastFetchTimeMs = now;
 
 	if((eTRACK_VIDEO == type) && aamp->IsFragmentBufferingRequired())
 	{
@@ -217,7 +446,7 @@ void MediaTrack::UpdateTSAfterFetch()
 		}
 	}
 	fragmentIdxToFetch++;
-	if (fragmentIdxToFetch == gpGlobalConfig->maxCachedFragmentsPerTrack)
+	if (fragmentIdxToFetch == maxCachedFragmentsPerTrack)
 	{
 		fragmentIdxToFetch = 0;
 	}
@@ -231,7 +460,7 @@ void MediaTrack::UpdateTSAfterFetch()
 	}
 #endif
 	numberOfFragmentsCached++;
-	assert(numberOfFragmentsCached <= gpGlobalConfig->maxCachedFragmentsPerTrack);
+	assert(numberOfFragmentsCached <= maxCachedFragmentsPerTrack);
 #ifdef AAMP_DEBUG_FETCH_INJECT
 	if ((1 << type) & AAMP_DEBUG_FETCH_INJECT)
 	{
@@ -247,6 +476,7 @@ void MediaTrack::UpdateTSAfterFetch()
 		aamp->NotifyFragmentCachingComplete();
 		notifiedCachingComplete = true;
 	}
+	UpdateBufferHealth();
 }
 
 
@@ -269,7 +499,7 @@ bool MediaTrack::WaitForFreeFragmentAvailable( int timeoutMs)
 	{
 		ret = false;
 	}
-	else if (numberOfFragmentsCached == gpGlobalConfig->maxCachedFragmentsPerTrack)
+	else if (numberOfFragmentsCached == maxCachedFragmentsPerTrack)
 	{
 		if (timeoutMs >= 0)
 		{
@@ -325,6 +555,8 @@ bool MediaTrack::WaitForFreeFragmentAvailable( int timeoutMs)
 #endif
 			ret = false;
 		}
+		// time spent waiting on full cache is not a slow download
+		lastFetchTimeMs = aamp_GetCurrentTimeMS();
 	}
 #ifdef AAMP_DEBUG_FETCH_INJECT
 	if ((1 << type) & AAMP_DEBUG_FETCH_INJECT)
@@ -405,11 +637,13 @@ bool MediaTrack::InjectFragment()
 	bool ret = true;
 	aamp->BlockUntilGstreamerWantsData(NULL, 0, type);
 
-	if (WaitForCachedFragmentAvailable())
+	CachedFragment replayFragment;
+	bool replay = GetReplayFragment(&replayFragment);
+	if (replay || WaitForCachedFragmentAvailable())
 	{
 		bool stopInjection = false;
 		bool fragmentDiscarded = false;
-		CachedFragment* cachedFragment = &this->cachedFragment[fragmentIdxToInject];
+		CachedFragment* cachedFragment = replay ? &replayFragment : &this->cachedFragment[fragmentIdxToInject];
 #ifdef TRACE
 		logprintf("%s:%d [%s] - fragmentIdxToInject %d cachedFragment %p ptr %p\n", __FUNCTION__, __LINE__,
 				name, fragmentIdxToInject, cachedFragment, cachedFragment->fragment.ptr);
@@ -417,11 +651,26 @@ bool MediaTrack::InjectFragment()
 		if (cachedFragment->fragment.ptr)
 		{
 			StreamAbstractionAAMP*  context = GetContext();
-			if ((cachedFragment->discontinuity || ptsError) &&  (AAMP_NORMAL_PLAY_RATE == context->aamp->rate))
+			if (cachedFragment->discontinuity && !ptsError && cachedFragment->continuousTimeline && (AAMP_NORMAL_PLAY_RATE == context->aamp->rate)
+			        && aamp->ContinueTimeline((MediaType) type, cachedFragment->discontinuityPts))
+			{ // codec compatible, keep injecting on the same pipeline
+				logprintf("%s:%d - track %s- continuing timeline across discontinuity\n", __FUNCTION__, __LINE__, name);
+				cachedFragment->discontinuity = false;
+				mFragmentDiscontinuity = retainInjectedFragments;
+				FlushFragments();
+				/*For muxed streams, continue timeline of audio track as well*/
+				if (!context->GetMediaTrack(eTRACK_AUDIO)->enabled)
+				{
+					aamp->ContinueTimeline(eMEDIATYPE_AUDIO, cachedFragment->discontinuityPts);
+				}
+			}
+			else if ((cachedFragment->discontinuity || ptsError) &&  (AAMP_NORMAL_PLAY_RATE == context->aamp->rate))
 			{
 				logprintf("%s:%d - track %s- notifying aamp discontinuity\n", __FUNCTION__, __LINE__, name);
 				cachedFragment->discontinuity = false;
 				ptsError = false;
+				mFragmentDiscontinuity = retainInjectedFragments;
+				FlushFragments();
 				stopInjection = aamp->Discontinuity((MediaType) type);
 				/*For muxed streams, give discontinuity for audio track as well*/
 				if (!context->GetMediaTrack(eTRACK_AUDIO)->enabled)
@@ -444,9 +693,14 @@ bool MediaTrack::InjectFragment()
 #ifdef AAMP_DEBUG_INJECT
 				if ((1 << type) & AAMP_DEBUG_INJECT)
 				{
-					logprintf("%s:%d [%s] Inject uri %s\n", __FUNCTION__, __LINE__, name, cachedFragment->uri);
+					logprintf("%s:%d [%s] Inject uri %s\n", __FUNCTION__, __LINE__, name, cachedFragment->uri.c_str());
 				}
 #endif
+				if (retainInjectedFragments && !replay)
+				{ // copy taken before injection, which may rewrite the buffer
+					RetainFragment(cachedFragment);
+				}
+				size_t fragmentLen = cachedFragment->fragment.len; // injection may consume the buffer
 #ifndef SUPRESS_DECODE
 #ifndef FOG_HAMMER_TEST // support aamp stress-tests of fog without video decoding/presentation
 				InjectFragmentInternal(cachedFragment, fragmentDiscarded);
@@ -466,6 +720,11 @@ bool MediaTrack::InjectFragment()
 				{
 					totalInjectedDuration += cachedFragment->duration;
 					mSegInjectFailCount = 0;
+					if (cachedFragment->duration > 0)
+					{
+						double rate = fragmentLen / cachedFragment->duration;
+						injectedBytesPerSecond = (injectedBytesPerSecond > 0) ? (injectedBytesPerSecond * 0.7 + rate * 0.3) : rate;
+					}
 				}
 				else
 				{
@@ -479,7 +738,15 @@ bool MediaTrack::InjectFragment()
 					}
 					
 				}
-				UpdateTSAfterInject();
+				if (replay)
+				{
+					UpdateAfterReplay();
+				}
+				else
+				{
+					UpdateTSAfterInject();
+				}
+				UpdateBufferHealth();
 			}
 		}
 		else
@@ -488,6 +755,7 @@ bool MediaTrack::InjectFragment()
 			{
 				//Save the playback rate prior to sending EOS
 				int rate = GetContext()->aamp->rate;
+				FlushFragments();
 				aamp->EndOfStreamReached((MediaType)type);
 				/*For muxed streams, provide EOS for audio track as well since
 				 * no separate MediaTrack for audio is present*/
@@ -503,6 +771,10 @@ bool MediaTrack::InjectFragment()
 			}
 			ret = false;
 		}
+		if (replay)
+		{
+			aamp_Free(&replayFragment.fragment.ptr);
+		}
 	}
 	else
 	{
@@ -511,6 +783,7 @@ bool MediaTrack::InjectFragment()
 		{
 			//Save the playback rate prior to sending EOS
 			int rate = GetContext()->aamp->rate;
+			FlushFragments();
 			aamp->EndOfStreamReached((MediaType)type);
 			/*For muxed streams, provide EOS for audio track as well since
 			 * no separate MediaTrack for audio is present*/
@@ -576,17 +849,6 @@ void MediaTrack::RunInjectLoop()
 	const bool isAudioTrack = (eTRACK_AUDIO == type);
 	bool notifyFirstFragment = true;
 	bool keepInjecting = true;
-	if ((AAMP_NORMAL_PLAY_RATE == aamp->rate) && !bufferMonitorThreadStarted )
-	{
-		if (0 == pthread_create(&bufferMonitorThreadID, NULL, &BufferHealthMonitor, this))
-		{
-			bufferMonitorThreadStarted = true;
-		}
-		else
-		{
-			logprintf("Failed to create BufferHealthMonitor thread errno = %d, %s\n", errno, strerror(errno));
-		}
-	}
 	totalInjectedDuration = 0;
 	while (aamp->DownloadsAreEnabled() && keepInjecting)
 	{
@@ -618,6 +880,22 @@ void MediaTrack::RunInjectLoop()
 }
 
 
+/**
+ * @brief Resync track with pipeline at next injected fragment
+ *
+ * Next fragment is handled like a discontinuity: EOS is sent on this track's stream and,
+ * once processed, the whole pipeline is flushed and reconfigured. Stream abstraction,
+ * playlists and cached fragments of all tracks are kept, so unlike re-tune nothing is
+ * downloaded again.
+ */
+void MediaTrack::Resync()
+{
+	pthread_mutex_lock(&mutex);
+	ptsError = true;
+	pthread_mutex_unlock(&mutex);
+}
+
+
 /**
  * @brief Stop inject loop of track
  */
@@ -706,20 +984,20 @@ int MediaTrack::GetCurrentBandWidth()
  */
 MediaTrack::MediaTrack(TrackType type, PrivateInstanceAAMP* aamp, const char* name) :
 		eosReached(false), enabled(false), numberOfFragmentsCached(0), fragmentIdxToInject(0),
-		fragmentIdxToFetch(0), abort(false), fragmentInjectorThreadID(0), bufferMonitorThreadID(0), totalFragmentsDownloaded(0),
-		fragmentInjectorThreadStarted(false), bufferMonitorThreadStarted(false), totalInjectedDuration(0), cacheDurationSeconds(0),
+		fragmentIdxToFetch(0), abort(false), fragmentInjectorThreadID(0), totalFragmentsDownloaded(0),
+		fragmentInjectorThreadStarted(false), totalInjectedDuration(0), cacheDurationSeconds(0),
 		notifiedCachingComplete(false), fragmentDurationSeconds(0), segDLFailCount(0),segDrmDecryptFailCount(0),mSegInjectFailCount(0),
-		bufferStatus(BUFFER_STATUS_GREEN), prevBufferStatus(BUFFER_STATUS_GREEN),
+		bufferStatus(BUFFER_STATUS_GREEN), prevBufferStatus(BUFFER_STATUS_GREEN), fillRate(0), lastFetchTimeMs(0),
+		injectedBytesPerSecond(0), timeToEmpty(-1), stallPredicted(false), lastRampDownRequestMs(0),
 		bandwidthBytesPerSecond(AAMP_DEFAULT_BANDWIDTH_BYTES_PREALLOC), totalFetchedDuration(0),
-		discontinuityProcessed(false), ptsError(false), cachedFragment(NULL)
+		discontinuityProcessed(false), ptsError(false), cachedFragment(NULL), retainInjectedFragments(false),
+		mRetainedFragments(), mReplayFragments(), mFragmentDiscontinuity(false),
+		maxCachedFragmentsPerTrack(aamp->mMaxCachedFragmentsPerTrack)
 {
 	this->type = type;
 	this->aamp = aamp;
 	this->name = name;
-	cachedFragment = new CachedFragment[gpGlobalConfig->maxCachedFragmentsPerTrack];
-	for(int X =0; X< gpGlobalConfig->maxCachedFragmentsPerTrack; ++X){
-		memset(&cachedFragment[X], 0, sizeof(CachedFragment));
-	}
+	cachedFragment = new CachedFragment[maxCachedFragmentsPerTrack]();
 	pthread_cond_init(&fragmentFetched, NULL);
 	pthread_cond_init(&fragmentInjected, NULL);
 	pthread_mutex_init(&mutex, NULL);
@@ -731,25 +1009,15 @@ MediaTrack::MediaTrack(TrackType type, PrivateInstanceAAMP* aamp, const char* na
  */
 MediaTrack::~MediaTrack()
 {
-	if (bufferMonitorThreadStarted)
+	if (stallPredicted)
 	{
-		void *value_ptr = NULL;
-		int rc = pthread_join(bufferMonitorThreadID, &value_ptr);
-		if (rc != 0)
-		{
-			logprintf("***pthread_join bufferMonitorThreadID returned %d(%s)\n", rc, strerror(rc));
-		}
-#ifdef TRACE
-		else
-		{
-			logprintf("joined bufferMonitorThreadID\n");
-		}
-#endif
+		aamp->SetStallPredicted((MediaType) type, false);
 	}
-	for (int j=0; j< gpGlobalConfig->maxCachedFragmentsPerTrack; j++)
+	for (int j=0; j< maxCachedFragmentsPerTrack; j++)
 	{
 		aamp_Free(&cachedFragment[j].fragment.ptr);
 	}
+	ClearRetainedFragments();
 	if(cachedFragment)
 	{
 		delete [] cachedFragment;
@@ -825,13 +1093,14 @@ StreamAbstractionAAMP::StreamAbstractionAAMP(PrivateInstanceAAMP* aamp):
 		mStartTimeStamp(-1),mLastPausedTimeStamp(-1), abortWait(false)
 {
 	mIsPlaybackStalled = false;
+	mRampDownRequested = false;
 	mLastVideoFragParsedTimeMS = aamp_GetCurrentTimeMS();
 	traceprintf("StreamAbstractionAAMP::%s\n", __FUNCTION__);
 	pthread_mutex_init(&mLock, NULL);
 	pthread_cond_init(&mCond, NULL);
 
 	// Set default init bitrate according to the config.
-	mAbrManager.setDefaultInitBitrate(gpGlobalConfig->defaultBitrate);
+	mAbrManager.setDefaultInitBitrate(aamp->mInitialBitrate);
 	if (gpGlobalConfig->iframeBitrate > 0)
 	{
 		mAbrManager.setDefaultIframeBitrate(gpGlobalConfig->iframeBitrate);
@@ -1097,6 +1366,14 @@ void StreamAbstractionAAMP::CheckForProfileChange(void)
 		// No profile change will be done or manifest download triggered based on profilechange
 		UpdateProfileBasedOnFragmentDownloaded();
 	}
+	else if (mRampDownRequested)
+	{
+		mRampDownRequested = false;
+		if (!RampDownProfile(0))
+		{
+			logprintf("%s:%d Requested ramp down not done, already at lowest profile\n", __FUNCTION__, __LINE__);
+		}
+	}
 	else
 	{
 		MediaTrack *video = GetMediaTrack(eTRACK_VIDEO);
@@ -1127,6 +1404,24 @@ void StreamAbstractionAAMP::CheckForProfileChange(void)
 }
 
 
+/**
+ *   @brief Update buffer health and stall prediction of enabled tracks.
+ *
+ *   Tracks update on fetch and inject; this catches tracks which ran dry without those events.
+ */
+void StreamAbstractionAAMP::UpdateBufferHealth(void)
+{
+	for (int i = 0; i < AAMP_TRACK_COUNT; i++)
+	{
+		MediaTrack *track = GetMediaTrack((TrackType) i);
+		if (track && track->Enabled())
+		{
+			track->UpdateBufferHealth();
+		}
+	}
+}
+
+
 /**
  *   @brief Get iframe track index.
  *
@@ -1136,7 +1431,17 @@ void StreamAbstractionAAMP::CheckForProfileChange(void)
  */
 int StreamAbstractionAAMP::GetIframeTrack()
 {
-	return mAbrManager.getDesiredIframeProfile();
+	int iframeProfile = mAbrManager.getDesiredIframeProfile();
+	if (aamp->mIframeThroughputLimited)
+	{
+		// Previous trickplay couldn't keep up with desired I-frame profile
+		int lowestIframeProfile = mAbrManager.getLowestIframeProfile();
+		if (ABRManager::INVALID_PROFILE != lowestIframeProfile)
+		{
+			iframeProfile = lowestIframeProfile;
+		}
+	}
+	return iframeProfile;
 }
 
 
@@ -1268,7 +1573,7 @@ void StreamAbstractionAAMP::CheckForPlaybackStall(bool fragmentParsed)
 		double timeElapsedSinceLastFragment = (aamp_GetCurrentTimeMS() - mLastVideoFragParsedTimeMS);
 
 		// We have not received a new fragment for a long time, check for cache empty required for dash
-		if (!mNetworkDownDetected && (timeElapsedSinceLastFragment > gpGlobalConfig->stallTimeoutInMS) && GetMediaTrack(eTRACK_VIDEO)->numberOfFragmentsCached == 0)
+		if (!mNetworkDownDetected && (timeElapsedSinceLastFragment > aamp->mStallTimeoutInMS) && GetMediaTrack(eTRACK_VIDEO)->numberOfFragmentsCached == 0)
 		{
 			AAMPLOG_INFO("StreamAbstractionAAMP::%s() Didn't download a new fragment for a long time(%f) and cache empty!\n", __FUNCTION__, timeElapsedSinceLastFragment);
 			mIsPlaybackStalled = true;
@@ -1346,7 +1651,7 @@ void StreamAbstractionAAMP::CheckUserProfileChangeReq(void)
 	MediaTrack *video = GetMediaTrack(eTRACK_VIDEO);
 	//Check if there is an actual change in bitrate
 	long userRequestedBandwidth = aamp->GetVideoBitrate();
-	if (userRequestedBandwidth != gpGlobalConfig->defaultBitrate)
+	if (userRequestedBandwidth != aamp->mInitialBitrate)
 	{
 		int desiredProfileIndex = mAbrManager.getBestMatchedProfileIndexByBandWidth(userRequestedBandwidth);
 		if (currentProfileIndex != desiredProfileIndex)
@@ -0,0 +1,189 @@
+/*
+ * If not stated otherwise in this file or this component's license file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/**
+ * @file mpdtimelinetest.cpp
+ * @brief Self tests expanding DASH SegmentTimeline S elements to segments,
+ * as done for thumbnail indexing and ad prefetch. Exit status is non-zero if
+ * any check fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include "../fragmentcollector_mpd.h"
+
+#define MPDTIMELINETEST_CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			printf("  FAIL %s:%d: %s\n", __FUNCTION__, __LINE__, #cond); \
+			ok = false; \
+		} \
+	} while (0)
+
+typedef std::vector<std::pair<uint64_t, uint64_t>> SegmentList;
+
+/**
+ * @brief Make an S element
+ */
+static TimelineEntry S(uint64_t startTime, uint64_t duration, uint32_t repeatCount)
+{
+	TimelineEntry entry;
+	entry.startTime = startTime;
+	entry.duration = duration;
+	entry.repeatCount = repeatCount;
+	return entry;
+}
+
+/**
+ * @brief Check segments are contiguous from startTime with given duration
+ */
+static bool CheckSegments(const SegmentList &segments, size_t first, size_t count, uint64_t startTime, uint64_t duration)
+{
+	bool ok = true;
+	MPDTIMELINETEST_CHECK(segments.size() >= first + count);
+	for (size_t i = 0; ok && i < count; i++)
+	{
+		MPDTIMELINETEST_CHECK(segments[first + i].first == startTime + i * duration);
+		MPDTIMELINETEST_CHECK(segments[first + i].second == duration);
+	}
+	return ok;
+}
+
+/**
+ * @brief Finite S@r lists r+1 segments, cut at maxTime
+ */
+static bool TestFiniteRepeat()
+{
+	bool ok = true;
+	std::vector<TimelineEntry> timeline;
+	timeline.push_back(S(1000, 10, 4));
+	timeline.push_back(S(0, 20, 0));
+	SegmentList segments;
+	MPDTIMELINETEST_CHECK(StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 0, 0, segments) == 1000);
+	MPDTIMELINETEST_CHECK(segments.size() == 6);
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 0, 5, 1000, 10));
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 5, 1, 1050, 20));
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 0, 25, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 3);
+	return ok;
+}
+
+/**
+ * @brief S@r=-1 on last S element repeats till period end
+ */
+static bool TestOpenRepeatToPeriodEnd()
+{
+	bool ok = true;
+	std::vector<TimelineEntry> timeline;
+	timeline.push_back(S(1000, 10, (uint32_t)-1));
+	SegmentList segments;
+	MPDTIMELINETEST_CHECK(StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 95, 0, segments) == 1000);
+	MPDTIMELINETEST_CHECK(segments.size() == 10);
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 0, 10, 1000, 10));
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 100, 0, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 10);
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 95, 30, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 3);
+
+	/* two hour period at 90 kHz, as listed for thumbnails */
+	timeline[0] = S(0, 6 * 90000, (uint32_t)-1);
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 7200ULL * 90000, 0, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 1200);
+	return ok;
+}
+
+/**
+ * @brief S@r=-1 followed by S@t repeats till that S@t
+ */
+static bool TestOpenRepeatToNextStart()
+{
+	bool ok = true;
+	std::vector<TimelineEntry> timeline;
+	timeline.push_back(S(0, 10, (uint32_t)-1));
+	timeline.push_back(S(50, 20, 1));
+	SegmentList segments;
+	MPDTIMELINETEST_CHECK(StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 1000, 0, segments) == 0);
+	MPDTIMELINETEST_CHECK(segments.size() == 7);
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 0, 5, 0, 10));
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 5, 2, 50, 20));
+	return ok;
+}
+
+/**
+ * @brief S@r=-1 without an end or with zero duration terminates
+ */
+static bool TestOpenRepeatUnbounded()
+{
+	bool ok = true;
+	std::vector<TimelineEntry> timeline;
+	timeline.push_back(S(0, 10, (uint32_t)-1));
+	SegmentList segments;
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 0, 0, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 1);
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 0, 35, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 4);
+	MPDTIMELINETEST_CHECK(CheckSegments(segments, 0, 4, 0, 10));
+	timeline[0] = S(0, 0, (uint32_t)-1);
+	segments.clear();
+	StreamAbstractionAAMP_MPD::GetTimelineSegments(timeline, 100, 0, segments);
+	MPDTIMELINETEST_CHECK(segments.size() == 1);
+	return ok;
+}
+
+/**
+ * @struct SelfTest
+ * @brief Self test on a synthetic timeline
+ */
+struct SelfTest
+{
+	const char *name;
+	bool (*run)();
+};
+
+static const SelfTest selfTests[] =
+{
+	{ "finite repeat", TestFiniteRepeat },
+	{ "open repeat to period end", TestOpenRepeatToPeriodEnd },
+	{ "open repeat to next S@t", TestOpenRepeatToNextStart },
+	{ "open repeat unbounded", TestOpenRepeatUnbounded }
+};
+
+int main()
+{
+	int failures = 0;
+	for (size_t t = 0; t < sizeof(selfTests) / sizeof(selfTests[0]); t++)
+	{
+		bool ok = selfTests[t].run();
+		printf("%s %s\n", ok ? "PASS" : "FAIL", selfTests[t].name);
+		if (!ok)
+		{
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
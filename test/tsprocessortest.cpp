@@ -0,0 +1,2150 @@
+/*
+ * If not stated otherwise in this file or this component's license file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2018 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+/**
+ * @file tsprocessortest.cpp
+ * @brief Stand alone driver feeding TS files and fuzzed variants of them through
+ * TSProcessor in all play modes, without a pipeline or network.
+ *
+ * Output of TSProcessor is consumed by a recording sink. Throughput (MB/s) and
+ * per segment cost are reported for every mode. For a per function breakdown,
+ * run under a profiler, e.g. "perf record -g tsprocessortest file.ts". Build
+ * with CMAKE_AAMP_SANITIZE to run the bitstream code under ASan/UBSan.
+ *
+ * Before the files, self tests run on synthetic streams with known frames and
+ * time stamps. Exit status is non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include <string>
+#include <priv_aamp.h>
+#include <main_aamp.h>
+#include "../tsprocessor.h"
+
+#define TSPROCESSORTEST_PACKET_SIZE 188
+#define TSPROCESSORTEST_DEFAULT_SEGMENT_PACKETS 5000
+#define TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION 2.0
+#define TSPROCESSORTEST_DEFAULT_FUZZ_ITERATIONS 100
+#define TSPROCESSORTEST_PMT_PID 0x100
+#define TSPROCESSORTEST_VIDEO_PID 0x101
+#define TSPROCESSORTEST_AUDIO_PID 0x102
+#define TSPROCESSORTEST_FIRST_PTS 900000LL
+#define TSPROCESSORTEST_PCR_OFFSET 9000LL /*PCR ahead of first PTS, within MAX_FIRST_PTS_OFFSET*/
+#define TSPROCESSORTEST_FRAME_TICKS 3003
+#define TSPROCESSORTEST_GOP_FRAMES 10
+#define TSPROCESSORTEST_FRAME_FILLER 300
+#define TSPROCESSORTEST_ABORT_TIMEOUT_MS 5000
+#define TSPROCESSORTEST_HEVC_GOPS 3
+#define TSPROCESSORTEST_HEVC_GOP_FRAMES 4
+#define TSPROCESSORTEST_HEVC_FIXTURE "hevc_keyframes.ts"
+#define TSPROCESSORTEST_DEFAULT_DATA_DIR "test/data"
+
+/**
+ * @brief Report a failed expectation and fail the test. Expects bool ok in scope.
+ */
+#define TSPROCESSORTEST_CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			printf("  FAIL %s:%d: %s\n", __FUNCTION__, __LINE__, #cond); \
+			ok = false; \
+		} \
+	} while (0)
+
+/**
+ * @struct TestMode
+ * @brief Play mode / stream operation combination exercised by the driver
+ */
+struct TestMode
+{
+	const char *name;
+	StreamOperation streamOperation;
+	PlayMode playMode;
+	double rate;
+};
+
+static const TestMode testModes[] =
+{
+	{ "normal", eStreamOp_NONE, PlayMode_normal, 1.0 },
+	{ "demux", eStreamOp_DEMUX_ALL, PlayMode_normal, 1.0 },
+	{ "restamp IPB", eStreamOp_NONE, PlayMode_retimestamp_IPB, 2.0 },
+	{ "restamp IandP", eStreamOp_NONE, PlayMode_retimestamp_IandP, 4.0 },
+	{ "restamp Ionly", eStreamOp_NONE, PlayMode_retimestamp_Ionly, 16.0 },
+	{ "reverse GOP", eStreamOp_NONE, PlayMode_reverse_GOP, -16.0 },
+	{ "demux Ionly", eStreamOp_DEMUX_ALL, PlayMode_retimestamp_Ionly, 16.0 }
+};
+
+static const char *gDataDir = TSPROCESSORTEST_DEFAULT_DATA_DIR; /**< Directory of test fixtures */
+
+/**
+ * @class RecordingSink
+ * @brief Stream sink which accounts what TSProcessor emits. Can keep the buffers
+ * and can block senders, to emulate back-pressure of a pipeline.
+ */
+class RecordingSink : public StreamSink
+{
+public:
+	/**
+	 * @struct Frame
+	 * @brief Buffer kept when capture is enabled
+	 */
+	struct Frame
+	{
+		std::vector<unsigned char> data;
+		double pts;
+		double dts;
+	};
+
+	RecordingSink() : capture(false), blocked(false), blockedSenders(0)
+	{
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+		Reset();
+	}
+
+	~RecordingSink()
+	{
+		pthread_mutex_destroy(&mutex);
+		pthread_cond_destroy(&cond);
+	}
+
+	void Configure(StreamOutputFormat format, StreamOutputFormat audioFormat, bool bESChangeStatus)
+	{
+	}
+
+	void Send(MediaType mediaType, const void *ptr, size_t len, double fpts, double fdts, double duration)
+	{
+		pthread_mutex_lock(&mutex);
+		while (blocked)
+		{
+			blockedSenders++;
+			pthread_cond_wait(&cond, &mutex);
+			blockedSenders--;
+		}
+		if (mediaType < AAMP_TRACK_COUNT)
+		{
+			buffers[mediaType]++;
+			bytes[mediaType] += len;
+			if (capture)
+			{
+				Frame frame;
+				frame.data.assign((const unsigned char *)ptr, (const unsigned char *)ptr + len);
+				frame.pts = fpts;
+				frame.dts = fdts;
+				frames[mediaType].push_back(frame);
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	void Send(MediaType mediaType, struct GrowableBuffer* buffer, double fpts, double fdts, double duration)
+	{
+		Send(mediaType, buffer->ptr, buffer->len, fpts, fdts, duration);
+		aamp_Free(&buffer->ptr);
+		memset(buffer, 0x00, sizeof(GrowableBuffer));
+	}
+
+	bool Discontinuity(MediaType mediaType)
+	{
+		return true;
+	}
+
+	/**
+	 * @brief Block or release senders
+	 * @param[in] block true to make Send wait till released
+	 */
+	void Block(bool block)
+	{
+		pthread_mutex_lock(&mutex);
+		blocked = block;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	/**
+	 * @brief Get number of senders waiting in Send
+	 * @retval blocked senders
+	 */
+	int GetBlockedSenders()
+	{
+		pthread_mutex_lock(&mutex);
+		int ret = blockedSenders;
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	void Reset()
+	{
+		memset(buffers, 0, sizeof(buffers));
+		memset(bytes, 0, sizeof(bytes));
+		for (int i = 0; i < AAMP_TRACK_COUNT; i++)
+		{
+			frames[i].clear();
+		}
+	}
+
+	bool capture;
+	int buffers[AAMP_TRACK_COUNT];
+	size_t bytes[AAMP_TRACK_COUNT];
+	std::vector<Frame> frames[AAMP_TRACK_COUNT];
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool blocked;
+	int blockedSenders;
+};
+
+/**
+ * @brief Get monotonic time in microseconds
+ * @retval time stamp
+ */
+static long long GetTimeUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec) * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Read a TS file, dropping any trailing partial packet
+ * @param[in] path file path
+ * @param[out] data file contents
+ * @retval true on success
+ */
+static bool ReadFile(const char *path, std::vector<unsigned char> &data)
+{
+	bool ret = false;
+	FILE *f = fopen(path, "rb");
+	if (f)
+	{
+		unsigned char chunk[64 * 1024];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		{
+			data.insert(data.end(), chunk, chunk + n);
+		}
+		fclose(f);
+		data.resize(data.size() - (data.size() % TSPROCESSORTEST_PACKET_SIZE));
+		ret = !data.empty();
+	}
+	return ret;
+}
+
+/**
+ * @brief Apply one random mutation to TS data. Sync bytes are mostly kept so
+ * that mutations reach the PSI/PES/ES parsers instead of being rejected upfront.
+ * @param[in,out] data TS data
+ * @param[in,out] seed random seed
+ */
+static void Mutate(std::vector<unsigned char> &data, unsigned int &seed)
+{
+	size_t packets = data.size() / TSPROCESSORTEST_PACKET_SIZE;
+	if (!packets)
+	{
+		return;
+	}
+	switch (rand_r(&seed) % 6)
+	{
+	case 0: // flip payload bits
+		for (int i = 1 + rand_r(&seed) % 32; i > 0; i--)
+		{
+			size_t pos = rand_r(&seed) % data.size();
+			if (pos % TSPROCESSORTEST_PACKET_SIZE)
+			{
+				data[pos] ^= (unsigned char)(1 << (rand_r(&seed) % 8));
+			}
+		}
+		break;
+	case 1: // corrupt TS/PES headers
+		for (int i = 1 + rand_r(&seed) % 8; i > 0; i--)
+		{
+			size_t pos = (rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE + 1 + rand_r(&seed) % 20;
+			data[pos] = (unsigned char)rand_r(&seed);
+		}
+		break;
+	case 2: // truncate
+		data.resize((1 + rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE);
+		break;
+	case 3: // duplicate a packet over another one
+		{
+			size_t from = (rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE;
+			size_t to = (rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE;
+			memmove(&data[to], &data[from], TSPROCESSORTEST_PACKET_SIZE);
+		}
+		break;
+	case 4: // garbage packet
+		{
+			size_t pos = (rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE;
+			for (int i = 1; i < TSPROCESSORTEST_PACKET_SIZE; i++)
+			{
+				data[pos + i] = (unsigned char)rand_r(&seed);
+			}
+		}
+		break;
+	default: // lose sync
+		data[(rand_r(&seed) % packets) * TSPROCESSORTEST_PACKET_SIZE] = (unsigned char)rand_r(&seed);
+		break;
+	}
+}
+
+/**
+ * @brief CRC of MPEG-2 PSI sections
+ * @param[in] p section data
+ * @param[in] len length of data
+ * @retval CRC32
+ */
+static uint32_t Crc32(const unsigned char *p, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	while (len--)
+	{
+		crc ^= (uint32_t)(*p++) << 24;
+		for (int i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04C11DB7) : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+/**
+ * @class BitWriter
+ * @brief Writes RBSP of synthetic parameter sets and slice headers
+ */
+class BitWriter
+{
+public:
+	BitWriter() : bytes(), bitCount(0)
+	{
+	}
+
+	void PutBits(unsigned int value, int count)
+	{
+		while (count-- > 0)
+		{
+			if (0 == (bitCount & 7))
+			{
+				bytes.push_back(0);
+			}
+			if ((value >> count) & 1)
+			{
+				bytes.back() |= (0x80 >> (bitCount & 7));
+			}
+			bitCount++;
+		}
+	}
+
+	void PutUExpGolomb(unsigned int value)
+	{
+		unsigned int code = value + 1;
+		int len = 0;
+		while ((code >> len) > 1)
+		{
+			len++;
+		}
+		PutBits(0, len);
+		PutBits(code, len + 1);
+	}
+
+	void PutFiller(int count)
+	{
+		while (count-- > 0)
+		{
+			PutBits(0x5A, 8);
+		}
+	}
+
+	void PutTrailingBits()
+	{
+		PutBits(1, 1);
+		while (bitCount & 7)
+		{
+			PutBits(0, 1);
+		}
+	}
+
+	std::vector<unsigned char> bytes;
+	size_t bitCount;
+};
+
+/**
+ * @brief Append a NAL unit in Annex B format, inserting emulation prevention bytes
+ * @param[in,out] es elementary stream
+ * @param[in] header NAL unit header
+ * @param[in] headerLen NAL unit header length, 1 for H.264 and 2 for HEVC
+ * @param[in] rbsp NAL unit payload
+ */
+static void AppendNAL(std::vector<unsigned char> &es, const unsigned char *header, int headerLen, const BitWriter &rbsp)
+{
+	static const unsigned char startCode[] = { 0x00, 0x00, 0x00, 0x01 };
+	int zeros = 0;
+	es.insert(es.end(), startCode, startCode + sizeof(startCode));
+	es.insert(es.end(), header, header + headerLen);
+	for (size_t i = 0; i < rbsp.bytes.size(); i++)
+	{
+		if ((zeros >= 2) && (rbsp.bytes[i] <= 0x03))
+		{
+			es.push_back(0x03);
+			zeros = 0;
+		}
+		es.push_back(rbsp.bytes[i]);
+		zeros = (rbsp.bytes[i] == 0x00) ? (zeros + 1) : 0;
+	}
+}
+
+/**
+ * @brief Append an H.264 access unit of 320x240 baseline video
+ * @param[in,out] es elementary stream
+ * @param[in] frame frame index, IDR with SPS/PPS at start of every GOP
+ */
+static void AppendH264AccessUnit(std::vector<unsigned char> &es, int frame)
+{
+	bool idr = (0 == (frame % TSPROCESSORTEST_GOP_FRAMES));
+	int frameInGop = frame % TSPROCESSORTEST_GOP_FRAMES;
+	BitWriter aud;
+	aud.PutBits(7, 3); // primary_pic_type
+	aud.PutTrailingBits();
+	unsigned char nalHeader = 0x09;
+	AppendNAL(es, &nalHeader, 1, aud);
+	if (idr)
+	{
+		BitWriter sps;
+		sps.PutBits(66, 8); // profile_idc
+		sps.PutBits(0, 8); // constraint flags
+		sps.PutBits(30, 8); // level_idc
+		sps.PutUExpGolomb(0); // seq_parameter_set_id
+		sps.PutUExpGolomb(0); // log2_max_frame_num_minus4
+		sps.PutUExpGolomb(0); // pic_order_cnt_type
+		sps.PutUExpGolomb(0); // log2_max_pic_order_cnt_lsb_minus4
+		sps.PutUExpGolomb(1); // max_num_ref_frames
+		sps.PutBits(0, 1); // gaps_in_frame_num_value_allowed_flag
+		sps.PutUExpGolomb(19); // pic_width_in_mbs_minus1
+		sps.PutUExpGolomb(14); // pic_height_in_map_units_minus1
+		sps.PutBits(1, 1); // frame_mbs_only_flag
+		sps.PutBits(1, 1); // direct_8x8_inference_flag
+		sps.PutBits(0, 1); // frame_cropping_flag
+		sps.PutBits(0, 1); // vui_parameters_present_flag
+		sps.PutTrailingBits();
+		nalHeader = 0x67;
+		AppendNAL(es, &nalHeader, 1, sps);
+
+		BitWriter pps;
+		pps.PutUExpGolomb(0); // pic_parameter_set_id
+		pps.PutUExpGolomb(0); // seq_parameter_set_id
+		pps.PutBits(0, 2); // entropy_coding_mode_flag, bottom_field_pic_order_in_frame_present_flag
+		pps.PutUExpGolomb(0); // num_slice_groups_minus1
+		pps.PutUExpGolomb(0); // num_ref_idx_l0_default_active_minus1
+		pps.PutUExpGolomb(0); // num_ref_idx_l1_default_active_minus1
+		pps.PutBits(0, 3); // weighted_pred_flag, weighted_bipred_idc
+		pps.PutUExpGolomb(0); // pic_init_qp_minus26
+		pps.PutUExpGolomb(0); // pic_init_qs_minus26
+		pps.PutUExpGolomb(0); // chroma_qp_index_offset
+		pps.PutBits(4, 3); // deblocking_filter_control_present_flag, constrained_intra_pred_flag, redundant_pic_cnt_present_flag
+		pps.PutTrailingBits();
+		nalHeader = 0x68;
+		AppendNAL(es, &nalHeader, 1, pps);
+	}
+	BitWriter slice;
+	slice.PutUExpGolomb(0); // first_mb_in_slice
+	slice.PutUExpGolomb(idr ? 7 : 5); // slice_type I or P
+	slice.PutUExpGolomb(0); // pic_parameter_set_id
+	slice.PutBits(frameInGop & 0x0F, 4); // frame_num
+	if (idr)
+	{
+		slice.PutUExpGolomb(0); // idr_pic_id
+	}
+	slice.PutBits((frameInGop * 2) & 0x0F, 4); // pic_order_cnt_lsb
+	slice.PutFiller(TSPROCESSORTEST_FRAME_FILLER);
+	slice.PutTrailingBits();
+	nalHeader = idr ? 0x65 : 0x41;
+	AppendNAL(es, &nalHeader, 1, slice);
+}
+
+/**
+ * @brief Append an ADTS frame of 48kHz stereo AAC-LC
+ * @param[in,out] es elementary stream
+ * @param[in] payloadLen raw frame length
+ */
+static void AppendADTSFrame(std::vector<unsigned char> &es, int payloadLen)
+{
+	int frameLen = payloadLen + 7;
+	unsigned char header[7];
+	header[0] = 0xFF;
+	header[1] = 0xF1; // MPEG-4, no CRC
+	header[2] = (1 << 6) | (3 << 2); // AAC-LC, 48kHz
+	header[3] = (2 << 6) | ((frameLen >> 11) & 0x03); // 2 channels
+	header[4] = (frameLen >> 3) & 0xFF;
+	header[5] = ((frameLen & 0x07) << 5) | 0x1F;
+	header[6] = 0xFC;
+	es.insert(es.end(), header, header + sizeof(header));
+	es.insert(es.end(), payloadLen, 0x21);
+}
+
+/**
+ * @class TSBuilder
+ * @brief Writes a single program TS with PAT/PMT, PCR on video PID and one PES per frame
+ */
+class TSBuilder
+{
+public:
+	TSBuilder() : data()
+	{
+		memset(continuity, 0, sizeof(continuity));
+	}
+
+	/**
+	 * @brief Add PAT and PMT
+	 * @param[in] videoStreamType stream type of video PID, 0 for audio only PMT
+	 * @param[in] withAudio true to add AAC audio PID
+	 */
+	void AddPatPmt(int videoStreamType, bool withAudio)
+	{
+		std::vector<unsigned char> pat;
+		const unsigned char patSection[] = { 0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00,
+			0x00, 0x01, 0xE0 | (TSPROCESSORTEST_PMT_PID >> 8), TSPROCESSORTEST_PMT_PID & 0xFF };
+		pat.assign(patSection, patSection + sizeof(patSection));
+		AddSection(0, pat);
+
+		std::vector<unsigned char> pmt;
+		int pcrPid = videoStreamType ? TSPROCESSORTEST_VIDEO_PID : TSPROCESSORTEST_AUDIO_PID;
+		const unsigned char pmtSection[] = { 0x02, 0xB0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+			(unsigned char)(0xE0 | (pcrPid >> 8)), (unsigned char)(pcrPid & 0xFF), 0xF0, 0x00 };
+		pmt.assign(pmtSection, pmtSection + sizeof(pmtSection));
+		if (videoStreamType)
+		{
+			const unsigned char videoStream[] = { (unsigned char)videoStreamType, 0xE0 | (TSPROCESSORTEST_VIDEO_PID >> 8), TSPROCESSORTEST_VIDEO_PID & 0xFF, 0xF0, 0x00 };
+			pmt.insert(pmt.end(), videoStream, videoStream + sizeof(videoStream));
+		}
+		if (withAudio)
+		{
+			const unsigned char audioStream[] = { 0x0F, 0xE0 | (TSPROCESSORTEST_AUDIO_PID >> 8), TSPROCESSORTEST_AUDIO_PID & 0xFF, 0xF0, 0x00 };
+			pmt.insert(pmt.end(), audioStream, audioStream + sizeof(audioStream));
+		}
+		AddSection(TSPROCESSORTEST_PMT_PID, pmt);
+	}
+
+	/**
+	 * @brief Add a packet carrying just a PCR, as inserted by TSProcessor::insertPCR
+	 * @param[in] pid PCR PID
+	 * @param[in] pcr PCR base
+	 */
+	void AddPcrPacket(int pid, long long pcr)
+	{
+		unsigned char none = 0;
+		AddPacket(pid, false, &none, 0, pcr);
+		unsigned char *packet = &data[data.size() - TSPROCESSORTEST_PACKET_SIZE];
+		// adaptation field only; continuity counter doesn't advance without payload
+		continuity[pid] = (continuity[pid] - 1) & 0x0F;
+		packet[3] = 0x20 | continuity[pid];
+	}
+
+	/**
+	 * @brief Add a PES carrying one frame
+	 * @param[in] pid PID
+	 * @param[in] streamId PES stream id
+	 * @param[in] pts PTS in 90kHz
+	 * @param[in] dts DTS in 90kHz, -1 for PTS only
+	 * @param[in] es frame data
+	 * @param[in] pcr PCR base to put in first packet, -1 for none
+	 */
+	void AddPes(int pid, int streamId, long long pts, long long dts, const std::vector<unsigned char> &es, long long pcr = -1)
+	{
+		std::vector<unsigned char> pes;
+		int headerDataLen = (-1 != dts) ? 10 : 5;
+		size_t pesLen = (0xE0 == (streamId & 0xF0)) ? 0 : (3 + headerDataLen + es.size());
+		const unsigned char pesHeader[] = { 0x00, 0x00, 0x01, (unsigned char)streamId, (unsigned char)(pesLen >> 8), (unsigned char)pesLen,
+			0x80, (unsigned char)((-1 != dts) ? 0xC0 : 0x80), (unsigned char)headerDataLen };
+		pes.assign(pesHeader, pesHeader + sizeof(pesHeader));
+		AppendTimeStamp(pes, (-1 != dts) ? 0x03 : 0x02, pts);
+		if (-1 != dts)
+		{
+			AppendTimeStamp(pes, 0x01, dts);
+		}
+		pes.insert(pes.end(), es.begin(), es.end());
+		size_t offset = 0;
+		while (offset < pes.size())
+		{
+			size_t maxLen = ((0 == offset) && (-1 != pcr)) ? (TSPROCESSORTEST_PACKET_SIZE - 12) : (TSPROCESSORTEST_PACKET_SIZE - 4);
+			size_t len = std::min(maxLen, pes.size() - offset);
+			AddPacket(pid, (0 == offset), &pes[offset], len, (0 == offset) ? pcr : -1);
+			offset += len;
+		}
+	}
+
+	std::vector<unsigned char> data;
+
+private:
+	static void AppendTimeStamp(std::vector<unsigned char> &pes, int prefix, long long ts)
+	{
+		pes.push_back((unsigned char)((prefix << 4) | ((ts >> 29) & 0x0E) | 0x01));
+		pes.push_back((unsigned char)(ts >> 22));
+		pes.push_back((unsigned char)(((ts >> 14) & 0xFE) | 0x01));
+		pes.push_back((unsigned char)(ts >> 7));
+		pes.push_back((unsigned char)(((ts << 1) & 0xFE) | 0x01));
+	}
+
+	void AddSection(int pid, std::vector<unsigned char> &section)
+	{
+		size_t sectionLength = section.size() - 3 + 4;
+		section[1] = 0xB0 | ((sectionLength >> 8) & 0x0F);
+		section[2] = sectionLength & 0xFF;
+		uint32_t crc = Crc32(&section[0], section.size());
+		for (int shift = 24; shift >= 0; shift -= 8)
+		{
+			section.push_back((unsigned char)(crc >> shift));
+		}
+		std::vector<unsigned char> payload(1, 0x00); // pointer_field
+		payload.insert(payload.end(), section.begin(), section.end());
+		payload.resize(TSPROCESSORTEST_PACKET_SIZE - 4, 0xFF);
+		AddPacket(pid, true, &payload[0], payload.size(), -1);
+	}
+
+	void AddPacket(int pid, bool payloadStart, const unsigned char *payload, size_t len, long long pcr)
+	{
+		unsigned char packet[TSPROCESSORTEST_PACKET_SIZE];
+		int adaptationLen = TSPROCESSORTEST_PACKET_SIZE - 4 - (int)len;
+		packet[0] = 0x47;
+		packet[1] = (payloadStart ? 0x40 : 0x00) | ((pid >> 8) & 0x1F);
+		packet[2] = pid & 0xFF;
+		packet[3] = ((adaptationLen > 0) ? 0x30 : 0x10) | continuity[pid];
+		continuity[pid] = (continuity[pid] + 1) & 0x0F;
+		if (adaptationLen > 0)
+		{
+			packet[4] = adaptationLen - 1;
+			if (adaptationLen > 1)
+			{
+				memset(&packet[5], 0xFF, adaptationLen - 1);
+				packet[5] = 0x00;
+				if (-1 != pcr)
+				{
+					packet[5] = 0x10;
+					packet[6] = (unsigned char)(pcr >> 25);
+					packet[7] = (unsigned char)(pcr >> 17);
+					packet[8] = (unsigned char)(pcr >> 9);
+					packet[9] = (unsigned char)(pcr >> 1);
+					packet[10] = (unsigned char)(((pcr & 1) << 7) | 0x7E);
+					packet[11] = 0x00;
+				}
+			}
+		}
+		memcpy(&packet[4 + adaptationLen], payload, len);
+		data.insert(data.end(), packet, packet + sizeof(packet));
+	}
+
+	unsigned char continuity[0x2000];
+};
+
+/**
+ * @brief Build H.264 TS with GOPs of TSPROCESSORTEST_GOP_FRAMES frames, PAT/PMT and PCR ahead of each IDR
+ * @param[out] ts TS builder
+ * @param[in] frames number of video frames
+ * @param[in] withAudio add an AAC PES with same PTS after each video frame
+ * @param[out] videoES access units, in order
+ */
+static void BuildH264Stream(TSBuilder &ts, int frames, bool withAudio, std::vector<std::vector<unsigned char> > &videoES)
+{
+	videoES.clear();
+	for (int i = 0; i < frames; i++)
+	{
+		long long pts = TSPROCESSORTEST_FIRST_PTS + (long long)i * TSPROCESSORTEST_FRAME_TICKS;
+		bool idr = (0 == (i % TSPROCESSORTEST_GOP_FRAMES));
+		if (idr)
+		{
+			ts.AddPatPmt(0x1B, withAudio);
+		}
+		videoES.push_back(std::vector<unsigned char>());
+		AppendH264AccessUnit(videoES.back(), i);
+		ts.AddPes(TSPROCESSORTEST_VIDEO_PID, 0xE0, pts, pts, videoES.back(), idr ? (pts - TSPROCESSORTEST_PCR_OFFSET) : -1);
+		if (withAudio)
+		{
+			std::vector<unsigned char> audio;
+			AppendADTSFrame(audio, 100);
+			ts.AddPes(TSPROCESSORTEST_AUDIO_PID, 0xC0, pts, -1, audio);
+		}
+	}
+}
+
+/**
+ * @brief Append an HEVC access unit of 320x240 Main profile video. SPS signals 8 bit
+ * slice_pic_order_cnt_lsb and PPS signals pic_output_flag and 2 extra slice header bits,
+ * so that slice_pic_order_cnt_lsb is found only if both are parsed.
+ * @param[in,out] es elementary stream
+ * @param[in] nalType slice NAL unit type, VPS/SPS/PPS are added ahead of IRAP
+ * @param[in] picOrderCntLsb slice_pic_order_cnt_lsb, not coded for IDR
+ */
+static void AppendHEVCAccessUnit(std::vector<unsigned char> &es, int nalType, int picOrderCntLsb)
+{
+	bool irap = (nalType >= 16) && (nalType <= 23);
+	bool idr = (19 == nalType) || (20 == nalType);
+	unsigned char nalHeader[2] = { 35 << 1, 0x01 };
+	BitWriter aud;
+	aud.PutBits(idr || irap ? 0 : 1, 3); // pic_type
+	aud.PutTrailingBits();
+	AppendNAL(es, nalHeader, 2, aud);
+	if (irap)
+	{
+		BitWriter ptl;
+		ptl.PutBits(1, 8); // general_profile_space, general_tier_flag, general_profile_idc Main
+		ptl.PutBits(0x60000000, 32); // general_profile_compatibility_flags
+		ptl.PutBits(0x9, 4); // progressive_source_flag .. frame_only_constraint_flag
+		ptl.PutBits(0, 32); // reserved
+		ptl.PutBits(0, 12);
+		ptl.PutBits(93, 8); // general_level_idc
+
+		BitWriter vps;
+		vps.PutBits(0, 4); // vps_video_parameter_set_id
+		vps.PutBits(3, 2); // vps_base_layer_internal_flag, vps_base_layer_available_flag
+		vps.PutBits(0, 6); // vps_max_layers_minus1
+		vps.PutBits(0, 3); // vps_max_sub_layers_minus1
+		vps.PutBits(1, 1); // vps_temporal_id_nesting_flag
+		vps.PutBits(0xFFFF, 16); // vps_reserved_0xffff_16bits
+		for (size_t i = 0; i < ptl.bytes.size(); i++)
+		{
+			vps.PutBits(ptl.bytes[i], 8);
+		}
+		vps.PutTrailingBits();
+		nalHeader[0] = 32 << 1;
+		AppendNAL(es, nalHeader, 2, vps);
+
+		BitWriter sps;
+		sps.PutBits(0, 4); // sps_video_parameter_set_id
+		sps.PutBits(0, 3); // sps_max_sub_layers_minus1
+		sps.PutBits(1, 1); // sps_temporal_id_nesting_flag
+		for (size_t i = 0; i < ptl.bytes.size(); i++)
+		{
+			sps.PutBits(ptl.bytes[i], 8);
+		}
+		sps.PutUExpGolomb(0); // sps_seq_parameter_set_id
+		sps.PutUExpGolomb(1); // chroma_format_idc
+		sps.PutUExpGolomb(320); // pic_width_in_luma_samples
+		sps.PutUExpGolomb(240); // pic_height_in_luma_samples
+		sps.PutBits(0, 1); // conformance_window_flag
+		sps.PutUExpGolomb(0); // bit_depth_luma_minus8
+		sps.PutUExpGolomb(0); // bit_depth_chroma_minus8
+		sps.PutUExpGolomb(4); // log2_max_pic_order_cnt_lsb_minus4
+		sps.PutBits(1, 1); // sps_sub_layer_ordering_info_present_flag
+		sps.PutUExpGolomb(4); // sps_max_dec_pic_buffering_minus1
+		sps.PutUExpGolomb(0); // sps_max_num_reorder_pics
+		sps.PutUExpGolomb(0); // sps_max_latency_increase_plus1
+		sps.PutTrailingBits();
+		nalHeader[0] = 33 << 1;
+		AppendNAL(es, nalHeader, 2, sps);
+
+		BitWriter pps;
+		pps.PutUExpGolomb(0); // pps_pic_parameter_set_id
+		pps.PutUExpGolomb(0); // pps_seq_parameter_set_id
+		pps.PutBits(0, 1); // dependent_slice_segments_enabled_flag
+		pps.PutBits(1, 1); // output_flag_present_flag
+		pps.PutBits(2, 3); // num_extra_slice_header_bits
+		pps.PutBits(0, 2); // sign_data_hiding_enabled_flag, cabac_init_present_flag
+		pps.PutTrailingBits();
+		nalHeader[0] = 34 << 1;
+		AppendNAL(es, nalHeader, 2, pps);
+	}
+	BitWriter slice;
+	slice.PutBits(1, 1); // first_slice_segment_in_pic_flag
+	if (irap)
+	{
+		slice.PutBits(0, 1); // no_output_of_prior_pics_flag
+	}
+	slice.PutUExpGolomb(0); // slice_pic_parameter_set_id
+	slice.PutBits(0, 2); // slice_reserved_flag
+	slice.PutUExpGolomb(irap ? 2 : 1); // slice_type I or P
+	slice.PutBits(1, 1); // pic_output_flag
+	if (!idr)
+	{
+		slice.PutBits(picOrderCntLsb, 8); // slice_pic_order_cnt_lsb
+	}
+	slice.PutFiller(TSPROCESSORTEST_FRAME_FILLER);
+	slice.PutTrailingBits();
+	nalHeader[0] = (unsigned char)(nalType << 1);
+	AppendNAL(es, nalHeader, 2, slice);
+}
+
+/**
+ * @brief Build HEVC TS with TSPROCESSORTEST_HEVC_GOPS GOPs, each of PAT, PMT, key frame with
+ * PCR and TSPROCESSORTEST_HEVC_GOP_FRAMES - 1 TRAIL_R frames. First key frame is IDR_W_RADL,
+ * rest are CRA. This is how the HEVC fixture is generated.
+ * @param[out] ts TS builder
+ */
+static void BuildHEVCStream(TSBuilder &ts)
+{
+	for (int i = 0; i < TSPROCESSORTEST_HEVC_GOPS * TSPROCESSORTEST_HEVC_GOP_FRAMES; i++)
+	{
+		long long pts = TSPROCESSORTEST_FIRST_PTS + (long long)i * TSPROCESSORTEST_FRAME_TICKS;
+		int frameInGop = i % TSPROCESSORTEST_HEVC_GOP_FRAMES;
+		int nalType = frameInGop ? 1 : ((0 == i) ? 19 : 21);
+		if (0 == frameInGop)
+		{
+			ts.AddPatPmt(0x24, false);
+		}
+		std::vector<unsigned char> es;
+		// Not in output order, so that re-stamped values are told apart
+		AppendHEVCAccessUnit(es, nalType, (i * 37) & 0xFF);
+		ts.AddPes(TSPROCESSORTEST_VIDEO_PID, 0xE0, pts, pts, es, frameInGop ? -1 : (pts - TSPROCESSORTEST_PCR_OFFSET));
+	}
+}
+
+/**
+ * @brief Feed TS data through a fresh TSProcessor as consecutive segments
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] mode mode to run
+ * @param[in] data TS data
+ * @param[in] segmentSize segment size in bytes
+ * @param[in] segmentDuration duration reported per segment
+ * @param[out] maxSegmentUs most expensive segment
+ * @retval Time spent in sendSegment in microseconds
+ */
+static long long Run(PrivateInstanceAAMP *aamp, const TestMode &mode, const std::vector<unsigned char> &data,
+		size_t segmentSize, double segmentDuration, long long &maxSegmentUs)
+{
+	long long total = 0;
+	double position = 0;
+	std::vector<char> segment;
+	TSProcessor *tsProcessor = new TSProcessor(aamp, mode.streamOperation, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(mode.rate, mode.playMode);
+	maxSegmentUs = 0;
+	for (size_t offset = 0; offset < data.size(); offset += segmentSize)
+	{
+		size_t len = data.size() - offset;
+		if (len > segmentSize)
+		{
+			len = segmentSize;
+		}
+		// TSProcessor restamps in place, so each pass works on a copy
+		segment.assign(data.begin() + offset, data.begin() + offset + len);
+		bool ptsError = false;
+		long long start = GetTimeUs();
+		tsProcessor->sendSegment(&segment[0], len, position, segmentDuration, (offset == 0), ptsError);
+		long long elapsed = GetTimeUs() - start;
+		total += elapsed;
+		if (elapsed > maxSegmentUs)
+		{
+			maxSegmentUs = elapsed;
+		}
+		position += segmentDuration;
+	}
+	delete tsProcessor;
+	return total;
+}
+
+/**
+ * @brief Send TS data to TSProcessor as two segments and flush, so that every frame is emitted
+ * @param[in] tsProcessor TSProcessor
+ * @param[in] data TS data
+ * @param[in] position position of first segment
+ */
+static void SendInTwoSegments(TSProcessor *tsProcessor, const std::vector<unsigned char> &data, double position)
+{
+	size_t split = (data.size() / TSPROCESSORTEST_PACKET_SIZE / 2) * TSPROCESSORTEST_PACKET_SIZE;
+	std::vector<char> segment(data.begin(), data.begin() + split);
+	size_t len = segment.size();
+	bool ptsError = false;
+	tsProcessor->sendSegment(&segment[0], len, position, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, true, ptsError);
+	segment.assign(data.begin() + split, data.end());
+	len = segment.size();
+	tsProcessor->sendSegment(&segment[0], len, position + TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION,
+			TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, false, ptsError);
+	tsProcessor->flush();
+}
+
+/**
+ * @brief Demux synthetic H.264/AAC and check that every frame is emitted intact and in
+ * order, with PTS/DTS relative to first PCR, offset by position of the discontinuity
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool DemuxAndCheck(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const int frameCount = 3 * TSPROCESSORTEST_GOP_FRAMES;
+	const double position = 10.0;
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	BuildH264Stream(ts, frameCount, true, videoES);
+
+	sink.Reset();
+	sink.capture = true;
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_DEMUX_ALL, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(1.0, PlayMode_normal);
+	SendInTwoSegments(tsProcessor, ts.data, position);
+	delete tsProcessor;
+	sink.capture = false;
+
+	const std::vector<RecordingSink::Frame> &video = sink.frames[eMEDIATYPE_VIDEO];
+	const std::vector<RecordingSink::Frame> &audio = sink.frames[eMEDIATYPE_AUDIO];
+	TSPROCESSORTEST_CHECK(video.size() == (size_t)frameCount);
+	TSPROCESSORTEST_CHECK(audio.size() == (size_t)frameCount);
+	for (size_t i = 0; ok && (i < video.size()); i++)
+	{
+		double expected = position + (double)(TSPROCESSORTEST_PCR_OFFSET + (long long)i * TSPROCESSORTEST_FRAME_TICKS) / 90000;
+		TSPROCESSORTEST_CHECK(video[i].data == videoES[i]);
+		TSPROCESSORTEST_CHECK(fabs(video[i].pts - expected) < 1e-6);
+		TSPROCESSORTEST_CHECK(fabs(video[i].dts - expected) < 1e-6);
+		if (!ok)
+		{
+			printf("  video frame %d pts %f dts %f expected %f\n", (int)i, video[i].pts, video[i].dts, expected);
+		}
+	}
+	for (size_t i = 0; ok && (i < audio.size()); i++)
+	{
+		double expected = position + (double)(TSPROCESSORTEST_PCR_OFFSET + (long long)i * TSPROCESSORTEST_FRAME_TICKS) / 90000;
+		TSPROCESSORTEST_CHECK(audio[i].data.size() == 107);
+		TSPROCESSORTEST_CHECK(fabs(audio[i].pts - expected) < 1e-6);
+		if (!ok)
+		{
+			printf("  audio frame %d pts %f expected %f\n", (int)i, audio[i].pts, expected);
+		}
+	}
+	return ok;
+}
+
+/**
+ * @brief Demux with frames sent from caller's thread
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestDemux(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	int demuxPipeline = gpGlobalConfig->demuxPipeline;
+	gpGlobalConfig->demuxPipeline = 0;
+	bool ok = DemuxAndCheck(aamp, sink);
+	gpGlobalConfig->demuxPipeline = demuxPipeline;
+	return ok;
+}
+
+/**
+ * @brief Demux with frames sent from ESSendQueue threads. flush() shall drain the queues.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestDemuxPipeline(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	int demuxPipeline = gpGlobalConfig->demuxPipeline;
+	gpGlobalConfig->demuxPipeline = 1;
+	bool ok = DemuxAndCheck(aamp, sink);
+	gpGlobalConfig->demuxPipeline = demuxPipeline;
+	return ok;
+}
+
+/**
+ * @struct AsyncCall
+ * @brief TSProcessor call made from a helper thread, so that a hang can be detected
+ */
+struct AsyncCall
+{
+	TSProcessor *tsProcessor;
+	std::vector<char> *segment;
+	pthread_mutex_t mutex;
+	bool done;
+};
+
+static void *SendSegmentThread(void *arg)
+{
+	AsyncCall *call = (AsyncCall *)arg;
+	size_t len = call->segment->size();
+	bool ptsError = false;
+	call->tsProcessor->sendSegment(&(*call->segment)[0], len, 0, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, true, ptsError);
+	pthread_mutex_lock(&call->mutex);
+	call->done = true;
+	pthread_mutex_unlock(&call->mutex);
+	return NULL;
+}
+
+static void *AbortThread(void *arg)
+{
+	AsyncCall *call = (AsyncCall *)arg;
+	call->tsProcessor->abort();
+	pthread_mutex_lock(&call->mutex);
+	call->done = true;
+	pthread_mutex_unlock(&call->mutex);
+	return NULL;
+}
+
+/**
+ * @brief Wait for an async call to complete
+ * @param[in] call async call
+ * @param[in] timeoutMs time to wait
+ * @retval true if call completed
+ */
+static bool WaitForCall(AsyncCall *call, int timeoutMs)
+{
+	bool done = false;
+	for (int waited = 0; !done && (waited <= timeoutMs); waited++)
+	{
+		pthread_mutex_lock(&call->mutex);
+		done = call->done;
+		pthread_mutex_unlock(&call->mutex);
+		if (!done)
+		{
+			usleep(1000);
+		}
+	}
+	return done;
+}
+
+/**
+ * @brief Abort while sink blocks the sender thread and demux is blocked on a full ESSendQueue.
+ * abort() shall discard queued frames and return once the frame in sink is sent; nothing is
+ * sent after abort returned.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestDemuxPipelineAbort(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	// More frames than ESSendQueue holds, so that demux blocks on it
+	const int frameCount = 400;
+	int demuxPipeline = gpGlobalConfig->demuxPipeline;
+	gpGlobalConfig->demuxPipeline = 1;
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	BuildH264Stream(ts, frameCount, false, videoES);
+	std::vector<char> segment(ts.data.begin(), ts.data.end());
+
+	sink.Reset();
+	sink.Block(true);
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_DEMUX_VIDEO, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(1.0, PlayMode_normal);
+
+	AsyncCall send;
+	send.tsProcessor = tsProcessor;
+	send.segment = &segment;
+	send.done = false;
+	pthread_mutex_init(&send.mutex, NULL);
+	pthread_t sendThread;
+	pthread_create(&sendThread, NULL, SendSegmentThread, &send);
+	for (int waited = 0; (0 == sink.GetBlockedSenders()) && (waited < TSPROCESSORTEST_ABORT_TIMEOUT_MS); waited++)
+	{
+		usleep(1000);
+	}
+	TSPROCESSORTEST_CHECK(1 == sink.GetBlockedSenders());
+	// sendSegment stays blocked on the full queue
+	TSPROCESSORTEST_CHECK(!WaitForCall(&send, 100));
+
+	AsyncCall abort;
+	abort.tsProcessor = tsProcessor;
+	abort.segment = NULL;
+	abort.done = false;
+	pthread_mutex_init(&abort.mutex, NULL);
+	pthread_t abortThread;
+	pthread_create(&abortThread, NULL, AbortThread, &abort);
+	// abort waits for the frame in sink
+	TSPROCESSORTEST_CHECK(!WaitForCall(&abort, 100));
+
+	sink.Block(false);
+	TSPROCESSORTEST_CHECK(WaitForCall(&abort, TSPROCESSORTEST_ABORT_TIMEOUT_MS));
+	TSPROCESSORTEST_CHECK(WaitForCall(&send, TSPROCESSORTEST_ABORT_TIMEOUT_MS));
+	// Only the frame which was in sink is sent, queued frames are discarded
+	int sentAtAbort = sink.buffers[eMEDIATYPE_VIDEO];
+	TSPROCESSORTEST_CHECK(1 == sentAtAbort);
+	usleep(50000);
+	TSPROCESSORTEST_CHECK(sentAtAbort == sink.buffers[eMEDIATYPE_VIDEO]);
+
+	pthread_join(abortThread, NULL);
+	pthread_join(sendThread, NULL);
+	pthread_mutex_destroy(&abort.mutex);
+	pthread_mutex_destroy(&send.mutex);
+	delete tsProcessor;
+	gpGlobalConfig->demuxPipeline = demuxPipeline;
+	return ok;
+}
+
+/**
+ * @brief Locate key frames of synthetic H.264/AAC. Each range shall start at the PAT ahead
+ * of the IDR, end before the next video PES and demux to just that IDR.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestH264KeyFrames(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const int gopCount = 3;
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	BuildH264Stream(ts, gopCount * TSPROCESSORTEST_GOP_FRAMES, true, videoES);
+	const std::vector<unsigned char> &data = ts.data;
+
+	// PAT is followed by PMT and the IDR, audio packets interleave till next video PES
+	std::vector<std::pair<size_t, size_t> > expected;
+	size_t patOffset = 0;
+	int videoPesCount = 0;
+	bool inKeyFrame = false;
+	for (size_t offset = 0; offset < data.size(); offset += TSPROCESSORTEST_PACKET_SIZE)
+	{
+		const unsigned char *packet = &data[offset];
+		int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+		if (0 == pid)
+		{
+			patOffset = offset;
+		}
+		else if ((TSPROCESSORTEST_VIDEO_PID == pid) && (packet[1] & 0x40))
+		{
+			if (inKeyFrame)
+			{
+				expected.push_back(std::pair<size_t, size_t>(patOffset, offset - patOffset));
+			}
+			inKeyFrame = (0 == (videoPesCount % TSPROCESSORTEST_GOP_FRAMES));
+			videoPesCount++;
+		}
+	}
+	TSPROCESSORTEST_CHECK(expected.size() == (size_t)gopCount);
+	if (!ok)
+	{
+		return ok;
+	}
+
+	std::vector<std::pair<size_t, size_t> > ranges;
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRanges(&data[0], data.size(), ranges));
+	TSPROCESSORTEST_CHECK(ranges == expected);
+	for (size_t i = 0; ok && (i < ranges.size()); i++)
+	{
+		std::vector<char> segment(data.begin() + ranges[i].first, data.begin() + ranges[i].first + ranges[i].second);
+		size_t len = segment.size();
+		bool ptsError = false;
+		sink.Reset();
+		sink.capture = true;
+		TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_DEMUX_VIDEO, eMEDIATYPE_VIDEO);
+		tsProcessor->setThrottleEnable(false);
+		tsProcessor->setRate(1.0, PlayMode_normal);
+		tsProcessor->sendSegment(&segment[0], len, 0, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, true, ptsError);
+		tsProcessor->flush();
+		delete tsProcessor;
+		sink.capture = false;
+		const std::vector<RecordingSink::Frame> &video = sink.frames[eMEDIATYPE_VIDEO];
+		TSPROCESSORTEST_CHECK(1 == video.size());
+		TSPROCESSORTEST_CHECK((1 == video.size()) && (video[0].data == videoES[i * TSPROCESSORTEST_GOP_FRAMES]));
+	}
+	size_t rangeStart = 0, rangeLength = 0;
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRange(&data[0], data.size(), rangeStart, rangeLength));
+	TSPROCESSORTEST_CHECK((expected[0].first == rangeStart) && (expected[0].second == rangeLength));
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRanges(&data[0], data.size(), ranges, 2) && (2 == ranges.size()));
+	// Segment cut inside the first GOP starts with the second key frame
+	size_t cut = expected[0].first + expected[0].second;
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRange(&data[cut], data.size() - cut, rangeStart, rangeLength));
+	TSPROCESSORTEST_CHECK((cut + rangeStart == expected[1].first) && (expected[1].second == rangeLength));
+	return ok;
+}
+
+/**
+ * @brief Read 33 bit PTS/DTS of a PES header
+ */
+static long long ReadTimeStamp(const unsigned char *p)
+{
+	return ((long long)(p[0] & 0x0E) << 29) | ((long long)p[1] << 22) | ((long long)(p[2] & 0xFE) << 14) | ((long long)p[3] << 7) | (p[4] >> 1);
+}
+
+/**
+ * @brief Read PCR base and PES PTS/DTS of a TS packet
+ * @param[in] packet TS packet
+ * @param[out] pcr PCR base, -1 if none
+ * @param[out] pts PTS, -1 if none
+ * @param[out] dts DTS, -1 if none
+ */
+static void ReadPacketTimeStamps(const unsigned char *packet, long long &pcr, long long &pts, long long &dts)
+{
+	pcr = pts = dts = -1;
+	int payloadOffset = 4;
+	if (packet[3] & 0x20)
+	{
+		if ((packet[4] >= 7) && (packet[5] & 0x10))
+		{
+			pcr = ((long long)packet[6] << 25) | ((long long)packet[7] << 17) | ((long long)packet[8] << 9) | ((long long)packet[9] << 1) | (packet[10] >> 7);
+		}
+		payloadOffset += 1 + packet[4];
+	}
+	const unsigned char *pes = packet + payloadOffset;
+	if ((packet[1] & 0x40) && (packet[3] & 0x10) && (payloadOffset + 19 <= TSPROCESSORTEST_PACKET_SIZE)
+		&& (0 == pes[0]) && (0 == pes[1]) && (1 == pes[2]))
+	{
+		if (pes[7] & 0x80)
+		{
+			pts = ReadTimeStamp(pes + 9);
+		}
+		if (pes[7] & 0x40)
+		{
+			dts = ReadTimeStamp(pes + 14);
+		}
+	}
+}
+
+/**
+ * @brief Shift a segment with restampSegment across the 33 bit wrap. Every PCR, PTS and DTS
+ * shall move by the offset and TS headers, continuity counters included, shall not change.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestRestampSegment(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const int gopCount = 4;
+	const int frameCount = gopCount * TSPROCESSORTEST_GOP_FRAMES;
+	const long long mask = 0x1FFFFFFFFLL;
+	// Time stamps from 6th frame of each GOP on wrap
+	const long long offset = (mask + 1) - TSPROCESSORTEST_FIRST_PTS - 5 * TSPROCESSORTEST_FRAME_TICKS;
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	for (int i = 0; i < gopCount; i++)
+	{
+		// PCR only packet between payload packets
+		BuildH264Stream(ts, TSPROCESSORTEST_GOP_FRAMES, true, videoES);
+		ts.AddPcrPacket(TSPROCESSORTEST_VIDEO_PID, TSPROCESSORTEST_FIRST_PTS + i * 90000);
+	}
+	const std::vector<unsigned char> original(ts.data);
+
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_NONE, eMEDIATYPE_VIDEO);
+	std::vector<unsigned char> segment(original);
+	TSPROCESSORTEST_CHECK(tsProcessor->restampSegment(&segment[0], segment.size(), offset));
+	int pcrCount = 0, ptsCount = 0, dtsCount = 0, wrapped = 0;
+	for (size_t i = 0; ok && (i < segment.size()); i += TSPROCESSORTEST_PACKET_SIZE)
+	{
+		long long pcr, pts, dts, originalPCR, originalPTS, originalDTS;
+		ReadPacketTimeStamps(&original[i], originalPCR, originalPTS, originalDTS);
+		ReadPacketTimeStamps(&segment[i], pcr, pts, dts);
+		TSPROCESSORTEST_CHECK(0 == memcmp(&segment[i], &original[i], 4));
+		TSPROCESSORTEST_CHECK(((-1 == originalPCR) && (-1 == pcr)) || (pcr == ((originalPCR + offset) & mask)));
+		TSPROCESSORTEST_CHECK(((-1 == originalPTS) && (-1 == pts)) || (pts == ((originalPTS + offset) & mask)));
+		TSPROCESSORTEST_CHECK(((-1 == originalDTS) && (-1 == dts)) || (dts == ((originalDTS + offset) & mask)));
+		pcrCount += (-1 != pcr);
+		ptsCount += (-1 != pts);
+		dtsCount += (-1 != dts);
+		wrapped += ((-1 != pts) && (pts < originalPTS));
+	}
+	TSPROCESSORTEST_CHECK(2 * gopCount == pcrCount);
+	TSPROCESSORTEST_CHECK(2 * frameCount == ptsCount);
+	TSPROCESSORTEST_CHECK(frameCount == dtsCount);
+	TSPROCESSORTEST_CHECK(wrapped > 0);
+
+	// Shifting back restores every byte, so nothing but time stamps was touched
+	TSPROCESSORTEST_CHECK(tsProcessor->restampSegment(&segment[0], segment.size(), -offset));
+	TSPROCESSORTEST_CHECK(segment == original);
+
+	// Segments which are not packet aligned or lost sync are left untouched
+	TSPROCESSORTEST_CHECK(!tsProcessor->restampSegment(&segment[0], segment.size() - 1, offset));
+	TSPROCESSORTEST_CHECK(segment == original);
+	const size_t lostAt[] = { 5, segment.size() / TSPROCESSORTEST_PACKET_SIZE - 1 };
+	for (size_t i = 0; i < sizeof(lostAt) / sizeof(lostAt[0]); i++)
+	{
+		segment = original;
+		segment[lostAt[i] * TSPROCESSORTEST_PACKET_SIZE] = 0x00;
+		std::vector<unsigned char> lost(segment);
+		TSPROCESSORTEST_CHECK(!tsProcessor->restampSegment(&segment[0], segment.size(), offset));
+		TSPROCESSORTEST_CHECK(segment == lost);
+	}
+	delete tsProcessor;
+	return ok;
+}
+
+/**
+ * @brief Check PAT/PMT packets TSProcessor emits: every section shall have a valid CRC and
+ * continuity counters of PAT and PMT PIDs shall increment by one from packet to packet
+ * @param[in] data TS output of TSProcessor
+ * @param[out] streamPids elementary PIDs of last PMT
+ * @param[out] patCount number of PAT packets
+ * @retval true if all checks passed
+ */
+static bool CheckPatPmt(const std::vector<unsigned char> &data, std::vector<int> &streamPids, int &patCount)
+{
+	bool ok = true;
+	int pmtPid = -1;
+	int lastCounter[2] = { -1, -1 };
+	patCount = 0;
+	streamPids.clear();
+	for (size_t i = 0; ok && (i + TSPROCESSORTEST_PACKET_SIZE <= data.size()); i += TSPROCESSORTEST_PACKET_SIZE)
+	{
+		const unsigned char *packet = &data[i];
+		int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+		if ((0 != pid) && (pmtPid != pid))
+		{
+			continue;
+		}
+		int table = (0 == pid) ? 0 : 1;
+		int counter = packet[3] & 0x0F;
+		TSPROCESSORTEST_CHECK((-1 == lastCounter[table]) || (counter == ((lastCounter[table] + 1) & 0x0F)));
+		lastCounter[table] = counter;
+		// Generated tables start in the packet, without adaptation field
+		TSPROCESSORTEST_CHECK((packet[1] & 0x40) && (0x10 == (packet[3] & 0x30)));
+		const unsigned char *section = packet + 5 + packet[4];
+		int sectionLength = ((section[1] & 0x0F) << 8) | section[2];
+		TSPROCESSORTEST_CHECK(section + 3 + sectionLength <= packet + TSPROCESSORTEST_PACKET_SIZE);
+		if (!ok)
+		{
+			break;
+		}
+		TSPROCESSORTEST_CHECK(0 == Crc32(section, 3 + sectionLength));
+		if (0 == pid)
+		{
+			TSPROCESSORTEST_CHECK(0x00 == section[0]);
+			pmtPid = ((section[10] & 0x1F) << 8) | section[11];
+			patCount++;
+		}
+		else
+		{
+			TSPROCESSORTEST_CHECK(0x02 == section[0]);
+			streamPids.clear();
+			const unsigned char *sectionEnd = section + 3 + sectionLength - 4;
+			const unsigned char *stream = section + 12 + (((section[10] & 0x0F) << 8) | section[11]);
+			while (stream + 5 <= sectionEnd)
+			{
+				streamPids.push_back(((stream[1] & 0x1F) << 8) | stream[2]);
+				stream += 5 + (((stream[3] & 0x0F) << 8) | stream[4]);
+			}
+		}
+	}
+	return ok;
+}
+
+/**
+ * @brief Concatenate captured buffers of a track
+ */
+static void GetCapturedData(RecordingSink &sink, MediaType type, std::vector<unsigned char> &data)
+{
+	data.clear();
+	const std::vector<RecordingSink::Frame> &frames = sink.frames[type];
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		data.insert(data.end(), frames[i].data.begin(), frames[i].data.end());
+	}
+}
+
+/**
+ * @brief PAT/PMT inserted in trick play, from cached templates, over several segments.
+ * Trick play PMT has no audio.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestPatPmtTrick(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const int segmentCount = 3;
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	BuildH264Stream(ts, segmentCount * TSPROCESSORTEST_GOP_FRAMES, true, videoES);
+	std::vector<std::pair<size_t, size_t> > ranges;
+	TSProcessor::getIframeRanges(&ts.data[0], ts.data.size(), ranges);
+	TSPROCESSORTEST_CHECK(ranges.size() == (size_t)segmentCount);
+	if (!ok)
+	{
+		return ok;
+	}
+
+	sink.Reset();
+	sink.capture = true;
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_NONE, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(16.0, PlayMode_retimestamp_Ionly);
+	for (int i = 0; i < segmentCount; i++)
+	{
+		// Each segment is a GOP, starting with PAT/PMT
+		size_t end = (i + 1 < segmentCount) ? ranges[i + 1].first : ts.data.size();
+		std::vector<char> segment(ts.data.begin() + ranges[i].first, ts.data.begin() + end);
+		size_t len = segment.size();
+		bool ptsError = false;
+		tsProcessor->sendSegment(&segment[0], len, i, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, (0 == i), ptsError);
+	}
+	delete tsProcessor;
+	sink.capture = false;
+
+	std::vector<unsigned char> out;
+	GetCapturedData(sink, eMEDIATYPE_VIDEO, out);
+	std::vector<int> streamPids;
+	int patCount = 0;
+	TSPROCESSORTEST_CHECK(CheckPatPmt(out, streamPids, patCount));
+	TSPROCESSORTEST_CHECK(segmentCount == patCount);
+	TSPROCESSORTEST_CHECK((1 == streamPids.size()) && (TSPROCESSORTEST_VIDEO_PID == streamPids[0]));
+	return ok;
+}
+
+/**
+ * @brief PAT/PMT inserted when audio of a separate TS is merged into video, from cached
+ * templates, over several segments. PMT lists video and the audio of the peer.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestPatPmtAudioMerge(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const int segmentCount = 3;
+	std::vector<std::vector<unsigned char> > videoES;
+	TSBuilder video[segmentCount];
+	TSBuilder audio[segmentCount];
+	for (int i = 0; i < segmentCount; i++)
+	{
+		BuildH264Stream(video[i], TSPROCESSORTEST_GOP_FRAMES, false, videoES);
+		audio[i].AddPatPmt(0, true);
+		for (int j = 0; j < TSPROCESSORTEST_GOP_FRAMES; j++)
+		{
+			long long pts = TSPROCESSORTEST_FIRST_PTS + (long long)j * TSPROCESSORTEST_FRAME_TICKS;
+			std::vector<unsigned char> frame;
+			AppendADTSFrame(frame, 100);
+			audio[i].AddPes(TSPROCESSORTEST_AUDIO_PID, 0xC0, pts, -1, frame, (0 == j) ? (pts - TSPROCESSORTEST_PCR_OFFSET) : -1);
+		}
+	}
+
+	sink.Reset();
+	sink.capture = true;
+	TSProcessor *audioProcessor = new TSProcessor(aamp, eStreamOp_QUEUE_AUDIO, eMEDIATYPE_AUDIO);
+	TSProcessor *videoProcessor = new TSProcessor(aamp, eStreamOp_SEND_VIDEO_AND_QUEUED_AUDIO, eMEDIATYPE_VIDEO, audioProcessor);
+	audioProcessor->setThrottleEnable(false);
+	videoProcessor->setThrottleEnable(false);
+	audioProcessor->setRate(1.0, PlayMode_normal);
+	videoProcessor->setRate(1.0, PlayMode_normal);
+	for (int i = 0; i < segmentCount; i++)
+	{
+		bool ptsError = false;
+		std::vector<char> segment(audio[i].data.begin(), audio[i].data.end());
+		size_t len = segment.size();
+		audioProcessor->sendSegment(&segment[0], len, 0, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, (0 == i), ptsError);
+		segment.assign(video[i].data.begin(), video[i].data.end());
+		len = segment.size();
+		videoProcessor->sendSegment(&segment[0], len, 0, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, (0 == i), ptsError);
+	}
+	delete videoProcessor;
+	delete audioProcessor;
+	sink.capture = false;
+
+	std::vector<unsigned char> out;
+	GetCapturedData(sink, eMEDIATYPE_VIDEO, out);
+	std::vector<int> streamPids;
+	int patCount = 0;
+	TSPROCESSORTEST_CHECK(CheckPatPmt(out, streamPids, patCount));
+	TSPROCESSORTEST_CHECK(segmentCount == patCount);
+	TSPROCESSORTEST_CHECK((2 == streamPids.size()) && (TSPROCESSORTEST_VIDEO_PID == streamPids[0]) && (TSPROCESSORTEST_AUDIO_PID == streamPids[1]));
+	// Queued audio is sent within the video segments, after discontinuity packet of the first one
+	TSPROCESSORTEST_CHECK(segmentCount * audio[0].data.size() + TSPROCESSORTEST_PACKET_SIZE == sink.bytes[eMEDIATYPE_AUDIO]);
+	TSPROCESSORTEST_CHECK(segmentCount + 1 == sink.buffers[eMEDIATYPE_AUDIO]);
+	return ok;
+}
+
+/**
+ * @brief Read big endian 32 bit value
+ */
+static uint32_t ReadU32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief List types of top level boxes
+ * @param[in] data buffer containing ISO BMFF boxes
+ * @retval space separated box types, "invalid" if box sizes do not add up to buffer size
+ */
+static std::string GetBoxTypes(const std::vector<unsigned char> &data)
+{
+	std::string types;
+	size_t offset = 0;
+	while (offset + 8 <= data.size())
+	{
+		uint32_t size = ReadU32(&data[offset]);
+		if ((size < 8) || (offset + size > data.size()))
+		{
+			break;
+		}
+		if (!types.empty())
+		{
+			types += " ";
+		}
+		types.append((const char *)&data[offset + 4], 4);
+		offset += size;
+	}
+	return (offset == data.size()) ? types : "invalid";
+}
+
+/**
+ * @brief Find a box by path of container box types, e.g. "moof/traf/tfdt"
+ * @param[in] data buffer containing ISO BMFF boxes
+ * @param[in] len length of buffer
+ * @param[in] path box types separated by '/'
+ * @retval start of box, NULL if not found
+ */
+static const unsigned char *FindBox(const unsigned char *data, size_t len, const char *path)
+{
+	size_t offset = 0;
+	while (offset + 8 <= len)
+	{
+		uint32_t size = ReadU32(data + offset);
+		if ((size < 8) || (offset + size > len))
+		{
+			break;
+		}
+		if (0 == memcmp(data + offset + 4, path, 4))
+		{
+			if ('\0' == path[4])
+			{
+				return data + offset;
+			}
+			return FindBox(data + offset + 8, size - 8, path + 5);
+		}
+		offset += size;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Remux a demuxed track of synthetic H.264/AAC and check fMP4 layout: one init
+ * segment, then moof+mdat per fragment with contiguous sequence numbers, decode time of
+ * first sample and sample table matching the mdat
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @param[in] track track to remux
+ * @retval true if all checks passed
+ */
+static bool RemuxAndCheck(PrivateInstanceAAMP *aamp, RecordingSink &sink, MediaType track)
+{
+	bool ok = true;
+	const int frameCount = 3 * TSPROCESSORTEST_GOP_FRAMES;
+	const double position = 10.0;
+	const long long firstDecodeTime = llround(position * 90000) + TSPROCESSORTEST_PCR_OFFSET;
+	bool video = (eMEDIATYPE_VIDEO == track);
+	TSBuilder ts;
+	std::vector<std::vector<unsigned char> > videoES;
+	BuildH264Stream(ts, frameCount, true, videoES);
+
+	sink.Reset();
+	sink.capture = true;
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_DEMUX_ALL, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(1.0, PlayMode_normal);
+	TSPROCESSORTEST_CHECK(tsProcessor->enableRemux(track, video ? FORMAT_VIDEO_ES_H264 : FORMAT_AUDIO_ES_AAC));
+	SendInTwoSegments(tsProcessor, ts.data, position);
+	delete tsProcessor;
+	sink.capture = false;
+
+	const std::vector<RecordingSink::Frame> &out = sink.frames[track];
+	TSPROCESSORTEST_CHECK(out.size() >= 2);
+	if (!ok)
+	{
+		return ok;
+	}
+	const unsigned char *init = &out[0].data[0];
+	size_t initLen = out[0].data.size();
+	TSPROCESSORTEST_CHECK(GetBoxTypes(out[0].data) == "ftyp moov");
+	const unsigned char *mdhd = FindBox(init, initLen, "moov/trak/mdia/mdhd");
+	const unsigned char *hdlr = FindBox(init, initLen, "moov/trak/mdia/hdlr");
+	const unsigned char *tkhd = FindBox(init, initLen, "moov/trak/tkhd");
+	TSPROCESSORTEST_CHECK(mdhd && hdlr && tkhd);
+	if (!ok)
+	{
+		return ok;
+	}
+	TSPROCESSORTEST_CHECK(90000 == ReadU32(mdhd + 20));
+	TSPROCESSORTEST_CHECK(0 == memcmp(hdlr + 16, video ? "vide" : "soun", 4));
+	if (video)
+	{
+		// size from SPS, 16.16 fixed point
+		TSPROCESSORTEST_CHECK((320 << 16) == ReadU32(tkhd + 84));
+		TSPROCESSORTEST_CHECK((240 << 16) == ReadU32(tkhd + 88));
+	}
+
+	size_t sampleIndex = 0;
+	for (size_t i = 1; ok && (i < out.size()); i++)
+	{
+		const unsigned char *fragment = &out[i].data[0];
+		size_t fragmentLen = out[i].data.size();
+		TSPROCESSORTEST_CHECK(GetBoxTypes(out[i].data) == "moof mdat");
+		const unsigned char *mfhd = FindBox(fragment, fragmentLen, "moof/mfhd");
+		const unsigned char *tfdt = FindBox(fragment, fragmentLen, "moof/traf/tfdt");
+		const unsigned char *trun = FindBox(fragment, fragmentLen, "moof/traf/trun");
+		TSPROCESSORTEST_CHECK(mfhd && tfdt && trun);
+		if (!ok)
+		{
+			break;
+		}
+		uint32_t moofLen = ReadU32(fragment);
+		const unsigned char *mdatData = fragment + moofLen + 8;
+		size_t mdatLen = ReadU32(fragment + moofLen) - 8;
+		long long decodeTime = ((long long)ReadU32(tfdt + 12) << 32) | ReadU32(tfdt + 16);
+		TSPROCESSORTEST_CHECK(i == ReadU32(mfhd + 12));
+		TSPROCESSORTEST_CHECK(1 == tfdt[8]);
+		TSPROCESSORTEST_CHECK(decodeTime == firstDecodeTime + (long long)sampleIndex * TSPROCESSORTEST_FRAME_TICKS);
+		TSPROCESSORTEST_CHECK(fabs(out[i].dts - (double)decodeTime / 90000) < 1e-6);
+		TSPROCESSORTEST_CHECK(moofLen + 8 == ReadU32(trun + 16));
+		uint32_t sampleCount = ReadU32(trun + 12);
+		const unsigned char *sample = trun + 20;
+		size_t mdatOffset = 0;
+		for (uint32_t j = 0; ok && (j < sampleCount); j++, sample += 16)
+		{
+			uint32_t duration = ReadU32(sample);
+			uint32_t size = ReadU32(sample + 4);
+			uint32_t flags = ReadU32(sample + 8);
+			TSPROCESSORTEST_CHECK(0 == ReadU32(sample + 12));
+			TSPROCESSORTEST_CHECK(mdatOffset + size <= mdatLen);
+			if (!ok)
+			{
+				break;
+			}
+			if (video)
+			{
+				bool sync = (0 == ((sampleIndex + j) % TSPROCESSORTEST_GOP_FRAMES));
+				TSPROCESSORTEST_CHECK(TSPROCESSORTEST_FRAME_TICKS == duration);
+				TSPROCESSORTEST_CHECK((sync ? 0x02000000 : 0x01010000) == flags);
+				// Only the slice is left in the sample, length prefixed. AUD is dropped, SPS/PPS are in avcC.
+				TSPROCESSORTEST_CHECK((size > 5) && (size - 4 == ReadU32(mdatData + mdatOffset)));
+				TSPROCESSORTEST_CHECK((sync ? 5 : 1) == (mdatData[mdatOffset + 4] & 0x1F));
+			}
+			else
+			{
+				// 1024 samples at 48kHz
+				TSPROCESSORTEST_CHECK(1920 == duration);
+				TSPROCESSORTEST_CHECK(0x02000000 == flags);
+				TSPROCESSORTEST_CHECK(100 == size);
+			}
+			mdatOffset += size;
+		}
+		TSPROCESSORTEST_CHECK(mdatOffset == mdatLen);
+		sampleIndex += sampleCount;
+		if (!ok)
+		{
+			printf("  fragment %d\n", (int)i);
+		}
+	}
+	TSPROCESSORTEST_CHECK(sampleIndex == (size_t)frameCount);
+	return ok;
+}
+
+/**
+ * @brief Remux video to fMP4
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestRemuxVideo(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	return RemuxAndCheck(aamp, sink, eMEDIATYPE_VIDEO);
+}
+
+/**
+ * @brief Remux audio to fMP4
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestRemuxAudio(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	return RemuxAndCheck(aamp, sink, eMEDIATYPE_AUDIO);
+}
+
+/**
+ * @class BitReader
+ * @brief Reads RBSP of slice headers found in TSProcessor output
+ */
+class BitReader
+{
+public:
+	BitReader(const std::vector<unsigned char> &rbsp) : rbsp(rbsp), bitPos(0)
+	{
+	}
+
+	unsigned int GetBits(int count)
+	{
+		unsigned int value = 0;
+		while (count-- > 0)
+		{
+			size_t byte = bitPos >> 3;
+			unsigned int bit = (byte < rbsp.size()) ? ((rbsp[byte] >> (7 - (bitPos & 7))) & 1) : 0;
+			value = (value << 1) | bit;
+			bitPos++;
+		}
+		return value;
+	}
+
+	unsigned int GetUExpGolomb()
+	{
+		int leadingZeros = 0;
+		while ((leadingZeros < 32) && (0 == GetBits(1)))
+		{
+			leadingZeros++;
+		}
+		return ((1u << leadingZeros) - 1) + GetBits(leadingZeros);
+	}
+
+private:
+	const std::vector<unsigned char> &rbsp;
+	size_t bitPos;
+};
+
+/**
+ * @struct HEVCPicture
+ * @brief Slice header fields of a picture written by AppendHEVCAccessUnit
+ */
+struct HEVCPicture
+{
+	long long pts;
+	int nalType;
+	int sliceType;
+	int picOrderCntLsb; /**< -1 for IDR */
+	bool intact; /**< fields around slice_pic_order_cnt_lsb and slice data are as written */
+};
+
+/**
+ * @brief Parse slice header of each picture in a video PES payload
+ * @param[in] es PES payload
+ * @param[in] pts PTS of PES
+ * @param[out] pictures parsed pictures are appended
+ */
+static void ParseHEVCPictures(const std::vector<unsigned char> &es, long long pts, std::vector<HEVCPicture> &pictures)
+{
+	for (size_t i = 0; i + 5 < es.size(); i++)
+	{
+		if ((es[i] != 0x00) || (es[i + 1] != 0x00) || (es[i + 2] != 0x01))
+		{
+			continue;
+		}
+		int nalType = (es[i + 3] >> 1) & 0x3F;
+		if (nalType > 21)
+		{
+			continue;
+		}
+		std::vector<unsigned char> rbsp;
+		int zeros = 0;
+		for (size_t j = i + 5; j < es.size(); j++)
+		{
+			if ((zeros >= 2) && (es[j] == 0x01))
+			{
+				rbsp.resize(rbsp.size() - zeros);
+				break;
+			}
+			if ((zeros >= 2) && (es[j] == 0x03))
+			{
+				zeros = 0;
+				continue;
+			}
+			zeros = (es[j] == 0x00) ? (zeros + 1) : 0;
+			rbsp.push_back(es[j]);
+		}
+		bool irap = (nalType >= 16);
+		bool idr = (19 == nalType) || (20 == nalType);
+		BitReader reader(rbsp);
+		HEVCPicture picture;
+		picture.pts = pts;
+		picture.nalType = nalType;
+		picture.intact = (1 == reader.GetBits(1));
+		if (irap)
+		{
+			reader.GetBits(1);
+		}
+		picture.intact &= (0 == reader.GetUExpGolomb()) && (0 == reader.GetBits(2));
+		picture.sliceType = reader.GetUExpGolomb();
+		picture.intact &= (1 == reader.GetBits(1));
+		picture.picOrderCntLsb = idr ? -1 : (int)reader.GetBits(8);
+		for (int j = 0; j < TSPROCESSORTEST_FRAME_FILLER; j++)
+		{
+			picture.intact &= (0x5A == reader.GetBits(8));
+		}
+		pictures.push_back(picture);
+	}
+}
+
+/**
+ * @brief Collect video PES of a TS and parse its pictures
+ * @param[in] data TS data
+ * @param[out] pictures parsed pictures, in stream order
+ */
+static void ParseHEVCStream(const std::vector<unsigned char> &data, std::vector<HEVCPicture> &pictures)
+{
+	std::vector<unsigned char> es;
+	long long pts = -1;
+	pictures.clear();
+	for (size_t offset = 0; offset + TSPROCESSORTEST_PACKET_SIZE <= data.size(); offset += TSPROCESSORTEST_PACKET_SIZE)
+	{
+		const unsigned char *packet = &data[offset];
+		int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+		if ((packet[0] != 0x47) || (pid != TSPROCESSORTEST_VIDEO_PID) || !(packet[3] & 0x10))
+		{
+			continue;
+		}
+		int payloadOffset = 4 + ((packet[3] & 0x20) ? (1 + packet[4]) : 0);
+		if (payloadOffset >= TSPROCESSORTEST_PACKET_SIZE)
+		{
+			continue;
+		}
+		const unsigned char *payload = packet + payloadOffset;
+		if (packet[1] & 0x40)
+		{
+			ParseHEVCPictures(es, pts, pictures);
+			es.clear();
+			pts = ((long long)(payload[9] & 0x0E) << 29) | (payload[10] << 22) | ((payload[11] & 0xFE) << 14)
+				| (payload[12] << 7) | (payload[13] >> 1);
+			payloadOffset += 9 + payload[8];
+			payload = packet + payloadOffset;
+		}
+		es.insert(es.end(), payload, packet + TSPROCESSORTEST_PACKET_SIZE);
+	}
+	ParseHEVCPictures(es, pts, pictures);
+}
+
+/**
+ * @brief Check that PTS follows previous one by less than a second, allowing for 33 bit wrap
+ * @param[in] prev previous PTS
+ * @param[in] pts PTS
+ * @retval true if pts is later
+ */
+static bool IsPTSIncreasing(long long prev, long long pts)
+{
+	long long delta = (pts - prev) & 0x1FFFFFFFFLL;
+	return (delta > 0) && (delta < 90000);
+}
+
+/**
+ * @brief Load HEVC fixture written by BuildHEVCStream
+ * @param[out] data fixture
+ * @retval true on success
+ */
+static bool LoadHEVCFixture(std::vector<unsigned char> &data)
+{
+	std::string path = std::string(gDataDir) + "/" + TSPROCESSORTEST_HEVC_FIXTURE;
+	bool ret = ReadFile(path.c_str(), data);
+	if (!ret)
+	{
+		printf("  unable to read %s, set data directory with -t\n", path.c_str());
+	}
+	return ret;
+}
+
+/**
+ * @brief Index key frames of HEVC fixture. Each GOP is PAT, PMT, IRAP PES of 3 packets and
+ * 3 TRAIL_R PES of 2 packets, so each range is PAT to end of IRAP, 5 packets, every 11 packets.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestHEVCKeyFrames(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	const size_t gopSize = 11 * TSPROCESSORTEST_PACKET_SIZE;
+	const size_t rangeSize = 5 * TSPROCESSORTEST_PACKET_SIZE;
+	std::vector<unsigned char> data;
+	TSPROCESSORTEST_CHECK(LoadHEVCFixture(data));
+	if (!ok)
+	{
+		return ok;
+	}
+	TSPROCESSORTEST_CHECK(data.size() == TSPROCESSORTEST_HEVC_GOPS * gopSize);
+
+	std::vector<std::pair<size_t, size_t> > ranges;
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRanges(&data[0], data.size(), ranges));
+	TSPROCESSORTEST_CHECK(ranges.size() == TSPROCESSORTEST_HEVC_GOPS);
+	for (size_t i = 0; ok && (i < ranges.size()); i++)
+	{
+		TSPROCESSORTEST_CHECK(ranges[i].first == i * gopSize);
+		TSPROCESSORTEST_CHECK(ranges[i].second == rangeSize);
+		std::vector<unsigned char> range(data.begin() + ranges[i].first, data.begin() + ranges[i].first + ranges[i].second);
+		std::vector<HEVCPicture> pictures;
+		ParseHEVCStream(range, pictures);
+		TSPROCESSORTEST_CHECK((1 == pictures.size()) && pictures[0].intact);
+		TSPROCESSORTEST_CHECK((1 == pictures.size()) && (pictures[0].nalType == (i ? 21 : 19)));
+	}
+	size_t rangeStart = 0, rangeLength = 0;
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRange(&data[0], data.size(), rangeStart, rangeLength));
+	TSPROCESSORTEST_CHECK((0 == rangeStart) && (rangeSize == rangeLength));
+	TSPROCESSORTEST_CHECK(TSProcessor::getIframeRanges(&data[0], data.size(), ranges, 2) && (2 == ranges.size()));
+	return ok;
+}
+
+/**
+ * @brief Re-timestamp HEVC fixture in a trick mode and parse the pictures
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @param[in] rate play rate
+ * @param[in] mode PlayMode_retimestamp_Ionly or PlayMode_reverse_GOP
+ * @param[out] pictures pictures of output, in injection order
+ * @retval true if fixture is loaded
+ */
+static bool RestampHEVC(PrivateInstanceAAMP *aamp, RecordingSink &sink, double rate, PlayMode mode, std::vector<HEVCPicture> &pictures)
+{
+	std::vector<unsigned char> data;
+	if (!LoadHEVCFixture(data))
+	{
+		return false;
+	}
+	TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_NONE, eMEDIATYPE_VIDEO);
+	tsProcessor->setThrottleEnable(false);
+	tsProcessor->setRate(rate, mode);
+	// Trick mode PID filter is set up from PAT/PMT of previous segment, so start with PAT/PMT alone
+	std::vector<char> segment(data.begin(), data.begin() + 2 * TSPROCESSORTEST_PACKET_SIZE);
+	size_t len = segment.size();
+	bool ptsError = false;
+	tsProcessor->sendSegment(&segment[0], len, 0, 0, true, ptsError);
+	sink.Reset();
+	sink.capture = true;
+	segment.assign(data.begin(), data.end());
+	len = segment.size();
+	tsProcessor->sendSegment(&segment[0], len, 0, TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION, false, ptsError);
+	delete tsProcessor;
+	sink.capture = false;
+
+	std::vector<unsigned char> out;
+	const std::vector<RecordingSink::Frame> &frames = sink.frames[eMEDIATYPE_VIDEO];
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		out.insert(out.end(), frames[i].data.begin(), frames[i].data.end());
+	}
+	ParseHEVCStream(out, pictures);
+	return true;
+}
+
+/**
+ * @brief I-frame only re-timestamping of HEVC. slice_pic_order_cnt_lsb of non IDR pictures
+ * shall be rewritten to follow injection order, leaving rest of slice header intact.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestHEVCIonly(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	std::vector<HEVCPicture> pictures;
+	TSPROCESSORTEST_CHECK(RestampHEVC(aamp, sink, 16.0, PlayMode_retimestamp_Ionly, pictures));
+	TSPROCESSORTEST_CHECK(pictures.size() == TSPROCESSORTEST_HEVC_GOPS * TSPROCESSORTEST_HEVC_GOP_FRAMES);
+	int picOrderCnt = 0;
+	for (size_t i = 0; ok && (i < pictures.size()); i++)
+	{
+		int frameInGop = i % TSPROCESSORTEST_HEVC_GOP_FRAMES;
+		TSPROCESSORTEST_CHECK(pictures[i].nalType == (frameInGop ? 1 : (i ? 21 : 19)));
+		TSPROCESSORTEST_CHECK(pictures[i].sliceType == (frameInGop ? 1 : 2));
+		TSPROCESSORTEST_CHECK(pictures[i].intact);
+		if (19 != pictures[i].nalType)
+		{
+			TSPROCESSORTEST_CHECK(pictures[i].picOrderCntLsb == picOrderCnt++);
+		}
+		TSPROCESSORTEST_CHECK((0 == i) || IsPTSIncreasing(pictures[i - 1].pts, pictures[i].pts));
+		if (!ok)
+		{
+			printf("  picture %d nal type %d poc lsb %d pts %lld\n", (int)i, pictures[i].nalType, pictures[i].picOrderCntLsb, pictures[i].pts);
+		}
+	}
+	return ok;
+}
+
+/**
+ * @brief Reverse GOP playback of HEVC. Key frames shall be injected last to first with
+ * increasing PTS and sequential slice_pic_order_cnt_lsb.
+ * @param[in] aamp private aamp instance, sink already attached
+ * @param[in] sink sink attached to aamp
+ * @retval true if all checks passed
+ */
+static bool TestHEVCReverseGOP(PrivateInstanceAAMP *aamp, RecordingSink &sink)
+{
+	bool ok = true;
+	std::vector<HEVCPicture> pictures;
+	TSPROCESSORTEST_CHECK(RestampHEVC(aamp, sink, -16.0, PlayMode_reverse_GOP, pictures));
+	TSPROCESSORTEST_CHECK(pictures.size() == TSPROCESSORTEST_HEVC_GOPS);
+	for (size_t i = 0; ok && (i < pictures.size()); i++)
+	{
+		bool last = (i + 1 == pictures.size());
+		TSPROCESSORTEST_CHECK(pictures[i].nalType == (last ? 19 : 21));
+		TSPROCESSORTEST_CHECK(pictures[i].sliceType == 2);
+		TSPROCESSORTEST_CHECK(pictures[i].intact);
+		TSPROCESSORTEST_CHECK(pictures[i].picOrderCntLsb == (last ? -1 : (int)i));
+		TSPROCESSORTEST_CHECK((0 == i) || IsPTSIncreasing(pictures[i - 1].pts, pictures[i].pts));
+		if (!ok)
+		{
+			printf("  picture %d nal type %d poc lsb %d pts %lld\n", (int)i, pictures[i].nalType, pictures[i].picOrderCntLsb, pictures[i].pts);
+		}
+	}
+	return ok;
+}
+
+/**
+ * @struct SelfTest
+ * @brief Self test run on synthetic streams before files
+ */
+struct SelfTest
+{
+	const char *name;
+	bool (*run)(PrivateInstanceAAMP *aamp, RecordingSink &sink);
+};
+
+static const SelfTest selfTests[] =
+{
+	{ "demux", TestDemux },
+	{ "demux pipeline", TestDemuxPipeline },
+	{ "demux pipeline abort", TestDemuxPipelineAbort },
+	{ "h264 key frames", TestH264KeyFrames },
+	{ "restamp segment", TestRestampSegment },
+	{ "PAT/PMT trick play", TestPatPmtTrick },
+	{ "PAT/PMT audio merge", TestPatPmtAudioMerge },
+	{ "remux video", TestRemuxVideo },
+	{ "remux audio", TestRemuxAudio },
+	{ "hevc key frames", TestHEVCKeyFrames },
+	{ "hevc Ionly", TestHEVCIonly },
+	{ "hevc reverse GOP", TestHEVCReverseGOP }
+};
+
+/**
+ * @brief Print usage
+ */
+static void Usage()
+{
+	printf("usage: tsprocessortest [-n iterations] [-f fuzzIterations] [-s seed] [-p segmentPackets] [-d segmentDuration] [-t dataDir] [-g fixture.ts] [file.ts...]\n");
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 1;
+	int fuzzIterations = TSPROCESSORTEST_DEFAULT_FUZZ_ITERATIONS;
+	unsigned int seed = (unsigned int)time(NULL);
+	size_t segmentPackets = TSPROCESSORTEST_DEFAULT_SEGMENT_PACKETS;
+	double segmentDuration = TSPROCESSORTEST_DEFAULT_SEGMENT_DURATION;
+	int opt;
+	const char *fixturePath = NULL;
+	while ((opt = getopt(argc, argv, "n:f:s:p:d:t:g:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': iterations = atoi(optarg); break;
+		case 'f': fuzzIterations = atoi(optarg); break;
+		case 's': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+		case 'p': segmentPackets = (size_t)atoi(optarg); break;
+		case 'd': segmentDuration = atof(optarg); break;
+		case 't': gDataDir = optarg; break;
+		case 'g': fixturePath = optarg; break;
+		default: Usage(); return 1;
+		}
+	}
+	if (iterations < 1 || fuzzIterations < 0 || segmentPackets < 1)
+	{
+		Usage();
+		return 1;
+	}
+	size_t segmentSize = segmentPackets * TSPROCESSORTEST_PACKET_SIZE;
+
+	if (fixturePath)
+	{
+		TSBuilder ts;
+		BuildHEVCStream(ts);
+		FILE *f = fopen(fixturePath, "wb");
+		bool written = f && (fwrite(&ts.data[0], 1, ts.data.size(), f) == ts.data.size());
+		if (f)
+		{
+			fclose(f);
+		}
+		printf("%s: %s %zu bytes\n", fixturePath, written ? "wrote" : "unable to write", ts.data.size());
+		return written ? 0 : 1;
+	}
+
+	RecordingSink sink;
+	PlayerInstanceAAMP *player = new PlayerInstanceAAMP(&sink);
+	PrivateInstanceAAMP *aamp = player->aamp;
+
+	int failures = 0;
+	for (size_t t = 0; t < sizeof(selfTests) / sizeof(selfTests[0]); t++)
+	{
+		bool ok = selfTests[t].run(aamp, sink);
+		printf("%s %s\n", ok ? "PASS" : "FAIL", selfTests[t].name);
+		if (!ok)
+		{
+			failures++;
+		}
+	}
+
+	printf("seed 0x%x\n", seed);
+	for (int fileIdx = optind; fileIdx < argc; fileIdx++)
+	{
+		std::vector<unsigned char> data;
+		if (!ReadFile(argv[fileIdx], data))
+		{
+			printf("%s: unable to read\n", argv[fileIdx]);
+			continue;
+		}
+		printf("%s: %zu bytes\n", argv[fileIdx], data.size());
+		for (size_t m = 0; m < sizeof(testModes) / sizeof(testModes[0]); m++)
+		{
+			const TestMode &mode = testModes[m];
+			long long total = 0;
+			long long maxSegmentUs = 0;
+			sink.Reset();
+			for (int i = 0; i < iterations; i++)
+			{
+				long long maxUs;
+				total += Run(aamp, mode, data, segmentSize, segmentDuration, maxUs);
+				if (maxUs > maxSegmentUs)
+				{
+					maxSegmentUs = maxUs;
+				}
+			}
+			double mb = ((double)data.size() * iterations) / (1024 * 1024);
+			printf("  %-14s %8.2f MB/s  %8lld us total  %6lld us max/segment  video %d bufs %zu bytes  audio %d bufs %zu bytes\n",
+					mode.name, total ? (mb * 1000000.0 / total) : 0.0, total, maxSegmentUs,
+					sink.buffers[eMEDIATYPE_VIDEO], sink.bytes[eMEDIATYPE_VIDEO],
+					sink.buffers[eMEDIATYPE_AUDIO], sink.bytes[eMEDIATYPE_AUDIO]);
+			if (0 == sink.buffers[eMEDIATYPE_VIDEO])
+			{
+				printf("  FAIL %s: no video emitted\n", mode.name);
+				failures++;
+			}
+
+			long long fuzzTotal = 0;
+			for (int i = 0; i < fuzzIterations; i++)
+			{
+				std::vector<unsigned char> fuzzed(data);
+				for (int j = 1 + rand_r(&seed) % 4; j > 0; j--)
+				{
+					Mutate(fuzzed, seed);
+				}
+				long long maxUs;
+				fuzzTotal += Run(aamp, mode, fuzzed, segmentSize, segmentDuration, maxUs);
+			}
+			if (fuzzIterations)
+			{
+				printf("  %-14s %d fuzzed inputs survived, %lld us\n", mode.name, fuzzIterations, fuzzTotal);
+			}
+		}
+
+		TSProcessor *tsProcessor = new TSProcessor(aamp, eStreamOp_NONE, eMEDIATYPE_VIDEO);
+		long long restampTotal = 0;
+		for (int i = 0; i < iterations; i++)
+		{
+			std::vector<unsigned char> segment(data);
+			long long start = GetTimeUs();
+			tsProcessor->restampSegment(&segment[0], segment.size(), 90000);
+			restampTotal += GetTimeUs() - start;
+		}
+		delete tsProcessor;
+		double mb = ((double)data.size() * iterations) / (1024 * 1024);
+		printf("  %-14s %8.2f MB/s  %8lld us total\n", "restamp", restampTotal ? (mb * 1000000.0 / restampTotal) : 0.0, restampTotal);
+	}
+
+	delete player;
+	if (failures)
+	{
+		printf("%d failures\n", failures);
+	}
+	return failures ? 1 : 0;
+}
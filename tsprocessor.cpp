@@ -30,10 +30,31 @@
 #include <errno.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
 #include "priv_aamp.h"
 
 #include "tsprocessor.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TS_SCAN_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TS_SCAN_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TS_SCAN_NEON 1
+#endif
+
+/**
+ * @brief Number of PIDs checked by the batched PID classification
+ */
+#define TS_PID_SET_SIZE 2
+
 
 /**
  * @brief NOP function used to controll logging
@@ -112,6 +133,8 @@ void print_nop(const char *format, ...){}
 #define DEFAULT_THROTTLE_MAX_DIFF_SEGMENTS_MS 400
 #define DEFAULT_THROTTLE_DELAY_IGNORED_MS 200
 #define DEFAULT_THROTTLE_DELAY_FOR_DISCONTINUITY_MS 2000
+#define PACING_JITTER_REPORT_INTERVAL 256 /* frames between pacing jitter reports */
+#define PACING_MAX_LEAD_US 4000 /* max early wake up used to compensate wake up latency */
 
 #define PES_STATE_WAITING_FOR_HEADER  0
 #define PES_STATE_GETTING_HEADER  1
@@ -128,6 +151,12 @@ void print_nop(const char *format, ...){}
 #define ADAPTATION_FIELD_PRESENT(mpegbuf) ((mpegbuf[3] & 0x20) == 0x20)
 #define PES_PAYLOAD_LENGTH(pesStart) (pesStart[4]<<8|pesStart[5])
 #define MAX_FIRST_PTS_OFFSET (45000) /*500 ms*/
+#define ES_SEND_QUEUE_MAX_FRAMES (256)
+#define ES_SEND_QUEUE_MAX_BYTES (8*1024*1024)
+#define REMUX_TIMESCALE (90000)
+#define REMUX_DEFAULT_FRAME_DURATION (3003)
+#define IFRAME_INDEX_SCAN_SIZE (4096) /*PES payload scanned for key frame*/
+#define IFRAME_INDEX_MAX_PSI_GAP (16) /*Max packets between PAT and key frame to include PAT/PMT in range*/
 
 //#define DEBUG_DEMUX_TRACK 1
 #ifdef DEBUG_DEMUX_TRACK
@@ -151,6 +180,998 @@ void print_nop(const char *format, ...){}
  */
 
 
+/**
+ * @class ESSendQueue
+ * @brief Bounded queue of demuxed frames. A dedicated thread pushes them to sink,
+ * so that demux of next segment is not blocked by back-pressure of sink.
+ */
+class ESSendQueue
+{
+private:
+	/**
+	 * @struct ESFrame
+	 * @brief Demuxed frame waiting to be sent
+	 */
+	struct ESFrame
+	{
+		GrowableBuffer buffer;
+		double pts;
+		double dts;
+		double duration;
+	};
+
+	class PrivateInstanceAAMP *aamp;
+	MediaType type;
+	std::deque<ESFrame> frames;
+	size_t queuedBytes;
+	bool enabled;
+	bool exitThread;
+	bool sending;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t senderThreadID;
+	bool senderThreadStarted;
+
+	/**
+	 * @brief Free all queued frames
+	 *
+	 * @note Caller shall hold mutex
+	 */
+	void clearUnlocked()
+	{
+		while (!frames.empty())
+		{
+			aamp_Free(&frames.front().buffer.ptr);
+			frames.pop_front();
+		}
+		queuedBytes = 0;
+	}
+
+	/**
+	 * @brief Sender thread entry point
+	 *
+	 * @param[in] arg ESSendQueue instance
+	 */
+	static void *SenderThread(void *arg)
+	{
+		ESSendQueue *queue = (ESSendQueue *)arg;
+		if (aamp_pthread_setname(pthread_self(), (queue->type == eMEDIATYPE_VIDEO) ? "aampVidESSend" : "aampAudESSend"))
+		{
+			logprintf("%s:%d: aamp_pthread_setname failed\n", __FUNCTION__, __LINE__);
+		}
+		queue->run();
+		return NULL;
+	}
+
+	/**
+	 * @brief Sender loop. Pops frames and injects them to sink
+	 */
+	void run()
+	{
+		pthread_mutex_lock(&mutex);
+		while (!exitThread)
+		{
+			if (!enabled || frames.empty())
+			{
+				pthread_cond_wait(&cond, &mutex);
+				continue;
+			}
+			ESFrame frame = frames.front();
+			frames.pop_front();
+			queuedBytes -= frame.buffer.len;
+			sending = true;
+			pthread_cond_broadcast(&cond);
+			pthread_mutex_unlock(&mutex);
+
+			if (aamp->DownloadsAreEnabled())
+			{
+				aamp->SendStream(type, &frame.buffer, frame.pts, frame.dts, frame.duration);
+			}
+			aamp_Free(&frame.buffer.ptr);
+
+			pthread_mutex_lock(&mutex);
+			sending = false;
+			pthread_cond_broadcast(&cond);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+public:
+	/**
+	 * @brief ESSendQueue Constructor
+	 *
+	 * @param[in] aamp pointer to PrivateInstanceAAMP object
+	 * @param[in] type Media type of queued frames
+	 */
+	ESSendQueue(class PrivateInstanceAAMP *aamp, MediaType type) : aamp(aamp), type(type), frames(), queuedBytes(0),
+		enabled(true), exitThread(false), sending(false), senderThreadID(), senderThreadStarted(false)
+	{
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+		if (0 == pthread_create(&senderThreadID, NULL, &SenderThread, this))
+		{
+			senderThreadStarted = true;
+		}
+		else
+		{
+			logprintf("ESSendQueue::%s:%d pthread_create failed errno = %d, %s\n", __FUNCTION__, __LINE__, errno, strerror(errno));
+		}
+	}
+
+	/**
+	 * @brief ESSendQueue Destructor
+	 */
+	~ESSendQueue()
+	{
+		pthread_mutex_lock(&mutex);
+		exitThread = true;
+		enabled = false;
+		clearUnlocked();
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		if (senderThreadStarted)
+		{
+			pthread_join(senderThreadID, NULL);
+		}
+		pthread_mutex_destroy(&mutex);
+		pthread_cond_destroy(&cond);
+	}
+
+	/**
+	 * @brief Queue a frame. Blocks while queue is full.
+	 *
+	 * @param[in,out] buffer   Frame data. Ownership is taken and buffer is reset on success
+	 * @param[in]     pts      PTS in seconds
+	 * @param[in]     dts      DTS in seconds
+	 * @param[in]     duration Duration in seconds
+	 *
+	 * @retval false if queue is aborted or sender is not running; caller keeps ownership of buffer
+	 */
+	bool push(GrowableBuffer *buffer, double pts, double dts, double duration)
+	{
+		bool ret = false;
+		pthread_mutex_lock(&mutex);
+		while (enabled && ((frames.size() >= ES_SEND_QUEUE_MAX_FRAMES) || (queuedBytes >= ES_SEND_QUEUE_MAX_BYTES)))
+		{
+			pthread_cond_wait(&cond, &mutex);
+		}
+		if (enabled && senderThreadStarted)
+		{
+			ESFrame frame;
+			frame.buffer = *buffer;
+			frame.pts = pts;
+			frame.dts = dts;
+			frame.duration = duration;
+			frames.push_back(frame);
+			queuedBytes += buffer->len;
+			memset(buffer, 0x00, sizeof(GrowableBuffer));
+			pthread_cond_broadcast(&cond);
+			ret = true;
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	/**
+	 * @brief Wait till all queued frames are sent
+	 */
+	void drain()
+	{
+		pthread_mutex_lock(&mutex);
+		while (enabled && (!frames.empty() || sending))
+		{
+			pthread_cond_wait(&cond, &mutex);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	/**
+	 * @brief Discard queued frames, unblock waiting callers and wait for frame being sent
+	 *
+	 * Once abort returns, no frame is pushed to sink till resume, so that a flush
+	 * which follows doesn't get frames of the previous position.
+	 */
+	void abort()
+	{
+		pthread_mutex_lock(&mutex);
+		enabled = false;
+		clearUnlocked();
+		pthread_cond_broadcast(&cond);
+		while (sending)
+		{
+			pthread_cond_wait(&cond, &mutex);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	/**
+	 * @brief Accept frames again after abort
+	 */
+	void resume()
+	{
+		pthread_mutex_lock(&mutex);
+		enabled = true;
+		pthread_mutex_unlock(&mutex);
+	}
+};
+
+
+static const unsigned char* findStartCode(const unsigned char *p, const unsigned char *last);
+
+/**
+ * @class Mp4Remuxer
+ * @brief Packs demuxed H.264/AAC frames into fragmented MP4.
+ *
+ * Init segment (ftyp+moov) is built from in-band SPS/PPS or ADTS header and is
+ * emitted on first sample, on codec configuration change and after reset.
+ * Samples are collected till flush() and then emitted as one moof+mdat.
+ */
+class Mp4Remuxer
+{
+private:
+	/**
+	 * @struct Mp4Sample
+	 * @brief Sample table entry of pending fragment
+	 */
+	struct Mp4Sample
+	{
+		uint32_t size;
+		long long dts;
+		int32_t compositionOffset;
+		uint32_t duration;
+		bool sync;
+	};
+
+	/**
+	 * @struct Mp4Output
+	 * @brief Remuxed buffer ready to be sent
+	 */
+	struct Mp4Output
+	{
+		GrowableBuffer buffer;
+		double pts;
+		double dts;
+		double duration;
+	};
+
+	StreamOutputFormat format;
+	std::vector<Mp4Sample> samples;
+	std::deque<Mp4Output> outputs;
+	GrowableBuffer mdat;
+	size_t mdatSizeHint;
+	double fragmentPts;
+	uint32_t sequenceNumber;
+	uint32_t lastDuration;
+	bool needInit;
+	std::string sps;
+	std::string pps;
+	int width;
+	int height;
+	unsigned int audioConfig;
+	int sampleRate;
+	int channelCount;
+
+	static void appendU8(GrowableBuffer *buf, unsigned int value)
+	{
+		unsigned char b = (unsigned char)value;
+		aamp_AppendBytes(buf, &b, 1);
+	}
+
+	static void appendU16(GrowableBuffer *buf, unsigned int value)
+	{
+		unsigned char b[2] = { (unsigned char)(value >> 8), (unsigned char)value };
+		aamp_AppendBytes(buf, b, 2);
+	}
+
+	static void appendU32(GrowableBuffer *buf, uint32_t value)
+	{
+		unsigned char b[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value };
+		aamp_AppendBytes(buf, b, 4);
+	}
+
+	static void appendU64(GrowableBuffer *buf, unsigned long long value)
+	{
+		appendU32(buf, (uint32_t)(value >> 32));
+		appendU32(buf, (uint32_t)value);
+	}
+
+	static void appendZeros(GrowableBuffer *buf, int count)
+	{
+		while (count-- > 0)
+		{
+			appendU8(buf, 0);
+		}
+	}
+
+	static void writeU32(GrowableBuffer *buf, size_t offset, uint32_t value)
+	{
+		unsigned char *p = (unsigned char *)&buf->ptr[offset];
+		p[0] = (unsigned char)(value >> 24);
+		p[1] = (unsigned char)(value >> 16);
+		p[2] = (unsigned char)(value >> 8);
+		p[3] = (unsigned char)value;
+	}
+
+	/**
+	 * @brief Start a box. Size is patched by endBox
+	 *
+	 * @retval offset of box in buffer
+	 */
+	static size_t beginBox(GrowableBuffer *buf, const char *type)
+	{
+		size_t offset = buf->len;
+		appendU32(buf, 0);
+		aamp_AppendBytes(buf, type, 4);
+		return offset;
+	}
+
+	static size_t beginFullBox(GrowableBuffer *buf, const char *type, int version, uint32_t flags)
+	{
+		size_t offset = beginBox(buf, type);
+		appendU32(buf, (version << 24) | (flags & 0xFFFFFF));
+		return offset;
+	}
+
+	static void endBox(GrowableBuffer *buf, size_t offset)
+	{
+		writeU32(buf, offset, (uint32_t)(buf->len - offset));
+	}
+
+	static void appendMatrix(GrowableBuffer *buf)
+	{
+		static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+		for (int i = 0; i < 9; i++)
+		{
+			appendU32(buf, unity[i]);
+		}
+	}
+
+	/**
+	 * @brief Read bits from RBSP, returns 0 past end of data
+	 */
+	static unsigned int readBits(const std::string &rbsp, size_t &bitPos, int count)
+	{
+		unsigned int value = 0;
+		while (count-- > 0)
+		{
+			size_t byte = bitPos >> 3;
+			unsigned int bit = 0;
+			if (byte < rbsp.size())
+			{
+				bit = ((unsigned char)rbsp[byte] >> (7 - (bitPos & 7))) & 1;
+			}
+			value = (value << 1) | bit;
+			bitPos++;
+		}
+		return value;
+	}
+
+	static unsigned int readUExpGolomb(const std::string &rbsp, size_t &bitPos)
+	{
+		int leadingZeros = 0;
+		while ((leadingZeros < 32) && (0 == readBits(rbsp, bitPos, 1)))
+		{
+			leadingZeros++;
+		}
+		return ((1u << leadingZeros) - 1) + readBits(rbsp, bitPos, leadingZeros);
+	}
+
+	static int readSExpGolomb(const std::string &rbsp, size_t &bitPos)
+	{
+		unsigned int code = readUExpGolomb(rbsp, bitPos);
+		return (code & 1) ? (int)((code + 1) >> 1) : -(int)(code >> 1);
+	}
+
+	/**
+	 * @brief Update width and height from SPS
+	 */
+	void parseSPS()
+	{
+		std::string rbsp;
+		// Remove emulation prevention bytes, skip NAL header
+		for (size_t i = 1; i < sps.size(); i++)
+		{
+			if ((i + 2 < sps.size()) && (sps[i] == 0) && (sps[i + 1] == 0) && (sps[i + 2] == 3))
+			{
+				rbsp.append(2, 0);
+				i += 2;
+				continue;
+			}
+			rbsp.push_back(sps[i]);
+		}
+		size_t pos = 0;
+		int profile_idc = readBits(rbsp, pos, 8);
+		readBits(rbsp, pos, 16);
+		readUExpGolomb(rbsp, pos);
+		int chroma_format_idc = 1;
+		switch (profile_idc)
+		{
+		case 44:  case 83:  case 86:
+		case 100: case 110: case 118:
+		case 122: case 128: case 244:
+			chroma_format_idc = readUExpGolomb(rbsp, pos);
+			if (chroma_format_idc == 3)
+			{
+				readBits(rbsp, pos, 1);
+			}
+			readUExpGolomb(rbsp, pos);
+			readUExpGolomb(rbsp, pos);
+			readBits(rbsp, pos, 1);
+			if (readBits(rbsp, pos, 1))
+			{
+				int count = (chroma_format_idc != 3) ? 8 : 12;
+				for (int i = 0; i < count; i++)
+				{
+					if (readBits(rbsp, pos, 1))
+					{
+						int size = (i < 6) ? 16 : 64;
+						int lastScale = 8, nextScale = 8;
+						for (int j = 0; j < size; j++)
+						{
+							if (nextScale != 0)
+							{
+								nextScale = (lastScale + readSExpGolomb(rbsp, pos) + 256) % 256;
+							}
+							lastScale = (nextScale == 0) ? lastScale : nextScale;
+						}
+					}
+				}
+			}
+			break;
+		}
+		readUExpGolomb(rbsp, pos);
+		int pic_order_cnt_type = readUExpGolomb(rbsp, pos);
+		if (pic_order_cnt_type == 0)
+		{
+			readUExpGolomb(rbsp, pos);
+		}
+		else if (pic_order_cnt_type == 1)
+		{
+			readBits(rbsp, pos, 1);
+			readSExpGolomb(rbsp, pos);
+			readSExpGolomb(rbsp, pos);
+			int num_ref_frames_in_pic_order_cnt_cycle = readUExpGolomb(rbsp, pos);
+			for (int i = 0; i < num_ref_frames_in_pic_order_cnt_cycle; i++)
+			{
+				readSExpGolomb(rbsp, pos);
+			}
+		}
+		readUExpGolomb(rbsp, pos);
+		readBits(rbsp, pos, 1);
+		int pic_width_in_mbs_minus1 = readUExpGolomb(rbsp, pos);
+		int pic_height_in_map_units_minus1 = readUExpGolomb(rbsp, pos);
+		int frame_mbs_only_flag = readBits(rbsp, pos, 1);
+		if (!frame_mbs_only_flag)
+		{
+			readBits(rbsp, pos, 1);
+		}
+		readBits(rbsp, pos, 1);
+		width = (pic_width_in_mbs_minus1 + 1) * 16;
+		height = (2 - frame_mbs_only_flag) * (pic_height_in_map_units_minus1 + 1) * 16;
+		if (readBits(rbsp, pos, 1))
+		{
+			int cropUnitX = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+			int cropUnitY = ((chroma_format_idc == 1) ? 2 : 1) * (2 - frame_mbs_only_flag);
+			int left = readUExpGolomb(rbsp, pos);
+			int right = readUExpGolomb(rbsp, pos);
+			int top = readUExpGolomb(rbsp, pos);
+			int bottom = readUExpGolomb(rbsp, pos);
+			width -= cropUnitX * (left + right);
+			height -= cropUnitY * (top + bottom);
+		}
+		INFO("Mp4Remuxer: SPS profile %d size %dx%d\n", profile_idc, width, height);
+	}
+
+	/**
+	 * @brief Queue output buffer
+	 */
+	void pushOutput(GrowableBuffer *buffer, double pts, double dts, double duration)
+	{
+		Mp4Output output;
+		output.buffer = *buffer;
+		output.pts = pts;
+		output.dts = dts;
+		output.duration = duration;
+		outputs.push_back(output);
+		memset(buffer, 0x00, sizeof(GrowableBuffer));
+	}
+
+	/**
+	 * @brief Build ftyp and moov for current codec configuration
+	 *
+	 * @param[in] pts PTS of first sample following init segment
+	 */
+	void emitInit(double pts)
+	{
+		bool video = (format == FORMAT_VIDEO_ES_H264);
+		GrowableBuffer buf;
+		memset(&buf, 0x00, sizeof(GrowableBuffer));
+		aamp_Malloc(&buf, 1024);
+
+		size_t ftyp = beginBox(&buf, "ftyp");
+		aamp_AppendBytes(&buf, "iso6", 4);
+		appendU32(&buf, 1);
+		aamp_AppendBytes(&buf, video ? "iso6isomavc1" : "iso6isommp41", 12);
+		endBox(&buf, ftyp);
+
+		size_t moov = beginBox(&buf, "moov");
+		size_t mvhd = beginFullBox(&buf, "mvhd", 0, 0);
+		appendU32(&buf, 0); // creation_time
+		appendU32(&buf, 0); // modification_time
+		appendU32(&buf, 1000); // timescale
+		appendU32(&buf, 0); // duration
+		appendU32(&buf, 0x00010000); // rate
+		appendU16(&buf, 0x0100); // volume
+		appendZeros(&buf, 10);
+		appendMatrix(&buf);
+		appendZeros(&buf, 24);
+		appendU32(&buf, 2); // next_track_ID
+		endBox(&buf, mvhd);
+
+		size_t trak = beginBox(&buf, "trak");
+		size_t tkhd = beginFullBox(&buf, "tkhd", 0, 0x7);
+		appendU32(&buf, 0); // creation_time
+		appendU32(&buf, 0); // modification_time
+		appendU32(&buf, 1); // track_ID
+		appendU32(&buf, 0);
+		appendU32(&buf, 0); // duration
+		appendZeros(&buf, 8);
+		appendU16(&buf, 0); // layer
+		appendU16(&buf, 0); // alternate_group
+		appendU16(&buf, video ? 0 : 0x0100); // volume
+		appendU16(&buf, 0);
+		appendMatrix(&buf);
+		appendU32(&buf, video ? (width << 16) : 0);
+		appendU32(&buf, video ? (height << 16) : 0);
+		endBox(&buf, tkhd);
+
+		size_t mdia = beginBox(&buf, "mdia");
+		size_t mdhd = beginFullBox(&buf, "mdhd", 0, 0);
+		appendU32(&buf, 0); // creation_time
+		appendU32(&buf, 0); // modification_time
+		appendU32(&buf, REMUX_TIMESCALE);
+		appendU32(&buf, 0); // duration
+		appendU16(&buf, 0x55C4); // language 'und'
+		appendU16(&buf, 0);
+		endBox(&buf, mdhd);
+
+		size_t hdlr = beginFullBox(&buf, "hdlr", 0, 0);
+		appendU32(&buf, 0);
+		aamp_AppendBytes(&buf, video ? "vide" : "soun", 4);
+		appendZeros(&buf, 12);
+		const char *name = video ? "VideoHandler" : "SoundHandler";
+		aamp_AppendBytes(&buf, name, strlen(name) + 1);
+		endBox(&buf, hdlr);
+
+		size_t minf = beginBox(&buf, "minf");
+		if (video)
+		{
+			size_t vmhd = beginFullBox(&buf, "vmhd", 0, 1);
+			appendZeros(&buf, 8);
+			endBox(&buf, vmhd);
+		}
+		else
+		{
+			size_t smhd = beginFullBox(&buf, "smhd", 0, 0);
+			appendZeros(&buf, 4);
+			endBox(&buf, smhd);
+		}
+		size_t dinf = beginBox(&buf, "dinf");
+		size_t dref = beginFullBox(&buf, "dref", 0, 0);
+		appendU32(&buf, 1);
+		size_t url = beginFullBox(&buf, "url ", 0, 1);
+		endBox(&buf, url);
+		endBox(&buf, dref);
+		endBox(&buf, dinf);
+
+		size_t stbl = beginBox(&buf, "stbl");
+		size_t stsd = beginFullBox(&buf, "stsd", 0, 0);
+		appendU32(&buf, 1);
+		if (video)
+		{
+			size_t avc1 = beginBox(&buf, "avc1");
+			appendZeros(&buf, 6);
+			appendU16(&buf, 1); // data_reference_index
+			appendZeros(&buf, 16);
+			appendU16(&buf, width);
+			appendU16(&buf, height);
+			appendU32(&buf, 0x00480000); // horizresolution
+			appendU32(&buf, 0x00480000); // vertresolution
+			appendU32(&buf, 0);
+			appendU16(&buf, 1); // frame_count
+			appendZeros(&buf, 32); // compressorname
+			appendU16(&buf, 0x0018); // depth
+			appendU16(&buf, 0xFFFF);
+			size_t avcC = beginBox(&buf, "avcC");
+			appendU8(&buf, 1);
+			appendU8(&buf, (unsigned char)sps[1]); // profile
+			appendU8(&buf, (unsigned char)sps[2]); // compatibility
+			appendU8(&buf, (unsigned char)sps[3]); // level
+			appendU8(&buf, 0xFF); // 4 byte NAL length
+			appendU8(&buf, 0xE1); // 1 SPS
+			appendU16(&buf, sps.size());
+			aamp_AppendBytes(&buf, sps.data(), sps.size());
+			appendU8(&buf, 1); // 1 PPS
+			appendU16(&buf, pps.size());
+			aamp_AppendBytes(&buf, pps.data(), pps.size());
+			endBox(&buf, avcC);
+			endBox(&buf, avc1);
+		}
+		else
+		{
+			size_t mp4a = beginBox(&buf, "mp4a");
+			appendZeros(&buf, 6);
+			appendU16(&buf, 1); // data_reference_index
+			appendZeros(&buf, 8);
+			appendU16(&buf, channelCount);
+			appendU16(&buf, 16); // samplesize
+			appendU32(&buf, 0);
+			appendU32(&buf, sampleRate << 16);
+			size_t esds = beginFullBox(&buf, "esds", 0, 0);
+			appendU8(&buf, 0x03); // ES_Descriptor
+			appendU8(&buf, 25);
+			appendU16(&buf, 1); // ES_ID
+			appendU8(&buf, 0);
+			appendU8(&buf, 0x04); // DecoderConfigDescriptor
+			appendU8(&buf, 17);
+			appendU8(&buf, 0x40); // MPEG-4 audio
+			appendU8(&buf, 0x15); // audio stream
+			appendZeros(&buf, 11); // bufferSizeDB, maxBitrate, avgBitrate
+			appendU8(&buf, 0x05); // DecoderSpecificInfo
+			appendU8(&buf, 2);
+			appendU16(&buf, audioConfig);
+			appendU8(&buf, 0x06); // SLConfigDescriptor
+			appendU8(&buf, 1);
+			appendU8(&buf, 0x02);
+			endBox(&buf, esds);
+			endBox(&buf, mp4a);
+		}
+		endBox(&buf, stsd);
+		const char *emptyTables[] = { "stts", "stsc", "stco" };
+		for (int i = 0; i < 3; i++)
+		{
+			size_t box = beginFullBox(&buf, emptyTables[i], 0, 0);
+			appendU32(&buf, 0);
+			endBox(&buf, box);
+		}
+		size_t stsz = beginFullBox(&buf, "stsz", 0, 0);
+		appendU32(&buf, 0);
+		appendU32(&buf, 0);
+		endBox(&buf, stsz);
+		endBox(&buf, stbl);
+		endBox(&buf, minf);
+		endBox(&buf, mdia);
+		endBox(&buf, trak);
+
+		size_t mvex = beginBox(&buf, "mvex");
+		size_t trex = beginFullBox(&buf, "trex", 0, 0);
+		appendU32(&buf, 1); // track_ID
+		appendU32(&buf, 1); // default_sample_description_index
+		appendZeros(&buf, 12);
+		endBox(&buf, trex);
+		endBox(&buf, mvex);
+		endBox(&buf, moov);
+
+		INFO("Mp4Remuxer: init segment format %d len %d\n", format, (int)buf.len);
+		pushOutput(&buf, pts, pts, 0);
+		needInit = false;
+	}
+
+	/**
+	 * @brief Build moof+mdat of pending samples
+	 *
+	 * @param[in] dataLen Bytes of mdat staging buffer belonging to pending samples
+	 */
+	void emitFragment(size_t dataLen)
+	{
+		if (samples.empty())
+		{
+			return;
+		}
+		uint32_t totalDuration = 0;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			if (samples[i].duration == 0)
+			{
+				long long delta = (i + 1 < samples.size()) ? (samples[i + 1].dts - samples[i].dts) : 0;
+				if (delta > 0 && delta < REMUX_TIMESCALE)
+				{
+					lastDuration = (uint32_t)delta;
+				}
+				samples[i].duration = lastDuration;
+			}
+			totalDuration += samples[i].duration;
+		}
+
+		GrowableBuffer buf;
+		memset(&buf, 0x00, sizeof(GrowableBuffer));
+		aamp_Malloc(&buf, 128 + (samples.size() * 16) + dataLen);
+
+		size_t moof = beginBox(&buf, "moof");
+		size_t mfhd = beginFullBox(&buf, "mfhd", 0, 0);
+		appendU32(&buf, ++sequenceNumber);
+		endBox(&buf, mfhd);
+		size_t traf = beginBox(&buf, "traf");
+		size_t tfhd = beginFullBox(&buf, "tfhd", 0, 0x020000); // default-base-is-moof
+		appendU32(&buf, 1);
+		endBox(&buf, tfhd);
+		size_t tfdt = beginFullBox(&buf, "tfdt", 1, 0);
+		appendU64(&buf, samples[0].dts);
+		endBox(&buf, tfdt);
+		// data-offset, sample-duration, sample-size, sample-flags, sample-composition-time-offset
+		size_t trun = beginFullBox(&buf, "trun", 1, 0x000F01);
+		appendU32(&buf, samples.size());
+		size_t dataOffset = buf.len;
+		appendU32(&buf, 0);
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			appendU32(&buf, samples[i].duration);
+			appendU32(&buf, samples[i].size);
+			appendU32(&buf, samples[i].sync ? 0x02000000 : 0x01010000);
+			appendU32(&buf, (uint32_t)samples[i].compositionOffset);
+		}
+		endBox(&buf, trun);
+		endBox(&buf, traf);
+		endBox(&buf, moof);
+		writeU32(&buf, dataOffset, (uint32_t)(buf.len - moof + 8));
+
+		appendU32(&buf, (uint32_t)(dataLen + 8));
+		aamp_AppendBytes(&buf, "mdat", 4);
+		aamp_AppendBytes(&buf, mdat.ptr, dataLen);
+
+		double dts = (double)samples[0].dts / REMUX_TIMESCALE;
+		pushOutput(&buf, fragmentPts, dts, (double)totalDuration / REMUX_TIMESCALE);
+
+		// Keep bytes of sample being added, if any
+		memmove(mdat.ptr, mdat.ptr + dataLen, mdat.len - dataLen);
+		mdat.len -= dataLen;
+		samples.clear();
+	}
+
+	/**
+	 * @brief Queue a sample and emit init segment before it if needed
+	 */
+	void addToFragment(uint32_t size, long long dts, long long pts, uint32_t duration, bool sync)
+	{
+		if (needInit)
+		{
+			emitFragment(mdat.len - size);
+			emitInit((double)pts / REMUX_TIMESCALE);
+		}
+		if (samples.empty())
+		{
+			fragmentPts = (double)pts / REMUX_TIMESCALE;
+		}
+		Mp4Sample sample;
+		sample.size = size;
+		sample.dts = dts;
+		sample.compositionOffset = (int32_t)(pts - dts);
+		sample.duration = duration;
+		sample.sync = sync;
+		samples.push_back(sample);
+	}
+
+	/**
+	 * @brief Convert Annex B access unit to length prefixed sample
+	 */
+	void addVideoSample(const unsigned char *data, size_t len, long long dts, long long pts)
+	{
+		size_t sampleStart = mdat.len;
+		bool sync = false;
+		const unsigned char *end = data + len;
+		const unsigned char *last = end - 2;
+		const unsigned char *sc = findStartCode(data, last);
+		while (sc < last)
+		{
+			const unsigned char *nal = sc + 3;
+			const unsigned char *next = findStartCode(nal, last);
+			const unsigned char *nalEnd = (next < last) ? next : end;
+			while ((nalEnd > nal) && (nalEnd[-1] == 0x00))
+			{
+				nalEnd--;
+			}
+			size_t nalLen = nalEnd - nal;
+			if (nalLen > 0)
+			{
+				int nalType = nal[0] & 0x1F;
+				if (nalType == 7)
+				{
+					if ((nalLen >= 4) && (sps.size() != nalLen || memcmp(sps.data(), nal, nalLen)))
+					{
+						sps.assign((const char *)nal, nalLen);
+						parseSPS();
+						needInit = true;
+					}
+				}
+				else if (nalType == 8)
+				{
+					if (pps.size() != nalLen || memcmp(pps.data(), nal, nalLen))
+					{
+						pps.assign((const char *)nal, nalLen);
+						needInit = true;
+					}
+				}
+				else if (nalType != 9)
+				{
+					sync |= (nalType == 5);
+					appendU32(&mdat, (uint32_t)nalLen);
+					aamp_AppendBytes(&mdat, nal, nalLen);
+				}
+			}
+			sc = next;
+		}
+		size_t size = mdat.len - sampleStart;
+		if (size == 0)
+		{
+			return;
+		}
+		if (sps.empty() || pps.empty())
+		{
+			DEBUG("Mp4Remuxer: discard frame before SPS/PPS\n");
+			mdat.len = sampleStart;
+			return;
+		}
+		addToFragment(size, dts, pts, 0, sync);
+	}
+
+	/**
+	 * @brief Split ADTS frames of a PES into raw AAC samples
+	 */
+	void addAudioSample(const unsigned char *data, size_t len, long long pts)
+	{
+		static const int sampleRates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+		long long frameIndex = 0;
+		while (len >= 7)
+		{
+			if ((data[0] != 0xFF) || ((data[1] & 0xF6) != 0xF0))
+			{
+				WARNING("Mp4Remuxer: ADTS sync lost, discarding %d bytes\n", (int)len);
+				break;
+			}
+			int headerLen = (data[1] & 0x01) ? 7 : 9;
+			int profile = (data[2] >> 6) & 0x03;
+			int samplingFrequencyIndex = (data[2] >> 2) & 0x0F;
+			int channelConfig = ((data[2] & 0x01) << 2) | (data[3] >> 6);
+			size_t frameLen = ((data[3] & 0x03) << 11) | (data[4] << 3) | (data[5] >> 5);
+			if ((frameLen <= (size_t)headerLen) || (frameLen > len) || (samplingFrequencyIndex > 12))
+			{
+				WARNING("Mp4Remuxer: invalid ADTS header, frameLen %d len %d\n", (int)frameLen, (int)len);
+				break;
+			}
+			unsigned int config = ((profile + 1) << 11) | (samplingFrequencyIndex << 7) | (channelConfig << 3);
+			if (config != audioConfig)
+			{
+				audioConfig = config;
+				sampleRate = sampleRates[samplingFrequencyIndex];
+				channelCount = (channelConfig == 7) ? 8 : channelConfig;
+				needInit = true;
+			}
+			long long frameStart = pts + (frameIndex * 1024 * REMUX_TIMESCALE) / sampleRate;
+			long long frameEnd = pts + ((frameIndex + 1) * 1024 * REMUX_TIMESCALE) / sampleRate;
+			aamp_AppendBytes(&mdat, data + headerLen, frameLen - headerLen);
+			addToFragment(frameLen - headerLen, frameStart, frameStart, (uint32_t)(frameEnd - frameStart), true);
+			frameIndex++;
+			data += frameLen;
+			len -= frameLen;
+		}
+	}
+
+public:
+	/**
+	 * @brief Check if remux is supported for a format
+	 *
+	 * @param[in] format Elementary stream format
+	 *
+	 * @retval true if format can be remuxed
+	 */
+	static bool isSupported(StreamOutputFormat format)
+	{
+		return (format == FORMAT_VIDEO_ES_H264) || (format == FORMAT_AUDIO_ES_AAC);
+	}
+
+	/**
+	 * @brief Mp4Remuxer Constructor
+	 *
+	 * @param[in] format Elementary stream format, shall be supported
+	 */
+	Mp4Remuxer(StreamOutputFormat format) : format(format), samples(), outputs(), mdat(), mdatSizeHint(0), fragmentPts(0),
+		sequenceNumber(0), lastDuration(REMUX_DEFAULT_FRAME_DURATION), needInit(true), sps(), pps(), width(0), height(0),
+		audioConfig(0), sampleRate(48000), channelCount(2)
+	{
+		memset(&mdat, 0x00, sizeof(GrowableBuffer));
+	}
+
+	/**
+	 * @brief Mp4Remuxer Destructor
+	 */
+	~Mp4Remuxer()
+	{
+		reset();
+	}
+
+	/**
+	 * @brief Add a demuxed frame
+	 *
+	 * @param[in] data Frame data
+	 * @param[in] len  Frame length
+	 * @param[in] pts  PTS in seconds
+	 * @param[in] dts  DTS in seconds
+	 */
+	void addSample(const unsigned char *data, size_t len, double pts, double dts)
+	{
+		if (!mdat.ptr)
+		{
+			aamp_Malloc(&mdat, std::max(mdatSizeHint, len * 2));
+		}
+		long long ptsTicks = llround(pts * REMUX_TIMESCALE);
+		if (format == FORMAT_VIDEO_ES_H264)
+		{
+			if (len >= 4)
+			{
+				addVideoSample(data, len, llround(dts * REMUX_TIMESCALE), ptsTicks);
+			}
+		}
+		else
+		{
+			addAudioSample(data, len, ptsTicks);
+		}
+	}
+
+	/**
+	 * @brief Emit pending samples as a fragment
+	 */
+	void flush()
+	{
+		if (!samples.empty())
+		{
+			mdatSizeHint = mdat.len + (mdat.len >> 2);
+			emitFragment(mdat.len);
+		}
+	}
+
+	/**
+	 * @brief Discard pending samples and outputs, next sample starts with init segment
+	 */
+	void reset()
+	{
+		samples.clear();
+		while (!outputs.empty())
+		{
+			aamp_Free(&outputs.front().buffer.ptr);
+			outputs.pop_front();
+		}
+		aamp_Free(&mdat.ptr);
+		memset(&mdat, 0x00, sizeof(GrowableBuffer));
+		needInit = true;
+	}
+
+	/**
+	 * @brief Get next remuxed buffer
+	 *
+	 * @param[out] buffer   Remuxed data, ownership is transferred to caller
+	 * @param[out] pts      PTS in seconds
+	 * @param[out] dts      DTS in seconds
+	 * @param[out] duration Duration in seconds
+	 *
+	 * @retval true if a buffer is returned
+	 */
+	bool getOutput(GrowableBuffer *buffer, double &pts, double &dts, double &duration)
+	{
+		if (outputs.empty())
+		{
+			return false;
+		}
+		Mp4Output &output = outputs.front();
+		*buffer = output.buffer;
+		pts = output.pts;
+		dts = output.dts;
+		duration = output.duration;
+		outputs.pop_front();
+		return true;
+	}
+};
+
+
 /**
  * @class Demuxer
  * @brief Software demuxer of MPEGTS
@@ -159,6 +1180,8 @@ class Demuxer
 {
 private:
 	class PrivateInstanceAAMP *aamp;
+	ESSendQueue *sendQueue;
+	Mp4Remuxer *remuxer;
 	int pes_state;
 	int pes_header_ext_len;
 	int pes_header_ext_read;
@@ -172,6 +1195,7 @@ private:
 	MediaType type;
 	bool trickmode;
 	bool finalized_base_pts;
+	size_t es_size_hint;
 #ifdef DEBUG_DEMUX_TRACK
 	int sentESCount;
 	int packetCount;
@@ -182,8 +1206,44 @@ private:
  * @{
  */
 
+	/**
+	 * @brief Hand over a buffer to sink, directly or through send queue
+	 *
+	 * @note buffer is reset if ownership is taken
+	 */
+	void sendBuffer(GrowableBuffer *buffer, double pts, double dts, double duration)
+	{
+		if (sendQueue)
+		{
+			sendQueue->push(buffer, pts, dts, duration);
+		}
+		else
+		{
+			aamp->SendStream(type, buffer, pts, dts, duration);
+		}
+	}
+
+	/**
+	 * @brief Send buffers produced by remuxer
+	 */
+	void sendRemuxed()
+	{
+		GrowableBuffer buffer;
+		double pts, dts, duration;
+		while (remuxer->getOutput(&buffer, pts, dts, duration))
+		{
+			if (aamp->DownloadsAreEnabled())
+			{
+				sendBuffer(&buffer, pts, dts, duration);
+			}
+			aamp_Free(&buffer.ptr);
+		}
+	}
+
 	/**
 	 * @brief Sends elementary stream with proper PTS
+	 *
+	 * @note Ownership of es buffer is handed over to sink, avoiding a copy per frame
 	 */
 	void send()
 	{
@@ -209,7 +1269,21 @@ private:
 			}
 			DEBUG_DEMUX("Send : pts %f dts %f\n", pts, dts);
 			DEBUG_DEMUX("position %f base_pts %llu current_pts %llu diff %f seconds length %d\n", position, base_pts, current_pts, (double)(current_pts - base_pts) / 90000, (int)es.len );
-			aamp->SendStream(type, es.ptr, es.len, pts, dts, duration);
+			if (aamp->DownloadsAreEnabled())
+			{
+				if (remuxer)
+				{
+					// es buffer is retained and reused, remuxer copies sample data to its fragment
+					remuxer->addSample((const unsigned char *)es.ptr, es.len, pts, dts);
+					sendRemuxed();
+				}
+				else
+				{
+					// Next frame is likely to be of similar size; pre-size its buffer to avoid realloc churn
+					es_size_hint = es.len + (es.len >> 2);
+					sendBuffer(&es, pts, dts, duration);
+				}
+			}
 #ifdef DEBUG_DEMUX_TRACK
 			sentESCount++;
 #endif
@@ -223,11 +1297,15 @@ public:
          *
 	 * @param[in] aamp pointer to PrivateInstanceAAMP object associated with demux
 	 * @param[in] type Media type to be demuxed
+	 * @param[in] sendQueue queue used to send frames asynchronously, NULL to send from caller's thread
 	 */
-	Demuxer(class PrivateInstanceAAMP *aamp,MediaType type)
+	Demuxer(class PrivateInstanceAAMP *aamp,MediaType type, ESSendQueue *sendQueue = NULL)
 	{
 		this->aamp = aamp;
 		this->type = type;
+		this->sendQueue = sendQueue;
+		this->remuxer = NULL;
+		es_size_hint = 0;
 		init(0, 0, false, true);
 	}
 
@@ -238,6 +1316,40 @@ public:
 	{
 		aamp_Free(&es.ptr);
 		aamp_Free(&pes_header.ptr);
+		if (remuxer)
+		{
+			delete remuxer;
+		}
+	}
+
+
+	/**
+	 * @brief Remux demuxed frames to fragmented MP4 instead of sending elementary stream
+	 *
+	 * @param[in] format Elementary stream format of demuxed track
+	 *
+	 * @retval true if remux is enabled, false if format is not supported
+	 */
+	bool enableRemux(StreamOutputFormat format)
+	{
+		if (!remuxer && Mp4Remuxer::isSupported(format))
+		{
+			remuxer = new Mp4Remuxer(format);
+		}
+		return (NULL != remuxer);
+	}
+
+
+	/**
+	 * @brief Send frames of current segment as one fragment when remuxing
+	 */
+	void endSegment()
+	{
+		if (remuxer)
+		{
+			remuxer->flush();
+			sendRemuxed();
+		}
 	}
 
 
@@ -282,6 +1394,7 @@ public:
 			INFO("demux : sending remaining bytes. es.len %d\n", (int)es.len);
 			send();
 		}
+		endSegment();
 		reset();
 #ifdef DEBUG_DEMUX_TRACK
 		INFO("Sent Segment. ES count %d in duration %f packetCount %d\n", sentESCount, duration, packetCount);
@@ -298,6 +1411,10 @@ public:
 		aamp_Free(&pes_header.ptr);
 		memset(&pes_header, 0x00, sizeof(GrowableBuffer));
 		memset(&es, 0x00, sizeof(GrowableBuffer));
+		if (remuxer)
+		{
+			remuxer->reset();
+		}
 	}
 
 
@@ -539,6 +1656,10 @@ public:
 					case PES_STATE_GETTING_ES:
 						/*Handle padding?*/
 						TRACE1("PES_STATE_GETTING_ES bytes_to_read = %d\n", size);
+						if (!es.ptr)
+						{
+							aamp_Malloc(&es, (es_size_hint > (size_t)size) ? es_size_hint : size);
+						}
 						aamp_AppendBytes(&es, data, size);
 						size = 0;
 						break;
@@ -600,9 +1721,310 @@ static uint32_t get_crc32(unsigned char *data, int size, uint32_t initial = 0xff
 	init_crc32();
 	for (i = 0; i < size; i++)
 	{
-		result = (result << 8) ^ crc32_table[(result >> 24) ^ data[i]];
+		result = (result << 8) ^ crc32_table[(result >> 24) ^ data[i]];
+	}
+	return result;
+}
+
+
+/**
+ * @brief Find next ES start code prefix (0x00 0x00 0x01)
+ *
+ * Uses SIMD compares when available, scalar scan otherwise.
+ *
+ * @param[in] p     First candidate position
+ * @param[in] last  End of candidate range. Caller guarantees last[0] and last[1] are readable.
+ *
+ * @retval Pointer to start code, or last if none found
+ */
+static const unsigned char* findStartCode(const unsigned char *p, const unsigned char *last)
+{
+	if (p >= last)
+	{
+		return last;
+	}
+#if defined(TS_SCAN_AVX2)
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi8(1);
+	while (last - p >= 32)
+	{
+		__m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+		__m256i b2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+		__m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)), _mm256_cmpeq_epi8(b2, one));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(match);
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+#elif defined(TS_SCAN_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	while (last - p >= 16)
+	{
+		__m128i b0 = _mm_loadu_si128((const __m128i *)p);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+		__m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(match);
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+#elif defined(TS_SCAN_NEON)
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t one = vdupq_n_u8(1);
+	while (last - p >= 16)
+	{
+		uint8x16_t b0 = vld1q_u8(p);
+		uint8x16_t b1 = vld1q_u8(p + 1);
+		uint8x16_t b2 = vld1q_u8(p + 2);
+		uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one));
+		uint64x2_t lanes = vreinterpretq_u64_u8(match);
+		if (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1))
+		{
+			// Locate exact offset with scalar scan of this block
+			break;
+		}
+		p += 16;
+	}
+#endif
+	while (p < last)
+	{
+		if ((p[0] == 0x00) && (p[1] == 0x00) && (p[2] == 0x01))
+		{
+			return p;
+		}
+		++p;
+	}
+	return last;
+}
+
+
+/**
+ * @brief Check sync byte of every TS packet in a buffer
+ *
+ * Sync bytes are a packet size apart, so they are checked in an unrolled,
+ * branch-free batch rather than one packet at a time.
+ *
+ * @param[in] packet      First packet (after TTS header, if any)
+ * @param[in] count       Number of packets
+ * @param[in] packetSize  Stride between packets
+ *
+ * @retval Index of first packet with a bad sync byte, or -1 if all are valid
+ */
+static int findSyncLoss(const unsigned char *packet, int count, int packetSize)
+{
+	int i = 0;
+	while (i + 4 <= count)
+	{
+		unsigned char bad = (packet[0] ^ 0x47) | (packet[packetSize] ^ 0x47) |
+			(packet[2 * packetSize] ^ 0x47) | (packet[3 * packetSize] ^ 0x47);
+		if (bad)
+		{
+			break;
+		}
+		packet += 4 * packetSize;
+		i += 4;
+	}
+	while (i < count)
+	{
+		if (packet[0] != 0x47)
+		{
+			return i;
+		}
+		packet += packetSize;
+		++i;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief Skip leading TS packets which have a valid sync byte and a PID not in a set
+ *
+ * Loads the 4 byte header of several packets into one vector and compares sync byte
+ * and PID of all of them against the set at once. Headers are little endian packed,
+ * so sync byte is in bits 0-7 and PID in bits 8-12 and 16-23 of each lane.
+ *
+ * @param[in] packet      First packet (after TTS header, if any)
+ * @param[in] count       Number of packets
+ * @param[in] packetSize  Stride between packets
+ * @param[in] pids        PIDs of interest, -1 for unused entries
+ *
+ * @retval Number of leading packets which can be skipped
+ */
+static int skipPacketsNotInPidSet(const unsigned char *packet, int count, int packetSize, const int pids[TS_PID_SET_SIZE])
+{
+	int i = 0;
+#if defined(TS_SCAN_AVX2) || defined(TS_SCAN_SSE2) || defined(TS_SCAN_NEON)
+	const uint32_t headerMask = 0x00FF1FFF;
+	uint32_t pidHeader[TS_PID_SET_SIZE];
+	for (int n = 0; n < TS_PID_SET_SIZE; n++)
+	{
+		// unused entry can never match, as bits 13-15 are outside header mask
+		pidHeader[n] = (pids[n] < 0) ? 0xFFFFFFFF : (0x47 | ((pids[n] & 0x1F00)) | ((pids[n] & 0xFF) << 16));
+	}
+#endif
+#if defined(TS_SCAN_AVX2)
+	const __m256i vindex = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(packetSize));
+	const __m256i mask = _mm256_set1_epi32(headerMask);
+	const __m256i sync = _mm256_set1_epi32(0x47);
+	const __m256i syncMask = _mm256_set1_epi32(0xFF);
+	while (i + 8 <= count)
+	{
+		__m256i header = _mm256_and_si256(_mm256_i32gather_epi32((const int *)packet, vindex, 1), mask);
+		__m256i stop = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(header, syncMask), sync), _mm256_set1_epi32(-1));
+		for (int n = 0; n < TS_PID_SET_SIZE; n++)
+		{
+			stop = _mm256_or_si256(stop, _mm256_cmpeq_epi32(header, _mm256_set1_epi32(pidHeader[n])));
+		}
+		unsigned int stopMask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(stop));
+		if (stopMask)
+		{
+			return i + __builtin_ctz(stopMask);
+		}
+		packet += 8 * packetSize;
+		i += 8;
+	}
+#elif defined(TS_SCAN_SSE2) || defined(TS_SCAN_NEON)
+	uint32_t lanes[4];
+	while (i + 4 <= count)
+	{
+		for (int n = 0; n < 4; n++)
+		{
+			memcpy(&lanes[n], packet + n * packetSize, sizeof(uint32_t));
+		}
+#if defined(TS_SCAN_SSE2)
+		__m128i header = _mm_and_si128(_mm_loadu_si128((const __m128i *)lanes), _mm_set1_epi32(headerMask));
+		__m128i stop = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(header, _mm_set1_epi32(0xFF)), _mm_set1_epi32(0x47)), _mm_set1_epi32(-1));
+		for (int n = 0; n < TS_PID_SET_SIZE; n++)
+		{
+			stop = _mm_or_si128(stop, _mm_cmpeq_epi32(header, _mm_set1_epi32(pidHeader[n])));
+		}
+		unsigned int stopMask = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(stop));
+#else
+		uint32x4_t header = vandq_u32(vld1q_u32(lanes), vdupq_n_u32(headerMask));
+		uint32x4_t stop = vmvnq_u32(vceqq_u32(vandq_u32(header, vdupq_n_u32(0xFF)), vdupq_n_u32(0x47)));
+		for (int n = 0; n < TS_PID_SET_SIZE; n++)
+		{
+			stop = vorrq_u32(stop, vceqq_u32(header, vdupq_n_u32(pidHeader[n])));
+		}
+		unsigned int stopMask = 0;
+		for (int n = 0; n < 4; n++)
+		{
+			stopMask |= (vgetq_lane_u32(stop, 0) ? (1 << n) : 0);
+			stop = vextq_u32(stop, stop, 1);
+		}
+#endif
+		if (stopMask)
+		{
+			return i + __builtin_ctz(stopMask);
+		}
+		packet += 4 * packetSize;
+		i += 4;
+	}
+#endif
+	while (i < count)
+	{
+		if (packet[0] != 0x47)
+		{
+			return i;
+		}
+		int pid = (((packet[1] << 8) | packet[2]) & 0x1FFF);
+		for (int n = 0; n < TS_PID_SET_SIZE; n++)
+		{
+			if (pid == pids[n])
+			{
+				return i;
+			}
+		}
+		packet += packetSize;
+		++i;
+	}
+	return i;
+}
+
+
+/**
+ * @brief Skip leading TS packets which can't carry a PES header or PCR
+ *
+ * Only payload unit start packets can start a PES header and only packets with an
+ * adaptation field can carry a PCR. Those flags of several packets are tested at once,
+ * in the same little endian header lanes as skipPacketsNotInPidSet: payload unit start
+ * is bit 14 and adaptation field control bit 1 is bit 29 of each lane.
+ *
+ * @param[in] packet      First packet (after TTS header, if any), sync bytes already checked
+ * @param[in] count       Number of packets
+ * @param[in] packetSize  Stride between packets
+ *
+ * @retval Number of leading packets which can be skipped
+ */
+static int skipPacketsWithoutTimeStamps(const unsigned char *packet, int count, int packetSize)
+{
+	int i = 0;
+#if defined(TS_SCAN_AVX2) || defined(TS_SCAN_SSE2) || defined(TS_SCAN_NEON)
+	const uint32_t flagsMask = 0x20004000;
+#endif
+#if defined(TS_SCAN_AVX2)
+	const __m256i vindex = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(packetSize));
+	const __m256i mask = _mm256_set1_epi32(flagsMask);
+	while (i + 8 <= count)
+	{
+		__m256i flags = _mm256_and_si256(_mm256_i32gather_epi32((const int *)packet, vindex, 1), mask);
+		__m256i stop = _mm256_xor_si256(_mm256_cmpeq_epi32(flags, _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+		unsigned int stopMask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(stop));
+		if (stopMask)
+		{
+			return i + __builtin_ctz(stopMask);
+		}
+		packet += 8 * packetSize;
+		i += 8;
+	}
+#elif defined(TS_SCAN_SSE2) || defined(TS_SCAN_NEON)
+	uint32_t lanes[4];
+	while (i + 4 <= count)
+	{
+		for (int n = 0; n < 4; n++)
+		{
+			memcpy(&lanes[n], packet + n * packetSize, sizeof(uint32_t));
+		}
+#if defined(TS_SCAN_SSE2)
+		__m128i flags = _mm_and_si128(_mm_loadu_si128((const __m128i *)lanes), _mm_set1_epi32(flagsMask));
+		__m128i stop = _mm_xor_si128(_mm_cmpeq_epi32(flags, _mm_setzero_si128()), _mm_set1_epi32(-1));
+		unsigned int stopMask = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(stop));
+#else
+		uint32x4_t flags = vandq_u32(vld1q_u32(lanes), vdupq_n_u32(flagsMask));
+		uint32x4_t stop = vmvnq_u32(vceqq_u32(flags, vdupq_n_u32(0)));
+		unsigned int stopMask = 0;
+		for (int n = 0; n < 4; n++)
+		{
+			stopMask |= (vgetq_lane_u32(stop, 0) ? (1 << n) : 0);
+			stop = vextq_u32(stop, stop, 1);
+		}
+#endif
+		if (stopMask)
+		{
+			return i + __builtin_ctz(stopMask);
+		}
+		packet += 4 * packetSize;
+		i += 4;
+	}
+#endif
+	while (i < count)
+	{
+		if ((packet[1] & 0x40) || (packet[3] & 0x20))
+		{
+			return i;
+		}
+		packet += packetSize;
+		++i;
 	}
-	return result;
+	return i;
 }
 
 
@@ -677,6 +2099,7 @@ TSProcessor::TSProcessor(class PrivateInstanceAAMP *aamp,StreamOperation streamO
 	this->aamp = aamp;
 
 	m_playMode = m_playModeNext = PlayMode_normal;
+	m_reverseGOP = m_reverseGOPNext = false;
 	m_playRate = m_playRateNext = m_absPlayRate = 1.0f;
 	m_packetSize = PACKET_SIZE;
 	m_ttsSize = 0;
@@ -714,6 +2137,12 @@ TSProcessor::TSProcessor(class PrivateInstanceAAMP *aamp,StreamOperation streamO
 	m_baseThrottleContentTime = -1LL;
 	m_baseThrottleRealTime = -1LL;
 	m_throttlePTS = -1LL;
+	m_pcrPacketTemplatePid = -1;
+	m_nextFrameDeadline = 0;
+	m_pacingJitterSum = 0;
+	m_pacingJitterMax = 0;
+	m_pacingJitterCount = 0;
+	m_pacingLead = 0;
 	m_insertPCR = false;
 	m_picOrderCount = 0;
 	m_isInterlacedKnown = false;
@@ -723,6 +2152,9 @@ TSProcessor::TSProcessor(class PrivateInstanceAAMP *aamp,StreamOperation streamO
 
 	memset(m_SPS, 0, 32 * sizeof(H264SPS));
 	memset(m_PPS, 0, 256 * sizeof(H264PPS));
+	m_isHEVC = false;
+	memset(m_hevcSPS, 0, sizeof(m_hevcSPS));
+	memset(m_hevcPPS, 0, sizeof(m_hevcPPS));
 
 	m_scanSkipPacketsEnabled = false;
 	m_actualStartPTS = -1LL;
@@ -735,7 +2167,16 @@ TSProcessor::TSProcessor(class PrivateInstanceAAMP *aamp,StreamOperation streamO
 	m_throttleMaxDiffSegments = DEFAULT_THROTTLE_MAX_DIFF_SEGMENTS_MS;
 	m_throttleDelayIgnoredMs = DEFAULT_THROTTLE_DELAY_IGNORED_MS;
 	m_throttleDelayForDiscontinuityMs = DEFAULT_THROTTLE_DELAY_FOR_DISCONTINUITY_MS;
+#ifdef __APPLE__
+	// No pthread_condattr_setclock, waitUntil converts deadlines to realtime
 	pthread_cond_init(&m_throttleCond, NULL);
+#else
+	pthread_condattr_t throttleCondAttr;
+	pthread_condattr_init(&throttleCondAttr);
+	pthread_condattr_setclock(&throttleCondAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m_throttleCond, &throttleCondAttr);
+	pthread_condattr_destroy(&throttleCondAttr);
+#endif
 	pthread_cond_init(&m_basePTSCond, NULL);
 	pthread_mutex_init(&m_mutex, NULL);
 	m_enabled = true;
@@ -765,18 +2206,28 @@ TSProcessor::TSProcessor(class PrivateInstanceAAMP *aamp,StreamOperation streamO
 	m_streamOperation = streamOperation;
 	m_audDemuxer = NULL;
 	m_vidDemuxer = NULL;
+	m_audSendQueue = NULL;
+	m_vidSendQueue = NULL;
 	m_demux = NULL;
 	m_peerTSProcessor = peerTSProcessor;
 
 	if ((m_streamOperation == eStreamOp_DEMUX_ALL) || (m_streamOperation == eStreamOp_DEMUX_VIDEO))
 	{
-		m_vidDemuxer = new Demuxer(aamp,eMEDIATYPE_VIDEO);
+		if (gpGlobalConfig->demuxPipeline)
+		{
+			m_vidSendQueue = new ESSendQueue(aamp, eMEDIATYPE_VIDEO);
+		}
+		m_vidDemuxer = new Demuxer(aamp,eMEDIATYPE_VIDEO, m_vidSendQueue);
 		m_demux = true;
 	}
 
 	if ((m_streamOperation == eStreamOp_DEMUX_ALL) || (m_streamOperation == eStreamOp_DEMUX_AUDIO))
 	{
-		m_audDemuxer = new Demuxer(aamp, eMEDIATYPE_AUDIO);
+		if (gpGlobalConfig->demuxPipeline)
+		{
+			m_audSendQueue = new ESSendQueue(aamp, eMEDIATYPE_AUDIO);
+		}
+		m_audDemuxer = new Demuxer(aamp, eMEDIATYPE_AUDIO, m_audSendQueue);
 		m_demux = true;
 	}
 	m_queuedSegment = NULL;
@@ -846,6 +2297,14 @@ TSProcessor::~TSProcessor()
 	{
 		delete m_audDemuxer;
 	}
+	if (m_vidSendQueue)
+	{
+		delete m_vidSendQueue;
+	}
+	if (m_audSendQueue)
+	{
+		delete m_audSendQueue;
+	}
 
 	if (m_queuedSegment)
 	{
@@ -924,27 +2383,30 @@ void TSProcessor::insertPCR(unsigned char *packet, int pid)
 	long long currPCR;
 
 	assert(m_playMode == PlayMode_retimestamp_Ionly);
-	i = 0;
-	if (m_ttsSize)
+	i = m_ttsSize;
+	if (m_pcrPacketTemplatePid != pid)
 	{
-		memset(packet, 0, m_ttsSize);
-		i += m_ttsSize;
+		// Only continuity counter and PCR differ between insertions, build the rest once per pid
+		m_pcrPacketTemplate.assign(m_packetSize, 0xFF);
+		unsigned char *tmpl = &m_pcrPacketTemplate[0];
+		if (m_ttsSize)
+		{
+			memset(tmpl, 0, m_ttsSize);
+		}
+		tmpl[i + 0] = 0x47;
+		tmpl[i + 1] = (0x60 | (unsigned char)((pid >> 8) & 0x1F));
+		tmpl[i + 2] = (unsigned char)(0xFF & pid);
+		tmpl[i + 3] = 0x20; // 2 bits Scrambling = no; 2 bits adaptation field = has adaptation, no payload; 4 bits continuity counter
+		tmpl[i + 4] = 0xB7; // 1 byte of adaptation data, but require length of 183 when no payload is indicated
+		tmpl[i + 5] = 0x10; // PCR
+		m_pcrPacketTemplatePid = pid;
 	}
-	packet[i + 0] = 0x47;
-	packet[i + 1] = (0x60 | (unsigned char)((pid >> 8) & 0x1F));
-	packet[i + 2] = (unsigned char)(0xFF & pid);
-	// 2 bits Scrambling = no; 2 bits adaptation field = has adaptation, no payload; 4 bits continuity counter
+	memcpy(packet, &m_pcrPacketTemplate[0], m_packetSize);
 	// Don't increment continuity counter since there is no payload
 	packet[i + 3] = (0x20 | (m_continuityCounters[pid] & 0x0F));
-	packet[i + 4] = 0xB7; // 1 byte of adaptation data, but require length of 183 when no payload is indicated
-	packet[i + 5] = 0x10; // PCR
 	currPCR = ((m_currRateAdjustedPTS - 10000) & 0x1FFFFFFFFLL);
 	TRACE1("TSProcessor::insertPCR: m_currRateAdjustedPTS= %llx currPCR= %llx\n", m_currRateAdjustedPTS, currPCR);
 	writePCR(&packet[i + 6], currPCR, true);
-	for (int i = 6 + 6 + m_ttsSize; i < m_packetSize; i++)
-	{
-		packet[i] = 0xFF;
-	}
 }
 
 /**
@@ -998,7 +2460,6 @@ void TSProcessor::processPMTSection(unsigned char* section, int sectionLength)
 		switch (streamType)
 		{
 		case 0x02: // MPEG2 Video
-		case 0x24: // HEVC video
 		case 0x80: // ATSC Video
 			if (videoComponentCount < MAX_PIDS)
 			{
@@ -1011,6 +2472,20 @@ void TSProcessor::processPMTSection(unsigned char* section, int sectionLength)
 				WARNING("Warning: RecordContext: pmt contains more than %d video PIDs\n", MAX_PIDS);
 			}
 			break;
+		case 0x24: // HEVC video
+			if (videoComponentCount < MAX_PIDS)
+			{
+				videoComponents[videoComponentCount].pid = pid;
+				videoComponents[videoComponentCount].elemStreamType = streamType;
+				++videoComponentCount;
+				m_isHEVC = true;
+				m_scanRemainderLimit = SCAN_REMAINDER_SIZE_HEVC;
+			}
+			else
+			{
+				WARNING("Warning: RecordContext: pmt contains more than %d video PIDs\n", MAX_PIDS);
+			}
+			break;
 		case 0x1B: // H.264 Video
 			if (videoComponentCount < MAX_PIDS)
 			{
@@ -1180,6 +2655,15 @@ void TSProcessor::processPMTSection(unsigned char* section, int sectionLength)
  */
 void TSProcessor::updatePATPMT()
 {
+	std::vector<int> key;
+	getPATPMTKey(key);
+	if (m_PatPmt && m_PatPmtTrick && m_PatPmtPcr && (key == m_patPmtKey))
+	{
+		// Stream information is unchanged. Keep the tables, including their CRCs, so that
+		// insertion only has to patch continuity counters.
+		TRACE2("PAT/PMT unchanged\n");
+		return;
+	}
 
 	if (m_PatPmt)
 	{
@@ -1201,6 +2685,54 @@ void TSProcessor::updatePATPMT()
 	generatePATandPMT(false, &m_PatPmt, &m_PatPmtLen);
 	generatePATandPMT(true, &m_PatPmtTrick, &m_PatPmtTrickLen);
 	generatePATandPMT(false, &m_PatPmtPcr, &m_PatPmtPcrLen, true);
+
+	// Generation may settle the PCR pid, so key on the state the tables were built from
+	getPATPMTKey(m_patPmtKey);
+}
+
+
+/**
+ * @brief Collect stream information PAT and PMT generation depends on
+ *
+ * @param[out] key values which change whenever the generated PAT/PMT would change
+ */
+void TSProcessor::getPATPMTKey(std::vector<int> &key)
+{
+	int audioComponentCount = this->audioComponentCount;
+	const RecordingComponent* audioComponents = this->audioComponents;
+	if ((eStreamOp_SEND_VIDEO_AND_QUEUED_AUDIO == m_streamOperation) && m_peerTSProcessor)
+	{
+		m_peerTSProcessor->getAudioComponents(&audioComponents, audioComponentCount);
+	}
+	key.clear();
+	key.push_back(m_program);
+	key.push_back(m_versionPMT);
+	key.push_back(m_pmtPid);
+	key.push_back(m_pcrPid);
+	key.push_back(videoComponentCount);
+	key.push_back(audioComponentCount);
+	key.push_back(dataComponentCount);
+	for (int i = 0; i < videoComponentCount; i++)
+	{
+		key.push_back(videoComponents[i].pid);
+		key.push_back(videoComponents[i].elemStreamType);
+	}
+	for (int i = 0; i < audioComponentCount; i++)
+	{
+		key.push_back(audioComponents[i].pid);
+		key.push_back(audioComponents[i].elemStreamType);
+		for (const char *lang = audioComponents[i].associatedLanguage; lang && *lang; lang++)
+		{
+			key.push_back(*lang);
+		}
+		key.push_back(0);
+	}
+	for (int i = 0; i < dataComponentCount; i++)
+	{
+		key.push_back(dataComponents[i].pid);
+		key.push_back(dataComponents[i].elemStreamType);
+		key.push_back((int)dataComponents[i].descriptorTags);
+	}
 }
 
 
@@ -1321,41 +2853,61 @@ void TSProcessor::sendDiscontinuity(double position)
 
 
 /**
- * @brief Get current time stamp in milliseconds
+ * @brief Get current monotonic time stamp in microseconds
  *
- * @retval Time stamp in milliseconds
+ * Throttling schedules against absolute deadlines, so a clock which does not
+ * jump with wall clock adjustments is used.
+ *
+ * @retval Time stamp in microseconds
  */
 long long TSProcessor::getCurrentTime()
 {
-	struct timeval tv;
+	struct timespec ts;
 	long long currentTime;
 
-	gettimeofday(&tv, 0);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	currentTime = (((unsigned long long)tv.tv_sec) * 1000 + ((unsigned long long)tv.tv_usec) / 1000);
+	currentTime = (((long long)ts.tv_sec) * 1000000LL + ((long long)ts.tv_nsec) / 1000LL);
 
 	return currentTime;
 }
 
 /**
- * @brief Sleep used internal by throttle logic
+ * @brief Block until an absolute deadline. Used internally by throttle logic
  *
- * @param[in] throttleDiff time in milliseconds
+ * @param[in] deadline monotonic time in microseconds, see getCurrentTime
  *
  * @retval True on abort
  */
-bool TSProcessor::msleep(long long throttleDiff)
+bool TSProcessor::waitUntil(long long deadline)
 {
 	struct timespec ts;
-	struct timeval tv;
 	bool aborted = false;
-	gettimeofday(&tv, NULL);
-	ts.tv_sec = time(NULL) + throttleDiff / 1000;
-	ts.tv_nsec = (long)(tv.tv_usec * 1000 + 1000 * 1000 * (throttleDiff % 1000));
-	ts.tv_sec += ts.tv_nsec / (1000 * 1000 * 1000);
-	ts.tv_nsec %= (1000 * 1000 * 1000);
+#ifndef __APPLE__
+	ts.tv_sec = (time_t)(deadline / 1000000LL);
+	ts.tv_nsec = (long)((deadline % 1000000LL) * 1000LL);
+#endif
 	pthread_mutex_lock(&m_mutex);
-	pthread_cond_timedwait(&m_throttleCond, &m_mutex, &ts);
+	while (m_enabled)
+	{
+#ifdef __APPLE__
+		// m_throttleCond uses realtime clock; wait for remaining monotonic time from now
+		long long remaining = deadline - getCurrentTime();
+		if (remaining <= 0)
+		{
+			break;
+		}
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		long long realDeadline = ((long long)tv.tv_sec) * 1000000LL + tv.tv_usec + remaining;
+		ts.tv_sec = (time_t)(realDeadline / 1000000LL);
+		ts.tv_nsec = (long)((realDeadline % 1000000LL) * 1000LL);
+#endif
+		if (ETIMEDOUT == pthread_cond_timedwait(&m_throttleCond, &m_mutex, &ts))
+		{
+			break;
+		}
+	}
 	if (!m_enabled)
 	{
 		aborted = true;
@@ -1364,10 +2916,76 @@ bool TSProcessor::msleep(long long throttleDiff)
 	return aborted;
 }
 
+/**
+ * @brief Sleep used internal by throttle logic
+ *
+ * @param[in] throttleDiff time in milliseconds
+ *
+ * @retval True on abort
+ */
+bool TSProcessor::msleep(long long throttleDiff)
+{
+	return waitUntil(getCurrentTime() + throttleDiff * 1000LL);
+}
+
+/**
+ * @brief Account deviation of actual emission time from its scheduled deadline
+ *
+ * Deviation also adapts m_pacingLead, the time throttle wakes ahead of a deadline,
+ * so that wake up latency of the platform is compensated on following frames.
+ *
+ * @param[in] deadline scheduled emission time in microseconds
+ */
+void TSProcessor::updatePacingJitter(long long deadline)
+{
+	long long jitter = getCurrentTime() - deadline;
+	m_pacingLead += jitter / 8;
+	if (m_pacingLead < 0)
+	{
+		m_pacingLead = 0;
+	}
+	else if (m_pacingLead > PACING_MAX_LEAD_US)
+	{
+		m_pacingLead = PACING_MAX_LEAD_US;
+	}
+	if (jitter < 0)
+	{
+		jitter = -jitter;
+	}
+	m_pacingJitterSum += jitter;
+	if (jitter > m_pacingJitterMax)
+	{
+		m_pacingJitterMax = jitter;
+	}
+	if (++m_pacingJitterCount >= PACING_JITTER_REPORT_INTERVAL)
+	{
+		reportPacingJitter();
+	}
+}
+
+/**
+ * @brief Log emitted vs scheduled jitter accumulated since last report and reset it
+ */
+void TSProcessor::reportPacingJitter()
+{
+	if (m_pacingJitterCount)
+	{
+		NOTICE("TSProcessor[%p] track %d rate %f pacing jitter over %d frames avg %lld us max %lld us lead %lld us\n",
+				this, m_track, m_playRate, m_pacingJitterCount, m_pacingJitterSum / m_pacingJitterCount, m_pacingJitterMax, m_pacingLead);
+	}
+	m_pacingJitterSum = 0;
+	m_pacingJitterMax = 0;
+	m_pacingJitterCount = 0;
+}
+
 
 /**
  * @brief Blocks based on PTS. Can be used for pacing injection.
  *
+ * Each frame is released at an absolute deadline derived from its (rate adjusted)
+ * PTS on the throttle time base, so oversleeping one frame is absorbed by the next
+ * one instead of accumulating as drift.
+ *
  * @retval True if aborted
  */
 bool TSProcessor::throttle()
@@ -1382,10 +3000,12 @@ bool TSProcessor::throttle()
 		if (contentTime != -1LL)
 		{
 			long long now, contentTimeDiff, realTimeDiff;
+			long long maxDiff = m_throttleMaxDiffSegments * 1000LL;
+			long long discontinuityDiff = m_throttleDelayForDiscontinuityMs * 1000LL;
 			TRACE2("contentTime %lld (%lld ms) m_playRate %f\n", contentTime, contentTime / 90, m_playRate);
 
-			// Convert from 90KHz milliseconds
-			contentTime = (contentTime / 90LL);
+			// Convert from 90KHz to microseconds
+			contentTime = ((contentTime * 100LL) / 9LL);
 
 			now = getCurrentTime();
 			if (m_haveThrottleBase)
@@ -1395,47 +3015,42 @@ bool TSProcessor::throttle()
 				{
 					contentTimeDiff = contentTime - m_lastThrottleContentTime;
 					realTimeDiff = now - m_lastThrottleRealTime;
-					if (((contentTimeDiff > 0) && (contentTimeDiff < m_throttleMaxDiffSegments)) && ((realTimeDiff > 0) && (realTimeDiff < m_throttleMaxDiffSegments)))
+					if (((contentTimeDiff > 0) && (contentTimeDiff < maxDiff)) && ((realTimeDiff > 0) && (realTimeDiff < maxDiff)))
 					{
-						contentTimeDiff = contentTime - m_baseThrottleContentTime;
-						realTimeDiff = now - m_baseThrottleRealTime;
-						if ((realTimeDiff > 0) && (realTimeDiff < contentTimeDiff))
+						long long deadline = m_baseThrottleRealTime + (contentTime - m_baseThrottleContentTime) - m_throttleDelayIgnoredMs * 1000LL;
+						if (deadline > now)
 						{
-							long long throttleDiff = (contentTimeDiff - realTimeDiff - m_throttleDelayIgnoredMs);
-							if (throttleDiff > 0)
+							if ((deadline - now) > m_throttleMaxDelayMs * 1000LL)
 							{
-								if (throttleDiff > m_throttleMaxDelayMs)
-								{
-									// Don't delay more than 500 ms in any given request
-									TRACE2("TSProcessor::fillBuffer: throttle: cap %lld to %d ms\n", throttleDiff, m_throttleMaxDelayMs);
-									throttleDiff = m_throttleMaxDelayMs;
-								}
-								else
-								{
-									TRACE2("TSProcessor::fillBuffer: throttle: sleep %lld ms\n", throttleDiff);
-								}
-								aborted = msleep(throttleDiff);
+								// Don't delay more than 500 ms in any given request
+								TRACE2("TSProcessor::fillBuffer: throttle: cap %lld us to %d ms\n", deadline - now, m_throttleMaxDelayMs);
+								deadline = now + m_throttleMaxDelayMs * 1000LL;
 							}
 							else
 							{
-								INFO("throttleDiff negative? %lld\n", throttleDiff);
+								TRACE2("TSProcessor::fillBuffer: throttle: sleep %lld us\n", deadline - now);
+							}
+							aborted = waitUntil(deadline - m_pacingLead);
+							if (!aborted)
+							{
+								updatePacingJitter(deadline);
 							}
 						}
 						else
 						{
-							TRACE2("realTimeDiff %lld\n", realTimeDiff);
+							TRACE2("behind schedule by %lld us\n", now - deadline);
 						}
 					}
-					else if ((contentTimeDiff < -m_throttleDelayForDiscontinuityMs) || (contentTimeDiff > m_throttleDelayForDiscontinuityMs))
+					else if ((contentTimeDiff < -discontinuityDiff) || (contentTimeDiff > discontinuityDiff))
 					{
 						// There has been some timing irregularity such as a PTS discontinuity.
 						// Establish a new throttling time base.
 						m_haveThrottleBase = false;
-						INFO(" contentTimeDiff( %lld) greater than threshold (%d) - probable pts discontinuity\n", contentTimeDiff, m_throttleDelayForDiscontinuityMs);
+						INFO(" contentTimeDiff( %lld us) greater than threshold (%d ms) - probable pts discontinuity\n", contentTimeDiff, m_throttleDelayForDiscontinuityMs);
 					}
 					else
 					{
-						INFO(" Out of throttle window - contentTimeDiff %lld realTimeDiff  %lld\n", contentTimeDiff, realTimeDiff);
+						INFO(" Out of throttle window - contentTimeDiff %lld us realTimeDiff  %lld us\n", contentTimeDiff, realTimeDiff);
 					}
 				}
 				else
@@ -1459,18 +3074,35 @@ bool TSProcessor::throttle()
 		}
 		else if (m_demux && (1.0 != m_playRate))
 		{
-			if (m_last_frame_time)
+			long long frameInterval = (long long)(1000000 / m_apparentFrameRate);
+			long long now = getCurrentTime();
+			if (m_nextFrameDeadline)
 			{
-				long long now = getCurrentTime();
-				long long nextFrameTime = m_last_frame_time + 1000 / m_apparentFrameRate;
-				if (nextFrameTime > now)
+				if (now - m_nextFrameDeadline > frameInterval)
+				{
+					// Fell behind by more than a frame, e.g. on a slow fragment download.
+					// Re-anchor instead of bursting frames out to catch up.
+					INFO("Behind schedule by %lld us, re-anchor\n", now - m_nextFrameDeadline);
+					m_nextFrameDeadline = now;
+				}
+				else
 				{
-					long long throttleDiff = nextFrameTime - now;
-					INFO("Wait %llu ms \n", throttleDiff);
-					aborted = msleep(throttleDiff);
+					if (m_nextFrameDeadline - m_pacingLead > now)
+					{
+						TRACE2("Wait %lld us\n", m_nextFrameDeadline - m_pacingLead - now);
+						aborted = waitUntil(m_nextFrameDeadline - m_pacingLead);
+					}
+					if (!aborted)
+					{
+						updatePacingJitter(m_nextFrameDeadline);
+					}
 				}
+				m_nextFrameDeadline += frameInterval;
+			}
+			else
+			{
+				m_nextFrameDeadline = now + frameInterval;
 			}
-			m_last_frame_time = getCurrentTime();
 		}
 		else
 		{
@@ -1528,15 +3160,35 @@ bool TSProcessor::processBuffer(unsigned char *buffer, int size, bool &insPatPmt
 	// For the moment, insist on buffers being TS packet aligned
 	if (!((packet[0] == 0x47) && ((size%m_packetSize) == 0)))
 	{
-		FATAL("Error: data buffer not TS packet aligned\n");
+		FATAL("Error: data buffer not TS packet aligned, discarding\n");
 		logprintf("packet=%p size=%d m_packetSize=%d\n", packet, size, m_packetSize);
 		dumpPacket(packet, m_packetSize);
-		assert(false);
+		return false;
 	}
 
+	bool syncLossReported = false;
 	bufferEnd = packet + size - m_ttsSize;
 	while (packet < bufferEnd)
 	{
+		/*At normal rate, only PAT and PMT packets need processing once throttle is done
+		  and, when queued audio is inserted, once the first video PTS is found*/
+		if (!doThrottle && !m_checkContinuity && (m_playRate == 1.0)
+			&& ((eStreamOp_SEND_VIDEO_AND_QUEUED_AUDIO != m_streamOperation) || (-1 != m_packetStartAfterFirstPTS)))
+		{
+			const int pids[TS_PID_SET_SIZE] = { 0, m_pmtPid };
+			int skip = skipPacketsNotInPidSet(packet, (int)((bufferEnd - packet) / m_packetSize), m_packetSize, pids);
+			packet += skip * m_packetSize;
+			packetCount += skip;
+			if (packet >= bufferEnd)
+			{
+				break;
+			}
+		}
+		if ((packet[0] != 0x47) && !syncLossReported)
+		{
+			WARNING("TS sync lost at packet %d offset %d\n", packetCount, packetCount * m_packetSize);
+			syncLossReported = true;
+		}
 		pid = (((packet[1] << 8) | packet[2]) & 0x1FFF);
 		TRACE4("pid = %d, m_ttsSize %d\n", pid, m_ttsSize);
 
@@ -2064,31 +3716,308 @@ bool TSProcessor::demuxAndSend(const void *ptr, size_t len, double position, dou
 				}
 				else if (m_vidDemuxer && (m_vidDemuxer!= demuxer) && (eStreamOp_DEMUX_VIDEO != m_streamOperation))
 				{
-					WARNING("Using first audio pts as base pts\n");
-					m_vidDemuxer->setBasePTS(demuxer->getBasePTS(), true);
+					WARNING("Using first audio pts as base pts\n");
+					m_vidDemuxer->setBasePTS(demuxer->getBasePTS(), true);
+				}
+				if(m_peerTSProcessor)
+				{
+					m_peerTSProcessor->setBasePTS( position, demuxer->getBasePTS());
+				}
+				notifyPeerBasePTS = false;
+			}
+			if (ptsError)
+			{
+				WARNING("PTS error, discarding segment\n");
+				ret = false;
+				break;
+			}
+		}
+		else
+		{
+			INFO("demuxAndSend : discarded packet with pid %d\n", pid);
+		}
+
+		packetStart += PACKET_SIZE;
+		len -= PACKET_SIZE;
+	}
+	if (videoPid != -1)
+	{
+		m_vidDemuxer->endSegment();
+	}
+	if (audioPid != -1)
+	{
+		m_audDemuxer->endSegment();
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Remux demuxed track to fragmented MP4
+ *
+ * @param[in] track  MediaType of demuxed track
+ * @param[in] format StreamOutputFormat of the track
+ *
+ * @retval true if remux is enabled, false if track is not demuxed or format is not supported
+ */
+bool TSProcessor::enableRemux(int track, int format)
+{
+	bool ret = false;
+	Demuxer *demuxer = (eMEDIATYPE_VIDEO == track) ? m_vidDemuxer : m_audDemuxer;
+	if (demuxer)
+	{
+		ret = demuxer->enableRemux((StreamOutputFormat)format);
+	}
+	NOTICE("TSProcessor[%p] remux track %d format %d : %s\n", this, track, format, ret ? "enabled" : "not supported");
+	return ret;
+}
+
+
+/**
+ * @brief Check if PES payload contains start of a key frame
+ *
+ * @param[in] data        PES payload
+ * @param[in] len         Length of payload
+ * @param[in] from        Offset to start the search from
+ * @param[in] streamType  Video stream type from PMT
+ *
+ * @retval true if IDR (H.264), IRAP (HEVC) or I picture (MPEG2) is present
+ */
+static bool containsKeyFrame(const unsigned char *data, int len, int from, int streamType)
+{
+	if (len < 6)
+	{
+		return false;
+	}
+	const unsigned char *last = data + len - 3;
+	const unsigned char *p = findStartCode(data + from, last);
+	while (p < last)
+	{
+		if (0x1B == streamType)
+		{
+			if ((p[3] & 0x1F) == 5)
+			{
+				return true;
+			}
+		}
+		else if (0x24 == streamType)
+		{
+			int nalType = (p[3] >> 1) & 0x3F;
+			if ((nalType >= 16) && (nalType <= 23))
+			{
+				return true;
+			}
+		}
+		else if ((p[3] == 0x00) && (p + 5 < data + len))
+		{
+			// picture_coding_type
+			if (((p[5] >> 3) & 0x07) == 1)
+			{
+				return true;
+			}
+		}
+		p = findStartCode(p + 3, last);
+	}
+	return false;
+}
+
+
+/**
+ * @brief Locate first key frame of a TS segment
+ *
+ * @param[in]  buffer       Buffer containing TS segment
+ * @param[in]  size         Size of buffer
+ * @param[out] rangeStart   Byte offset of range containing key frame
+ * @param[out] rangeLength  Length of range containing key frame
+ *
+ * @retval true if key frame is found
+ */
+bool TSProcessor::getIframeRange(const unsigned char *buffer, size_t size, size_t &rangeStart, size_t &rangeLength)
+{
+	std::vector<std::pair<size_t, size_t>> ranges;
+	if (!getIframeRanges(buffer, size, ranges, 1))
+	{
+		return false;
+	}
+	rangeStart = ranges[0].first;
+	rangeLength = ranges[0].second;
+	return true;
+}
+
+
+/**
+ * @brief Locate key frames of a TS segment
+ *
+ * Each range starts at the PAT/PMT just ahead of the key frame when present, so that
+ * it can be processed without rest of the segment, and ends before next video PES.
+ *
+ * @param[in]  buffer     Buffer containing TS segment
+ * @param[in]  size       Size of buffer
+ * @param[out] ranges     Byte offset and length of each range containing a key frame, in stream order
+ * @param[in]  maxRanges  Stop after this many key frames, 0 for no limit
+ *
+ * @retval true if at least one key frame is found
+ */
+bool TSProcessor::getIframeRanges(const unsigned char *buffer, size_t size, std::vector<std::pair<size_t, size_t>> &ranges, size_t maxRanges)
+{
+	int pmtPid = -1;
+	int videoPid = -1;
+	int videoStreamType = 0;
+	long long patOffset = -1;
+	long long pesStart = -1;
+	long long keyFrameStart = -1;
+	size_t prevRangeEnd = 0;
+	unsigned char pesData[IFRAME_INDEX_SCAN_SIZE];
+	int pesDataLen = 0;
+	size_t offset;
+
+	ranges.clear();
+	for (offset = 0; offset + PACKET_SIZE <= size; offset += PACKET_SIZE)
+	{
+		const unsigned char *packet = buffer + offset;
+		if (packet[0] != 0x47)
+		{
+			WARNING("TS sync lost at offset %d\n", (int)offset);
+			keyFrameStart = -1;
+			break;
+		}
+		int pid = (((packet[1] << 8) | packet[2]) & 0x1FFF);
+		int payloadOffset = 4;
+		if (ADAPTATION_FIELD_PRESENT(packet))
+		{
+			payloadOffset += 1 + packet[4];
+		}
+		if (!CONTAINS_PAYLOAD(packet) || (payloadOffset >= PACKET_SIZE))
+		{
+			continue;
+		}
+		const unsigned char *payload = packet + payloadOffset;
+		int payloadLen = PACKET_SIZE - payloadOffset;
+
+		if ((0 == pid) || ((pid == pmtPid) && (-1 == videoPid)))
+		{
+			if (!PAYLOAD_UNIT_START(packet) || (1 + payload[0] + 12 > payloadLen))
+			{
+				continue;
+			}
+			const unsigned char *section = payload + 1 + payload[0];
+			int sectionLength = ((section[1] & 0x0F) << 8) | section[2];
+			const unsigned char *sectionEnd = section + 3 + sectionLength - 4;
+			if (sectionEnd > packet + PACKET_SIZE)
+			{
+				continue;
+			}
+			if (0 == pid)
+			{
+				patOffset = offset;
+				for (const unsigned char *program = section + 8; (-1 == pmtPid) && (program + 4 <= sectionEnd); program += 4)
+				{
+					if ((program[0] << 8) | program[1])
+					{
+						pmtPid = ((program[2] & 0x1F) << 8) | program[3];
+					}
+				}
+			}
+			else if (0x02 == section[0])
+			{
+				int programInfoLength = ((section[10] & 0x0F) << 8) | section[11];
+				const unsigned char *stream = section + 12 + programInfoLength;
+				while (stream + 5 <= sectionEnd)
+				{
+					int streamType = stream[0];
+					// 0x80 is user private (e.g. ATSC), its coding is not known
+					if ((0x1B == streamType) || (0x24 == streamType) || (0x02 == streamType))
+					{
+						videoPid = ((stream[1] & 0x1F) << 8) | stream[2];
+						videoStreamType = streamType;
+						break;
+					}
+					stream += 5 + (((stream[3] & 0x0F) << 8) | stream[4]);
+				}
+			}
+		}
+		else if (pid == videoPid)
+		{
+			if (PAYLOAD_UNIT_START(packet))
+			{
+				if (-1 != keyFrameStart)
+				{
+					ranges.push_back(std::pair<size_t, size_t>((size_t)keyFrameStart, offset - (size_t)keyFrameStart));
+					prevRangeEnd = offset;
+					keyFrameStart = -1;
+					if (maxRanges && (ranges.size() >= maxRanges))
+					{
+						break;
+					}
 				}
-				if(m_peerTSProcessor)
+				pesStart = -1;
+				pesDataLen = 0;
+				if (IS_PES_PACKET_START(payload) && (payloadLen > 9) && (9 + payload[8] < payloadLen))
 				{
-					m_peerTSProcessor->setBasePTS( position, demuxer->getBasePTS());
+					int pesHeaderLen = 9 + payload[8];
+					pesStart = offset;
+					payload += pesHeaderLen;
+					payloadLen -= pesHeaderLen;
 				}
-				notifyPeerBasePTS = false;
 			}
-			if (ptsError)
+			if ((-1 != pesStart) && (-1 == keyFrameStart) && (pesDataLen < IFRAME_INDEX_SCAN_SIZE))
 			{
-				WARNING("PTS error, discarding segment\n");
-				ret = false;
-				break;
+				int copyLen = std::min(payloadLen, IFRAME_INDEX_SCAN_SIZE - pesDataLen);
+				int from = std::max(0, pesDataLen - 5);
+				memcpy(&pesData[pesDataLen], payload, copyLen);
+				pesDataLen += copyLen;
+				if (containsKeyFrame(pesData, pesDataLen, from, videoStreamType))
+				{
+					bool patNearby = (-1 != patOffset) && (patOffset >= (long long)prevRangeEnd)
+						&& (pesStart - patOffset <= IFRAME_INDEX_MAX_PSI_GAP * PACKET_SIZE);
+					keyFrameStart = patNearby ? patOffset : pesStart;
+				}
 			}
 		}
-		else
-		{
-			INFO("demuxAndSend : discarded packet with pid %d\n", pid);
-		}
+	}
+	if (-1 != keyFrameStart)
+	{
+		// Key frame runs till end of segment
+		ranges.push_back(std::pair<size_t, size_t>((size_t)keyFrameStart, offset - (size_t)keyFrameStart));
+	}
+	return !ranges.empty();
+}
 
-		packetStart += PACKET_SIZE;
-		len -= PACKET_SIZE;
+
+/**
+ * @brief Collect key frames of a segment in reverse order for PlayMode_reverse_GOP
+ *
+ * Only the key frame of each GOP can be presented without decoding rest of the GOP,
+ * so last key frame of the segment is placed first. I-frame only re-timestamping then
+ * keeps PTS increasing, with spacing of content time between key frames divided by rate.
+ *
+ * @param[in] buffer  Segment, starting with a TS packet
+ * @param[in] size    Size of segment, multiple of TS packet size
+ *
+ * @retval true if m_reverseGOPBuffer is filled, false to process segment as is
+ */
+bool TSProcessor::reverseKeyFrames(const unsigned char *buffer, int size)
+{
+	std::vector<std::pair<size_t, size_t>> ranges;
+	if (!getIframeRanges(buffer, size, ranges))
+	{
+		WARNING("no key frame found in segment of %d bytes\n", size);
+		return false;
 	}
-	return ret;
+	size_t total = 0;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		total += ranges[i].second;
+	}
+	m_reverseGOPBuffer.resize(total);
+	unsigned char *dst = &m_reverseGOPBuffer[0];
+	for (size_t i = ranges.size(); i > 0; i--)
+	{
+		memcpy(dst, buffer + ranges[i - 1].first, ranges[i - 1].second);
+		dst += ranges[i - 1].second;
+	}
+	TRACE1("reversed %d key frames, %d of %d bytes\n", (int)ranges.size(), (int)total, size);
+	return true;
 }
 
 /**
@@ -2109,6 +4038,14 @@ void TSProcessor::reset()
 		logprintf("TSProcessor[%p]%s:%d - reset audio demux %p\n", this, __FUNCTION__, __LINE__, m_audDemuxer);
 		m_audDemuxer->reset();
 	}
+	if (m_vidSendQueue)
+	{
+		m_vidSendQueue->resume();
+	}
+	if (m_audSendQueue)
+	{
+		m_audSendQueue->resume();
+	}
 	m_enabled = true;
 	m_demuxInitialized = false;
 	m_basePTSFromPeer = -1;
@@ -2138,6 +4075,25 @@ void TSProcessor::flush()
 		m_audDemuxer->flush();
 	}
 	pthread_mutex_unlock(&m_mutex);
+	drain();
+}
+
+
+/**
+ * @brief Wait till demuxed frames queued for sending are injected to sink
+ *
+ * @note Relevant only when demux pipeline is enabled
+ */
+void TSProcessor::drain()
+{
+	if (m_vidSendQueue)
+	{
+		m_vidSendQueue->drain();
+	}
+	if (m_audSendQueue)
+	{
+		m_audSendQueue->drain();
+	}
 }
 
 
@@ -2236,10 +4192,11 @@ bool TSProcessor::sendSegment(char *segment, size_t& size, double position, doub
 		return false;
 	}
 	m_processing = true;
-	if ((m_playModeNext != m_playMode) || (m_playRateNext != m_playRate))
+	if ((m_playModeNext != m_playMode) || (m_playRateNext != m_playRate) || (m_reverseGOPNext != m_reverseGOP))
 	{
 		TRACE1("change play mode");
 		m_playMode = m_playModeNext;
+		m_reverseGOP = m_reverseGOPNext;
 
 		m_playRate = m_playRateNext;
 		m_absPlayRate = fabs(m_playRate);
@@ -2273,6 +4230,11 @@ bool TSProcessor::sendSegment(char *segment, size_t& size, double position, doub
 		INFO("Discarding %d bytes at end\n", discardAtEnd);
 		len = len - discardAtEnd;
 	}
+	if (m_reverseGOP && !m_ttsSize && reverseKeyFrames(packetStart, len))
+	{
+		packetStart = &m_reverseGOPBuffer[0];
+		len = m_reverseGOPBuffer.size();
+	}
 	ret = processBuffer((unsigned char*)packetStart, len, insPatPmt);
 	if (ret)
 	{
@@ -2355,8 +4317,8 @@ bool TSProcessor::sendSegment(char *segment, size_t& size, double position, doub
 			else
 			{
 				ERROR("m_packetStartAfterFirstPTS Not updated\n");
-				aamp->SendStream((MediaType)m_track, packetStart + m_packetStartAfterFirstPTS,
-				len - m_packetStartAfterFirstPTS, position, position, duration);
+				aamp->SendStream((MediaType)m_track, packetStart, len, position, position, duration);
+				m_peerTSProcessor->sendQueuedSegment();
 			}
 		}
 		else if (eStreamOp_QUEUE_AUDIO == m_streamOperation)
@@ -2650,6 +4612,10 @@ bool TSProcessor::processStartCode(unsigned char *buffer, bool& keepScanning, in
 			break;
 		}
 	}
+	else if (m_isHEVC)
+	{
+		processHEVCStartCode(buffer, keepScanning, length, base);
+	}
 	else
 	{
 		switch (buffer[INDEX(3)])
@@ -2680,6 +4646,184 @@ bool TSProcessor::processStartCode(unsigned char *buffer, bool& keepScanning, in
 	return result;
 }
 
+/**
+ * @brief Processes HEVC start code. Counterpart of processStartCode for stream type 0x24
+ *
+ * @param[in] buffer        Buffer containing start code
+ * @param[in] keepScanning  True to keep on scanning
+ * @param[in] length        Size of the buffer
+ * @param[in] base          Offset of buffer in the TS packet
+ */
+void TSProcessor::processHEVCStartCode(unsigned char *buffer, bool& keepScanning, int length, int base)
+{
+	int unitType = ((buffer[INDEX(3)] >> 1) & 0x3F);
+	switch (unitType)
+	{
+	case 0:  // TRAIL_N
+	case 1:  // TRAIL_R
+	case 2:  // TSA_N
+	case 3:  // TSA_R
+	case 4:  // STSA_N
+	case 5:  // STSA_R
+	case 6:  // RADL_N
+	case 7:  // RADL_R
+	case 8:  // RASL_N
+	case 9:  // RASL_R
+	case 16: // BLA_W_LP
+	case 17: // BLA_W_RADL
+	case 18: // BLA_N_LP
+	case 19: // IDR_W_RADL
+	case 20: // IDR_N_LP
+	case 21: // CRA_NUT
+		if (m_isInterlacedKnown && (m_playMode == PlayMode_retimestamp_Ionly) && m_updatePicOrderCount)
+		{
+			int mask = 0x80;
+			unsigned char *p = &buffer[INDEX(5)];
+			// first_slice_segment_in_pic_flag is set only on the first slice segment of a picture,
+			// which is the one carrying slice_pic_order_cnt_lsb for the whole picture
+			if (getBits(p, mask, 1))
+			{
+				bool irap = (unitType >= 16);
+				if (irap)
+				{
+					// no_output_of_prior_pics_flag
+					getBits(p, mask, 1);
+				}
+				unsigned int ppsId = getUExpGolomb(p, mask);
+				HEVCPPS *pPPS = ((ppsId < 64) ? &m_hevcPPS[ppsId] : NULL);
+				if (pPPS && pPPS->valid && m_hevcSPS[pPPS->spsId].valid)
+				{
+					HEVCSPS *pSPS = &m_hevcSPS[pPPS->spsId];
+					// dependent_slice_segment_flag and slice_segment_address are absent for first slice segment
+					getBits(p, mask, pPPS->numExtraSliceHeaderBits);
+					// slice_type
+					getUExpGolomb(p, mask);
+					if (pPPS->outputFlagPresentFlag)
+					{
+						// pic_output_flag
+						getBits(p, mask, 1);
+					}
+					if (pSPS->separateColourPlaneFlag)
+					{
+						// colour_plane_id
+						getBits(p, mask, 2);
+					}
+					if ((unitType != 19) && (unitType != 20))
+					{
+						// IDR pictures have implicit POC 0. For the rest replace slice_pic_order_cnt_lsb with
+						// sequentially incrementing values so that output order follows injection order.
+						int pocBits = pSPS->log2MaxPicOrderCntLsbMinus4 + 4;
+						putBits(p, mask, pocBits, m_picOrderCount);
+						m_picOrderCount = m_picOrderCount + 1;
+						if (m_picOrderCount == (1 << pocBits))
+						{
+							m_picOrderCount = 0;
+						}
+					}
+					m_updatePicOrderCount = false;
+					m_scanForFrameSize = false;
+				}
+			}
+		}
+		break;
+	case 32: // Video parameter set
+		// Nothing in the VPS is needed for re-stamping, SPS/PPS follow it
+		break;
+	case 33: // Sequence parameter set
+		if (unescapeHEVCNAL(buffer, length, base))
+		{
+			processHEVCSeqParameterSet(m_emulationPrevention, m_emulationPreventionOffset);
+			if ((m_playMode != PlayMode_retimestamp_Ionly) || !m_updatePicOrderCount)
+			{
+				// For IOnly we need to keep scanning in order to update
+				// slice_pic_order_cnt_lsb values
+				m_scanForFrameSize = false;
+				keepScanning = false;
+			}
+		}
+		m_emulationPreventionOffset = 0;
+		break;
+	case 34: // Picture parameter set
+		if (unescapeHEVCNAL(buffer, length, base))
+		{
+			processHEVCPictureParameterSet(m_emulationPrevention, m_emulationPreventionOffset);
+		}
+		m_emulationPreventionOffset = 0;
+		break;
+	case 35: // Access unit delimiter
+	case 36: // End of sequence
+	case 37: // End of bitstream
+	case 38: // Filler data
+	case 39: // Prefix SEI
+	case 40: // Suffix SEI
+	default:
+		break;
+	}
+}
+
+
+/**
+ * @brief Copy HEVC NAL unit payload into m_emulationPrevention without emulation prevention bytes
+ *
+ * The copy is followed by padding so that parsing a truncated or corrupt parameter set cannot
+ * run past the buffer.
+ *
+ * @param[in] buffer  Buffer containing start code
+ * @param[in] length  Size of the buffer
+ * @param[in] base    Offset of buffer in the TS packet
+ *
+ * @retval true if the end of NAL unit was found within length
+ */
+bool TSProcessor::unescapeHEVCNAL(unsigned char *buffer, int length, int base)
+{
+	bool complete = false;
+	const int padding = 8;
+
+	m_emulationPreventionOffset = 0;
+	if (!m_emulationPrevention || (m_emulationPreventionCapacity < (length + padding)))
+	{
+		int newSize = m_emulationPreventionCapacity * 2 + length + padding;
+		unsigned char *newBuff = (unsigned char *)malloc(newSize*sizeof(char));
+		if (!newBuff)
+		{
+			ERROR("Error: unable to allocate emulation prevention buffer\n");
+			return false;
+		}
+		if (m_emulationPrevention)
+		{
+			free(m_emulationPrevention);
+		}
+		m_emulationPreventionCapacity = newSize;
+		m_emulationPrevention = newBuff;
+	}
+	// Payload follows 3 byte start code and 2 byte NAL unit header. Zero bytes are counted
+	// rather than matched pairwise so that back to back escapes (00 00 03 00 00 03) are handled.
+	int zeroCount = 0;
+	for (int i = 5; i < length - 1; ++i)
+	{
+		unsigned char byte = buffer[INDEX(i)];
+		if (zeroCount >= 2)
+		{
+			if (byte == 0x01)
+			{
+				// Next start code, drop its leading zeros
+				m_emulationPreventionOffset -= zeroCount;
+				complete = true;
+				break;
+			}
+			else if (byte == 0x03)
+			{
+				zeroCount = 0;
+				continue;
+			}
+		}
+		zeroCount = ((byte == 0x00) ? (zeroCount + 1) : 0);
+		m_emulationPrevention[m_emulationPreventionOffset++] = byte;
+	}
+	memset(&m_emulationPrevention[m_emulationPreventionOffset], 0xFF, padding);
+	return complete;
+}
+
 
 /**
  * @brief Updates state variables depending on interlaced
@@ -2795,14 +4939,16 @@ void TSProcessor::checkIfInterlaced(unsigned char *packet, int length)
 
 						for (j = payload; j < jmax; ++j)
 						{
-							if ((packet[j] == 0x00) && (packet[j + 1] == 0x00) && (packet[j + 2] == 0x01))
+							j = findStartCode(&packet[j], &packet[jmax]) - packet;
+							if (j >= jmax)
 							{
-								processStartCode(&packet[j], m_scanForFrameSize, jmax - j, j);
+								break;
+							}
+							processStartCode(&packet[j], m_scanForFrameSize, jmax - j, j);
 
-								if (!m_scanForFrameSize || m_isInterlacedKnown)
-								{
-									break;
-								}
+							if (!m_scanForFrameSize || m_isInterlacedKnown)
+							{
+								break;
 							}
 						}
 
@@ -2841,7 +4987,7 @@ void TSProcessor::reTimestamp(unsigned char *&packet, int length)
 	unsigned char *pidFilter;
 	unsigned char* packetEnd = packet + length;
 
-	if (m_isH264 && !m_isInterlacedKnown)
+	if ((m_isH264 || m_isHEVC) && !m_isInterlacedKnown)
 	{
 		checkIfInterlaced(packet, length);
 		TRACE1("m_isH264 = %s m_isInterlacedKnown = %s m_isInterlaced %s\n", m_isH264 ? "true" : "false",
@@ -2850,7 +4996,7 @@ void TSProcessor::reTimestamp(unsigned char *&packet, int length)
 
 	// For MPEG2 use twice the desired frame rate for IOnly re-timestamping since
 	// we insert a null P-frame after every I-frame.
-	float rm = ((m_isH264 && !m_isInterlaced) ? 1.0 : 2.0);
+	float rm = (((m_isH264 || m_isHEVC) && !m_isInterlaced) ? 1.0 : 2.0);
 
 	if (!m_haveBaseTime) m_basePCR = -1LL;
 
@@ -2953,7 +5099,7 @@ void TSProcessor::reTimestamp(unsigned char *&packet, int length)
 							  if (m_playMode == PlayMode_retimestamp_Ionly)
 							  {
 								  m_scanForFrameSize = true;
-								  if (m_isH264)
+								  if (m_isH264 || m_isHEVC)
 								  {
 									  m_updatePicOrderCount = true;
 								  }
@@ -3145,14 +5291,16 @@ void TSProcessor::reTimestamp(unsigned char *&packet, int length)
 
 					  for (j = payload; j < jmax; ++j)
 					  {
-						  if ((packet[j] == 0x00) && (packet[j + 1] == 0x00) && (packet[j + 2] == 0x01))
+						  j = findStartCode(&packet[j], &packet[jmax]) - packet;
+						  if (j >= jmax)
 						  {
-							  processStartCode(&packet[j], m_scanForFrameSize, jmax - j, j);
+							  break;
+						  }
+						  processStartCode(&packet[j], m_scanForFrameSize, jmax - j, j);
 
-							  if (!m_scanForFrameSize)
-							  {
-								  break;
-							  }
+						  if (!m_scanForFrameSize)
+						  {
+							  break;
 						  }
 					  }
 
@@ -3206,7 +5354,17 @@ void TSProcessor::setPlayMode(PlayMode mode)
 		(mode == PlayMode_retimestamp_IandP) ? "PlayMode_retimestamp_IandP" :
 		(mode == PlayMode_retimestamp_Ionly) ? "PlayMode_retimestamp_Ionly" :
 		"PlayMode_reverse_GOP");
-	m_playModeNext = mode;
+	if (mode == PlayMode_reverse_GOP)
+	{
+		// Key frames are re-timestamped as in I-frame only mode, after being put in reverse order
+		m_reverseGOPNext = true;
+		m_playModeNext = PlayMode_retimestamp_Ionly;
+	}
+	else
+	{
+		m_reverseGOPNext = false;
+		m_playModeNext = mode;
+	}
 }
 
 
@@ -3219,6 +5377,14 @@ void TSProcessor::abortUnlocked()
 {
 	m_enabled = false;
 	pthread_cond_signal(&m_basePTSCond);
+	if (m_vidSendQueue)
+	{
+		m_vidSendQueue->abort();
+	}
+	if (m_audSendQueue)
+	{
+		m_audSendQueue->abort();
+	}
 	while (m_processing)
 	{
 		pthread_cond_signal(&m_throttleCond);
@@ -3257,8 +5423,17 @@ void TSProcessor::setRate(double rate, PlayMode mode)
 	INFO("set playback rate to %f\n", m_playRateNext);
 	setPlayMode(mode);
 	m_enabled = true;
+	if (m_vidSendQueue)
+	{
+		m_vidSendQueue->resume();
+	}
+	if (m_audSendQueue)
+	{
+		m_audSendQueue->resume();
+	}
 	m_startPosition = -1.0;
-	m_last_frame_time = 0;
+	reportPacingJitter();
+	m_nextFrameDeadline = 0;
 	pthread_mutex_unlock(&m_mutex);
 }
 
@@ -3322,7 +5497,8 @@ bool TSProcessor::generatePATandPMT(bool trick, unsigned char **buff, int *bufle
 	if (videoComponentCount > 0)
 	{
 		m_isH264 = (videoComponents[0].elemStreamType == 0x1B);
-		m_scanRemainderLimit = (m_isH264 ? SCAN_REMAINDER_SIZE_H264 : SCAN_REMAINDER_SIZE_MPEG2);
+		m_isHEVC = (videoComponents[0].elemStreamType == 0x24);
+		m_scanRemainderLimit = (m_isH264 ? SCAN_REMAINDER_SIZE_H264 : (m_isHEVC ? SCAN_REMAINDER_SIZE_HEVC : SCAN_REMAINDER_SIZE_MPEG2));
 	}
 
 	if (pmtVersion == -1)
@@ -3905,6 +6081,83 @@ void TSProcessor::writePCR(unsigned char *p, long long PCR, bool clearExtension)
 	}
 }
 
+
+/**
+ * @brief Shift PTS, DTS and PCR of a whole segment in place, in a single pass
+ *
+ * Only payload unit start packets can carry a PES header and only packets with an
+ * adaptation field can carry a PCR, so the TS headers alone decide what is examined;
+ * runs of other packets are skipped in batches.
+ *
+ * @param[in,out] segment  TS packet aligned data
+ * @param[in]     size     Size of segment
+ * @param[in]     offset   Offset to apply in 90KHz units, may be negative. Results wrap at 33 bits.
+ *
+ * @retval false if segment is not TS packet aligned, segment left untouched
+ */
+bool TSProcessor::restampSegment(unsigned char *segment, size_t size, long long offset)
+{
+	int packetCount = (int)(size / m_packetSize);
+	if ((size % m_packetSize) || (packetCount == 0) || (segment[m_ttsSize] != 0x47))
+	{
+		ERROR("segment not TS packet aligned, size %zu\n", size);
+		return false;
+	}
+	int lostAt = findSyncLoss(segment + m_ttsSize, packetCount, m_packetSize);
+	if (lostAt != -1)
+	{
+		ERROR("TS sync lost at packet %d, segment not restamped\n", lostAt);
+		return false;
+	}
+
+	int payloadSize = m_packetSize - m_ttsSize;
+	unsigned char *packet = segment + m_ttsSize;
+	for (int n = 0; n < packetCount; n++, packet += m_packetSize)
+	{
+		int skip = skipPacketsWithoutTimeStamps(packet, packetCount - n, m_packetSize);
+		if (skip)
+		{
+			n += skip;
+			packet += skip * m_packetSize;
+			if (n == packetCount)
+			{
+				break;
+			}
+		}
+		int adaptation = ((packet[3] & 0x30) >> 4);
+		int payloadOffset = 4;
+		if (adaptation & 0x02)
+		{
+			int adaptationLength = packet[4];
+			if ((adaptationLength >= 7) && (packet[5] & 0x10))
+			{
+				long long PCR = readPCR(&packet[6]);
+				writePCR(&packet[6], ((PCR + offset) & 0x1FFFFFFFFLL), false);
+			}
+			payloadOffset += 1 + adaptationLength;
+		}
+		// PES header with PTS and DTS needs 19 bytes
+		if ((packet[1] & 0x40) && (adaptation & 0x01) && ((payloadOffset + 19) <= payloadSize))
+		{
+			unsigned char *pes = &packet[payloadOffset];
+			if ((pes[0] == 0x00) && (pes[1] == 0x00) && (pes[2] == 0x01) && ((pes[6] & 0xC0) == 0x80))
+			{
+				int ptsDtsFlags = ((pes[7] & 0xC0) >> 6);
+				long long timeStamp;
+				if ((ptsDtsFlags & 0x02) && readTimeStamp(&pes[9], timeStamp))
+				{
+					writeTimeStamp(&pes[9], (pes[9] >> 4), ((timeStamp + offset) & 0x1FFFFFFFFLL));
+				}
+				if ((ptsDtsFlags == 0x03) && readTimeStamp(&pes[14], timeStamp))
+				{
+					writeTimeStamp(&pes[14], (pes[14] >> 4), ((timeStamp + offset) & 0x1FFFFFFFFLL));
+				}
+			}
+		}
+	}
+	return true;
+}
+
 /**
  * @struct MBAddrIncCode
  * @brief Holds macro block address increment codes
@@ -4378,6 +6631,147 @@ void TSProcessor::processPictureParameterSet(unsigned char *p, int length)
 	pPPS->spsId = seq_parameter_set_id;
 }
 
+/**
+ * @brief Consume HEVC profile_tier_level() syntax
+ *
+ * @param[in,out] p                   Buffer position
+ * @param[in,out] mask                Bit mask at buffer position
+ * @param[in]     maxSubLayersMinus1  sps_max_sub_layers_minus1
+ */
+void TSProcessor::skipHEVCProfileTierLevel(unsigned char *& p, int& mask, int maxSubLayersMinus1)
+{
+	int subLayerProfilePresent[8];
+	int subLayerLevelPresent[8];
+
+	// general profile space/tier/idc, compatibility flags, constraint flags and level idc (96 bits)
+	for (int i = 0; i < 6; i++)
+	{
+		getBits(p, mask, 16);
+	}
+	for (int i = 0; i < maxSubLayersMinus1; i++)
+	{
+		subLayerProfilePresent[i] = getBits(p, mask, 1);
+		subLayerLevelPresent[i] = getBits(p, mask, 1);
+	}
+	if (maxSubLayersMinus1 > 0)
+	{
+		// reserved_zero_2bits
+		getBits(p, mask, 2 * (8 - maxSubLayersMinus1));
+	}
+	for (int i = 0; i < maxSubLayersMinus1; i++)
+	{
+		if (subLayerProfilePresent[i])
+		{
+			// sub layer profile space/tier/idc, compatibility and constraint flags (88 bits)
+			for (int j = 0; j < 5; j++)
+			{
+				getBits(p, mask, 16);
+			}
+			getBits(p, mask, 8);
+		}
+		if (subLayerLevelPresent[i])
+		{
+			getBits(p, mask, 8);
+		}
+	}
+}
+
+/**
+ * @brief Parse through the HEVC sequence parameter set to get required items
+ *
+ * @param[in] p       Buffer containing SPS payload, without NAL unit header
+ * @param[in] length  Size of SPS
+ *
+ * @retval true if SPS was parsed
+ */
+bool TSProcessor::processHEVCSeqParameterSet(unsigned char *p, int length)
+{
+	int mask = 0x80;
+	unsigned char *end = p + length;
+
+	// sps_video_parameter_set_id
+	getBits(p, mask, 4);
+	int maxSubLayersMinus1 = getBits(p, mask, 3);
+	// sps_temporal_id_nesting_flag
+	getBits(p, mask, 1);
+	skipHEVCProfileTierLevel(p, mask, maxSubLayersMinus1);
+
+	unsigned int spsId = getUExpGolomb(p, mask);
+	int chromaFormatIdc = getUExpGolomb(p, mask);
+	int separateColourPlaneFlag = 0;
+	if (chromaFormatIdc == 3)
+	{
+		separateColourPlaneFlag = getBits(p, mask, 1);
+	}
+	int width = getUExpGolomb(p, mask);
+	int height = getUExpGolomb(p, mask);
+	if (getBits(p, mask, 1))
+	{
+		// conformance window, in chroma sample units
+		int subWidth = ((chromaFormatIdc == 1) || (chromaFormatIdc == 2)) ? 2 : 1;
+		int subHeight = (chromaFormatIdc == 1) ? 2 : 1;
+		int left = getUExpGolomb(p, mask);
+		int right = getUExpGolomb(p, mask);
+		int top = getUExpGolomb(p, mask);
+		int bottom = getUExpGolomb(p, mask);
+		width -= subWidth * (left + right);
+		height -= subHeight * (top + bottom);
+	}
+	// bit_depth_luma_minus8, bit_depth_chroma_minus8
+	getUExpGolomb(p, mask);
+	getUExpGolomb(p, mask);
+	int log2MaxPicOrderCntLsbMinus4 = getUExpGolomb(p, mask);
+
+	if ((p > end) || (spsId >= 16) || (log2MaxPicOrderCntLsbMinus4 > 12))
+	{
+		WARNING("TSProcessor: invalid HEVC SPS id %u log2_max_pic_order_cnt_lsb_minus4 %d\n", spsId, log2MaxPicOrderCntLsbMinus4);
+		return false;
+	}
+
+	HEVCSPS *pSPS = &m_hevcSPS[spsId];
+	pSPS->log2MaxPicOrderCntLsbMinus4 = log2MaxPicOrderCntLsbMinus4;
+	pSPS->separateColourPlaneFlag = separateColourPlaneFlag;
+	pSPS->valid = true;
+
+	if ((width != m_frameWidth) || (height != m_frameHeight))
+	{
+		INFO("TSProcessor: HEVC SPS %u frame size %dx%d\n", spsId, width, height);
+		m_frameWidth = width;
+		m_frameHeight = height;
+	}
+	// HEVC always codes frames, field coding is only signalled through VUI/SEI
+	m_isInterlaced = false;
+	m_isInterlacedKnown = true;
+	return true;
+}
+
+/**
+ * @brief Parse through the HEVC picture parameter set to get required items
+ *
+ * @param[in] p       Buffer containing PPS payload, without NAL unit header
+ * @param[in] length  Size of PPS
+ */
+void TSProcessor::processHEVCPictureParameterSet(unsigned char *p, int length)
+{
+	int mask = 0x80;
+	unsigned int ppsId = getUExpGolomb(p, mask);
+	unsigned int spsId = getUExpGolomb(p, mask);
+	if ((ppsId < 64) && (spsId < 16))
+	{
+		HEVCPPS *pPPS = &m_hevcPPS[ppsId];
+		pPPS->spsId = spsId;
+		// dependent_slice_segments_enabled_flag
+		getBits(p, mask, 1);
+		pPPS->outputFlagPresentFlag = getBits(p, mask, 1);
+		pPPS->numExtraSliceHeaderBits = getBits(p, mask, 3);
+		pPPS->valid = true;
+	}
+	else
+	{
+		WARNING("TSProcessor: invalid HEVC PPS id %u sps id %u\n", ppsId, spsId);
+	}
+}
+
 /**
  * @brief Consume all bits used by the scaling list
  *
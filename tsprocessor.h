@@ -78,6 +78,7 @@ typedef enum _PlayMode
 // Maximum number of bytes needed to examine in a start code
 #define SCAN_REMAINDER_SIZE_MPEG2 (7)
 #define SCAN_REMAINDER_SIZE_H264 (29)
+#define SCAN_REMAINDER_SIZE_HEVC SCAN_REMAINDER_SIZE_H264
 #if (SCAN_REMAINDER_SIZE_MPEG2 > SCAN_REMAINDER_SIZE_H264)
 #define MAX_SCAN_REMAINDER_SIZE SCAN_REMAINDER_SIZE_MPEG2
 #else
@@ -85,6 +86,7 @@ typedef enum _PlayMode
 #endif
 
 class Demuxer;
+class ESSendQueue;
 
 /**
  * @enum StreamOperation
@@ -145,6 +147,11 @@ class TSProcessor
       void abort();
       void reset();
       void flush();
+      void drain();
+      bool enableRemux(int track, int format);
+      bool restampSegment(unsigned char *segment, size_t size, long long offset);
+      static bool getIframeRange(const unsigned char *buffer, size_t size, size_t &rangeStart, size_t &rangeLength);
+      static bool getIframeRanges(const unsigned char *buffer, size_t size, std::vector<std::pair<size_t, size_t>> &ranges, size_t maxRanges = 0);
 
    protected:
       void getAudioComponents(const RecordingComponent** audioComponentsPtr, int &count);
@@ -168,6 +175,11 @@ class TSProcessor
       void writePCR( unsigned char *p, long long PCR, bool clearExtension );
       unsigned char* createNullPFrame( int width, int height, int *nullPFrameLen );
       bool processSeqParameterSet( unsigned char *p, int length );
+      void processHEVCStartCode( unsigned char *buffer, bool& keepScanning, int length, int base );
+      bool unescapeHEVCNAL( unsigned char *buffer, int length, int base );
+      bool processHEVCSeqParameterSet( unsigned char *p, int length );
+      void processHEVCPictureParameterSet( unsigned char *p, int length );
+      void skipHEVCProfileTierLevel( unsigned char *& p, int& mask, int maxSubLayersMinus1 );
       void processPictureParameterSet( unsigned char *p, int length );
       void processScalingList( unsigned char *& p, int& mask, int size );
       unsigned int getBits( unsigned char *& p, int& mask, int bitCount );
@@ -175,6 +187,7 @@ class TSProcessor
       unsigned int getUExpGolomb( unsigned char *& p, int& mask );
       int getSExpGolomb( unsigned char *& p, int& mask );
       void updatePATPMT();
+      void getPATPMTKey(std::vector<int> &key);
       void abortUnlocked();
 
       bool m_needDiscontinuity;
@@ -194,9 +207,15 @@ class TSProcessor
       unsigned char *m_PatPmtPcr;
       int m_patCounter;
       int m_pmtCounter;
+      std::vector<int> m_patPmtKey; //!< Stream information m_PatPmt/m_PatPmtTrick/m_PatPmtPcr were generated from
+      std::vector<unsigned char> m_pcrPacketTemplate; //!< PCR only packet, patched per insertion by insertPCR
+      int m_pcrPacketTemplatePid; //!< PID m_pcrPacketTemplate was built for
 
       PlayMode m_playMode;
       PlayMode m_playModeNext;
+      bool m_reverseGOP; //!< PlayMode_reverse_GOP requested, key frames of each segment are sent last to first as in I-frame only mode
+      bool m_reverseGOPNext;
+      std::vector<unsigned char> m_reverseGOPBuffer; //!< Key frames of current segment in reverse order
       double m_playRate;
       double m_absPlayRate;
       double m_playRateNext;
@@ -273,13 +292,44 @@ class TSProcessor
 
       H264SPS m_SPS[32];
       H264PPS m_PPS[256];
+
+      /**
+       * @struct HEVCSPS
+       * @brief Holds HEVC SPS parameters needed to locate slice_pic_order_cnt_lsb
+       */
+      typedef struct _HEVCSPS
+      {
+         bool valid;
+         int log2MaxPicOrderCntLsbMinus4;
+         int separateColourPlaneFlag;
+      } HEVCSPS;
+
+      /**
+       * @struct HEVCPPS
+       * @brief Holds HEVC PPS parameters needed to parse slice segment header
+       */
+      typedef struct _HEVCPPS
+      {
+         bool valid;
+         int spsId;
+         int outputFlagPresentFlag;
+         int numExtraSliceHeaderBits;
+      } HEVCPPS;
+
+      bool m_isHEVC;
+      HEVCSPS m_hevcSPS[16];
+      HEVCPPS m_hevcPPS[64];
       int m_currSPSId;      
       int m_picOrderCount;
       bool m_updatePicOrderCount;
 
       bool processBuffer(unsigned char *buffer, int size, bool &insPatPmt);
+      bool reverseKeyFrames(const unsigned char *buffer, int size);
       long long getCurrentTime();
       bool throttle(); 
+      bool waitUntil(long long deadline);
+      void updatePacingJitter(long long deadline);
+      void reportPacingJitter();
       void sendDiscontinuity(double position);
       void setupThrottle(int segmentDurationMs);
       bool demuxAndSend(const void *ptr, size_t len, double fTimestamp, double fDuration, bool discontinuous, TrackToDemux trackToDemux = ePC_Track_Both);
@@ -322,6 +372,8 @@ class TSProcessor
       StreamOperation m_streamOperation;
       Demuxer* m_vidDemuxer;
       Demuxer* m_audDemuxer;
+      ESSendQueue* m_vidSendQueue;
+      ESSendQueue* m_audSendQueue;
       bool m_demux;
       TSProcessor* m_peerTSProcessor;
       int m_packetStartAfterFirstPTS;
@@ -332,7 +384,11 @@ class TSProcessor
       bool m_queuedSegmentDiscontinuous;
       double m_startPosition;
       int m_track;
-      long long m_last_frame_time;
+      long long m_nextFrameDeadline; //!< Monotonic time (us) at which next trick mode frame is due
+      long long m_pacingJitterSum; //!< Sum of absolute emitted vs scheduled deviation (us) since last report
+      long long m_pacingJitterMax; //!< Largest emitted vs scheduled deviation (us) since last report
+      int m_pacingJitterCount; //!< Number of paced frames since last report
+      long long m_pacingLead; //!< Time (us) throttle wakes ahead of a deadline, adapted from measured jitter
       bool m_demuxInitialized;
       long long m_basePTSFromPeer;
 };